@@ -0,0 +1,143 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "batch.h"
+
+struct batch * batch_new(int fd, uint32_t pipe)
+{
+	struct batch *batch = calloc(1, sizeof(*batch));
+
+	if (!batch)
+		return NULL;
+
+	batch->submit = msm_submit_new(fd, pipe);
+	if (!batch->submit) {
+		free(batch);
+		return NULL;
+	}
+
+	return batch;
+}
+
+void batch_del(struct batch *batch)
+{
+	batch_flush(batch);
+	msm_submit_del(batch->submit);
+	free(batch->queued_ns);
+	free(batch);
+}
+
+int batch_flush(struct batch *batch)
+{
+	uint32_t i;
+	uint64_t now;
+	int ret;
+
+	if (!batch->nr_queued)
+		return 0;
+
+	/* account the latency added by batching up to the point where
+	 * we hand things to the kernel:
+	 */
+	now = gettime_ns();
+	for (i = 0; i < batch->nr_queued; i++) {
+		uint64_t delay = now - batch->queued_ns[i];
+		batch->total_delay_ns += delay;
+		batch->max_delay_seen_ns = max(batch->max_delay_seen_ns, delay);
+	}
+
+	ret = msm_submit_flush(batch->submit);
+
+	batch->nr_ioctls++;
+	batch->nr_queued = 0;
+	batch->queued_bytes = 0;
+
+	return ret;
+}
+
+static bool threshold_hit(struct batch *batch, uint64_t now)
+{
+	if (!batch->nr_queued)
+		return false;
+	if (batch->max_cmds && (batch->nr_queued >= batch->max_cmds))
+		return true;
+	if (batch->max_bytes && (batch->queued_bytes >= batch->max_bytes))
+		return true;
+	if (batch->max_delay_ns &&
+			((now - batch->queued_ns[0]) >= batch->max_delay_ns))
+		return true;
+	return false;
+}
+
+/* Queue a cmdbuf (see msm_submit_cmd() for lifetime rules), flushing
+ * the batch if that hits a threshold.
+ */
+int batch_queue(struct batch *batch, struct cmdbuf *cb)
+{
+	uint64_t now = gettime_ns();
+
+	GROW(batch->queued_ns, batch->nr_queued, batch->max_queued);
+	batch->queued_ns[batch->nr_queued++] = now;
+
+	msm_submit_cmd(batch->submit, MSM_SUBMIT_CMD_BUF, cb);
+
+	batch->queued_bytes += cmdbuf_dwords(cb) * 4;
+	batch->nr_flushes++;
+
+	if (threshold_hit(batch, now))
+		return batch_flush(batch);
+
+	return 0;
+}
+
+/* For callers which go idle for a while, to enforce the time threshold
+ * without having to queue more cmds:
+ */
+int batch_poll(struct batch *batch)
+{
+	if (threshold_hit(batch, gettime_ns()))
+		return batch_flush(batch);
+	return 0;
+}
+
+void batch_dump_stats(struct batch *batch)
+{
+	uint64_t saved = batch->nr_flushes - batch->nr_ioctls;
+
+	printf("batch: %"PRIu64" flushes in %"PRIu64" ioctls (%"PRIu64" saved, %.1f%%)\n",
+			batch->nr_flushes, batch->nr_ioctls, saved,
+			batch->nr_flushes ? 100.0 * saved / batch->nr_flushes : 0.0);
+	printf("batch: added latency avg %.3fus, max %.3fus\n",
+			batch->nr_flushes ?
+				batch->total_delay_ns / 1000.0 / batch->nr_flushes : 0.0,
+			batch->max_delay_seen_ns / 1000.0);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdint.h>
+
+#include "submit.h"
+
+/*
+ * Batching of logical flushes: rather than one DRM_MSM_GEM_SUBMIT per
+ * cmdbuf, queued cmdbufs are accumulated into a single multi-cmd submit
+ * (sharing one merged bos[] table), which is only sent to the kernel
+ * once one of the thresholds is hit, or on an explicit batch_flush().
+ *
+ * A threshold of zero is disabled.
+ */
+
+struct batch {
+	struct msm_submit *submit;
+
+	/* thresholds: */
+	uint32_t max_cmds;
+	uint32_t max_bytes;
+	uint64_t max_delay_ns;
+
+	/* currently queued: */
+	uint32_t queued_bytes;
+	uint64_t *queued_ns;     /* per-cmdbuf time it was queued */
+	uint32_t nr_queued, max_queued;
+
+	/* stats: */
+	uint64_t nr_flushes;     /* logical flushes, ie. cmdbufs queued */
+	uint64_t nr_ioctls;
+	uint64_t total_delay_ns; /* sum of per-cmd time spent queued */
+	uint64_t max_delay_seen_ns;
+};
+
+struct batch * batch_new(int fd, uint32_t pipe);
+void batch_del(struct batch *batch);
+int batch_queue(struct batch *batch, struct cmdbuf *cb);
+int batch_poll(struct batch *batch);
+int batch_flush(struct batch *batch);
+void batch_dump_stats(struct batch *batch);
+
+static inline uint32_t batch_fence(struct batch *batch)
+{
+	return batch->submit->fence;
+}
+
+#endif /* BATCH_H_ */
@@ -0,0 +1,167 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include <freedreno_drmif.h>
+#include <freedreno_ringbuffer.h>
+
+#include "util.h"
+#include "bo.h"
+#include "batch.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+
+/* compares one submit ioctl per logical flush vs. batching several
+ * logical flushes into multi-cmd submits.  Each logical flush is a
+ * small cmdbuf writing its sequence number into a shared target bo,
+ * so we can check afterwards that nothing got lost or re-ordered.
+ */
+
+static int run(int fd, struct fd_device *dev, struct fd_pipe *pipe,
+		struct cmdbuf **cbs, struct fd_bo *target, uint32_t n,
+		uint32_t max_cmds, uint64_t max_delay_ns)
+{
+	struct batch *batch = batch_new(fd, MSM_PIPE_3D0);
+	uint32_t *ptr, i, errors = 0;
+	uint64_t t;
+
+	batch->max_cmds = max_cmds;
+	batch->max_delay_ns = max_delay_ns;
+
+	memset(fd_bo_map(target), 0, n * 4);
+
+	t = gettime_ns();
+	for (i = 0; i < n; i++) {
+		struct cmdbuf *cb = cbs[i];
+
+		cmdbuf_reset(cb);
+		CB_PKT3(cb, CP_MEM_WRITE, 2);
+		CB_RELOC(cb, target, i * 4, 0);
+		CB_RING(cb, i + 1);
+
+		batch_queue(batch, cb);
+	}
+	batch_flush(batch);
+	t = gettime_ns() - t;
+
+	printf("max_cmds=%u: %u flushes in %.3fms (%.3fus/flush)\n",
+			max_cmds, n, t / 1000000.0, t / 1000.0 / n);
+	batch_dump_stats(batch);
+
+	msm_bo_cpu_prep(target, pipe, DRM_FREEDRENO_PREP_READ);
+	ptr = fd_bo_map(target);
+	for (i = 0; i < n; i++) {
+		if (ptr[i] != (i + 1)) {
+			if (errors++ < 8)
+				printf("%04x: expected %08x, got %08x\n", i, i + 1, ptr[i]);
+		}
+	}
+	fd_bo_cpu_fini(target);
+
+	batch_del(batch);
+
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fd_device *dev;
+	struct fd_pipe *pipe;
+	struct cmdbuf **cbs;
+	struct fd_bo *target;
+	uint32_t i, n = 256, b = 32;
+	uint64_t max_delay_ns = 0;
+	int fd, opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:b:t:")) != -1) {
+		switch (opt) {
+		case 'n': n = strtoul(optarg, NULL, 0); break;
+		case 'b': b = strtoul(optarg, NULL, 0); break;
+		case 't': max_delay_ns = strtoull(optarg, NULL, 0) * 1000; break;
+		default:
+			printf("usage: %s [-n flushes] [-b max-cmds-per-submit] [-t max-delay-us]\n",
+					argv[0]);
+			return -1;
+		}
+	}
+
+	fd = drmOpen("msm", NULL);
+	if (fd < 0) {
+		printf("failed to initialize DRM\n");
+		return fd;
+	}
+
+	dev = fd_device_new(fd);
+	if (!dev) {
+		printf("failed to initialize freedreno device\n");
+		return -1;
+	}
+
+	pipe = fd_pipe_new(dev, FD_PIPE_3D);
+	if (!pipe) {
+		printf("failed to initialize freedreno pipe\n");
+		return -1;
+	}
+
+	cbs = calloc(n, sizeof(cbs[0]));
+	for (i = 0; i < n; i++) {
+		cbs[i] = cmdbuf_new(dev, 0x1000);
+		if (!cbs[i]) {
+			printf("failed to allocate cmdbuf\n");
+			return -1;
+		}
+	}
+
+	target = fd_bo_new(dev, ALIGN(n * 4, 0x1000), 0);
+
+	printf("Test 1: one submit per flush:\n");
+	if (run(fd, dev, pipe, cbs, target, n, 1, 0))
+		ret = -1;
+
+	printf("Test 2: batched submits:\n");
+	if (run(fd, dev, pipe, cbs, target, n, b, max_delay_ns))
+		ret = -1;
+
+	for (i = 0; i < n; i++)
+		cmdbuf_del(cbs[i]);
+	free(cbs);
+	fd_bo_del(target);
+
+	printf("%s\n", ret ? "FAILED" : "PASSED");
+
+	return ret;
+}
@@ -0,0 +1,261 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "gmem.h"
+
+/* Compares two ways of building a binned render pass, for a range of bin
+ * counts: re-emitting the draws for every bin, and recording them once
+ * into an IB which each bin calls (gmem_pass).  Reports the CPU time to
+ * build the pass, and the size of what the kernel has to look at, and
+ * checks on the emulated CP that both end up doing the same thing.
+ */
+
+static uint32_t nr_draws = 100;
+static uint32_t nr_iters = 20;
+
+static const struct {
+	uint32_t nbins_x, nbins_y;
+} grids[] = {
+	{ 2, 2 }, { 3, 2 }, { 4, 3 }, { 6, 4 }, { 8, 6 }, { 12, 8 },
+	{ 16, 12 }, { 30, 17 },
+};
+
+struct bench {
+	struct emu *emu;
+	struct emu_bo *vbo;
+	struct cmdbuf *bins, *draws;
+	struct gmem_config cfg;
+	struct gmem_layout layout;
+};
+
+static void emit_draw(struct cmdbuf *cb, struct emu_bo *vbo, uint32_t n)
+{
+	uint32_t i;
+
+	CB_PKT0(cb, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 6);
+	for (i = 0; i < 6; i++)
+		CB_RING(cb, n + i);
+
+	CB_PKT3(cb, CP_SET_CONSTANT, 9);
+	CB_RING(cb, CP_REG(REG_A3XX_RB_DEPTH_CONTROL));
+	for (i = 0; i < 8; i++)
+		CB_RING(cb, n * i);
+
+	CB_PKT0(cb, REG_A3XX_VFD_FETCH_INSTR_0(0), 2);
+	CB_RING(cb, 0x00000000);
+	EMU_RELOC(cb, vbo, (n % 64) * 64, 0);
+
+	CB_PKT3(cb, CP_DRAW_INDX, 3);
+	CB_RING(cb, 0x00000000);
+	CB_RING(cb, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+			INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+	CB_RING(cb, 3);
+}
+
+static int bench_init(struct bench *b, uint32_t nbins_x, uint32_t nbins_y)
+{
+	uint32_t bin_w, bin_h, size;
+	int ret;
+
+	memset(b, 0, sizeof(*b));
+
+	b->cfg.width = 1920;
+	b->cfg.height = 1080;
+	b->cfg.nr_rts = 1;
+	b->cfg.rts[0].fmt = RB_R8G8B8A8_UNORM;
+
+	bin_w = ALIGN((b->cfg.width + nbins_x - 1) / nbins_x, GMEM_BIN_ALIGN);
+	bin_h = ALIGN((b->cfg.height + nbins_y - 1) / nbins_y, GMEM_BIN_ALIGN);
+
+	/* the bin count is what is being varied, not the GMEM size: */
+	ret = gmem_layout(&b->layout, &b->cfg, ~0, bin_w, bin_h);
+	if (ret)
+		return ret;
+
+	b->emu = emu_new();
+	b->vbo = emu_bo_new(b->emu, 0x1000);
+	b->cfg.rts[0].handle = emu_bo_new(b->emu,
+			gmem_rt_pitch(&b->cfg, 0) * b->cfg.height)->handle;
+
+	/* big enough for re-emitting every draw in every bin: */
+	size = (b->layout.nr_bins * (nr_draws * 32 + 64) + 64) * 4;
+	b->bins = emu_cmdbuf_new(b->emu, size);
+	b->draws = emu_cmdbuf_new(b->emu, (nr_draws * 32 + 64) * 4);
+
+	return 0;
+}
+
+static void bench_fini(struct bench *b)
+{
+	cmdbuf_del(b->bins);
+	cmdbuf_del(b->draws);
+	emu_del(b->emu);
+}
+
+static void build_naive(struct bench *b)
+{
+	uint32_t n, i;
+
+	cmdbuf_reset(b->bins);
+	gmem_emit_setup(b->bins, &b->layout, &b->cfg);
+	for (n = 0; n < b->layout.nr_bins; n++) {
+		gmem_emit_prologue(b->bins, &b->layout, &b->cfg, n);
+		for (i = 0; i < nr_draws; i++)
+			emit_draw(b->bins, b->vbo, i);
+		gmem_emit_resolve(b->bins, &b->layout, &b->cfg, n);
+	}
+}
+
+static void build_replay(struct bench *b, struct gmem_pass *pass)
+{
+	struct cmdbuf *draws;
+	uint32_t i;
+
+	cmdbuf_reset(b->bins);
+	cmdbuf_reset(b->draws);
+
+	draws = gmem_pass_begin(pass);
+	for (i = 0; i < nr_draws; i++)
+		emit_draw(draws, b->vbo, i);
+	gmem_pass_end(pass);
+}
+
+/* returns us per build: */
+static double time_build(struct bench *b, struct gmem_pass *pass)
+{
+	uint64_t t;
+	uint32_t i;
+
+	t = gettime_ns();
+	for (i = 0; i < nr_iters; i++) {
+		if (pass)
+			build_replay(b, pass);
+		else
+			build_naive(b);
+	}
+	t = gettime_ns() - t;
+
+	return (double)t / nr_iters / 1000.0;
+}
+
+static int execute(struct bench *b)
+{
+	struct msm_submit *submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	int ret;
+
+	emu_attach(b->emu, submit);
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, b->bins);
+	ret = msm_submit_flush(submit);
+	msm_submit_del(submit);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			nr_draws = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_iters = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-d draws] [-n iterations]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	printf("%u draws, %u iterations\n", nr_draws, nr_iters);
+	printf("%5s %9s %12s %12s %8s %9s %9s %7s %7s\n", "bins", "bin",
+			"re-emit us", "replay us", "speedup", "re-emit", "replay",
+			"re-emit", "replay");
+	printf("%5s %9s %12s %12s %8s %9s %9s %7s %7s\n", "", "", "", "", "",
+			"dwords", "dwords", "relocs", "relocs");
+
+	for (i = 0; i < ARRAY_SIZE(grids); i++) {
+		struct bench naive, replay;
+		struct gmem_pass *pass;
+		double naive_us, replay_us;
+		uint32_t replay_dwords;
+
+		if (bench_init(&naive, grids[i].nbins_x, grids[i].nbins_y) ||
+				bench_init(&replay, grids[i].nbins_x, grids[i].nbins_y)) {
+			printf("could not set up %ux%u bins\n", grids[i].nbins_x,
+					grids[i].nbins_y);
+			return -1;
+		}
+
+		pass = gmem_pass_new(&replay.cfg, &replay.layout,
+				replay.draws, replay.bins);
+
+		naive_us = time_build(&naive, NULL);
+		replay_us = time_build(&replay, pass);
+		replay_dwords = cmdbuf_dwords(replay.bins) +
+				cmdbuf_dwords(replay.draws);
+
+		printf("%5u %4ux%-4u %12.1f %12.1f %7.1fx %9u %9u %7u %7u\n",
+				naive.layout.nr_bins, naive.layout.bin_w,
+				naive.layout.bin_h, naive_us, replay_us,
+				naive_us / replay_us, cmdbuf_dwords(naive.bins),
+				replay_dwords, naive.bins->nr_relocs,
+				replay.bins->nr_relocs + replay.draws->nr_relocs);
+
+		/* same draws, same register state at the end: */
+		if (execute(&naive) || execute(&replay) ||
+				(naive.emu->stats.draws != replay.emu->stats.draws) ||
+				memcmp(naive.emu->regs, replay.emu->regs,
+					EMU_NUM_REGS * sizeof(naive.emu->regs[0]))) {
+			printf("  replay does not match re-emitting!\n");
+			ret = -1;
+		}
+
+		gmem_pass_del(pass);
+		bench_fini(&naive);
+		bench_fini(&replay);
+	}
+
+	printf("Test 1: IB replay matches re-emitting draws per bin\n");
+	printf("%s\n", ret ? "FAILED" : "PASSED");
+
+	return ret;
+}
@@ -0,0 +1,64 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include "bo.h"
+#include "util.h"
+
+struct fd_bo * msm_bo_new(struct fd_device *dev, int fd,
+		uint32_t size, uint32_t flags)
+{
+	struct drm_msm_gem_new req = {
+			.size  = size,
+			.flags = flags,
+	};
+	struct fd_bo *bo;
+	int ret;
+
+	TRACE_BEGIN(TRACE_BO_ALLOC, size, flags);
+	ret = drmCommandWriteRead(fd, DRM_MSM_GEM_NEW, &req, sizeof(req));
+	TRACE_END(TRACE_BO_ALLOC, size, ret ? 0 : req.handle);
+	if (ret) {
+		ERROR_MSG("gem new failed: %d (%s)", ret, strerror(errno));
+		return NULL;
+	}
+
+	bo = fd_bo_from_handle(dev, req.handle, size);
+	if (!bo) {
+		struct drm_gem_close close = {
+				.handle = req.handle,
+		};
+		drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &close);
+	}
+
+	return bo;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BO_H_
+#define BO_H_
+
+#include <stdint.h>
+
+#include <freedreno_drmif.h>
+
+#ifndef __user
+#  define __user
+#endif
+#include "msm_drm.h"
+#include "trace.h"
+
+/*
+ * libdrm_freedreno's fd_bo_new() does not let us pick the cache mode
+ * (the flags are not passed through to the kernel), so for anything
+ * that cares, allocate with DRM_MSM_GEM_NEW directly and wrap the
+ * handle in an fd_bo.
+ *
+ * flags is a mask of MSM_BO_x (see msm_drm.h).
+ */
+struct fd_bo * msm_bo_new(struct fd_device *dev, int fd,
+		uint32_t size, uint32_t flags);
+
+/* fd_bo_cpu_prep(), traced: */
+static inline int msm_bo_cpu_prep(struct fd_bo *bo, struct fd_pipe *pipe,
+		uint32_t op)
+{
+	int ret;
+
+	TRACE_BEGIN(TRACE_CPU_PREP, fd_bo_handle(bo), op);
+	ret = fd_bo_cpu_prep(bo, pipe, op);
+	TRACE_END(TRACE_CPU_PREP, fd_bo_handle(bo), ret);
+
+	return ret;
+}
+
+static inline const char * msm_bo_cache_name(uint32_t flags)
+{
+	switch (flags & MSM_BO_CACHE_MASK) {
+	case MSM_BO_CACHED:   return "cached";
+	case MSM_BO_WC:       return "wc";
+	case MSM_BO_UNCACHED: return "uncached";
+	default:              return "default";
+	}
+}
+
+#endif /* BO_H_ */
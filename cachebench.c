@@ -0,0 +1,215 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include <freedreno_drmif.h>
+#include <freedreno_ringbuffer.h>
+
+#include "util.h"
+#include "bo.h"
+
+/* benchmark CPU access to bo's in each of the cache modes, to help pick
+ * the cache mode per type of buffer:
+ *
+ *   seq     - sequential write (memcpy), ie. streaming upload
+ *   scatter - dword writes in a scattered (but full coverage) order,
+ *             ie. patching state/cmdstream
+ *   read    - cpu_prep(READ) + sequential read, ie. the pm4test readback
+ *   prep    - cpu_prep() + cpu_fini() on an idle bo
+ */
+
+static const uint32_t modes[] = {
+		MSM_BO_CACHED, MSM_BO_WC, MSM_BO_UNCACHED,
+};
+
+/* run each test for at least this long: */
+#define MIN_NS  (50 * 1000 * 1000)
+
+static double seq_write(struct fd_bo *bo, uint32_t size, void *src)
+{
+	void *ptr = fd_bo_map(bo);
+	uint64_t t, n = 0;
+
+	t = gettime_ns();
+	do {
+		memcpy(ptr, src, size);
+		n++;
+	} while ((gettime_ns() - t) < MIN_NS);
+	t = gettime_ns() - t;
+
+	return (double)n * size / t * 1000.0;  /* MB/s */
+}
+
+static double scatter_write(struct fd_bo *bo, uint32_t size)
+{
+	volatile uint32_t *ptr = fd_bo_map(bo);
+	uint32_t i, ndw = size / 4, mask = ndw - 1;
+	uint64_t t, n = 0;
+
+	t = gettime_ns();
+	do {
+		/* odd stride over a power of two visits every dword once: */
+		uint32_t idx = 0;
+		for (i = 0; i < ndw; i++) {
+			ptr[idx] = i;
+			idx = (idx + 0x9e3779b1) & mask;
+		}
+		n++;
+	} while ((gettime_ns() - t) < MIN_NS);
+	t = gettime_ns() - t;
+
+	return (double)n * size / t * 1000.0;
+}
+
+static double readback(struct fd_bo *bo, struct fd_pipe *pipe, uint32_t size)
+{
+	uint32_t i, ndw = size / 4;
+	uint64_t t, n = 0;
+	uint32_t sum = 0;
+
+	t = gettime_ns();
+	do {
+		const volatile uint32_t *ptr;
+
+		msm_bo_cpu_prep(bo, pipe, DRM_FREEDRENO_PREP_READ);
+		ptr = fd_bo_map(bo);
+		for (i = 0; i < ndw; i++)
+			sum += ptr[i];
+		fd_bo_cpu_fini(bo);
+		n++;
+	} while ((gettime_ns() - t) < MIN_NS);
+	t = gettime_ns() - t;
+
+	if (sum == 0x12345678)  /* keep the reads from being dropped */
+		printf("\n");
+
+	return (double)n * size / t * 1000.0;
+}
+
+static double prep_fini(struct fd_bo *bo, struct fd_pipe *pipe)
+{
+	uint64_t t, n = 0;
+
+	t = gettime_ns();
+	do {
+		msm_bo_cpu_prep(bo, pipe, DRM_FREEDRENO_PREP_READ |
+				DRM_FREEDRENO_PREP_WRITE);
+		fd_bo_cpu_fini(bo);
+		n++;
+	} while ((gettime_ns() - t) < MIN_NS);
+	t = gettime_ns() - t;
+
+	return (double)t / n / 1000.0;  /* us */
+}
+
+int main(int argc, char *argv[])
+{
+	struct fd_device *dev;
+	struct fd_pipe *pipe;
+	uint32_t size, min_size = 0x1000, max_size = 0x1000000;
+	void *src;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "s:S:")) != -1) {
+		switch (opt) {
+		case 's': min_size = strtoul(optarg, NULL, 0); break;
+		case 'S': max_size = strtoul(optarg, NULL, 0); break;
+		default:
+			printf("usage: %s [-s min-size] [-S max-size]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	/* sizes must be power of two for the scatter pattern: */
+	min_size = ALIGN(min_size, 0x1000);
+	while (min_size & (min_size - 1))
+		min_size &= min_size - 1;
+
+	fd = drmOpen("msm", NULL);
+	if (fd < 0) {
+		printf("failed to initialize DRM\n");
+		return fd;
+	}
+
+	dev = fd_device_new(fd);
+	if (!dev) {
+		printf("failed to initialize freedreno device\n");
+		return -1;
+	}
+
+	pipe = fd_pipe_new(dev, FD_PIPE_3D);
+	if (!pipe) {
+		printf("failed to initialize freedreno pipe\n");
+		return -1;
+	}
+
+	src = malloc(max_size);
+	memset(src, 0x5a, max_size);
+
+	printf("%10s %-9s %12s %12s %12s %12s\n", "size", "mode",
+			"seq MB/s", "scatter MB/s", "read MB/s", "prep+fini us");
+
+	for (size = min_size; size <= max_size; size *= 2) {
+		uint32_t i;
+
+		for (i = 0; i < ARRAY_SIZE(modes); i++) {
+			struct fd_bo *bo = msm_bo_new(dev, fd, size, modes[i]);
+
+			if (!bo) {
+				printf("%10u %-9s: allocation failed\n", size,
+						msm_bo_cache_name(modes[i]));
+				continue;
+			}
+
+			/* fault in the pages first: */
+			memset(fd_bo_map(bo), 0, size);
+
+			printf("%10u %-9s %12.1f %12.1f %12.1f %12.3f\n", size,
+					msm_bo_cache_name(modes[i]),
+					seq_write(bo, size, src),
+					scatter_write(bo, size),
+					readback(bo, pipe, size),
+					prep_fini(bo, pipe));
+
+			fd_bo_del(bo);
+		}
+	}
+
+	free(src);
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include <freedreno_drmif.h>
+#include <freedreno_ringbuffer.h>
+
+#include "util.h"
+#include "submit.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+#include "a3xx.xml.h"
+
+/* cmdstream emit bandwidth, emitting directly into a mapped WC cmdbuf
+ * (submitted by segment offset/size) vs. emitting into a cached staging
+ * buffer which is then copied into the bo.
+ */
+
+#define CMDBUF_SIZE    0x100000
+#define SEG_PKTS       64       /* packet pairs per segment */
+#define SEG_DWORDS     (SEG_PKTS * (9 + 4))
+#define SEGS_PER_SUBMIT 16
+#define NSEGS          8192
+
+static void emit(struct cmdbuf *cb, struct fd_bo *target, uint32_t n)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < SEG_PKTS; i++) {
+		CB_PKT0(cb, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 8);
+		for (j = 0; j < 8; j++)
+			CB_RING(cb, fui(n + j));
+
+		CB_PKT3(cb, CP_MEM_WRITE, 3);
+		CB_RELOC(cb, target, (i % 1024) * 8, 0);
+		CB_RING(cb, n);
+		CB_RING(cb, i);
+	}
+}
+
+static void run(int fd, struct fd_device *dev, struct fd_bo *target,
+		bool staged)
+{
+	struct msm_submit *submit = msm_submit_new(fd, MSM_PIPE_3D0);
+	struct cmdbuf *cb = cmdbuf_new_wc(dev, fd, CMDBUF_SIZE);
+	struct cmdbuf *staging = cb;
+	uint64_t t, emit_ns = 0, bytes = 0;
+	uint32_t i, waits = 0;
+
+	if (!cb) {
+		printf("failed to allocate cmdbuf\n");
+		return;
+	}
+
+	if (staged) {
+		/* a cmdbuf with the same layout, but cached malloc'd storage,
+		 * which gets copied into the real cmdbuf bo before submit:
+		 */
+		staging = cmdbuf_new_user(cb->handle, malloc(cb->size), cb->size);
+	}
+
+	t = gettime_ns();
+	for (i = 0; i < NSEGS; i++) {
+		uint64_t e;
+
+		if (!cmdbuf_segment(cb, SEG_DWORDS)) {
+			/* out of space, wait for the GPU and start over: */
+			msm_submit_flush(submit);
+			msm_wait_fence(fd, submit->fence, 5000000000ull);
+			cmdbuf_reset(cb);
+			waits++;
+		}
+
+		e = gettime_ns();
+		if (staged) {
+			cmdbuf_reset(staging);
+			staging->cur = staging->seg = staging->start +
+					(cb->seg - cb->start);
+			emit(staging, target, i);
+			memcpy(cb->seg, staging->seg, cmdbuf_dwords(staging) * 4);
+			cb->cur = cb->seg + cmdbuf_dwords(staging);
+		} else {
+			emit(cb, target, i);
+		}
+		emit_ns += gettime_ns() - e;
+		bytes += cmdbuf_dwords(cb) * 4;
+
+		msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, staging);
+
+		if ((i % SEGS_PER_SUBMIT) == (SEGS_PER_SUBMIT - 1))
+			msm_submit_flush(submit);
+	}
+	msm_submit_flush(submit);
+	t = gettime_ns() - t;
+
+	printf("%-8s: %8.1f MB/s emit, %.3fus/segment, %.3fms total, %u waits\n",
+			staged ? "staged" : "direct",
+			(double)bytes / emit_ns * 1000.0, emit_ns / 1000.0 / NSEGS,
+			t / 1000000.0, waits);
+
+	msm_wait_fence(fd, submit->fence, 5000000000ull);
+
+	if (staged) {
+		free(staging->start);
+		cmdbuf_del(staging);
+	}
+	cmdbuf_del(cb);
+	msm_submit_del(submit);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fd_device *dev;
+	struct fd_bo *target;
+	int fd;
+
+	fd = drmOpen("msm", NULL);
+	if (fd < 0) {
+		printf("failed to initialize DRM\n");
+		return fd;
+	}
+
+	dev = fd_device_new(fd);
+	if (!dev) {
+		printf("failed to initialize freedreno device\n");
+		return -1;
+	}
+
+	target = fd_bo_new(dev, 0x2000, 0);
+
+	run(fd, dev, target, false);
+	run(fd, dev, target, true);
+
+	fd_bo_del(target);
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmdbuf.h"
+#include "bo.h"
+
+/* memory backing the cmdbuf is not owned by the cmdbuf: */
+struct cmdbuf * cmdbuf_new_user(uint32_t handle, void *ptr, uint32_t size)
+{
+	struct cmdbuf *cb = calloc(1, sizeof(*cb));
+
+	if (!cb)
+		return NULL;
+
+	cb->handle = handle;
+	cb->size   = size;
+	cb->start  = ptr;
+	cb->end    = cb->start + (size / 4);
+	cb->cur    = cb->start;
+	cb->seg    = cb->start;
+
+	return cb;
+}
+
+static struct cmdbuf * cmdbuf_init(struct fd_bo *bo, uint32_t size)
+{
+	struct cmdbuf *cb;
+
+	if (!bo) {
+		ERROR_MSG("failed to allocate cmdbuf bo");
+		return NULL;
+	}
+
+	cb = cmdbuf_new_user(fd_bo_handle(bo), fd_bo_map(bo), size);
+	if (!cb) {
+		fd_bo_del(bo);
+		return NULL;
+	}
+
+	cb->bo = bo;
+
+	return cb;
+}
+
+struct cmdbuf * cmdbuf_new(struct fd_device *dev, uint32_t size)
+{
+	return cmdbuf_init(fd_bo_new(dev, size, 0), size);
+}
+
+/* explicitly write-combined, for cmdbufs which are only ever written
+ * (sequentially) by the CPU:
+ */
+struct cmdbuf * cmdbuf_new_wc(struct fd_device *dev, int fd, uint32_t size)
+{
+	return cmdbuf_init(msm_bo_new(dev, fd, size, MSM_BO_WC), size);
+}
+
+void cmdbuf_del(struct cmdbuf *cb)
+{
+	if (cb->bo)
+		fd_bo_del(cb->bo);
+	free(cb->relocs);
+	free(cb->ibs);
+	free(cb);
+}
+
+void cmdbuf_reset(struct cmdbuf *cb)
+{
+	cb->cur = cb->seg = cb->start;
+	cb->nr_relocs = cb->first_reloc = 0;
+	cb->nr_ibs = 0;
+}
+
+/* Start a new segment, with room for at least ndwords.  Returns false if
+ * there is not enough space left, in which case the caller needs to wait
+ * for the GPU to be done with the cmdbuf and cmdbuf_reset() it.
+ */
+bool cmdbuf_segment(struct cmdbuf *cb, uint32_t ndwords)
+{
+	uint32_t *seg = cb->start + ALIGN(cb->cur - cb->start, CMDBUF_ALIGN / 4);
+
+	if ((seg + ndwords) > cb->end)
+		return false;
+
+	cb->cur = cb->seg = seg;
+	cb->first_reloc = cb->nr_relocs;
+	cb->nr_ibs = 0;
+
+	return true;
+}
+
+void cmdbuf_reloc(struct cmdbuf *cb, const struct cmdbuf_reloc *reloc)
+{
+	struct cmdbuf_reloc *r;
+
+	GROW(cb->relocs, cb->nr_relocs, cb->max_relocs);
+
+	RING_PROF_RELOC();
+
+	r = &cb->relocs[cb->nr_relocs++];
+	*r = *reloc;
+	r->submit_offset = (cb->cur - cb->start) * 4;
+
+	/* the kernel patches in the real address, until then emit
+	 * the 'or' value so the dword is at least not garbage:
+	 */
+	CB_RING(cb, reloc->or);
+}
+
+void cmdbuf_add_ib(struct cmdbuf *cb, struct cmdbuf *target)
+{
+	uint32_t i;
+
+	for (i = 0; i < cb->nr_ibs; i++)
+		if (cb->ibs[i] == target)
+			return;
+
+	GROW(cb->ibs, cb->nr_ibs, cb->max_ibs);
+	cb->ibs[cb->nr_ibs++] = target;
+}
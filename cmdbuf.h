@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CMDBUF_H_
+#define CMDBUF_H_
+
+#include <stdint.h>
+
+#include <freedreno_drmif.h>
+
+#ifndef __user
+#  define __user
+#endif
+#include "msm_drm.h"
+
+#include "adreno_pm4.xml.h"
+
+#include "util.h"
+#include "ringprof.h"
+
+/*
+ * A cmdbuf is a cmdstream buffer that we build ourselves, rather than
+ * going through fd_ringbuffer.  It is backed by a bo, and keeps its own
+ * table of relocs (which reference bo's by GEM handle, the submit_bo index
+ * is only assigned when the cmdbuf is added to a submit).  This is what
+ * lets us build submits with more than a single cmd, see submit.h.
+ *
+ * Since nothing past construction needs the fd_bo, a cmdbuf can also be
+ * built on top of memory which is not an fd_bo at all (see
+ * cmdbuf_new_user()), for example an emulated bo, see emu.h.
+ *
+ * A cmdbuf can also be used as an IB target: built once, and then called
+ * from any number of other cmdbufs with CB_IB().  The referencing cmdbuf
+ * remembers the targets it calls, so when it is added to a submit the
+ * targets get added as MSM_SUBMIT_CMD_IB_TARGET_BUF cmds (so the kernel
+ * processes their relocs) without the CPU touching their contents again.
+ *
+ * The CB_x() emit helpers always write straight into the mapped bo, there
+ * is no staging copy between emit and submit.  To avoid having to wait for
+ * the GPU before re-using a cmdbuf, it can be split into segments with
+ * cmdbuf_segment(): each segment starts on a CMDBUF_ALIGN boundary (so
+ * write-combining never mixes two segments in one buffer) and is submitted
+ * by its offset/size within the bo.  Only the current segment is seen by
+ * msm_submit_cmd(), so each segment must be added to a submit before the
+ * next one is started.
+ */
+
+/* cache-line / WC buffer size: */
+#define CMDBUF_ALIGN 64
+
+struct cmdbuf_reloc {
+	uint32_t handle;         /* GEM handle of reloc bo */
+	uint32_t flags;          /* mask of MSM_SUBMIT_BO_x */
+	uint32_t submit_offset;  /* byte offset of patched dword in cmdbuf */
+	uint32_t offset;         /* offset from start of reloc bo */
+	uint32_t or;
+	int32_t  shift;
+};
+
+struct cmdbuf {
+	struct fd_bo *bo;        /* NULL if not backed by an fd_bo */
+	uint32_t handle;
+	uint32_t size;           /* in bytes */
+	uint32_t *start, *cur, *end;
+	uint32_t *seg;           /* start of current segment */
+
+	struct cmdbuf_reloc *relocs;
+	uint32_t nr_relocs, max_relocs;
+	uint32_t first_reloc;    /* first reloc of current segment */
+
+	/* IB targets called from this cmdbuf: */
+	struct cmdbuf **ibs;
+	uint32_t nr_ibs, max_ibs;
+};
+
+struct cmdbuf * cmdbuf_new(struct fd_device *dev, uint32_t size);
+struct cmdbuf * cmdbuf_new_wc(struct fd_device *dev, int fd, uint32_t size);
+struct cmdbuf * cmdbuf_new_user(uint32_t handle, void *ptr, uint32_t size);
+void cmdbuf_del(struct cmdbuf *cb);
+void cmdbuf_reset(struct cmdbuf *cb);
+bool cmdbuf_segment(struct cmdbuf *cb, uint32_t ndwords);
+void cmdbuf_reloc(struct cmdbuf *cb, const struct cmdbuf_reloc *reloc);
+void cmdbuf_add_ib(struct cmdbuf *cb, struct cmdbuf *target);
+
+/* size of the current segment: */
+static inline uint32_t cmdbuf_dwords(struct cmdbuf *cb)
+{
+	return cb->cur - cb->seg;
+}
+
+/* byte offset of the current segment within the bo: */
+static inline uint32_t cmdbuf_offset(struct cmdbuf *cb)
+{
+	return (cb->seg - cb->start) * 4;
+}
+
+static inline void
+CB_RING(struct cmdbuf *cb, uint32_t data)
+{
+	RING_PROF_DWORDS(1);
+	*(cb->cur++) = data;
+}
+
+static inline void
+CB_RELOC(struct cmdbuf *cb, struct fd_bo *bo, uint32_t offset, uint32_t or)
+{
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = fd_bo_handle(bo),
+		.flags = MSM_SUBMIT_BO_READ | MSM_SUBMIT_BO_WRITE,
+		.offset = offset,
+		.or = or,
+	});
+}
+
+/* shifted reloc: */
+static inline void
+CB_RELOCS(struct cmdbuf *cb, struct fd_bo *bo,
+		uint32_t offset, uint32_t or, int32_t shift)
+{
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = fd_bo_handle(bo),
+		.flags = MSM_SUBMIT_BO_READ | MSM_SUBMIT_BO_WRITE,
+		.offset = offset,
+		.or = or,
+		.shift = shift,
+	});
+}
+
+static inline void
+CB_BEGIN(struct cmdbuf *cb, uint32_t ndwords)
+{
+	if ((cb->cur + ndwords) > cb->end)
+		WARN_MSG("cmdbuf overflow: %u dwords at %u/%u", ndwords,
+				cmdbuf_dwords(cb), (uint32_t)(cb->end - cb->start));
+}
+
+static inline void
+CB_PKT0(struct cmdbuf *cb, uint16_t regindx, uint16_t cnt)
+{
+	RING_PROF_PKT(RING_PROF_PKT0, cnt+1);
+	CB_BEGIN(cb, cnt+1);
+	CB_RING(cb, CP_TYPE0_PKT | ((cnt-1) << 16) | (regindx & 0x7FFF));
+}
+
+static inline void
+CB_PKT3(struct cmdbuf *cb, uint8_t opcode, uint16_t cnt)
+{
+	RING_PROF_PKT(opcode, cnt+1);
+	CB_BEGIN(cb, cnt+1);
+	CB_RING(cb, CP_TYPE3_PKT | ((cnt-1) << 16) | ((opcode & 0xFF) << 8));
+}
+
+/* call another cmdbuf as an IB.  With pfd, the CP is allowed to
+ * prefetch the IB (CP_INDIRECT_BUFFER_PFD):
+ */
+static inline void
+CB_IB(struct cmdbuf *cb, struct cmdbuf *target, bool pfd)
+{
+	CB_PKT3(cb, pfd ? CP_INDIRECT_BUFFER_PFD : CP_INDIRECT_BUFFER, 2);
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = target->handle,
+		.flags = MSM_SUBMIT_BO_READ,
+		.offset = cmdbuf_offset(target),
+	});
+	CB_RING(cb, cmdbuf_dwords(target));
+	cmdbuf_add_ib(cb, target);
+}
+
+#endif /* CMDBUF_H_ */
@@ -0,0 +1,494 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "util.h"
+#include "emu.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+#include "a3xx.xml.h"
+
+/* Runs a few representative cmdstreams through the emulated CP, and
+ * reports the estimated front-end time of each submit.  Doesn't need
+ * a GPU, so it can run in CI to catch cmdstream bloat.  With -l, fails
+ * if any submit is estimated to take longer than the limit.  With -i,
+ * uses the (slower) packet interpreter rather than pre-decoded IBs.
+ */
+
+static struct emu *emu;
+static struct msm_submit *submit;
+static double limit_us;
+static int failed;
+
+static void flush(const char *name, struct cmdbuf *cb)
+{
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+	if (msm_submit_flush(submit)) {
+		printf("%s: submit failed\n", name);
+		failed = 1;
+		return;
+	}
+
+	emu_dump_stats(emu, name, &emu->submit_stats);
+
+	if (limit_us && (emu_cycles_to_us(emu, emu->submit_stats.cycles) > limit_us)) {
+		printf("%s: exceeds limit of %.3fus\n", name, limit_us);
+		failed = 1;
+	}
+}
+
+/* the pm4test cmdstream, which also checks that the results are right: */
+static void test_pm4(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x1000);
+	struct emu_bo *bo = emu_bo_new(emu, 0x1000);
+	static const uint32_t expected[] = { 0, 1, 0x234, 3, 4, 5 };
+	uint32_t *ptr = bo->map;
+	uint32_t i;
+
+#define BASE REG_A3XX_GRAS_CL_VPORT_XOFFSET
+
+	CB_PKT0(cb, REG_AXXX_CP_SCRATCH_REG4, 1);
+	CB_RING(cb, 0x123);
+
+	CB_PKT0(cb, BASE, ARRAY_SIZE(expected));
+	for (i = 0; i < ARRAY_SIZE(expected); i++)
+		CB_RING(cb, i);
+
+	CB_PKT3(cb, CP_SET_CONSTANT, 3);
+	CB_RING(cb, 0x80000000 | CP_REG(BASE + 2));
+	CB_RING(cb, REG_AXXX_CP_SCRATCH_REG4);
+	CB_RING(cb, 0x111);
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++) {
+		CB_PKT3(cb, CP_REG_TO_MEM, 2);
+		CB_RING(cb, BASE + i);
+		EMU_RELOC(cb, bo, i * 4, 0);
+	}
+
+	flush("pm4", cb);
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++) {
+		if (ptr[i] != expected[i]) {
+			printf("pm4: %02x: expected %08x, got %08x\n", i,
+					expected[i], ptr[i]);
+			failed = 1;
+		}
+	}
+
+	cmdbuf_del(cb);
+}
+
+/* the same static content (as in ibtest), inline vs. in an IB: */
+static void test_ib(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x4000);
+	struct cmdbuf *ib = emu_cmdbuf_new(emu, 0x4000);
+	struct emu_bo *bo = emu_bo_new(emu, 0x1000);
+	uint32_t i, j;
+
+	for (i = 0; i < 256; i++) {
+		CB_PKT3(ib, CP_MEM_WRITE, 2);
+		EMU_RELOC(ib, bo, i * 4, 0);
+		CB_RING(ib, i);
+	}
+
+	for (j = 0; j < 4; j++) {
+		for (i = 0; i < 256; i++) {
+			CB_PKT3(cb, CP_MEM_WRITE, 2);
+			EMU_RELOC(cb, bo, i * 4, 0);
+			CB_RING(cb, i);
+		}
+	}
+	flush("inline", cb);
+
+	cmdbuf_reset(cb);
+	for (j = 0; j < 4; j++)
+		CB_IB(cb, ib, false);
+	flush("ib", cb);
+
+	cmdbuf_reset(cb);
+	for (j = 0; j < 4; j++)
+		CB_IB(cb, ib, true);
+	flush("ib_pfd", cb);
+
+	cmdbuf_del(cb);
+	cmdbuf_del(ib);
+}
+
+/* an IB whose size in bytes overflows 32 bits must be rejected, not
+ * fetched past the end of its bo:
+ */
+static void test_bad_ib(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x1000);
+	struct emu_bo *bo = emu_bo_new(emu, 0x1000);
+
+	CB_PKT3(cb, CP_INDIRECT_BUFFER, 2);
+	EMU_RELOC(cb, bo, 0, 0);
+	CB_RING(cb, 0x40000001);
+
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+	if (!msm_submit_flush(submit)) {
+		printf("bad_ib: oversized IB was not rejected\n");
+		failed = 1;
+	}
+
+	cmdbuf_del(cb);
+}
+
+/* cmds and relocs which don't fit (including ones whose end wraps
+ * around 32 bits) are rejected before anything is patched:
+ */
+static void test_bad_reloc(void)
+{
+	static const struct {
+		uint32_t cmd_offset, cmd_size, reloc_offset;
+	} cases[] = {
+			{ 0,          0x100,  0xfffffffc },  /* wraps */
+			{ 0,          0x100,  0x100 },       /* past the cmd */
+			{ 0x100,      0x100,  0x0fc },       /* before the cmd */
+			{ 0xfffff000, 0x2000, 0 },           /* cmd wraps */
+	};
+	struct emu_bo *bo = emu_bo_new(emu, 0x1000);
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		struct drm_msm_gem_submit_bo sbo = {
+				.handle = bo->handle,
+		};
+		struct drm_msm_gem_submit_reloc reloc = {
+				.submit_offset = cases[i].reloc_offset,
+		};
+		struct drm_msm_gem_submit_cmd cmd = {
+				.type          = MSM_SUBMIT_CMD_BUF,
+				.submit_offset = cases[i].cmd_offset,
+				.size          = cases[i].cmd_size,
+				.nr_relocs     = 1,
+				.relocs        = VOID2U64(&reloc),
+		};
+		struct drm_msm_gem_submit req = {
+				.pipe    = MSM_PIPE_3D0,
+				.nr_bos  = 1,
+				.bos     = VOID2U64(&sbo),
+				.nr_cmds = 1,
+				.cmds    = VOID2U64(&cmd),
+		};
+
+		if (!emu_submit(emu, &req)) {
+			printf("bad_reloc: %d: not rejected\n", i);
+			failed = 1;
+		}
+	}
+}
+
+/* a draw state group which loads itself is rejected, not recursed into: */
+static void test_group_loop(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x1000);
+	struct emu_bo *bo = emu_bo_new(emu, 0x1000);
+	uint32_t *ptr = bo->map;
+
+	ptr[0] = CP_TYPE3_PKT | (1 << 16) | (CP_SET_DRAW_STATE << 8);
+	ptr[1] = CP_SET_DRAW_STATE_0_COUNT(3) |
+			CP_SET_DRAW_STATE_0_LOAD_IMMED |
+			CP_SET_DRAW_STATE_0_GROUP_ID(0);
+	ptr[2] = bo->iova;
+
+	CB_PKT3(cb, CP_SET_DRAW_STATE, 2);
+	CB_RING(cb, CP_SET_DRAW_STATE_0_COUNT(3) |
+			CP_SET_DRAW_STATE_0_LOAD_IMMED |
+			CP_SET_DRAW_STATE_0_GROUP_ID(0));
+	EMU_RELOC(cb, bo, 0, 0);
+
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+	if (!msm_submit_flush(submit)) {
+		printf("group_loop: recursive draw state was not rejected\n");
+		failed = 1;
+	}
+
+	cmdbuf_del(cb);
+}
+
+/* a visibility stream doesn't carry over into the next submit, which
+ * would otherwise skip draws against a stale bin:
+ */
+static void test_bin_data(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x1000);
+	struct emu_bo *bo = emu_bo_new(emu, 0x1000);
+	uint32_t *ptr = bo->map;
+
+	ptr[0] = 0;              /* no draws visible */
+	ptr[1] = 4;              /* stream size */
+
+	CB_PKT3(cb, CP_SET_BIN_DATA, 2);
+	EMU_RELOC(cb, bo, 0, 0);
+	EMU_RELOC(cb, bo, 4, 0);
+	flush("bin_data", cb);
+
+	cmdbuf_reset(cb);
+	CB_PKT3(cb, CP_DRAW_INDX, 3);
+	CB_RING(cb, 0x00000000);
+	CB_RING(cb, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+			INDEX_SIZE_IGN, USE_VISIBILITY));
+	CB_RING(cb, 3);
+	flush("bin_draw", cb);
+
+	if (emu->submit_stats.draws != 1) {
+		printf("bin_data: draw skipped by a previous submit's bin\n");
+		failed = 1;
+	}
+
+	cmdbuf_del(cb);
+}
+
+/* draws, with a WFI after every draw vs. only at the end: */
+static void test_wfi(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x4000);
+	uint32_t i;
+
+	for (i = 0; i < 100; i++) {
+		CB_PKT3(cb, CP_DRAW_INDX, 3);
+		CB_RING(cb, 0x00000000);
+		CB_RING(cb, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+				INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+		CB_RING(cb, 3);
+		CB_PKT3(cb, CP_WAIT_FOR_IDLE, 1);
+		CB_RING(cb, 0x00000000);
+	}
+	flush("draw_wfi", cb);
+
+	cmdbuf_reset(cb);
+	for (i = 0; i < 100; i++) {
+		CB_PKT3(cb, CP_DRAW_INDX, 3);
+		CB_RING(cb, 0x00000000);
+		CB_RING(cb, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+				INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+		CB_RING(cb, 3);
+	}
+	CB_PKT3(cb, CP_WAIT_FOR_IDLE, 1);
+	CB_RING(cb, 0x00000000);
+	flush("draw", cb);
+
+	cmdbuf_del(cb);
+}
+
+/* conditional and polling packets.  The last wait can only be satisfied
+ * by the CPU, so the CP blocks until the register is written:
+ */
+static void test_cond(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x1000);
+	struct emu_bo *bo = emu_bo_new(emu, 0x1000);
+	static const uint32_t expected[] = {
+			1, 0, 0x0000ff12, 0x11, 0, 0x33, 0, 0x44, 0x55, 0x77,
+	};
+	uint32_t *ptr = bo->map;
+	uint32_t i;
+
+	ptr[0] = 1;
+	ptr[1] = 0;
+
+	/* 2: CP_REG_RMW: */
+	CB_PKT0(cb, REG_AXXX_CP_SCRATCH_REG0, 1);
+	CB_RING(cb, 0xff00ff00);
+	CB_PKT3(cb, CP_REG_RMW, 3);
+	CB_RING(cb, REG_AXXX_CP_SCRATCH_REG0);
+	CB_RING(cb, 0x0000ffff);
+	CB_RING(cb, 0x00000012);
+	CB_PKT3(cb, CP_REG_TO_MEM, 2);
+	CB_RING(cb, REG_AXXX_CP_SCRATCH_REG0);
+	EMU_RELOC(cb, bo, 2 * 4, 0);
+
+	/* 3, 4: CP_COND_EXEC, taken and not taken: */
+	for (i = 0; i < 2; i++) {
+		CB_PKT3(cb, CP_COND_EXEC, 4);
+		EMU_RELOCS(cb, bo, 0 * 4, 0, -2);
+		EMU_RELOCS(cb, bo, 1 * 4, 0, -2);
+		CB_RING(cb, 1 - i);
+		CB_RING(cb, 3);
+		CB_PKT3(cb, CP_MEM_WRITE, 2);
+		EMU_RELOC(cb, bo, (3 + i) * 4, 0);
+		CB_RING(cb, 0x11 * (i + 1));
+	}
+
+	/* 5, 6: CP_COND_WRITE, true and false: */
+	for (i = 0; i < 2; i++) {
+		CB_PKT3(cb, CP_COND_WRITE, 6);
+		CB_RING(cb, 0x100 | 0x10 | EMU_FUNC_EQ);
+		EMU_RELOC(cb, bo, 0 * 4, 0);
+		CB_RING(cb, 1 + i);
+		CB_RING(cb, 0xffffffff);
+		EMU_RELOC(cb, bo, (5 + i) * 4, 0);
+		CB_RING(cb, 0x33);
+	}
+
+	/* 7, 8: wait for a timestamp written by the back-end after a draw,
+	 * which skips ahead to when the draw is done:
+	 */
+	CB_PKT3(cb, CP_DRAW_INDX, 3);
+	CB_RING(cb, 0x00000000);
+	CB_RING(cb, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+			INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+	CB_RING(cb, 3);
+	CB_PKT3(cb, CP_EVENT_WRITE, 3);
+	CB_RING(cb, CACHE_FLUSH_TS);
+	EMU_RELOC(cb, bo, 7 * 4, 0);
+	CB_RING(cb, 0x44);
+	CB_PKT3(cb, CP_WAIT_REG_MEM, 5);
+	CB_RING(cb, 0x10 | EMU_FUNC_EQ);
+	EMU_RELOC(cb, bo, 7 * 4, 0);
+	CB_RING(cb, 0x44);
+	CB_RING(cb, 0xffffffff);
+	CB_RING(cb, 0x10);
+	CB_PKT3(cb, CP_MEM_WRITE, 2);
+	EMU_RELOC(cb, bo, 8 * 4, 0);
+	CB_RING(cb, 0x55);
+
+	/* 9: wait for the CPU: */
+	CB_PKT3(cb, CP_WAIT_REG_EQ, 4);
+	CB_RING(cb, REG_AXXX_CP_SCRATCH_REG1);
+	CB_RING(cb, 0x66);
+	CB_RING(cb, 0xffffffff);
+	CB_RING(cb, 0x10);
+	CB_PKT3(cb, CP_MEM_WRITE, 2);
+	EMU_RELOC(cb, bo, 9 * 4, 0);
+	CB_RING(cb, 0x77);
+
+	flush("cond", cb);
+
+	if (emu_idle(emu) || (emu->completed == emu->fence) || ptr[9]) {
+		printf("cond: did not block\n");
+		failed = 1;
+	}
+
+	emu_write_reg(emu, REG_AXXX_CP_SCRATCH_REG1, 0x66);
+
+	if (!emu_idle(emu) || (emu->completed != emu->fence)) {
+		printf("cond: did not wake up\n");
+		failed = 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++) {
+		if (ptr[i] != expected[i]) {
+			printf("cond: %02x: expected %08x, got %08x\n", i,
+					expected[i], ptr[i]);
+			failed = 1;
+		}
+	}
+
+	cmdbuf_del(cb);
+}
+
+static int set_cost(struct emu_costs *costs, char *arg)
+{
+	static const struct {
+		const char *name;
+		size_t off;
+	} names[] = {
+#define C(n) { #n, offsetof(struct emu_costs, n) }
+		C(clock_mhz), C(pkt), C(dword), C(reg_write), C(mem_write),
+		C(wfi), C(ib), C(ib_pfd), C(event), C(draw),
+#undef C
+	};
+	char *val = strchr(arg, '=');
+	uint32_t i;
+
+	if (val) {
+		*val++ = '\0';
+		for (i = 0; i < ARRAY_SIZE(names); i++) {
+			if (!strcmp(arg, names[i].name)) {
+				*(uint32_t *)((char *)costs + names[i].off) =
+						strtoul(val, NULL, 0);
+				return 0;
+			}
+		}
+	}
+
+	printf("invalid cost, expected one of:");
+	for (i = 0; i < ARRAY_SIZE(names); i++)
+		printf(" %s", names[i].name);
+	printf("\n");
+
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+
+	emu = emu_new();
+
+	while ((opt = getopt(argc, argv, "c:il:")) != -1) {
+		switch (opt) {
+		case 'c':
+			if (set_cost(&emu->costs, optarg))
+				return -1;
+			break;
+		case 'i':
+			emu->decode = 0;
+			break;
+		case 'l':
+			limit_us = strtod(optarg, NULL);
+			break;
+		default:
+			printf("usage: %s [-c cost=cycles].. [-i] [-l limit-us]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	emu_attach(emu, submit);
+
+	test_pm4();
+	test_ib();
+	test_wfi();
+	test_cond();
+	test_bin_data();
+	test_bad_ib();
+	test_bad_reloc();
+	test_group_loop();
+
+	emu_dump_stats(emu, "total", &emu->stats);
+
+	msm_submit_del(submit);
+	emu_del(emu);
+
+	printf("%s\n", failed ? "FAILED" : "PASSED");
+
+	return failed;
+}
@@ -0,0 +1,428 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <xf86drm.h>
+
+#include "deps.h"
+
+struct deps * deps_new(struct emu *emu)
+{
+	struct deps *deps = calloc(1, sizeof(*deps));
+
+	if (!deps)
+		return NULL;
+
+	deps->emu = emu;
+
+	return deps;
+}
+
+void deps_reset(struct deps *deps)
+{
+	uint32_t i;
+
+	for (i = 0; i < deps->nr_submits; i++)
+		free(deps->submits[i].refs);
+	for (i = 0; i < deps->nr_bos; i++)
+		free(deps->bos[i].readers);
+
+	memset(deps->bos, 0, deps->nr_bos * sizeof(deps->bos[0]));
+	deps->nr_submits = 0;
+	deps->nr_edges = 0;
+}
+
+void deps_del(struct deps *deps)
+{
+	deps_reset(deps);
+	free(deps->submits);
+	free(deps->edges);
+	free(deps->bos);
+	free(deps);
+}
+
+static struct dep_bo * get_bo(struct deps *deps, uint32_t handle)
+{
+	if (handle >= deps->nr_bos) {
+		uint32_t nr = max(2 * deps->nr_bos, handle + 1);
+		deps->bos = realloc(deps->bos, nr * sizeof(deps->bos[0]));
+		memset(&deps->bos[deps->nr_bos], 0,
+				(nr - deps->nr_bos) * sizeof(deps->bos[0]));
+		deps->nr_bos = nr;
+	}
+	return &deps->bos[handle];
+}
+
+static void add_edge(struct deps *deps, uint32_t from, uint32_t handle,
+		enum dep_kind kind)
+{
+	GROW(deps->edges, deps->nr_edges, deps->max_edges);
+	deps->edges[deps->nr_edges++] = (struct dep_edge){
+		.from = from,
+		.handle = handle,
+		.kind = kind,
+	};
+}
+
+static struct dep_ref * get_ref(struct dep_submit *s, uint32_t handle)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->nr_refs; i++)
+		if (s->refs[i].handle == handle)
+			return &s->refs[i];
+
+	return NULL;
+}
+
+/* add the next submit to the graph, with the same rules the kernel uses:
+ * any access waits for the last write, and a write also waits for the
+ * reads since then.  Returns the submit's index:
+ */
+uint32_t deps_add(struct deps *deps, const struct drm_msm_gem_submit *req)
+{
+	struct drm_msm_gem_submit_bo *bos = U642VOID(req->bos);
+	uint32_t idx = deps->nr_submits;
+	struct dep_submit *s;
+	uint32_t i, j;
+
+	GROW(deps->submits, deps->nr_submits, deps->max_submits);
+	s = &deps->submits[deps->nr_submits++];
+	memset(s, 0, sizeof(*s));
+
+	s->pipe = req->pipe;
+	s->fence = req->fence;
+	s->cost = 1;
+	s->refs = calloc(req->nr_bos, sizeof(s->refs[0]));
+	s->nr_refs = req->nr_bos;
+	s->first_edge = deps->nr_edges;
+
+	for (i = 0; i < req->nr_bos; i++) {
+		uint32_t handle = bos[i].handle;
+		uint32_t flags = bos[i].flags;
+		struct dep_bo *bo = get_bo(deps, handle);
+
+		s->refs[i] = (struct dep_ref){
+			.handle = handle,
+			.flags = flags,
+			.written = !!(flags & MSM_SUBMIT_BO_WRITE),
+		};
+
+		bo->nr_refs++;
+
+		if (bo->last_write) {
+			struct dep_submit *w = &deps->submits[bo->last_write - 1];
+
+			/* by now, whether it actually wrote is known: */
+			if (get_ref(w, handle)->written)
+				bo->last_real = bo->last_write;
+
+			add_edge(deps, bo->last_write - 1, handle, DEP_RAW);
+
+			/* if it didn't, what is read is still the last real
+			 * write's:
+			 */
+			if (bo->last_real && (bo->last_real != bo->last_write))
+				add_edge(deps, bo->last_real - 1, handle, DEP_IMPLIED);
+		}
+
+		if (flags & MSM_SUBMIT_BO_WRITE) {
+			for (j = 0; j < bo->nr_readers; j++)
+				add_edge(deps, bo->readers[j], handle, DEP_WAR);
+
+			bo->nr_write_refs++;
+			bo->last_write = idx + 1;
+			bo->nr_readers = 0;
+		} else if (flags & MSM_SUBMIT_BO_READ) {
+			GROW(bo->readers, bo->nr_readers, bo->max_readers);
+			bo->readers[bo->nr_readers++] = idx;
+		}
+	}
+
+	s->nr_edges = deps->nr_edges - s->first_edge;
+
+	for (i = s->first_edge; i < deps->nr_edges; i++)
+		if (deps->edges[i].kind != DEP_IMPLIED)
+			get_bo(deps, deps->edges[i].handle)->nr_edges++;
+
+	return idx;
+}
+
+/* record whether a submit actually wrote a bo it marked WRITE.  Once this
+ * is called for a submit, the bo's it is not called for count as written
+ * only if they are marked WRITE:
+ */
+void deps_set_written(struct deps *deps, uint32_t idx, uint32_t handle,
+		int written)
+{
+	struct dep_submit *s = &deps->submits[idx];
+	struct dep_ref *ref = get_ref(s, handle);
+	struct dep_bo *bo = get_bo(deps, handle);
+
+	if (!ref || !(ref->flags & MSM_SUBMIT_BO_WRITE))
+		return;
+
+	s->checked = 1;
+	ref->written = written;
+
+	bo->nr_checked++;
+	if (written)
+		bo->nr_writes++;
+}
+
+/* whether the edge is needed, given what the submits actually did: the
+ * earlier submit wrote the bo, or read it before the later one wrote it:
+ */
+int deps_edge_needed(struct deps *deps, uint32_t to,
+		const struct dep_edge *edge)
+{
+	struct dep_ref *a = get_ref(&deps->submits[edge->from], edge->handle);
+	struct dep_ref *b = get_ref(&deps->submits[to], edge->handle);
+
+	if (a->written)
+		return 1;
+
+	return (a->flags & MSM_SUBMIT_BO_READ) && b->written;
+}
+
+/* longest path through the graph, weighted by submit cost.  Edges only
+ * point back at earlier submits, so one pass in order does it.  Ordering
+ * within a ring is deliberately ignored, so compared to the total this
+ * shows how much the bo's alone allow to overlap:
+ */
+uint64_t deps_critical_path(struct deps *deps, int needed_only,
+		uint64_t *total)
+{
+	uint64_t longest = 0, sum = 0;
+	uint32_t i, j;
+
+	for (i = 0; i < deps->nr_submits; i++) {
+		struct dep_submit *s = &deps->submits[i];
+
+		s->path = 0;
+		s->path_prev = ~0;
+
+		for (j = 0; j < s->nr_edges; j++) {
+			struct dep_edge *e = &deps->edges[s->first_edge + j];
+			struct dep_submit *from = &deps->submits[e->from];
+
+			if (needed_only && !deps_edge_needed(deps, i, e))
+				continue;
+
+			if (from->path > s->path) {
+				s->path = from->path;
+				s->path_prev = e->from;
+			}
+		}
+
+		s->path += s->cost;
+		longest = max(longest, s->path);
+		sum += s->cost;
+	}
+
+	if (total)
+		*total = sum;
+
+	return longest;
+}
+
+static int deps_flush(void *priv, struct drm_msm_gem_submit *req)
+{
+	struct deps *deps = priv;
+	struct drm_msm_gem_submit_bo *bos = U642VOID(req->bos);
+	struct emu *emu = deps->emu;
+	uint32_t idx = deps_add(deps, req);
+	struct dep_submit *s = &deps->submits[idx];
+	uint32_t *gens = NULL;
+	uint64_t cycles = 0;
+	uint32_t i;
+	int ret;
+
+	if (emu) {
+		gens = calloc(req->nr_bos, sizeof(gens[0]));
+		for (i = 0; i < req->nr_bos; i++) {
+			struct emu_bo *bo = emu_bo_lookup(emu, bos[i].handle);
+			if (bo)
+				gens[i] = emu_bo_gen(bo);
+		}
+		cycles = emu->stats.cycles;
+	}
+
+	if (deps->flush) {
+		ret = deps->flush(deps->priv, req);
+	} else {
+		ret = drmCommandWriteRead(deps->fd, DRM_MSM_GEM_SUBMIT,
+				req, sizeof(*req));
+	}
+
+	s->fence = req->fence;
+
+	/* cost is always in cycles with the emulator, even for a submit
+	 * the CP blocked in.  But then it is not done yet, and what it
+	 * wrote isn't known:
+	 */
+	if (emu)
+		s->cost = emu->stats.cycles - cycles;
+
+	if (emu && !ret && emu_idle(emu)) {
+		for (i = 0; i < req->nr_bos; i++) {
+			struct emu_bo *bo = emu_bo_lookup(emu, bos[i].handle);
+
+			if (!bo || !(bos[i].flags & MSM_SUBMIT_BO_WRITE))
+				continue;
+
+			deps_set_written(deps, idx, bos[i].handle,
+					(emu_bo_gen(bo) != gens[i]) ||
+					emu_bo_pending(emu, bo));
+		}
+	}
+
+	free(gens);
+
+	return ret;
+}
+
+/* track the submits a submit builder flushes, passing them on to wherever
+ * they went before (so attach the emulator first, if there is one):
+ */
+void deps_attach(struct deps *deps, struct msm_submit *submit)
+{
+	deps->fd = submit->fd;
+	deps->flush = submit->flush;
+	deps->priv = submit->priv;
+
+	submit->flush = deps_flush;
+	submit->priv = deps;
+}
+
+static const char *kind_names[] = {
+		[DEP_RAW] = "raw",
+		[DEP_WAR] = "war",
+		[DEP_IMPLIED] = "implied",
+};
+
+static void print_cost(struct deps *deps, uint64_t cost)
+{
+	if (deps->emu)
+		printf("%.3fus", emu_cycles_to_us(deps->emu, cost));
+	else
+		printf("%"PRIu64" submits", cost);
+}
+
+void deps_dump(struct deps *deps, int verbose)
+{
+	uint64_t total, needed, longest;
+	uint32_t i, j, nr_false = 0, nr_implied = 0;
+	uint32_t *path;
+
+	for (i = 0; i < deps->nr_bos; i++)
+		deps->bos[i].nr_false = 0;
+
+	for (i = 0; i < deps->nr_submits; i++) {
+		struct dep_submit *s = &deps->submits[i];
+
+		for (j = 0; j < s->nr_edges; j++) {
+			struct dep_edge *e = &deps->edges[s->first_edge + j];
+			if (e->kind == DEP_IMPLIED)
+				nr_implied++;
+			else if (!deps_edge_needed(deps, i, e)) {
+				deps->bos[e->handle].nr_false++;
+				nr_false++;
+			}
+		}
+	}
+
+	printf("%u submits, %u dependencies (%u not needed)\n",
+			deps->nr_submits, deps->nr_edges - nr_implied, nr_false);
+
+	if (!deps->nr_submits)
+		return;
+
+	/* the last pass leaves the path info for the full graph: */
+	needed = deps_critical_path(deps, 1, NULL);
+	longest = deps_critical_path(deps, 0, &total);
+
+	printf("critical path: ");
+	print_cost(deps, longest);
+	printf(" of ");
+	print_cost(deps, total);
+	printf(" (%.1f%%), ", total ? 100.0 * longest / total : 0.0);
+	print_cost(deps, needed);
+	printf(" without the unneeded dependencies\n");
+
+	path = calloc(deps->nr_submits, sizeof(path[0]));
+	for (i = 0, j = 0; i < deps->nr_submits; i++)
+		if (deps->submits[i].path > deps->submits[j].path)
+			j = i;
+	for (i = 0; j != ~0u; j = deps->submits[j].path_prev)
+		path[i++] = j;
+	printf("  path:");
+	while (i-- > 0)
+		printf(" #%u", path[i]);
+	printf("\n");
+	free(path);
+
+	printf("serializing bo's:\n");
+	for (i = 0; i < deps->nr_bos; i++) {
+		struct dep_bo *bo = &deps->bos[i];
+
+		if (!bo->nr_edges)
+			continue;
+
+		printf("  bo %u: %u refs (%u write", i, bo->nr_refs,
+				bo->nr_write_refs);
+		if (bo->nr_checked)
+			printf(", %u of %u written", bo->nr_writes, bo->nr_checked);
+		printf("), %u dependencies (%u not needed)%s\n", bo->nr_edges,
+				bo->nr_false, (bo->nr_checked && !bo->nr_writes) ?
+						", false sharing: marked WRITE but only read" : "");
+	}
+
+	if (!verbose)
+		return;
+
+	for (i = 0; i < deps->nr_submits; i++) {
+		struct dep_submit *s = &deps->submits[i];
+
+		printf("  #%u: pipe %u, fence %u, ", i, s->pipe, s->fence);
+		print_cost(deps, s->cost);
+		printf("\n");
+
+		for (j = 0; j < s->nr_edges; j++) {
+			struct dep_edge *e = &deps->edges[s->first_edge + j];
+			printf("    waits on #%u for bo %u (%s)%s\n", e->from,
+					e->handle, kind_names[e->kind],
+					deps_edge_needed(deps, i, e) ? "" : ", not needed");
+		}
+	}
+}
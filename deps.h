@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef DEPS_H_
+#define DEPS_H_
+
+#include <stdint.h>
+
+#include "submit.h"
+#include "emu.h"
+
+/*
+ * Userspace view of the implicit synchronization the kernel does between
+ * submits: each submit's bos[] table is compared against the submits that
+ * came before it, the same way the kernel uses the READ/WRITE flags, to
+ * build a dependency graph.  From that we can report which submits
+ * serialize on which bo's, the critical path through the graph (ignoring
+ * the ordering within a ring, ie. how long the work would take if every
+ * submit were free to run as soon as its dependencies are met), and which
+ * bo's cause serialization that isn't needed.
+ *
+ * With an emulator (emu.h) behind the submits, each submit's cost is the
+ * CP cycles it took, and the bo's it actually wrote are known, so a bo
+ * marked WRITE but only read shows up as false sharing.  Otherwise each
+ * submit costs 1 and the flags are taken at their word.  A submit the CP
+ * blocked in costs the cycles it ran for before blocking, and the rest is
+ * counted against the submit that unblocks it.
+ */
+
+enum dep_kind {
+	DEP_RAW,        /* read (or write) after write */
+	DEP_WAR,        /* write after read */
+	DEP_IMPLIED,    /* read after the last actual write, when the submits
+	                 * marked WRITE since then didn't write.  The kernel
+	                 * has no such edge, it serializes through them:
+	                 */
+};
+
+struct dep_edge {
+	uint32_t from;       /* index of the earlier submit */
+	uint32_t handle;
+	enum dep_kind kind;
+};
+
+/* a bo as used by one submit: */
+struct dep_ref {
+	uint32_t handle;
+	uint32_t flags;      /* MSM_SUBMIT_BO_x */
+	int written;         /* actually written, if known */
+};
+
+struct dep_submit {
+	uint32_t pipe;
+	uint32_t fence;
+	uint64_t cost;
+	int checked;         /* whether dep_ref::written is known */
+
+	struct dep_ref *refs;
+	uint32_t nr_refs;
+
+	uint32_t first_edge, nr_edges;
+
+	/* longest path ending with this submit, and the submit before it
+	 * on that path (~0 if none):
+	 */
+	uint64_t path;
+	uint32_t path_prev;
+};
+
+/* per-bo state, indexed by handle: */
+struct dep_bo {
+	/* since the last write: */
+	uint32_t last_write;     /* submit index + 1, 0 if none */
+	uint32_t last_real;      /* .. that actually wrote, as far as known */
+	uint32_t *readers;
+	uint32_t nr_readers, max_readers;
+
+	/* stats: */
+	uint32_t nr_refs;
+	uint32_t nr_write_refs;  /* refs marked WRITE */
+	uint32_t nr_checked;     /* .. of those, how many are known */
+	uint32_t nr_writes;      /* .. of those, how many actually wrote */
+	uint32_t nr_edges;       /* serializations caused */
+	uint32_t nr_false;       /* .. which weren't needed */
+};
+
+struct deps {
+	struct dep_submit *submits;
+	uint32_t nr_submits, max_submits;
+
+	struct dep_edge *edges;
+	uint32_t nr_edges, max_edges;
+
+	struct dep_bo *bos;
+	uint32_t nr_bos;
+
+	/* when attached to a submit builder, whatever it flushed to before: */
+	int fd;
+	int (*flush)(void *priv, struct drm_msm_gem_submit *req);
+	void *priv;
+
+	/* optional, to measure cost and find the actual writes: */
+	struct emu *emu;
+};
+
+struct deps * deps_new(struct emu *emu);
+void deps_del(struct deps *deps);
+uint32_t deps_add(struct deps *deps, const struct drm_msm_gem_submit *req);
+void deps_set_written(struct deps *deps, uint32_t idx, uint32_t handle,
+		int written);
+void deps_attach(struct deps *deps, struct msm_submit *submit);
+int deps_edge_needed(struct deps *deps, uint32_t to,
+		const struct dep_edge *edge);
+uint64_t deps_critical_path(struct deps *deps, int needed_only,
+		uint64_t *total);
+void deps_reset(struct deps *deps);
+void deps_dump(struct deps *deps, int verbose);
+
+#endif /* DEPS_H_ */
@@ -0,0 +1,342 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "util.h"
+#include "deps.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+#include "a3xx.xml.h"
+
+/* Builds a few patterns of submits against the emulator, with a
+ * dependency tracker (deps.h) in between, and checks that it finds the
+ * serialization, critical path and false sharing we expect.
+ */
+
+static struct emu *emu;
+static struct deps *deps;
+static struct msm_submit *submit;
+static struct cmdbuf *cb, *work;
+static int nr_submits = 16;
+static int verbose;
+
+static void reloc(struct emu_bo *bo, uint32_t offset, uint32_t flags)
+{
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = bo->handle,
+		.flags = flags,
+		.offset = offset,
+	});
+}
+
+/* each submit does the same amount of work (only reading the shared
+ * work cmdbuf), plus whatever the test adds:
+ */
+static void begin(void)
+{
+	cmdbuf_reset(cb);
+	CB_IB(cb, work, true);
+}
+
+static void flush(void)
+{
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+	msm_submit_flush(submit);
+}
+
+/* read a bo from the CP, without writing anything: */
+static void read_bo(struct emu_bo *bo, uint32_t flags)
+{
+	CB_PKT3(cb, CP_COND_WRITE, 6);
+	CB_RING(cb, 0x10 | EMU_FUNC_ALWAYS);
+	reloc(bo, 0, flags);
+	CB_RING(cb, 0);
+	CB_RING(cb, 0);
+	CB_RING(cb, 0);
+	CB_RING(cb, 0);
+}
+
+static void write_bo(struct emu_bo *bo, uint32_t offset, uint32_t val)
+{
+	CB_PKT3(cb, CP_MEM_WRITE, 2);
+	reloc(bo, offset, MSM_SUBMIT_BO_WRITE);
+	CB_RING(cb, val);
+}
+
+static uint32_t count_false(void)
+{
+	uint32_t i, j, n = 0;
+
+	for (i = 0; i < deps->nr_submits; i++) {
+		struct dep_submit *s = &deps->submits[i];
+		for (j = 0; j < s->nr_edges; j++)
+			if (!deps_edge_needed(deps, i, &deps->edges[s->first_edge + j]))
+				n++;
+	}
+
+	return n;
+}
+
+/* every submit writes its own bo, so nothing serializes: */
+static int test_independent(void)
+{
+	uint64_t path, total;
+	int i;
+
+	for (i = 0; i < nr_submits; i++) {
+		begin();
+		write_bo(emu_bo_new(emu, 0x1000), 0, i);
+		flush();
+	}
+
+	deps_dump(deps, verbose);
+
+	path = deps_critical_path(deps, 0, &total);
+	if (deps->nr_edges || (path * nr_submits > total * 2)) {
+		printf("expected no dependencies\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* every submit reads a bo of constants, but marks it for write too (as
+ * CB_RELOC does), so they all serialize for nothing:
+ */
+static int test_false_sharing(void)
+{
+	struct emu_bo *consts = emu_bo_new(emu, 0x1000);
+	uint64_t path, needed, total;
+	int i;
+
+	for (i = 0; i < nr_submits; i++) {
+		begin();
+		read_bo(consts, MSM_SUBMIT_BO_READ | MSM_SUBMIT_BO_WRITE);
+		write_bo(emu_bo_new(emu, 0x1000), 0, i);
+		flush();
+	}
+
+	deps_dump(deps, verbose);
+
+	needed = deps_critical_path(deps, 1, NULL);
+	path = deps_critical_path(deps, 0, &total);
+
+	if ((deps->nr_edges != (uint32_t)(nr_submits - 1)) ||
+			(count_false() != deps->nr_edges)) {
+		printf("expected %d unneeded dependencies, got %u of %u\n",
+				nr_submits - 1, count_false(), deps->nr_edges);
+		return -1;
+	}
+
+	if ((path != total) || (needed * nr_submits > total * 2)) {
+		printf("unexpected critical path\n");
+		return -1;
+	}
+
+	if (deps->bos[consts->handle].nr_writes) {
+		printf("constants should not be written\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* a value is produced and then consumed, over and over, through the same
+ * bo, so every dependency is real:
+ */
+static int test_producer_consumer(void)
+{
+	struct emu_bo *val = emu_bo_new(emu, 0x1000);
+	uint64_t path, total;
+	int i;
+
+	for (i = 0; i < nr_submits / 2; i++) {
+		begin();
+		write_bo(val, 0, i);
+		flush();
+
+		begin();
+		read_bo(val, MSM_SUBMIT_BO_READ);
+		flush();
+	}
+
+	deps_dump(deps, verbose);
+
+	path = deps_critical_path(deps, 0, &total);
+
+	/* each read waits for the write before it, and each write after the
+	 * first waits for both the write and the read before it:
+	 */
+	if ((deps->nr_edges != (uint32_t)(3 * nr_submits / 2 - 2)) || count_false()) {
+		printf("expected %d dependencies, all needed\n",
+				3 * nr_submits / 2 - 2);
+		return -1;
+	}
+
+	if (path != total) {
+		printf("expected the whole sequence to be the critical path\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* a submit marks the bo WRITE but only reads it, between the real write
+ * and a read: the read still depends on the write, through it:
+ */
+static int test_write_through(void)
+{
+	struct emu_bo *val = emu_bo_new(emu, 0x1000);
+	struct dep_submit *s;
+	uint32_t j;
+
+	begin();
+	write_bo(val, 0, 1);
+	flush();
+
+	begin();
+	read_bo(val, MSM_SUBMIT_BO_READ | MSM_SUBMIT_BO_WRITE);
+	flush();
+
+	begin();
+	read_bo(val, MSM_SUBMIT_BO_READ);
+	flush();
+
+	deps_dump(deps, verbose);
+
+	s = &deps->submits[2];
+	for (j = 0; j < s->nr_edges; j++) {
+		struct dep_edge *e = &deps->edges[s->first_edge + j];
+		if ((e->from == 0) && deps_edge_needed(deps, 2, e))
+			break;
+	}
+
+	if (j == s->nr_edges) {
+		printf("expected the read to depend on the write\n");
+		return -1;
+	}
+
+	if (deps_critical_path(deps, 1, NULL) <
+			(deps->submits[0].cost + deps->submits[2].cost)) {
+		printf("unexpected critical path\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void init(void)
+{
+	int i;
+
+	emu = emu_new();
+	deps = deps_new(emu);
+	submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	emu_attach(emu, submit);
+	deps_attach(deps, submit);
+
+	cb = emu_cmdbuf_new(emu, 0x1000);
+	work = emu_cmdbuf_new(emu, 0x1000);
+	for (i = 0; i < 256; i++) {
+		CB_PKT0(work, REG_AXXX_CP_SCRATCH_REG0 + (i % 8), 1);
+		CB_RING(work, i);
+	}
+}
+
+static void fini(void)
+{
+	msm_submit_del(submit);
+	cmdbuf_del(cb);
+	cmdbuf_del(work);
+	deps_del(deps);
+	emu_del(emu);
+}
+
+static void report(int ret)
+{
+	printf("%s\n", ret ? "FAILED" : "PASSED");
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, ret, failed = 0;
+
+	while ((opt = getopt(argc, argv, "n:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_submits = strtol(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			printf("usage: %s [-n submits] [-v]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (nr_submits < 2)
+		nr_submits = 2;
+	nr_submits &= ~1;
+
+	printf("Test 1: independent submits\n");
+	init();
+	ret = test_independent();
+	fini();
+	report(ret);
+	failed |= ret;
+
+	printf("Test 2: bo marked WRITE but only read\n");
+	init();
+	ret = test_false_sharing();
+	fini();
+	report(ret);
+	failed |= ret;
+
+	printf("Test 3: producer and consumer\n");
+	init();
+	ret = test_producer_consumer();
+	fini();
+	report(ret);
+	failed |= ret;
+
+	printf("Test 4: read through a submit marked WRITE but not writing\n");
+	init();
+	ret = test_write_through();
+	fini();
+	report(ret);
+	failed |= ret;
+
+	return failed;
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef DRAW_H_
+#define DRAW_H_
+
+#include <stdint.h>
+
+#include "cmdbuf.h"
+#include "util.h"
+#include "index.h"
+
+/*
+ * Emitters for the draw packets.  Each takes a struct cb_draw describing
+ * the draw, and uses the fields which apply to its packet:
+ *
+ *   CB_DRAW_INDX()          auto-index, or indices from a bo
+ *   CB_DRAW_INDX_2()        indices inline in the cmdstream
+ *   CB_DRAW_INDX_OFFSET()   instanced, auto-index or indices from a bo
+ *   CB_DRAW_INDIRECT()      count/instances from a bo (struct
+ *                           draw_indirect)
+ *   CB_DRAW_INDX_INDIRECT() the same, for indices from a bo (struct
+ *                           draw_indx_indirect)
+ *
+ * A draw reads indices from a bo if idx_handle is set, otherwise the
+ * indices are generated (index_size is then ignored).
+ *
+ * Indexed draws which have their indices on the CPU too (indices, for
+ * CB_DRAW_INDX() and CB_DRAW_INDX_OFFSET() along with idx_handle) are
+ * preceded by VFD_INDEX_MIN/MAX for the range they use.  Otherwise the
+ * caller should emit CB_INDEX_RANGE() itself.
+ */
+
+struct cb_draw {
+	enum pc_di_primtype prim;
+	enum pc_di_vis_cull_mode vis;
+	enum pc_di_index_size index_size;
+	bool no_restart;         /* all ones indices are vertices, not restarts */
+	uint32_t count;          /* indices, or vertices */
+	uint32_t instances;      /* 0 is taken as 1 */
+
+	/* index buffer, idx_size in bytes from idx_offset: */
+	uint32_t idx_handle, idx_offset, idx_size;
+
+	/* indices for CB_DRAW_INDX_2(), packed at index_size, or a CPU copy
+	 * of the index buffer's for the range:
+	 */
+	const void *indices;
+
+	/* arguments of indirect draws: */
+	uint32_t arg_handle, arg_offset;
+};
+
+/* argument layouts for the indirect draws: */
+struct draw_indirect {
+	uint32_t count;
+	uint32_t instances;
+	uint32_t first_vertex;
+	uint32_t first_instance;
+};
+
+struct draw_indx_indirect {
+	uint32_t count;
+	uint32_t instances;
+	uint32_t first_index;
+	int32_t  base_vertex;
+	uint32_t first_instance;
+};
+
+static inline uint32_t draw_index_bytes(enum pc_di_index_size size)
+{
+	switch (size) {
+	case INDEX_SIZE_32_BIT: return 4;
+	case INDEX_SIZE_8_BIT:  return 1;
+	case INDEX_SIZE_16_BIT:
+	default:                return 2;
+	}
+}
+
+static inline enum pc_di_src_sel draw_src(const struct cb_draw *d)
+{
+	return d->idx_handle ? DI_SRC_SEL_DMA : DI_SRC_SEL_AUTO_INDEX;
+}
+
+static inline enum pc_di_index_size draw_index_size(const struct cb_draw *d)
+{
+	return d->idx_handle ? d->index_size : INDEX_SIZE_IGN;
+}
+
+/* draw initiator of CP_DRAW_INDX_OFFSET and the indirect draws: */
+static inline uint32_t draw_initiator(const struct cb_draw *d,
+		enum pc_di_src_sel src, enum pc_di_index_size size)
+{
+	return CP_DRAW_INDX_OFFSET_0_PRIM_TYPE(d->prim) |
+			CP_DRAW_INDX_OFFSET_0_SOURCE_SELECT(src) |
+			CP_DRAW_INDX_OFFSET_0_VIS_CULL(d->vis) |
+			CP_DRAW_INDX_OFFSET_0_INDEX_SIZE(size & 1) |
+			COND(size >> 1, CP_DRAW_INDX_OFFSET_0_SMALL_INDEX);
+}
+
+/* range of a draw's indices (d->indices), excluding restart indices
+ * unless restart is off:
+ */
+static inline void
+draw_index_range(const struct cb_draw *d, struct index_range *r)
+{
+	uint32_t i;
+
+	switch (d->index_size) {
+	case INDEX_SIZE_32_BIT:
+		index_scan_u32(d->indices, d->count, r);
+		break;
+	case INDEX_SIZE_8_BIT: {
+		const uint8_t *idx = d->indices;
+		*r = (struct index_range){ .min = ~0 };
+		for (i = 0; i < d->count; i++) {
+			if (idx[i] == 0xff) {
+				r->restart = true;
+				continue;
+			}
+			r->min = min(r->min, idx[i]);
+			r->max = max(r->max, idx[i]);
+		}
+		break;
+	}
+	case INDEX_SIZE_16_BIT:
+	default:
+		index_scan_u16(d->indices, d->count, r);
+		break;
+	}
+
+	if (d->no_restart)
+		index_range_no_restart(r, 0xffffffff >>
+				(32 - 8 * draw_index_bytes(d->index_size)));
+}
+
+/* VFD_INDEX_MIN/MAX, for the range of the following draws' indices: */
+static inline void
+CB_INDEX_RANGE(struct cmdbuf *cb, const struct index_range *r)
+{
+	bool empty = index_range_empty(r);
+
+	CB_PKT0(cb, REG_A3XX_VFD_INDEX_MIN, 2);
+	CB_RING(cb, empty ? 0 : r->min);
+	CB_RING(cb, empty ? 0 : r->max);
+}
+
+/* the range of an indexed draw, if its indices are on the CPU: */
+static inline void
+CB_DRAW_RANGE(struct cmdbuf *cb, const struct cb_draw *d)
+{
+	struct index_range r;
+
+	if (!d->indices)
+		return;
+
+	draw_index_range(d, &r);
+	CB_INDEX_RANGE(cb, &r);
+}
+
+static inline void
+CB_RELOC_READ(struct cmdbuf *cb, uint32_t handle, uint32_t offset)
+{
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = handle,
+		.flags = MSM_SUBMIT_BO_READ,
+		.offset = offset,
+	});
+}
+
+static inline void
+CB_DRAW_INDX(struct cmdbuf *cb, const struct cb_draw *d)
+{
+	if (d->idx_handle)
+		CB_DRAW_RANGE(cb, d);
+
+	CB_PKT3(cb, CP_DRAW_INDX, d->idx_handle ? 5 : 3);
+	CB_RING(cb, 0x00000000);        /* viz query info */
+	CB_RING(cb, DRAW(d->prim, draw_src(d), draw_index_size(d), d->vis));
+	CB_RING(cb, d->count);
+	if (d->idx_handle) {
+		CB_RELOC_READ(cb, d->idx_handle, d->idx_offset);
+		CB_RING(cb, d->idx_size);
+	}
+}
+
+static inline void
+CB_DRAW_INDX_2(struct cmdbuf *cb, const struct cb_draw *d)
+{
+	uint32_t bytes = d->count * draw_index_bytes(d->index_size);
+	uint32_t dwords = ALIGN(bytes, 4) / 4;
+
+	CB_DRAW_RANGE(cb, d);
+
+	CB_PKT3(cb, CP_DRAW_INDX_2, 3 + dwords);
+	CB_RING(cb, 0x00000000);        /* viz query info */
+	CB_RING(cb, DRAW(d->prim, DI_SRC_SEL_IMMEDIATE, d->index_size, d->vis));
+	CB_RING(cb, d->count);
+
+	/* the last dword is padded with zeros: */
+	if (dwords) {
+		cb->cur[dwords - 1] = 0;
+		memcpy(cb->cur, d->indices, bytes);
+		cb->cur += dwords;
+		RING_PROF_DWORDS(dwords);
+	}
+}
+
+static inline void
+CB_DRAW_INDX_OFFSET(struct cmdbuf *cb, const struct cb_draw *d)
+{
+	if (d->idx_handle)
+		CB_DRAW_RANGE(cb, d);
+
+	CB_PKT3(cb, CP_DRAW_INDX_OFFSET, d->idx_handle ? 6 : 3);
+	CB_RING(cb, draw_initiator(d, draw_src(d), draw_index_size(d)));
+	CB_RING(cb, max(d->instances, 1));
+	CB_RING(cb, d->count);
+	if (d->idx_handle) {
+		CB_RING(cb, 0x00000000);
+		CB_RELOC_READ(cb, d->idx_handle, d->idx_offset);
+		CB_RING(cb, d->idx_size);
+	}
+}
+
+static inline void
+CB_DRAW_INDIRECT(struct cmdbuf *cb, const struct cb_draw *d)
+{
+	CB_PKT3(cb, CP_DRAW_INDIRECT, 2);
+	CB_RING(cb, draw_initiator(d, DI_SRC_SEL_AUTO_INDEX, INDEX_SIZE_IGN));
+	CB_RELOC_READ(cb, d->arg_handle, d->arg_offset);
+}
+
+static inline void
+CB_DRAW_INDX_INDIRECT(struct cmdbuf *cb, const struct cb_draw *d)
+{
+	CB_PKT3(cb, CP_DRAW_INDX_INDIRECT, 4);
+	CB_RING(cb, draw_initiator(d, DI_SRC_SEL_DMA, d->index_size));
+	CB_RELOC_READ(cb, d->idx_handle, d->idx_offset);
+	CB_RING(cb, d->idx_size);
+	CB_RELOC_READ(cb, d->arg_handle, d->arg_offset);
+}
+
+#endif /* DRAW_H_ */
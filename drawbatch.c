@@ -0,0 +1,289 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "drawbatch.h"
+
+struct draw_batch * draw_batch_new(struct upload_ring *ring)
+{
+	struct draw_batch *batch = calloc(1, sizeof(*batch));
+
+	if (!batch)
+		return NULL;
+
+	batch->indices = malloc(DRAW_BATCH_MAX_INDICES * 4);
+	if (!batch->indices) {
+		free(batch);
+		return NULL;
+	}
+
+	batch->ring = ring;
+
+	return batch;
+}
+
+void draw_batch_del(struct draw_batch *batch)
+{
+	free(batch->indices);
+	free(batch);
+}
+
+static bool is_list(enum pc_di_primtype prim)
+{
+	switch (prim) {
+	case DI_PT_POINTLIST_A3XX:
+	case DI_PT_LINELIST:
+	case DI_PT_TRILIST:
+	case DI_PT_RECTLIST:
+		return true;
+	case DI_PT_NONE:
+	case DI_PT_POINTLIST_A2XX:
+	case DI_PT_LINESTRIP:
+	case DI_PT_TRIFAN:
+	case DI_PT_TRISTRIP:
+	case DI_PT_LINELOOP:
+	case DI_PT_QUADLIST:
+	case DI_PT_QUADSTRIP:
+	case DI_PT_POLYGON:
+	case DI_PT_2D_COPY_RECT_LIST_V0:
+	case DI_PT_2D_COPY_RECT_LIST_V1:
+	case DI_PT_2D_COPY_RECT_LIST_V2:
+	case DI_PT_2D_COPY_RECT_LIST_V3:
+	case DI_PT_2D_FILL_RECT_LIST:
+	case DI_PT_2D_LINE_STRIP:
+	case DI_PT_2D_TRI_STRIP:
+	default:
+		return false;
+	}
+}
+
+static bool is_restart(const struct cb_draw *d, uint32_t i)
+{
+	switch (d->index_size) {
+	case INDEX_SIZE_32_BIT:
+		return ((const uint32_t *)d->indices)[i] == 0xffffffff;
+	case INDEX_SIZE_8_BIT:
+		return ((const uint8_t *)d->indices)[i] == 0xff;
+	case INDEX_SIZE_16_BIT:
+	default:
+		return ((const uint16_t *)d->indices)[i] == 0xffff;
+	}
+}
+
+/* append a draw's rebased indices past the end of the open batch (they
+ * only become part of it once nr_indices is bumped), returning their
+ * range:
+ */
+static void stage_indices(struct draw_batch *batch,
+		const struct cb_draw *d, uint32_t base_vertex,
+		struct index_range *r)
+{
+	uint32_t *dst = &batch->indices[batch->nr_indices];
+	uint32_t i;
+
+	draw_index_range(d, r);
+
+	switch (d->index_size) {
+	case INDEX_SIZE_32_BIT: {
+		const uint32_t *src = d->indices;
+		for (i = 0; i < d->count; i++)
+			dst[i] = src[i] + base_vertex;
+		break;
+	}
+	case INDEX_SIZE_8_BIT: {
+		const uint8_t *src = d->indices;
+		for (i = 0; i < d->count; i++)
+			dst[i] = src[i] + base_vertex;
+		break;
+	}
+	case INDEX_SIZE_16_BIT:
+	default: {
+		const uint16_t *src = d->indices;
+		for (i = 0; i < d->count; i++)
+			dst[i] = src[i] + base_vertex;
+		break;
+	}
+	}
+
+	/* restart indices stay restart indices (rare, so not worth
+	 * slowing down the loops above for):
+	 */
+	if (r->restart)
+		for (i = 0; i < d->count; i++)
+			if (is_restart(d, i))
+				dst[i] = 0xffffffff;
+
+	if (!index_range_empty(r)) {
+		r->min += base_vertex;
+		r->max += base_vertex;
+	}
+}
+
+/* whether a draw, with the range of its rebased indices, can join the
+ * open batch:
+ */
+static bool can_join(struct draw_batch *batch, struct cmdbuf *cb,
+		const struct cb_draw *d, const struct index_range *r)
+{
+	return (batch->cb == cb) && (batch->end == cb->cur) &&
+			(batch->prim == d->prim) && (batch->vis == d->vis) &&
+			(batch->no_restart == d->no_restart) && is_list(d->prim) &&
+			((batch->index_size == INDEX_SIZE_32_BIT) ||
+					(r->max < 0xffff));
+}
+
+int draw_batch_draw(struct draw_batch *batch, struct cmdbuf *cb,
+		const struct cb_draw *d, uint32_t base_vertex)
+{
+	struct index_range r;
+	int ret;
+
+	if (!d->count)
+		return 0;
+
+	if (d->count > DRAW_BATCH_MAX_INDICES) {
+		ERROR_MSG("too many indices: %u", d->count);
+		return -EINVAL;
+	}
+
+	/* there is always room past the open batch for one more draw: */
+	if ((batch->nr_indices + d->count) > DRAW_BATCH_MAX_INDICES) {
+		ret = draw_batch_flush(batch);
+		if (ret)
+			return ret;
+	}
+
+	stage_indices(batch, d, base_vertex, &r);
+
+	if (batch->cb && !can_join(batch, cb, d, &r)) {
+		uint32_t *staged = &batch->indices[batch->nr_indices];
+
+		ret = draw_batch_flush(batch);
+		if (ret)
+			return ret;
+
+		memmove(batch->indices, staged, d->count * 4);
+	}
+
+	if (!batch->cb) {
+		batch->cb = cb;
+		batch->prim = d->prim;
+		batch->vis = d->vis;
+		batch->no_restart = d->no_restart;
+		batch->index_size = (r.max < 0xffff) ?
+				INDEX_SIZE_16_BIT : INDEX_SIZE_32_BIT;
+		batch->range = (struct index_range){ .min = ~0 };
+
+		/* the index range, count, index address and size are
+		 * patched in later:
+		 */
+		CB_INDEX_RANGE(cb, &batch->range);
+		batch->range_dw = cb->cur - 2;
+
+		CB_DRAW_INDX_OFFSET(cb, &(struct cb_draw){
+			.prim = d->prim,
+			.vis = d->vis,
+			.index_size = batch->index_size,
+			.no_restart = d->no_restart,
+			.idx_handle = batch->ring->handle,
+		});
+		batch->end = cb->cur;
+		batch->count = cb->cur - 4;
+		batch->size = cb->cur - 1;
+		batch->reloc = cb->nr_relocs - 1;
+	}
+
+	batch->nr_indices += d->count;
+	*batch->count = batch->nr_indices;
+
+	index_range_merge(&batch->range, &r);
+	if (!index_range_empty(&batch->range)) {
+		batch->range_dw[0] = batch->range.min;
+		batch->range_dw[1] = batch->range.max;
+	}
+
+	batch->draws++;
+
+	/* nothing else can join: */
+	if (!is_list(d->prim))
+		return draw_batch_flush(batch);
+
+	return 0;
+}
+
+/* close the open batch, uploading its indices: */
+int draw_batch_flush(struct draw_batch *batch)
+{
+	uint32_t bytes = batch->nr_indices *
+			draw_index_bytes(batch->index_size);
+	struct fd_bo *bo;
+	uint32_t offset;
+	void *ptr;
+
+	if (!batch->cb)
+		return 0;
+
+	ptr = upload_alloc(batch->ring, bytes, 4, &bo, &offset);
+	if (!ptr) {
+		/* leave the batch's draw with nothing to draw: */
+		*batch->count = 0;
+		batch->cb = NULL;
+		batch->nr_indices = 0;
+		return -ENOSPC;
+	}
+
+	if (batch->index_size == INDEX_SIZE_32_BIT) {
+		memcpy(ptr, batch->indices, bytes);
+	} else {
+		index_narrow(ptr, batch->indices, batch->nr_indices);
+	}
+
+	batch->cb->relocs[batch->reloc].offset = offset;
+	*batch->size = bytes;
+
+	batch->batches++;
+	batch->index_bytes += bytes;
+
+	batch->cb = NULL;
+	batch->nr_indices = 0;
+
+	return 0;
+}
+
+void draw_batch_dump_stats(struct draw_batch *batch)
+{
+	printf("draw batch: %"PRIu64" draws in %"PRIu64" batches (%.1f per batch), "
+			"%"PRIu64" index bytes\n", batch->draws, batch->batches,
+			batch->batches ? (double)batch->draws / batch->batches : 0.0,
+			batch->index_bytes);
+}
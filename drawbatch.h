@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef DRAWBATCH_H_
+#define DRAWBATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cmdbuf.h"
+#include "upload.h"
+#include "draw.h"
+
+/*
+ * Draw batcher, merging runs of small indexed draws (with indices on the
+ * CPU, see struct cb_draw) into a single CP_DRAW_INDX_OFFSET.  Each
+ * draw's indices are rebased by its base vertex and appended to the
+ * open batch, whose indices are copied into an upload ring (see
+ * upload.h) when the batch is closed.
+ *
+ * The batch's draw packet is emitted by its first draw and patched as
+ * later draws join it, so it keeps its place in the cmdstream.  A draw
+ * only joins the open batch if nothing has been emitted to the cmdbuf
+ * since (ie. the register state is the same), it has the same primitive
+ * type and visibility mode, and the primitive is a list (strips and fans
+ * can't be concatenated).  Otherwise the open batch is closed and the
+ * draw starts a new one.
+ *
+ * draw_batch_flush() closes the open batch, which must be done before the
+ * cmdbuf is submitted or reset.  Indices are emitted as 16 bit (narrowed
+ * by index_narrow(), see index.h), unless the rebased indices need 32
+ * bit.  The batch's draw is preceded by its VFD_INDEX_MIN/MAX, patched
+ * to the range of all of its indices.
+ */
+
+#define DRAW_BATCH_MAX_INDICES 0x10000
+
+struct draw_batch {
+	struct upload_ring *ring;
+
+	/* the open batch, if cb is set: */
+	struct cmdbuf *cb;
+	uint32_t *end;           /* just past its draw packet */
+	uint32_t *count, *size;  /* dwords of the packet to patch */
+	uint32_t reloc;          /* index of the index buffer reloc */
+	uint32_t *range_dw;      /* VFD_INDEX_MIN/MAX to patch */
+	struct index_range range;
+	enum pc_di_primtype prim;
+	enum pc_di_vis_cull_mode vis;
+	enum pc_di_index_size index_size;
+	bool no_restart;
+	uint32_t *indices;       /* rebased */
+	uint32_t nr_indices;
+
+	/* stats: */
+	uint64_t draws;
+	uint64_t batches;
+	uint64_t index_bytes;    /* uploaded */
+};
+
+struct draw_batch * draw_batch_new(struct upload_ring *ring);
+void draw_batch_del(struct draw_batch *batch);
+int draw_batch_draw(struct draw_batch *batch, struct cmdbuf *cb,
+		const struct cb_draw *d, uint32_t base_vertex);
+int draw_batch_flush(struct draw_batch *batch);
+void draw_batch_dump_stats(struct draw_batch *batch);
+
+#endif /* DRAWBATCH_H_ */
@@ -0,0 +1,412 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "upload.h"
+#include "drawbatch.h"
+
+/* Draw batcher benchmark: a synthetic frame of runs of tiny indexed
+ * draws, with a state change between runs, is emitted with each draw on
+ * its own (base vertex in VFD_INDEX_OFFSET, indices uploaded per draw),
+ * and through the draw batcher.  Reports cmdstream dwords, draw packets
+ * and CPU time to emit and to build the submit, and checks that both
+ * draw the same vertices in the same order on the emulator, with tight
+ * index ranges (VFD_INDEX_MIN/MAX).
+ */
+
+#define NR_VERTS    24       /* per draw's vertex range */
+#define MAX_TRIS    8
+#define RING_SIZE   (4 * 1024 * 1024)
+
+static uint32_t nr_runs = 400;
+static uint32_t max_run = 48;
+static uint32_t iters = 20;
+
+struct wdraw {
+	uint32_t base;
+	uint32_t count;
+	uint16_t indices[3 * MAX_TRIS];
+};
+static struct wdraw *draws;
+static uint32_t *run_len;
+static uint32_t nr_draws, nr_indices;
+
+struct run {
+	struct emu *emu;
+	struct upload_ring *ring;
+	struct draw_batch *batch;
+	struct cmdbuf *cb;
+	uint64_t emit_ns, submit_ns;
+	uint32_t dwords;
+	uint32_t *verts;         /* vertices drawn, from the cmdstream */
+	uint32_t nr_verts;
+	uint32_t loose;          /* draws whose index range isn't exact */
+};
+
+static uint32_t seed = 0x12345678;
+
+static void make_workload(void)
+{
+	uint32_t r, i, j;
+
+	run_len = calloc(nr_runs, sizeof(run_len[0]));
+	for (r = 0; r < nr_runs; r++) {
+		run_len[r] = 1 + rnd(&seed) % max_run;
+		nr_draws += run_len[r];
+	}
+
+	draws = calloc(nr_draws, sizeof(draws[0]));
+	for (i = 0; i < nr_draws; i++) {
+		struct wdraw *d = &draws[i];
+
+		d->base = (i % 2000) * NR_VERTS;
+		d->count = 3 * (1 + rnd(&seed) % MAX_TRIS);
+		for (j = 0; j < d->count; j++)
+			d->indices[j] = rnd(&seed) % NR_VERTS;
+		nr_indices += d->count;
+	}
+}
+
+static void emit_state(struct cmdbuf *cb, uint32_t r)
+{
+	CB_PKT0(cb, REG_A3XX_RB_BLEND_RED, 4);
+	CB_RING(cb, r);
+	CB_RING(cb, r + 1);
+	CB_RING(cb, r + 2);
+	CB_RING(cb, r + 3);
+}
+
+static int emit_plain(struct run *run)
+{
+	struct cmdbuf *cb = run->cb;
+	uint32_t r, i, n = 0;
+
+	for (r = 0; r < nr_runs; r++) {
+		emit_state(cb, r);
+
+		for (i = 0; i < run_len[r]; i++, n++) {
+			const struct wdraw *d = &draws[n];
+			struct cb_draw draw = {
+				.prim = DI_PT_TRILIST,
+				.vis = IGNORE_VISIBILITY,
+				.index_size = INDEX_SIZE_16_BIT,
+				.count = d->count,
+				.indices = d->indices,
+				.idx_handle = run->ring->handle,
+				.idx_size = d->count * 2,
+			};
+			struct fd_bo *bo;
+			void *ptr;
+
+			ptr = upload_alloc(run->ring, d->count * 2, 4, &bo,
+					&draw.idx_offset);
+			if (!ptr)
+				return -ENOSPC;
+			memcpy(ptr, d->indices, d->count * 2);
+
+			CB_PKT0(cb, REG_A3XX_VFD_INDEX_OFFSET, 1);
+			CB_RING(cb, d->base);
+			CB_DRAW_INDX(cb, &draw);
+		}
+	}
+
+	return 0;
+}
+
+static int emit_batched(struct run *run)
+{
+	struct cmdbuf *cb = run->cb;
+	uint32_t r, i, n = 0;
+	int ret;
+
+	for (r = 0; r < nr_runs; r++) {
+		emit_state(cb, r);
+		CB_PKT0(cb, REG_A3XX_VFD_INDEX_OFFSET, 1);
+		CB_RING(cb, 0);
+
+		for (i = 0; i < run_len[r]; i++, n++) {
+			const struct wdraw *d = &draws[n];
+
+			ret = draw_batch_draw(run->batch, cb, &(struct cb_draw){
+				.prim = DI_PT_TRILIST,
+				.vis = IGNORE_VISIBILITY,
+				.index_size = INDEX_SIZE_16_BIT,
+				.count = d->count,
+				.indices = d->indices,
+			}, d->base);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return draw_batch_flush(run->batch);
+}
+
+/* vertices drawn by the cmdstream, with relocs applied by the submit,
+ * counting the draws whose VFD_INDEX_MIN/MAX isn't their index range:
+ */
+static int collect_verts(struct run *run)
+{
+	const uint32_t *dw = run->cb->start, *end = run->cb->cur;
+	uint32_t base = 0, min_index = 0, max_index = 0;
+
+	run->verts = malloc(nr_indices * sizeof(run->verts[0]));
+	run->nr_verts = 0;
+
+	while (dw < end) {
+		uint32_t cnt = ((dw[0] >> 16) & 0x3fff) + 1;
+		uint32_t count, addr, size, i, lo = ~0, hi = 0;
+		const void *idx;
+		bool idx32;
+
+		if ((dw[0] & 0xc0000000) == CP_TYPE0_PKT) {
+			for (i = 0; i < cnt; i++) {
+				switch ((dw[0] & 0x7fff) + i) {
+				case REG_A3XX_VFD_INDEX_MIN:
+					min_index = dw[1 + i];
+					break;
+				case REG_A3XX_VFD_INDEX_MAX:
+					max_index = dw[1 + i];
+					break;
+				case REG_A3XX_VFD_INDEX_OFFSET:
+					base = dw[1 + i];
+					break;
+				}
+			}
+			dw += 1 + cnt;
+			continue;
+		}
+
+		switch ((dw[0] >> 8) & 0xff) {
+		case CP_DRAW_INDX:
+			idx32 = !!(dw[2] & CP_DRAW_INDX_1_INDEX_SIZE__MASK);
+			count = dw[3];
+			addr = dw[4];
+			size = dw[5];
+			break;
+		case CP_DRAW_INDX_OFFSET:
+			idx32 = !!(dw[1] & CP_DRAW_INDX_OFFSET_0_INDEX_SIZE__MASK);
+			count = dw[3];
+			addr = dw[5];
+			size = dw[6];
+			break;
+		default:
+			dw += 1 + cnt;
+			continue;
+		}
+
+		idx = emu_iova_ptr(run->emu, addr, size);
+		if (!idx || (size != count * (idx32 ? 4 : 2)) ||
+				((run->nr_verts + count) > nr_indices)) {
+			printf("  bad draw: %u indices, %u bytes at %08x\n",
+					count, size, addr);
+			return -1;
+		}
+
+		for (i = 0; i < count; i++) {
+			uint32_t v = idx32 ? ((const uint32_t *)idx)[i] :
+					((const uint16_t *)idx)[i];
+			lo = min(lo, v);
+			hi = max(hi, v);
+			run->verts[run->nr_verts++] = base + v;
+		}
+
+		if ((lo != min_index) || (hi != max_index))
+			run->loose++;
+
+		dw += 1 + cnt;
+	}
+
+	return 0;
+}
+
+static int run_mode(struct run *run, bool batched)
+{
+	struct emu_bo *ring_bo;
+	uint32_t it;
+	int ret = 0;
+
+	memset(run, 0, sizeof(*run));
+
+	run->emu = emu_new();
+	ring_bo = emu_bo_new(run->emu, RING_SIZE);
+	run->ring = upload_ring_new_user(ring_bo->handle, ring_bo->map,
+			RING_SIZE);
+	emu_attach_upload(run->emu, run->ring);
+	run->batch = draw_batch_new(run->ring);
+	run->cb = emu_cmdbuf_new(run->emu, nr_draws * 16 * 4 + nr_runs * 8 * 4);
+
+	for (it = 0; (it < iters) && !ret; it++) {
+		struct msm_submit *submit;
+		uint64_t t;
+
+		cmdbuf_reset(run->cb);
+
+		t = gettime_ns();
+		ret = batched ? emit_batched(run) : emit_plain(run);
+		run->emit_ns += gettime_ns() - t;
+		if (ret)
+			break;
+
+		run->dwords = cmdbuf_dwords(run->cb);
+
+		/* building the submit, relocs and all: */
+		t = gettime_ns();
+		submit = msm_submit_new(-1, MSM_PIPE_3D0);
+		msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, run->cb);
+		run->submit_ns += gettime_ns() - t;
+
+		emu_attach(run->emu, submit);
+		ret = msm_submit_flush(submit);
+		upload_ring_fence(run->ring, submit->fence);
+		msm_submit_del(submit);
+	}
+
+	if (ret)
+		return ret;
+
+	return collect_verts(run);
+}
+
+static void run_fini(struct run *run)
+{
+	draw_batch_del(run->batch);
+	upload_ring_del(run->ring);
+	cmdbuf_del(run->cb);
+	emu_del(run->emu);
+	free(run->verts);
+}
+
+static void print_run(struct run *run, const char *name)
+{
+	printf("%-8s %8u %8"PRIu64" %10.1f %10.1f\n", name, run->dwords,
+			run->emu->submit_stats.draws,
+			(double)run->emit_ns / iters / 1000,
+			(double)run->submit_ns / iters / 1000);
+}
+
+int main(int argc, char *argv[])
+{
+	struct run plain, batched;
+	uint32_t *expected, n = 0, i, j;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "i:l:r:")) != -1) {
+		switch (opt) {
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			max_run = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nr_runs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-i iterations] [-l max-run-length] "
+					"[-r runs]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (!iters || !max_run || !nr_runs) {
+		printf("nothing to do\n");
+		return -1;
+	}
+
+	make_workload();
+
+	expected = malloc(nr_indices * sizeof(expected[0]));
+	for (i = 0; i < nr_draws; i++)
+		for (j = 0; j < draws[i].count; j++)
+			expected[n++] = draws[i].base + draws[i].indices[j];
+
+	printf("%u runs, %u draws, %u indices\n", nr_runs, nr_draws,
+			nr_indices);
+
+	if (run_mode(&plain, false) || run_mode(&batched, true)) {
+		printf("could not run the frame\n");
+		return -1;
+	}
+
+	printf("%-8s %8s %8s %10s %10s\n", "mode", "dwords", "draws",
+			"emit us", "submit us");
+	print_run(&plain, "plain");
+	print_run(&batched, "batched");
+	printf("saved %u dwords (%.1f%%), %.1fus emit, %.1fus submit\n",
+			plain.dwords - batched.dwords,
+			100.0 * (plain.dwords - batched.dwords) / plain.dwords,
+			((double)plain.emit_ns - batched.emit_ns) / iters / 1000,
+			((double)plain.submit_ns - batched.submit_ns) / iters / 1000);
+	draw_batch_dump_stats(batched.batch);
+
+	printf("Test 1: both draw the same vertices in the same order\n");
+	if ((plain.nr_verts != nr_indices) || (batched.nr_verts != nr_indices) ||
+			memcmp(plain.verts, expected, nr_indices * 4) ||
+			memcmp(batched.verts, expected, nr_indices * 4)) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 2: each run is merged into one draw\n");
+	if ((batched.emu->submit_stats.draws != nr_runs) ||
+			(plain.emu->submit_stats.draws != nr_draws)) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 3: each draw's index range is exact\n");
+	if (plain.loose || batched.loose) {
+		printf("FAILED (%u plain, %u batched)\n", plain.loose,
+				batched.loose);
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	run_fini(&plain);
+	run_fini(&batched);
+	free(expected);
+	free(draws);
+	free(run_len);
+
+	return ret;
+}
@@ -0,0 +1,256 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "draw.h"
+
+/* Draw call throughput: N draws per submit, emitted with each of the
+ * draw packets.  Reports the CPU cost per draw of emitting it, and of
+ * building the submit (mostly relocs), the cmdstream size per draw, and
+ * the CP front-end time per draw on the emulator.
+ */
+
+#define NR_INDICES  36       /* a cube */
+#define NR_IDX_BUFS 64
+
+static uint32_t nr_draws = 10000;
+static uint32_t iters = 20;
+
+static struct emu *emu;
+static struct emu_bo *idx_bo, *arg_bo;
+static uint16_t indices[NR_INDICES];
+
+static void emit_auto(struct cmdbuf *cb, uint32_t i)
+{
+	CB_DRAW_INDX(cb, &(struct cb_draw){
+		.prim = DI_PT_TRILIST,
+		.vis = IGNORE_VISIBILITY,
+		.count = NR_INDICES,
+	});
+}
+
+static void emit_indexed(struct cmdbuf *cb, uint32_t i)
+{
+	CB_DRAW_INDX(cb, &(struct cb_draw){
+		.prim = DI_PT_TRILIST,
+		.vis = IGNORE_VISIBILITY,
+		.index_size = INDEX_SIZE_16_BIT,
+		.count = NR_INDICES,
+		.idx_handle = idx_bo->handle,
+		.idx_offset = (i % NR_IDX_BUFS) * sizeof(indices),
+		.idx_size = sizeof(indices),
+	});
+}
+
+static void emit_inline(struct cmdbuf *cb, uint32_t i)
+{
+	CB_DRAW_INDX_2(cb, &(struct cb_draw){
+		.prim = DI_PT_TRILIST,
+		.vis = IGNORE_VISIBILITY,
+		.index_size = INDEX_SIZE_16_BIT,
+		.count = NR_INDICES,
+		.indices = indices,
+	});
+}
+
+static void emit_instanced(struct cmdbuf *cb, uint32_t i)
+{
+	CB_DRAW_INDX_OFFSET(cb, &(struct cb_draw){
+		.prim = DI_PT_TRILIST,
+		.vis = IGNORE_VISIBILITY,
+		.index_size = INDEX_SIZE_16_BIT,
+		.count = NR_INDICES,
+		.instances = 4,
+		.idx_handle = idx_bo->handle,
+		.idx_offset = (i % NR_IDX_BUFS) * sizeof(indices),
+		.idx_size = sizeof(indices),
+	});
+}
+
+static void emit_indirect(struct cmdbuf *cb, uint32_t i)
+{
+	CB_DRAW_INDIRECT(cb, &(struct cb_draw){
+		.prim = DI_PT_TRILIST,
+		.vis = IGNORE_VISIBILITY,
+		.arg_handle = arg_bo->handle,
+		.arg_offset = i * sizeof(struct draw_indx_indirect),
+	});
+}
+
+static void emit_indx_indirect(struct cmdbuf *cb, uint32_t i)
+{
+	CB_DRAW_INDX_INDIRECT(cb, &(struct cb_draw){
+		.prim = DI_PT_TRILIST,
+		.vis = IGNORE_VISIBILITY,
+		.index_size = INDEX_SIZE_16_BIT,
+		.idx_handle = idx_bo->handle,
+		.idx_size = NR_IDX_BUFS * sizeof(indices),
+		.arg_handle = arg_bo->handle,
+		.arg_offset = i * sizeof(struct draw_indx_indirect),
+	});
+}
+
+static const struct {
+	const char *name;
+	const char *pkt;
+	void (*emit)(struct cmdbuf *cb, uint32_t i);
+} modes[] = {
+	{ "auto",         "CP_DRAW_INDX",          emit_auto },
+	{ "indexed",      "CP_DRAW_INDX",          emit_indexed },
+	{ "inline",       "CP_DRAW_INDX_2",        emit_inline },
+	{ "instanced",    "CP_DRAW_INDX_OFFSET",   emit_instanced },
+	{ "indirect",     "CP_DRAW_INDIRECT",      emit_indirect },
+	{ "indx-indirect", "CP_DRAW_INDX_INDIRECT", emit_indx_indirect },
+};
+
+int main(int argc, char *argv[])
+{
+	struct draw_indx_indirect *args;
+	struct cmdbuf *cb;
+	uint32_t i, m;
+	int opt, ret = 0;
+	bool ok = true;
+
+	while ((opt = getopt(argc, argv, "d:i:")) != -1) {
+		switch (opt) {
+		case 'd':
+			nr_draws = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-d draws] [-i iterations]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (!nr_draws || !iters) {
+		printf("nothing to do\n");
+		return -1;
+	}
+
+	emu = emu_new();
+
+	for (i = 0; i < NR_INDICES; i++)
+		indices[i] = (i * 7) % 24;
+
+	idx_bo = emu_bo_new(emu, NR_IDX_BUFS * sizeof(indices));
+	for (i = 0; i < NR_IDX_BUFS; i++)
+		memcpy((uint8_t *)idx_bo->map + i * sizeof(indices), indices,
+				sizeof(indices));
+
+	/* big enough for either layout: */
+	arg_bo = emu_bo_new(emu, nr_draws * sizeof(*args));
+	args = arg_bo->map;
+	for (i = 0; i < nr_draws; i++) {
+		args[i] = (struct draw_indx_indirect){
+			.count = NR_INDICES,
+			.instances = 1,
+			.first_index = (i % NR_IDX_BUFS) * NR_INDICES,
+		};
+	}
+
+	cb = emu_cmdbuf_new(emu, nr_draws * 28 * 4 + 64);
+
+	printf("%u draws per submit, %u iterations\n", nr_draws, iters);
+	printf("%-14s %-22s %8s %10s %12s %8s\n", "mode", "packet", "emit ns",
+			"submit ns", "dwords/draw", "CP ns");
+
+	for (m = 0; m < ARRAY_SIZE(modes); m++) {
+		uint64_t emit_ns = 0, submit_ns = 0, draws = 0, cycles = 0;
+		struct msm_submit *submit;
+		uint32_t dwords = 0, it;
+
+		for (it = 0; it < iters; it++) {
+			uint64_t t;
+
+			cmdbuf_reset(cb);
+
+			t = gettime_ns();
+			for (i = 0; i < nr_draws; i++)
+				modes[m].emit(cb, i);
+			emit_ns += gettime_ns() - t;
+
+			dwords = cmdbuf_dwords(cb);
+
+			/* building the submit, relocs and all: */
+			t = gettime_ns();
+			submit = msm_submit_new(-1, MSM_PIPE_3D0);
+			msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+			submit_ns += gettime_ns() - t;
+
+			/* and run the last one: */
+			if (it == (iters - 1)) {
+				draws = emu->stats.draws;
+				cycles = emu->stats.cycles;
+				emu_attach(emu, submit);
+				if (msm_submit_flush(submit))
+					ok = false;
+				draws = emu->stats.draws - draws;
+				cycles = emu->stats.cycles - cycles;
+			}
+
+			msm_submit_del(submit);
+		}
+
+		printf("%-14s %-22s %8.1f %10.1f %12.1f %8.1f\n", modes[m].name,
+				modes[m].pkt, (double)emit_ns / iters / nr_draws,
+				(double)submit_ns / iters / nr_draws,
+				(double)dwords / nr_draws,
+				emu_cycles_to_us(emu, cycles) * 1000 / nr_draws);
+
+		if (draws != nr_draws) {
+			printf("  %s: %"PRIu64" draws, expected %u\n",
+					modes[m].name, draws, nr_draws);
+			ok = false;
+		}
+	}
+
+	printf("Test 1: every draw reaches the CP\n");
+	if (!ok) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	cmdbuf_del(cb);
+	emu_del(emu);
+
+	return ret;
+}
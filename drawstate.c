@@ -0,0 +1,174 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "drawstate.h"
+
+struct draw_state * draw_state_new(struct state_cache *cache)
+{
+	struct draw_state *ds = calloc(1, sizeof(*ds));
+	void *stage;
+
+	if (!ds)
+		return NULL;
+
+	stage = malloc(DRAW_STATE_MAX_DWORDS * 4);
+	ds->stage = stage ? cmdbuf_new_user(0, stage,
+			DRAW_STATE_MAX_DWORDS * 4) : NULL;
+	if (!ds->stage) {
+		free(stage);
+		free(ds);
+		return NULL;
+	}
+
+	ds->cache = cache;
+	ds->reset = true;
+
+	return ds;
+}
+
+void draw_state_del(struct draw_state *ds)
+{
+	free(ds->stage->start);
+	cmdbuf_del(ds->stage);
+	free(ds);
+}
+
+/* start building a group IB: */
+struct cmdbuf * draw_state_begin(struct draw_state *ds)
+{
+	cmdbuf_reset(ds->stage);
+	ds->overflow = false;
+	return ds->stage;
+}
+
+/* check there is room for ndwords more in the group IB, before emitting
+ * them.  Once this fails the group is too large, and draw_state_end()
+ * rejects it:
+ */
+bool draw_state_reserve(struct draw_state *ds, uint32_t ndwords)
+{
+	struct cmdbuf *stage = ds->stage;
+
+	if (ds->overflow || (ndwords > (uint32_t)(stage->end - stage->cur)))
+		ds->overflow = true;
+
+	return !ds->overflow;
+}
+
+/* finish the group IB, finding or adding it in the state cache: */
+int draw_state_end(struct draw_state *ds, struct draw_group *group)
+{
+	struct cmdbuf *stage = ds->stage;
+	const struct state_entry *entry;
+
+	if (stage->nr_relocs) {
+		ERROR_MSG("relocs in draw state group");
+		return -EINVAL;
+	}
+
+	if (ds->overflow) {
+		ERROR_MSG("draw state group too large");
+		return -EINVAL;
+	}
+
+	entry = state_cache_get(ds->cache, stage->start, cmdbuf_dwords(stage));
+	if (!entry)
+		return -ENOSPC;
+
+	group->offset = entry->offset;
+	group->dwords = entry->dwords;
+
+	return 0;
+}
+
+/* forget what was emitted, so the next emit sets every bound group: */
+void draw_state_reset(struct draw_state *ds)
+{
+	uint32_t id;
+
+	ds->reset = true;
+	ds->dirty = 0;
+
+	for (id = 0; id < DRAW_STATE_GROUPS; id++) {
+		ds->emitted[id] = (struct draw_group){0};
+		if (ds->bound[id].dwords)
+			ds->dirty |= 1u << id;
+	}
+}
+
+/* emit the groups which changed, ahead of a draw: */
+void draw_state_emit(struct draw_state *ds, struct cmdbuf *cb)
+{
+	uint32_t n = __builtin_popcount(ds->dirty) + ds->reset;
+	uint32_t dirty = ds->dirty;
+
+	ds->emits++;
+
+	if (!n)
+		return;
+
+	CB_PKT3(cb, CP_SET_DRAW_STATE, 2 * n);
+
+	if (ds->reset) {
+		CB_RING(cb, CP_SET_DRAW_STATE_0_DISABLE_ALL_GROUPS);
+		CB_RING(cb, 0x00000000);
+	}
+
+	while (dirty) {
+		uint32_t id = ffs(dirty) - 1;
+		const struct draw_group *g = &ds->bound[id];
+
+		dirty &= ~(1u << id);
+
+		if (!g->dwords) {
+			CB_RING(cb, CP_SET_DRAW_STATE_0_DISABLE |
+					CP_SET_DRAW_STATE_0_GROUP_ID(id));
+			CB_RING(cb, 0x00000000);
+		} else {
+			CB_RING(cb, CP_SET_DRAW_STATE_0_COUNT(g->dwords) |
+					CP_SET_DRAW_STATE_0_GROUP_ID(id));
+			cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+				.handle = ds->cache->handle,
+				.flags = MSM_SUBMIT_BO_READ,
+				.offset = g->offset,
+			});
+		}
+
+		ds->emitted[id] = *g;
+	}
+
+	ds->entries += n;
+	ds->dirty = 0;
+	ds->reset = false;
+}
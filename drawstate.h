@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef DRAWSTATE_H_
+#define DRAWSTATE_H_
+
+#include <stdint.h>
+
+#include "cmdbuf.h"
+#include "state.h"
+
+/*
+ * Draw state groups (CP_SET_DRAW_STATE).  Related state (the program's
+ * registers, blend state, vertex fetch, ...) is packed into a small
+ * immutable IB per group, which the CP runs ahead of the next draw after
+ * it is set.  Group IBs are kept in a state cache (see state.h), so the
+ * same state is only stored once however often it is built.
+ *
+ * Each draw binds a group (or none) to each group id it uses, and then
+ * draw_state_emit() emits a single CP_SET_DRAW_STATE with an entry for
+ * just the ids whose group changed since the last emit, so the cost of a
+ * draw is in the number of groups which changed rather than the amount
+ * of state.  After draw_state_reset() (a new cmdstream, or an IB which
+ * may be called from anywhere) all bound groups are emitted again.
+ *
+ * Group IBs are built with the usual CB_x() helpers on the cmdbuf that
+ * draw_state_begin() returns, after checking with draw_state_reserve()
+ * that what is about to be emitted fits (DRAW_STATE_MAX_DWORDS).  They
+ * must not contain relocs (nothing would add them to the submit), call
+ * IBs, or wait.
+ */
+
+#define DRAW_STATE_GROUPS     32
+#define DRAW_STATE_MAX_DWORDS 1024
+
+/* a group IB in the state cache, dwords is zero for no group: */
+struct draw_group {
+	uint32_t offset;
+	uint32_t dwords;
+};
+
+struct draw_state {
+	struct state_cache *cache;
+	struct cmdbuf *stage;    /* for building group IBs */
+
+	struct draw_group bound[DRAW_STATE_GROUPS];
+	struct draw_group emitted[DRAW_STATE_GROUPS];
+	uint32_t dirty;          /* mask of ids where bound != emitted */
+	bool reset;              /* what the CP has is unknown */
+	bool overflow;           /* the group being built is too large */
+
+	/* stats: */
+	uint64_t emits;          /* draw_state_emit() calls */
+	uint64_t entries;        /* CP_SET_DRAW_STATE entries emitted */
+};
+
+struct draw_state * draw_state_new(struct state_cache *cache);
+void draw_state_del(struct draw_state *ds);
+struct cmdbuf * draw_state_begin(struct draw_state *ds);
+bool draw_state_reserve(struct draw_state *ds, uint32_t ndwords);
+int draw_state_end(struct draw_state *ds, struct draw_group *group);
+void draw_state_reset(struct draw_state *ds);
+void draw_state_emit(struct draw_state *ds, struct cmdbuf *cb);
+
+static inline bool
+draw_group_equal(const struct draw_group *a, const struct draw_group *b)
+{
+	return (a->offset == b->offset) && (a->dwords == b->dwords);
+}
+
+/* bind a group for the following draws, NULL for none: */
+static inline void
+draw_state_bind(struct draw_state *ds, uint32_t id,
+		const struct draw_group *group)
+{
+	static const struct draw_group none;
+
+	if (!group)
+		group = &none;
+
+	ds->bound[id] = *group;
+	if (draw_group_equal(&ds->bound[id], &ds->emitted[id]))
+		ds->dirty &= ~(1u << id);
+	else
+		ds->dirty |= 1u << id;
+}
+
+#endif /* DRAWSTATE_H_ */
@@ -0,0 +1,485 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "state.h"
+#include "drawstate.h"
+
+/* Draw state group benchmark: a run of draws, each with program, raster,
+ * blend, vertex fetch and constant state which changes at different
+ * rates, is emitted three ways: all the state inline for every draw,
+ * only the state which changed inline, and as CP_SET_DRAW_STATE groups.
+ * Reports CPU ns/draw and cmdstream dwords/draw for each, and the CP
+ * front-end time on the emulator, and checks the register state each draw sees.
+ */
+
+enum {
+	GROUP_PROG,
+	GROUP_RAST,
+	GROUP_BLEND,
+	GROUP_VTX,
+	GROUP_CONST,
+	NR_GROUPS,
+};
+
+static const struct group_desc {
+	const char *name;
+	uint32_t variants;
+	uint32_t period;         /* draws between changes */
+	struct {
+		uint32_t reg, n;
+	} ranges[3];
+	uint32_t consts;         /* dwords loaded with CP_LOAD_STATE */
+} descs[NR_GROUPS] = {
+	[GROUP_PROG] = { "prog", 12, 16, {
+			{ REG_A3XX_SP_VS_CTRL_REG0, 28 },
+			{ REG_A3XX_SP_FS_CTRL_REG0, 16 },
+			{ REG_A3XX_HLSQ_CONTROL_0_REG, 10 } } },
+	[GROUP_RAST] = { "rast", 4, 128, {
+			{ REG_A3XX_GRAS_CL_CLIP_CNTL, 8 },
+			{ REG_A3XX_GRAS_SU_POINT_MINMAX, 4 } } },
+	[GROUP_BLEND] = { "blend", 6, 48, {
+			{ REG_A3XX_RB_ALPHA_REF, 17 },
+			{ REG_A3XX_RB_BLEND_RED, 4 } } },
+	[GROUP_VTX] = { "vtx", 24, 8, {
+			{ REG_A3XX_VFD_CONTROL_0, 22 } } },
+	[GROUP_CONST] = { "const", 64, 1, { }, 32 },
+};
+
+struct variant {
+	uint32_t *dw;            /* the state's packets */
+	uint32_t dwords;
+	uint32_t *vals;          /* register values, in range order */
+	uint32_t nr_vals;
+	struct draw_group group;
+};
+static struct variant *variants[NR_GROUPS];
+
+enum mode {
+	MODE_INLINE,
+	MODE_CHANGED,
+	MODE_GROUPS,
+	NR_MODES,
+};
+
+static const char *mode_names[NR_MODES] = {
+	[MODE_INLINE]  = "inline",
+	[MODE_CHANGED] = "changed",
+	[MODE_GROUPS]  = "groups",
+};
+
+static uint32_t nr_draws = 10000;
+static uint32_t iters = 20;
+
+/* per draw: registers checked, and the most dwords emitted: */
+static uint32_t nr_check_regs, max_draw_dwords;
+
+struct run {
+	struct emu *emu;
+	struct emu_bo *state_bo, *check_bo;
+	struct state_cache *cache;
+	struct draw_state *ds;
+	struct cmdbuf *cb;
+};
+
+static uint32_t seed = 0x12345678;
+
+static void make_variants(void)
+{
+	uint32_t t, v, r, j;
+
+	for (t = 0; t < NR_GROUPS; t++) {
+		const struct group_desc *d = &descs[t];
+		uint32_t dwords = d->consts ? 3 + d->consts : 0, nr_vals = 0;
+
+		for (r = 0; r < ARRAY_SIZE(d->ranges) && d->ranges[r].n; r++) {
+			dwords += 1 + d->ranges[r].n;
+			nr_vals += d->ranges[r].n;
+		}
+
+		variants[t] = calloc(d->variants, sizeof(variants[t][0]));
+		nr_check_regs += nr_vals;
+		max_draw_dwords += dwords;
+
+		for (v = 0; v < d->variants; v++) {
+			struct variant *var = &variants[t][v];
+			struct cmdbuf *cb;
+
+			var->dw = malloc(dwords * 4);
+			var->vals = malloc(max(nr_vals, 1) * 4);
+			cb = cmdbuf_new_user(0, var->dw, dwords * 4);
+
+			for (r = 0; r < ARRAY_SIZE(d->ranges) && d->ranges[r].n; r++) {
+				CB_PKT0(cb, d->ranges[r].reg, d->ranges[r].n);
+				for (j = 0; j < d->ranges[r].n; j++) {
+					uint32_t val = rnd(&seed) ^ (t << 28) ^ (v << 20);
+					var->vals[var->nr_vals++] = val;
+					CB_RING(cb, val);
+				}
+			}
+
+			if (d->consts) {
+				CB_PKT3(cb, CP_LOAD_STATE, 2 + d->consts);
+				CB_RING(cb, CP_LOAD_STATE_0_STATE_SRC(SS_DIRECT) |
+						CP_LOAD_STATE_0_STATE_BLOCK(SB_VERT_SHADER) |
+						CP_LOAD_STATE_0_NUM_UNIT(d->consts / 2));
+				CB_RING(cb, CP_LOAD_STATE_1_STATE_TYPE(ST_CONSTANTS));
+				for (j = 0; j < d->consts; j++)
+					CB_RING(cb, rnd(&seed));
+			}
+
+			var->dwords = cmdbuf_dwords(cb);
+			cmdbuf_del(cb);
+		}
+	}
+
+	/* the draw, and REG_TO_MEM of each range when checking: */
+	max_draw_dwords += 4;
+	for (t = 0; t < NR_GROUPS; t++)
+		for (r = 0; r < ARRAY_SIZE(descs[t].ranges); r++)
+			max_draw_dwords += descs[t].ranges[r].n ? 3 : 0;
+}
+
+static uint32_t variant_idx(uint32_t t, uint32_t draw)
+{
+	return (draw / descs[t].period) % descs[t].variants;
+}
+
+/* build the state objects' group IBs, or with check set, build them
+ * again and check they come back as the same groups:
+ */
+static int build_groups(struct run *run, bool check)
+{
+	uint32_t t, v, j;
+
+	for (t = 0; t < NR_GROUPS; t++) {
+		for (v = 0; v < descs[t].variants; v++) {
+			struct variant *var = &variants[t][v];
+			struct cmdbuf *stage = draw_state_begin(run->ds);
+			struct draw_group group;
+			int ret;
+
+			if (!draw_state_reserve(run->ds, var->dwords))
+				return -ENOSPC;
+			for (j = 0; j < var->dwords; j++)
+				CB_RING(stage, var->dw[j]);
+
+			ret = draw_state_end(run->ds, &group);
+			if (ret)
+				return ret;
+
+			if (!check)
+				var->group = group;
+			else if (!draw_group_equal(&group, &var->group))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* a group which doesn't fit is rejected before anything is written: */
+static bool check_oversized(struct run *run)
+{
+	struct cmdbuf *stage = draw_state_begin(run->ds);
+	struct draw_group group;
+
+	if (!draw_state_reserve(run->ds, DRAW_STATE_MAX_DWORDS - 1))
+		return false;
+	CB_PKT3(stage, CP_NOP, DRAW_STATE_MAX_DWORDS - 2);
+	stage->cur += DRAW_STATE_MAX_DWORDS - 2;
+
+	if (draw_state_reserve(run->ds, 2) || (stage->cur >= stage->end))
+		return false;
+
+	return draw_state_end(run->ds, &group) != 0;
+}
+
+static int run_init(struct run *run)
+{
+	memset(run, 0, sizeof(*run));
+
+	run->emu = emu_new();
+	run->state_bo = emu_bo_new(run->emu, 256 * 1024);
+	run->check_bo = emu_bo_new(run->emu, nr_draws * nr_check_regs * 4);
+	run->cache = state_cache_new_user(run->state_bo->handle,
+			run->state_bo->map, run->state_bo->size);
+	run->ds = draw_state_new(run->cache);
+	run->cb = emu_cmdbuf_new(run->emu, nr_draws * max_draw_dwords * 4 + 64);
+
+	/* the state objects are built up front: */
+	return build_groups(run, false);
+}
+
+static void run_fini(struct run *run)
+{
+	draw_state_del(run->ds);
+	state_cache_del(run->cache);
+	cmdbuf_del(run->cb);
+	emu_del(run->emu);
+}
+
+static void emit_draws(struct run *run, enum mode mode, bool check)
+{
+	struct cmdbuf *cb = run->cb;
+	uint32_t last[NR_GROUPS];
+	uint32_t i, t, r, j;
+
+	memset(last, 0xff, sizeof(last));
+	draw_state_reset(run->ds);
+
+	for (i = 0; i < nr_draws; i++) {
+		uint32_t off = i * nr_check_regs * 4;
+
+		for (t = 0; t < NR_GROUPS; t++) {
+			uint32_t v = variant_idx(t, i);
+			const struct variant *var = &variants[t][v];
+
+			if (mode == MODE_GROUPS) {
+				draw_state_bind(run->ds, t, &var->group);
+				continue;
+			}
+
+			if ((mode == MODE_CHANGED) && (v == last[t]))
+				continue;
+
+			for (j = 0; j < var->dwords; j++)
+				CB_RING(cb, var->dw[j]);
+			last[t] = v;
+		}
+
+		if (mode == MODE_GROUPS)
+			draw_state_emit(run->ds, cb);
+
+		CB_PKT3(cb, CP_DRAW_INDX, 3);
+		CB_RING(cb, 0x00000000);
+		CB_RING(cb, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+				INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+		CB_RING(cb, 3);
+
+		if (!check)
+			continue;
+
+		for (t = 0; t < NR_GROUPS; t++) {
+			for (r = 0; r < ARRAY_SIZE(descs[t].ranges); r++) {
+				uint32_t n = descs[t].ranges[r].n;
+
+				if (!n)
+					continue;
+
+				CB_PKT3(cb, CP_REG_TO_MEM, 2);
+				CB_RING(cb, descs[t].ranges[r].reg | ((n - 1) << 19));
+				cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+					.handle = run->check_bo->handle,
+					.flags = MSM_SUBMIT_BO_WRITE,
+					.offset = off,
+				});
+				off += n * 4;
+			}
+		}
+	}
+}
+
+static int submit(struct run *run)
+{
+	struct msm_submit *submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	int ret;
+
+	emu_attach(run->emu, submit);
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, run->cb);
+	ret = msm_submit_flush(submit);
+	msm_submit_del(submit);
+
+	return ret;
+}
+
+/* the register state each draw saw: */
+static int check_regs(struct run *run)
+{
+	const uint32_t *got = run->check_bo->map;
+	uint32_t i, t, j, errors = 0;
+
+	for (i = 0; i < nr_draws; i++) {
+		for (t = 0; t < NR_GROUPS; t++) {
+			const struct variant *var = &variants[t][variant_idx(t, i)];
+
+			for (j = 0; j < var->nr_vals; j++, got++) {
+				if (*got == var->vals[j])
+					continue;
+				if (errors++ < 10)
+					printf("  draw %u, %s: %08x, expected %08x\n",
+							i, descs[t].name, *got,
+							var->vals[j]);
+			}
+		}
+	}
+
+	return errors ? -1 : 0;
+}
+
+/* CP_SET_DRAW_STATE entries: one per group change, plus the reset: */
+static uint64_t expected_entries(void)
+{
+	uint64_t n = 1;
+	uint32_t i, t;
+
+	for (i = 0; i < nr_draws; i++)
+		for (t = 0; t < NR_GROUPS; t++)
+			if (!i || (variant_idx(t, i) != variant_idx(t, i - 1)))
+				n++;
+
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t stored = 0, t;
+	int opt, ret = 0, m;
+	bool regs_ok = true, entries_ok = true, stored_ok = true;
+	bool oversized_ok = false;
+
+	while ((opt = getopt(argc, argv, "d:i:")) != -1) {
+		switch (opt) {
+		case 'd':
+			nr_draws = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-d draws] [-i iterations]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (!nr_draws || !iters) {
+		printf("nothing to do\n");
+		return -1;
+	}
+
+	make_variants();
+
+	for (t = 0; t < NR_GROUPS; t++)
+		stored += descs[t].variants;
+
+	printf("%u draws, %u iterations\n", nr_draws, iters);
+	printf("%-8s %8s %12s %10s\n", "mode", "ns/draw", "dwords/draw",
+			"CP us");
+
+	for (m = 0; m < NR_MODES; m++) {
+		struct run run;
+		uint64_t ns = 0, entries;
+		uint32_t dwords, i;
+
+		if (run_init(&run)) {
+			printf("could not build the state groups\n");
+			return -1;
+		}
+
+		for (i = 0; i < iters; i++) {
+			uint64_t t0;
+
+			cmdbuf_reset(run.cb);
+			t0 = gettime_ns();
+			emit_draws(&run, m, false);
+			ns += gettime_ns() - t0;
+		}
+
+		dwords = cmdbuf_dwords(run.cb);
+		if (submit(&run)) {
+			printf("%s: submit failed\n", mode_names[m]);
+			return -1;
+		}
+
+		printf("%-8s %8.1f %12.1f %10.1f\n", mode_names[m],
+				(double)ns / iters / nr_draws,
+				(double)dwords / nr_draws,
+				emu_cycles_to_us(run.emu, run.emu->stats.cycles));
+
+		/* and again, recording what each draw saw: */
+		entries = run.ds->entries;
+		cmdbuf_reset(run.cb);
+		emit_draws(&run, m, true);
+		if (submit(&run) || check_regs(&run))
+			regs_ok = false;
+
+		if (m == MODE_GROUPS) {
+			if (run.ds->entries - entries != expected_entries())
+				entries_ok = false;
+			if (build_groups(&run, true) ||
+					(run.cache->nr_entries != stored))
+				stored_ok = false;
+			oversized_ok = check_oversized(&run);
+		}
+
+		run_fini(&run);
+	}
+
+	printf("Test 1: every draw sees the right register state\n");
+	if (!regs_ok) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 2: only changed groups are emitted\n");
+	if (!entries_ok) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 3: each distinct group IB is stored once\n");
+	if (!stored_ok) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 4: a group too large for the stage is rejected\n");
+	if (!oversized_ok) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	return ret;
+}
@@ -0,0 +1,1923 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "emu.h"
+#include "trace.h"
+
+const struct emu_costs emu_default_costs = {
+		.clock_mhz = 400,
+		.pkt       = 4,
+		.dword     = 1,
+		.reg_write = 1,
+		.mem_write = 4,
+		.wfi       = 50,
+		.ib        = 60,
+		.ib_pfd    = 8,
+		.event     = 10,
+		.draw      = 500,
+};
+
+static struct emu * emu_new_space(struct emu_space *space)
+{
+	struct emu *emu = calloc(1, sizeof(*emu));
+
+	if (!emu)
+		return NULL;
+
+	if (!space) {
+		space = calloc(1, sizeof(*space));
+		space->next_iova = 0x100000;
+		space->next_handle = 1;
+		pthread_rwlock_init(&space->lock, NULL);
+	}
+	space->refcnt++;
+
+	emu->space = space;
+	emu->regs = calloc(EMU_NUM_REGS, sizeof(emu->regs[0]));
+	emu->costs = emu_default_costs;
+	emu->decode = 1;
+
+	return emu;
+}
+
+struct emu * emu_new(void)
+{
+	return emu_new_space(NULL);
+}
+
+/* a new CP, sharing the address space (bo's) of an existing one.  This
+ * must be done before the CPs start running:
+ */
+struct emu * emu_new_shared(struct emu *other)
+{
+	other->space->shared = 1;
+	return emu_new_space(other->space);
+}
+
+static void emu_space_put(struct emu_space *space)
+{
+	uint32_t i;
+
+	if (--space->refcnt)
+		return;
+
+	for (i = 0; i < space->nr_bos; i++) {
+		free(space->bos[i]->map);
+		free(space->bos[i]);
+	}
+	free(space->bos);
+	pthread_rwlock_destroy(&space->lock);
+	free(space);
+}
+
+void emu_del(struct emu *emu)
+{
+	emu_flush_progs(emu);
+	emu_space_put(emu->space);
+	free(emu->pending);
+	free(emu->jobs);
+	free(emu->regs);
+	free(emu);
+}
+
+struct emu_bo * emu_bo_new(struct emu *emu, uint32_t size)
+{
+	struct emu_space *space = emu->space;
+	struct emu_bo *bo = calloc(1, sizeof(*bo));
+
+	if (!bo)
+		return NULL;
+
+	size = ALIGN(size, 0x1000);
+
+	bo->size = size;
+	bo->map  = calloc(1, size);
+
+	if (space->shared)
+		pthread_rwlock_wrlock(&space->lock);
+
+	bo->handle = space->next_handle++;
+	bo->iova   = space->next_iova;
+
+	/* leave a guard page between bo's, to catch overruns: */
+	space->next_iova += size + 0x1000;
+
+	/* bo's are allocated in order of increasing iova, so the table
+	 * stays sorted by iova (and by handle):
+	 */
+	GROW(space->bos, space->nr_bos, space->max_bos);
+	space->bos[space->nr_bos++] = bo;
+
+	if (space->shared)
+		pthread_rwlock_unlock(&space->lock);
+
+	return bo;
+}
+
+static void space_rdlock(struct emu_space *space)
+{
+	if (space->shared)
+		pthread_rwlock_rdlock(&space->lock);
+}
+
+static void space_unlock(struct emu_space *space)
+{
+	if (space->shared)
+		pthread_rwlock_unlock(&space->lock);
+}
+
+struct emu_bo * emu_bo_lookup(struct emu *emu, uint32_t handle)
+{
+	struct emu_space *space = emu->space;
+	struct emu_bo *ret = NULL;
+	uint32_t lo = 0, hi;
+
+	space_rdlock(space);
+
+	hi = space->nr_bos;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		struct emu_bo *bo = space->bos[mid];
+		if (bo->handle == handle) {
+			ret = bo;
+			break;
+		}
+		if (bo->handle < handle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	space_unlock(space);
+
+	return ret;
+}
+
+/* find the bo containing a GPU address range, or NULL if it is not
+ * entirely within one bo:
+ */
+struct emu_bo * emu_iova_bo(struct emu *emu, uint32_t iova, uint32_t size)
+{
+	struct emu_space *space = emu->space;
+	struct emu_bo *ret = NULL;
+	uint32_t lo = 0, hi;
+
+	space_rdlock(space);
+
+	hi = space->nr_bos;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		struct emu_bo *bo = space->bos[mid];
+		if (iova < bo->iova) {
+			hi = mid;
+		} else if (iova >= (bo->iova + bo->size)) {
+			lo = mid + 1;
+		} else {
+			if (((uint64_t)(iova - bo->iova) + size) <= bo->size)
+				ret = bo;
+			break;
+		}
+	}
+
+	space_unlock(space);
+
+	return ret;
+}
+
+/* translate a GPU address range to a CPU pointer: */
+void * emu_iova_ptr(struct emu *emu, uint32_t iova, uint32_t size)
+{
+	struct emu_bo *bo = emu_iova_bo(emu, iova, size);
+
+	if (!bo)
+		return NULL;
+
+	return (uint8_t *)bo->map + (iova - bo->iova);
+}
+
+struct cmdbuf * emu_cmdbuf_new(struct emu *emu, uint32_t size)
+{
+	struct emu_bo *bo = emu_bo_new(emu, size);
+	if (!bo)
+		return NULL;
+	return cmdbuf_new_user(bo->handle, bo->map, size);
+}
+
+static void charge(struct emu *emu, uint64_t *bucket, uint64_t cycles)
+{
+	emu->now += cycles;
+	emu->submit_stats.cycles += cycles;
+	*bucket += cycles;
+}
+
+static void reg_write(struct emu *emu, uint32_t reg, uint32_t val)
+{
+	emu->regs[reg % EMU_NUM_REGS] = val;
+	emu->submit_stats.reg_writes++;
+	charge(emu, &emu->submit_stats.reg_cycles, emu->costs.reg_write);
+}
+
+/* the bo holding dwords from iova, without dwords * 4 overflowing: */
+static struct emu_bo * iova_bo_dwords(struct emu *emu, uint32_t iova,
+		uint32_t dwords)
+{
+	struct emu_bo *bo = emu_iova_bo(emu, iova, 0);
+
+	if (!bo || (dwords > (bo->size - (iova - bo->iova)) / 4))
+		return NULL;
+
+	return bo;
+}
+
+static int mem_write(struct emu *emu, uint32_t iova,
+		const uint32_t *data, uint32_t dwords)
+{
+	struct emu_bo *bo = iova_bo_dwords(emu, iova, dwords);
+
+	if (!bo) {
+		ERROR_MSG("invalid write: %08x (%u dwords)", iova, dwords);
+		return -EFAULT;
+	}
+
+	memcpy((uint8_t *)bo->map + (iova - bo->iova), data, dwords * 4);
+	emu_bo_dirty(bo);
+
+	emu->submit_stats.mem_writes += dwords;
+	charge(emu, &emu->submit_stats.mem_cycles,
+			(uint64_t)dwords * emu->costs.mem_write);
+
+	return 0;
+}
+
+static struct emu_prog * get_prog(struct emu *emu, struct emu_bo *bo,
+		uint32_t iova, uint32_t dwords);
+static int run_pkts(struct emu *emu, struct emu_ib *ib);
+
+static int push_ib(struct emu *emu, uint32_t iova, uint32_t dwords)
+{
+	struct emu_bo *bo = iova_bo_dwords(emu, iova, dwords);
+	struct emu_prog *prog = NULL;
+	const uint32_t *ptr;
+
+	if (!bo) {
+		ERROR_MSG("invalid IB: %08x (%u dwords)", iova, dwords);
+		return -EFAULT;
+	}
+
+	if (emu->depth == EMU_MAX_IB_DEPTH) {
+		ERROR_MSG("IB nested too deep");
+		return -EINVAL;
+	}
+
+	if (emu->in_group) {
+		ERROR_MSG("IB called from a draw state group");
+		return -EINVAL;
+	}
+
+	ptr = (const uint32_t *)((uint8_t *)bo->map + (iova - bo->iova));
+
+	if (emu->decode) {
+		prog = get_prog(emu, bo, iova, dwords);
+		if (!prog)
+			return -ENOMEM;
+		if (prog->interpret)
+			prog = NULL;
+	}
+
+	emu->stack[emu->depth].ptr = ptr;
+	emu->stack[emu->depth].end = ptr + dwords;
+	emu->stack[emu->depth].prog = prog;
+	emu->stack[emu->depth].pc = 0;
+	emu->depth++;
+
+	return 0;
+}
+
+static void wait_for_idle(struct emu *emu)
+{
+	struct emu_stats *s = &emu->submit_stats;
+
+	if (emu->backend_idle > emu->now)
+		charge(emu, &s->wfi_cycles, emu->backend_idle - emu->now);
+	charge(emu, &s->wfi_cycles, emu->costs.wfi);
+	s->wfis++;
+}
+
+/* visibility mode of a draw packet: */
+static uint32_t draw_vis(uint32_t opc, const uint32_t *dw, uint32_t cnt)
+{
+	switch (opc) {
+	case CP_DRAW_INDX:
+	case CP_DRAW_INDX_BIN:
+		if (cnt < 2)
+			return IGNORE_VISIBILITY;
+		return (dw[1] & CP_DRAW_INDX_1_VIS_CULL__MASK) >>
+				CP_DRAW_INDX_1_VIS_CULL__SHIFT;
+	case CP_DRAW_INDX_2:
+	case CP_DRAW_INDX_2_BIN:
+		if (cnt < 2)
+			return IGNORE_VISIBILITY;
+		return (dw[1] & CP_DRAW_INDX_2_1_VIS_CULL__MASK) >>
+				CP_DRAW_INDX_2_1_VIS_CULL__SHIFT;
+	case CP_DRAW_INDX_OFFSET:
+	case CP_DRAW_INDIRECT:
+	case CP_DRAW_INDX_INDIRECT:
+		/* same draw initiator in the first dword: */
+		if (cnt < 1)
+			return IGNORE_VISIBILITY;
+		return (dw[0] & CP_DRAW_INDX_OFFSET_0_VIS_CULL__MASK) >>
+				CP_DRAW_INDX_OFFSET_0_VIS_CULL__SHIFT;
+	default:
+		return IGNORE_VISIBILITY;
+	}
+}
+
+/* binning pass, append the bins the draw covers to each pipe's stream: */
+static void bin_draw(struct emu *emu)
+{
+	uint32_t *regs = emu->regs;
+	uint32_t tl = regs[REG_A3XX_GRAS_SC_SCREEN_SCISSOR_TL];
+	uint32_t br = regs[REG_A3XX_GRAS_SC_SCREEN_SCISSOR_BR];
+	uint32_t bin_size = regs[REG_A3XX_VSC_BIN_SIZE];
+	uint32_t bin_w, bin_h, x0, y0, x1, y1, p;
+	int empty;
+
+	emu->submit_stats.binned++;
+
+	bin_w = ((bin_size & A3XX_VSC_BIN_SIZE_WIDTH__MASK) >>
+			A3XX_VSC_BIN_SIZE_WIDTH__SHIFT) * 32;
+	bin_h = ((bin_size & A3XX_VSC_BIN_SIZE_HEIGHT__MASK) >>
+			A3XX_VSC_BIN_SIZE_HEIGHT__SHIFT) * 32;
+	if (!bin_w || !bin_h)
+		return;
+
+	x0 = (tl & A3XX_GRAS_SC_SCREEN_SCISSOR_TL_X__MASK) >>
+			A3XX_GRAS_SC_SCREEN_SCISSOR_TL_X__SHIFT;
+	y0 = (tl & A3XX_GRAS_SC_SCREEN_SCISSOR_TL_Y__MASK) >>
+			A3XX_GRAS_SC_SCREEN_SCISSOR_TL_Y__SHIFT;
+	x1 = (br & A3XX_GRAS_SC_SCREEN_SCISSOR_BR_X__MASK) >>
+			A3XX_GRAS_SC_SCREEN_SCISSOR_BR_X__SHIFT;
+	y1 = (br & A3XX_GRAS_SC_SCREEN_SCISSOR_BR_Y__MASK) >>
+			A3XX_GRAS_SC_SCREEN_SCISSOR_BR_Y__SHIFT;
+	empty = (x1 < x0) || (y1 < y0);
+
+	/* in units of bins: */
+	x0 /= bin_w;
+	y0 /= bin_h;
+	x1 /= bin_w;
+	y1 /= bin_h;
+
+	for (p = 0; p < 8; p++) {
+		uint32_t cfg = regs[REG_A3XX_VSC_PIPE_CONFIG(p)];
+		uint32_t addr = regs[REG_A3XX_VSC_PIPE_DATA_ADDRESS(p)];
+		uint32_t len = regs[REG_A3XX_VSC_PIPE_DATA_LENGTH(p)];
+		uint32_t size_addr = regs[REG_A3XX_VSC_SIZE_ADDRESS] + (p * 4);
+		uint32_t px, py, pw, ph, x, y, mask = 0;
+		struct emu_bo *size_bo, *bo;
+		uint32_t *size;
+
+		px = (cfg & A3XX_VSC_PIPE_CONFIG_X__MASK) >>
+				A3XX_VSC_PIPE_CONFIG_X__SHIFT;
+		py = (cfg & A3XX_VSC_PIPE_CONFIG_Y__MASK) >>
+				A3XX_VSC_PIPE_CONFIG_Y__SHIFT;
+		pw = (cfg & A3XX_VSC_PIPE_CONFIG_W__MASK) >>
+				A3XX_VSC_PIPE_CONFIG_W__SHIFT;
+		ph = (cfg & A3XX_VSC_PIPE_CONFIG_H__MASK) >>
+				A3XX_VSC_PIPE_CONFIG_H__SHIFT;
+		if (!pw || !ph)
+			continue;
+
+		size_bo = emu_iova_bo(emu, size_addr, 4);
+		if (!size_bo)
+			continue;
+		size = (uint32_t *)((uint8_t *)size_bo->map +
+				(size_addr - size_bo->iova));
+
+		/* the stream is full: */
+		if ((*size + 4) > len)
+			continue;
+
+		bo = emu_iova_bo(emu, addr + *size, 4);
+		if (!bo)
+			continue;
+
+		for (y = max(y0, py); !empty && (y <= min(y1, py + ph - 1)); y++) {
+			for (x = max(x0, px); x <= min(x1, px + pw - 1); x++) {
+				uint32_t bit = (y - py) * pw + (x - px);
+				if (bit < 32)
+					mask |= 1u << bit;
+			}
+		}
+
+		((uint32_t *)bo->map)[(addr + *size - bo->iova) / 4] = mask;
+		*size += 4;
+		emu_bo_dirty(bo);
+		emu_bo_dirty(size_bo);
+	}
+}
+
+/* render pass, whether the next draw is visible in the current bin: */
+static int visible(struct emu *emu)
+{
+	uint32_t n = (emu->regs[REG_A3XX_PC_VSTREAM_CONTROL] &
+			A3XX_PC_VSTREAM_CONTROL_N__MASK) >>
+			A3XX_PC_VSTREAM_CONTROL_N__SHIFT;
+	uint32_t *mask;
+
+	if (!emu->vis_ptr || (emu->vis_ptr >= emu->vis_end))
+		return 1;
+
+	mask = emu_iova_ptr(emu, emu->vis_ptr, 4);
+	emu->vis_ptr += 4;
+
+	return !mask || (*mask & (1u << n));
+}
+
+/* run a draw state group's IB, on top of the IB stack: */
+static int run_group(struct emu *emu, uint32_t id)
+{
+	struct emu_group *g = &emu->groups[id];
+	struct emu_stats *s = &emu->submit_stats;
+	struct emu_ib ib = {0};
+	struct emu_bo *bo;
+	uint32_t depth = emu->depth;
+	int ret;
+
+	bo = iova_bo_dwords(emu, g->iova, g->dwords);
+	if (!bo) {
+		ERROR_MSG("invalid draw state: %08x (%u dwords)", g->iova,
+				g->dwords);
+		return -EFAULT;
+	}
+	ib.ptr = (const uint32_t *)((uint8_t *)bo->map + (g->iova - bo->iova));
+	ib.end = ib.ptr + g->dwords;
+
+	s->groups++;
+	charge(emu, &s->ib_cycles, emu->costs.ib_pfd);
+
+	emu->in_group = 1;
+	emu->depth++;
+	ret = run_pkts(emu, &ib);
+	emu->depth = depth;
+	emu->in_group = 0;
+
+	if (ret > 0) {
+		ERROR_MSG("wait in draw state group %u", id);
+		emu->resume = NULL;
+		return -EINVAL;
+	}
+
+	return ret;
+}
+
+static int set_draw_state(struct emu *emu, const uint32_t *dw, uint32_t cnt)
+{
+	uint32_t i;
+	int ret;
+
+	/* a group loading groups (itself, with LOAD_IMMED) would never end: */
+	if (emu->in_group) {
+		ERROR_MSG("CP_SET_DRAW_STATE in a draw state group");
+		return -EINVAL;
+	}
+
+	for (i = 0; (i + 2) <= cnt; i += 2) {
+		uint32_t id = (dw[i] & CP_SET_DRAW_STATE_0_GROUP_ID__MASK) >>
+				CP_SET_DRAW_STATE_0_GROUP_ID__SHIFT;
+
+		if (dw[i] & CP_SET_DRAW_STATE_0_DISABLE_ALL_GROUPS) {
+			memset(emu->groups, 0, sizeof(emu->groups));
+			emu->groups_pending = 0;
+			continue;
+		}
+
+		emu->groups_pending &= ~(1u << id);
+
+		if (dw[i] & CP_SET_DRAW_STATE_0_DISABLE) {
+			emu->groups[id].dwords = 0;
+			continue;
+		}
+
+		emu->groups[id].iova = dw[i + 1];
+		emu->groups[id].dwords = (dw[i] &
+				CP_SET_DRAW_STATE_0_COUNT__MASK) >>
+				CP_SET_DRAW_STATE_0_COUNT__SHIFT;
+
+		if (dw[i] & CP_SET_DRAW_STATE_0_LOAD_IMMED) {
+			ret = run_group(emu, id);
+			if (ret)
+				return ret;
+		} else {
+			emu->groups_pending |= 1u << id;
+		}
+	}
+
+	return 0;
+}
+
+static int draw(struct emu *emu, uint32_t vis)
+{
+	/* pending state applies even if the draw ends up skipped: */
+	while (emu->groups_pending) {
+		uint32_t id = ffs(emu->groups_pending) - 1;
+		int ret;
+
+		emu->groups_pending &= ~(1u << id);
+		ret = run_group(emu, id);
+		if (ret)
+			return ret;
+	}
+
+	if (vis == USE_VISIBILITY) {
+		if (emu->regs[REG_A3XX_VSC_BIN_CONTROL] &
+				A3XX_VSC_BIN_CONTROL_BINNING_ENABLE) {
+			bin_draw(emu);
+			emu->backend_idle = max(emu->backend_idle, emu->now) +
+					emu->costs.draw;
+			return 0;
+		}
+		if (!visible(emu)) {
+			emu->submit_stats.vis_skipped++;
+			return 0;
+		}
+	}
+
+	emu->backend_idle = max(emu->backend_idle, emu->now) + emu->costs.draw;
+	emu->submit_stats.draws++;
+
+	return 0;
+}
+
+/* point the CP at the visibility stream for the following draws: */
+static int set_bin_data(struct emu *emu, const uint32_t *dw)
+{
+	uint32_t *size = emu_iova_ptr(emu, dw[1], 4);
+
+	if (!size) {
+		ERROR_MSG("invalid BIN_SIZE_ADDRESS: %08x", dw[1]);
+		return -EFAULT;
+	}
+
+	emu->vis_ptr = dw[0];
+	emu->vis_end = dw[0] + *size;
+
+	return 0;
+}
+
+/* queue a write which happens once the back-end is done with the work
+ * queued so far:
+ */
+static void queue_write(struct emu *emu, struct emu_bo *bo,
+		uint32_t offset, uint32_t val)
+{
+	struct emu_pending *p;
+
+	GROW(emu->pending, emu->nr_pending, emu->max_pending);
+	p = &emu->pending[emu->nr_pending++];
+	p->time = max(emu->backend_idle, emu->now);
+	p->bo = bo;
+	p->offset = offset;
+	p->val = val;
+}
+
+/* land the oldest queued back-end write: */
+static void retire_one(struct emu *emu)
+{
+	struct emu_pending *p = &emu->pending[emu->first_pending++];
+
+	((uint32_t *)p->bo->map)[p->offset / 4] = p->val;
+	emu_bo_dirty(p->bo);
+
+	if (emu->first_pending == emu->nr_pending)
+		emu->first_pending = emu->nr_pending = 0;
+}
+
+/* land the back-end writes that have happened by the given time: */
+static void retire(struct emu *emu, uint64_t time)
+{
+	while ((emu->first_pending < emu->nr_pending) &&
+			(emu->pending[emu->first_pending].time <= time))
+		retire_one(emu);
+}
+
+static int compare(uint32_t func, uint32_t val, uint32_t ref)
+{
+	switch (func) {
+	case EMU_FUNC_ALWAYS: return 1;
+	case EMU_FUNC_LT:     return val <  ref;
+	case EMU_FUNC_LE:     return val <= ref;
+	case EMU_FUNC_EQ:     return val == ref;
+	case EMU_FUNC_NE:     return val != ref;
+	case EMU_FUNC_GE:     return val >= ref;
+	case EMU_FUNC_GT:     return val >  ref;
+	default:              return 0;
+	}
+}
+
+/* returns 1 if the condition holds, 0 if not, or -errno: */
+static int check(struct emu *emu, const struct emu_wait *w)
+{
+	uint32_t val;
+
+	if (w->mem) {
+		uint32_t *ptr = emu_iova_ptr(emu, w->addr, 4);
+		if (!ptr) {
+			ERROR_MSG("invalid poll address: %08x", w->addr);
+			return -EFAULT;
+		}
+		retire(emu, emu->now);
+		val = *ptr;
+	} else {
+		val = emu->regs[w->addr % EMU_NUM_REGS];
+	}
+
+	return compare(w->func, val & w->mask, w->ref);
+}
+
+/* Rather than polling, a wait which is not satisfied yet skips ahead to
+ * the next back-end write that could change the outcome.  If there is
+ * none, the CP blocks until something else writes the polled location
+ * (see emu_write()).  Returns 1 if blocked.
+ */
+static int wait_until(struct emu *emu, const struct emu_wait *w)
+{
+	struct emu_stats *s = &emu->submit_stats;
+	int ret;
+
+	while (!(ret = check(emu, w))) {
+		uint64_t time;
+
+		if (!w->mem || (emu->first_pending == emu->nr_pending)) {
+			emu->wait = *w;
+			emu->blocked = 1;
+			return 1;
+		}
+
+		time = emu->pending[emu->first_pending].time;
+		charge(emu, &s->wait_cycles, time - emu->now);
+		retire_one(emu);
+	}
+
+	if (ret < 0)
+		return ret;
+
+	s->waits++;
+
+	return 0;
+}
+
+/* CP_COND_EXEC executes the following dwords if the dword at (dword
+ * address) dw[0] is non-zero and the one at dw[1] is less than dw[2].
+ * Returns 1 to execute, 0 to skip, or -errno:
+ */
+static int cond_exec(struct emu *emu, const uint32_t *dw)
+{
+	int32_t *a = emu_iova_ptr(emu, dw[0] << 2, 4);
+	int32_t *b = emu_iova_ptr(emu, dw[1] << 2, 4);
+
+	if (!a || !b) {
+		ERROR_MSG("invalid COND_EXEC address: %08x/%08x",
+				dw[0] << 2, dw[1] << 2);
+		return -EFAULT;
+	}
+
+	retire(emu, emu->now);
+
+	return (*a != 0) && (*b < (int32_t)dw[2]);
+}
+
+/* skipped dwords are still fetched: */
+static void skip(struct emu *emu, uint32_t dwords)
+{
+	struct emu_stats *s = &emu->submit_stats;
+
+	s->dwords += dwords;
+	charge(emu, &s->fetch_cycles, (uint64_t)dwords * emu->costs.dword);
+}
+
+/* indirect state is fetched much like the cmdstream itself: */
+static int load_state(struct emu *emu, const uint32_t *dw)
+{
+	struct emu_stats *s = &emu->submit_stats;
+	uint32_t src = (dw[0] & CP_LOAD_STATE_0_STATE_SRC__MASK) >>
+			CP_LOAD_STATE_0_STATE_SRC__SHIFT;
+	uint32_t dwords = 2 * ((dw[0] & CP_LOAD_STATE_0_NUM_UNIT__MASK) >>
+			CP_LOAD_STATE_0_NUM_UNIT__SHIFT);
+	uint32_t addr = dw[1] & CP_LOAD_STATE_1_EXT_SRC_ADDR__MASK;
+
+	if (src != SS_INDIRECT)
+		return 0;
+
+	if (!iova_bo_dwords(emu, addr, dwords)) {
+		ERROR_MSG("invalid state address: %08x (%u dwords)", addr, dwords);
+		return -EFAULT;
+	}
+
+	s->state_dwords += dwords;
+	charge(emu, &s->fetch_cycles, (uint64_t)dwords * emu->costs.dword);
+
+	return 0;
+}
+
+static int cond_write(struct emu *emu, const uint32_t *dw)
+{
+	struct emu_wait w = {
+		.func = dw[0] & 0x7,
+		.mem  = !!(dw[0] & 0x10),
+		.addr = dw[1],
+		.ref  = dw[2],
+		.mask = dw[3],
+	};
+	int ret = check(emu, &w);
+
+	if (ret <= 0)
+		return ret;
+
+	if (dw[0] & 0x100)
+		return mem_write(emu, dw[4], &dw[5], 1);
+
+	reg_write(emu, dw[4], dw[5]);
+
+	return 0;
+}
+
+static int exec_pkt3(struct emu *emu, uint32_t op,
+		const uint32_t *dw, uint32_t cnt)
+{
+	struct emu_stats *s = &emu->submit_stats;
+	uint32_t i;
+
+	switch (op) {
+	case CP_NOP:
+		return 0;
+
+	case CP_INDIRECT_BUFFER:
+	case CP_INDIRECT_BUFFER_PFD:
+		if (cnt < 2)
+			return -EINVAL;
+		if (op == CP_INDIRECT_BUFFER_PFD) {
+			s->ib_pfds++;
+			charge(emu, &s->ib_cycles, emu->costs.ib_pfd);
+		} else {
+			s->ibs++;
+			charge(emu, &s->ib_cycles, emu->costs.ib);
+		}
+		return push_ib(emu, dw[0], dw[1]);
+
+	case CP_WAIT_FOR_IDLE:
+		wait_for_idle(emu);
+		return 0;
+
+	case CP_MEM_WRITE:
+		if (cnt < 2)
+			return -EINVAL;
+		return mem_write(emu, dw[0], &dw[1], cnt - 1);
+
+	case CP_REG_TO_MEM: {
+		uint32_t reg = dw[0] & 0xffff;
+		uint32_t n = ((dw[0] >> 19) & 0x7ff) + 1;
+		if (cnt < 2)
+			return -EINVAL;
+		if ((reg + n) > EMU_NUM_REGS)
+			return -EINVAL;
+		return mem_write(emu, dw[1], &emu->regs[reg], n);
+	}
+
+	case CP_SET_CONSTANT:
+		if (cnt < 2)
+			return -EINVAL;
+		if (((dw[0] >> 16) & 0xff) != 0x4) {
+			/* not a register write, nothing to emulate */
+			return 0;
+		}
+		if (dw[0] & 0x80000000) {
+			/* reg = src_reg + immed: */
+			uint32_t reg = (dw[0] & 0xffff) + 0x2000;
+			if (cnt < 3)
+				return -EINVAL;
+			reg_write(emu, reg, emu->regs[dw[1] % EMU_NUM_REGS] + dw[2]);
+		} else {
+			uint32_t reg = (dw[0] & 0xffff) + 0x2000;
+			for (i = 1; i < cnt; i++)
+				reg_write(emu, reg + i - 1, dw[i]);
+		}
+		return 0;
+
+	case CP_EVENT_WRITE:
+		s->events++;
+		charge(emu, &s->event_cycles, emu->costs.event);
+		if ((dw[0] & 0xff) == CACHE_FLUSH_TS) {
+			/* the timestamp is written once the back-end is done,
+			 * the front-end does not wait for it:
+			 */
+			struct emu_bo *bo;
+			if (cnt < 3)
+				return -EINVAL;
+			bo = emu_iova_bo(emu, dw[1], 4);
+			if (!bo) {
+				ERROR_MSG("invalid write: %08x (1 dwords)", dw[1]);
+				return -EFAULT;
+			}
+			queue_write(emu, bo, dw[1] - bo->iova, dw[2]);
+			s->mem_writes++;
+			charge(emu, &s->mem_cycles, emu->costs.mem_write);
+		}
+		return 0;
+
+	case CP_REG_RMW: {
+		uint32_t reg = dw[0] % EMU_NUM_REGS;
+		if (cnt < 3)
+			return -EINVAL;
+		reg_write(emu, reg, (emu->regs[reg] & dw[1]) | dw[2]);
+		return 0;
+	}
+
+	case CP_COND_EXEC: {
+		struct emu_ib *ib = &emu->stack[emu->depth - 1];
+		uint32_t n;
+		int ret;
+		if (cnt < 4)
+			return -EINVAL;
+		ret = cond_exec(emu, dw);
+		if (ret)
+			return min(ret, 0);
+		n = min(dw[3], (uint32_t)(ib->end - ib->ptr));
+		ib->ptr += n;
+		skip(emu, n);
+		return 0;
+	}
+
+	case CP_COND_WRITE:
+		if (cnt < 6)
+			return -EINVAL;
+		return cond_write(emu, dw);
+
+	case CP_WAIT_REG_MEM:
+		if (cnt < 4)
+			return -EINVAL;
+		return wait_until(emu, &(struct emu_wait){
+			.func = dw[0] & 0x7,
+			.mem  = !!(dw[0] & 0x10),
+			.addr = dw[1],
+			.ref  = dw[2],
+			.mask = dw[3],
+		});
+
+	case CP_WAIT_REG_EQ:
+		if (cnt < 3)
+			return -EINVAL;
+		return wait_until(emu, &(struct emu_wait){
+			.func = EMU_FUNC_EQ,
+			.addr = dw[0] % EMU_NUM_REGS,
+			.ref  = dw[1],
+			.mask = dw[2],
+		});
+
+	case CP_WAIT_REG_GTE:
+		if (cnt < 2)
+			return -EINVAL;
+		return wait_until(emu, &(struct emu_wait){
+			.func = EMU_FUNC_GE,
+			.addr = dw[0] % EMU_NUM_REGS,
+			.ref  = dw[1],
+			.mask = ~0,
+		});
+
+	case CP_DRAW_INDX:
+	case CP_DRAW_INDX_2:
+	case CP_DRAW_INDX_BIN:
+	case CP_DRAW_INDX_2_BIN:
+	case CP_DRAW_INDX_OFFSET:
+	case CP_DRAW_INDIRECT:
+	case CP_DRAW_INDX_INDIRECT:
+	case CP_DRAW_AUTO:
+		return draw(emu, draw_vis(op, dw, cnt));
+
+	case CP_SET_BIN_DATA:
+		if (cnt < 2)
+			return -EINVAL;
+		return set_bin_data(emu, dw);
+
+	case CP_LOAD_STATE:
+		if (cnt < 2)
+			return -EINVAL;
+		return load_state(emu, dw);
+
+	case CP_SET_DRAW_STATE:
+		return set_draw_state(emu, dw, cnt);
+
+	default:
+		/* anything else only costs the fetch/decode: */
+		return 0;
+	}
+}
+
+/* interpret packets until the IB ends or pushes another IB: */
+static int run_pkts(struct emu *emu, struct emu_ib *ib)
+{
+	struct emu_stats *s = &emu->submit_stats;
+	uint32_t depth = emu->depth;
+
+	while (emu->depth == depth) {
+		const uint32_t *pkt = ib->ptr;
+		uint32_t hdr, cnt, i;
+		int ret = 0;
+
+		if (pkt >= ib->end) {
+			emu->depth--;
+			break;
+		}
+
+		hdr = *pkt;
+		cnt = ((hdr >> 16) & 0x3fff) + 1;
+
+		switch (hdr & 0xc0000000) {
+		case CP_TYPE2_PKT:
+			cnt = 0;
+			break;
+		case CP_TYPE0_PKT:
+		case CP_TYPE3_PKT:
+			if ((pkt + 1 + cnt) > ib->end) {
+				ERROR_MSG("packet overruns IB: %08x", hdr);
+				return -EINVAL;
+			}
+			break;
+		default:
+			ERROR_MSG("invalid packet: %08x", hdr);
+			return -EINVAL;
+		}
+
+		/* advance past the packet first, since it could push an IB: */
+		ib->ptr = pkt + 1 + cnt;
+
+		/* unless it is a wait that blocked, and is being retried: */
+		if (pkt != emu->resume) {
+			s->packets++;
+			s->dwords += 1 + cnt;
+			charge(emu, &s->fetch_cycles, emu->costs.pkt +
+					(uint64_t)(1 + cnt) * emu->costs.dword);
+		}
+		emu->resume = NULL;
+
+		switch (hdr & 0xc0000000) {
+		case CP_TYPE0_PKT:
+			for (i = 0; i < cnt; i++) {
+				uint32_t reg = hdr & 0x7fff;
+				/* bit 15 means write all values to the same reg: */
+				if (!(hdr & 0x8000))
+					reg += i;
+				reg_write(emu, reg, pkt[1 + i]);
+			}
+			break;
+		case CP_TYPE3_PKT:
+			ret = exec_pkt3(emu, (hdr >> 8) & 0xff, &pkt[1], cnt);
+			break;
+		}
+
+		if (ret > 0) {
+			/* blocked, retry the same packet later: */
+			ib->ptr = pkt;
+			emu->resume = pkt;
+		}
+
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * IB decode:
+ */
+
+static void add_stats(struct emu_stats *dst, const struct emu_stats *src)
+{
+	const uint64_t *s = (const uint64_t *)src;
+	uint64_t *d = (uint64_t *)dst;
+	uint32_t i;
+
+	for (i = 0; i < sizeof(*src) / sizeof(uint64_t); i++)
+		d[i] += s[i];
+}
+
+static struct emu_op * prog_op(struct emu_prog *prog, enum emu_opc opc)
+{
+	struct emu_op *op;
+
+	GROW(prog->ops, prog->nr_ops, prog->max_ops);
+	op = &prog->ops[prog->nr_ops++];
+	memset(op, 0, sizeof(*op));
+	op->op = opc;
+
+	return op;
+}
+
+/* reserve n dwords of data, returning the index of the first: */
+static uint32_t prog_data(struct emu_prog *prog, uint32_t n)
+{
+	uint32_t idx = prog->nr_data;
+
+	if ((prog->nr_data + n) > prog->max_data) {
+		prog->max_data = max(2 * prog->max_data, prog->nr_data + n);
+		prog->data = realloc(prog->data,
+				prog->max_data * sizeof(prog->data[0]));
+	}
+	prog->nr_data += n;
+
+	return idx;
+}
+
+/* emit the fixed costs accumulated so far, ahead of an op whose timing
+ * depends on the current cycle count:
+ */
+static void prog_account(struct emu_prog *prog, struct emu_stats *acc)
+{
+	if (!acc->packets)
+		return;
+
+	GROW(prog->deltas, prog->nr_deltas, prog->max_deltas);
+	prog->deltas[prog->nr_deltas] = *acc;
+	prog_op(prog, EMU_OP_ACCOUNT)->a = prog->nr_deltas++;
+
+	memset(acc, 0, sizeof(*acc));
+}
+
+/* (re)compute the cycles of the fixed costs, for the current costs: */
+static void prog_costs(struct emu_prog *prog, const struct emu_costs *costs)
+{
+	uint32_t i;
+
+	for (i = 0; i < prog->nr_deltas; i++) {
+		struct emu_stats *d = &prog->deltas[i];
+		d->fetch_cycles = d->packets * costs->pkt +
+				d->dwords * costs->dword;
+		d->reg_cycles = d->reg_writes * costs->reg_write;
+		d->mem_cycles = d->mem_writes * costs->mem_write;
+		d->event_cycles = d->events * costs->event;
+		d->cycles = d->fetch_cycles + d->reg_cycles +
+				d->mem_cycles + d->event_cycles;
+	}
+
+	prog->costs = *costs;
+}
+
+static void prog_regs(struct emu_prog *prog, struct emu_stats *acc,
+		uint32_t reg, const uint32_t *vals, uint32_t n)
+{
+	struct emu_op *op = (prog->nr_ops > prog->barrier) ?
+			&prog->ops[prog->nr_ops - 1] : NULL;
+
+	acc->reg_writes += n;
+
+	while (n > 0) {
+		uint32_t cnt, idx;
+
+		reg %= EMU_NUM_REGS;
+		cnt = min(n, EMU_NUM_REGS - reg);
+		idx = prog_data(prog, cnt);
+
+		/* extend the previous run if this one continues it: */
+		if (!op || (op->op != EMU_OP_REGS) || ((op->a + op->n) != reg) ||
+				((op->b + op->n) != idx)) {
+			op = prog_op(prog, EMU_OP_REGS);
+			op->a = reg;
+			op->b = idx;
+		}
+
+		op->n += cnt;
+		memcpy(&prog->data[idx], vals, cnt * 4);
+
+		reg += cnt;
+		vals += cnt;
+		n -= cnt;
+	}
+}
+
+static int prog_mem_write(struct emu *emu, struct emu_prog *prog,
+		struct emu_stats *acc, uint32_t iova,
+		const uint32_t *data, uint32_t dwords)
+{
+	struct emu_bo *bo = iova_bo_dwords(emu, iova, dwords);
+	struct emu_op *op;
+
+	/* leave invalid writes to exec_pkt3() to report: */
+	if (!bo)
+		return -EFAULT;
+
+	op = prog_op(prog, EMU_OP_MEM_WRITE);
+	op->bo = bo;
+	op->ptr = (uint8_t *)bo->map + (iova - bo->iova);
+	op->n = dwords;
+	op->b = prog_data(prog, dwords);
+	memcpy(&prog->data[op->b], data, dwords * 4);
+
+	acc->mem_writes += dwords;
+
+	return 0;
+}
+
+/* decode a type3 packet, returning non-zero if it has to be left to
+ * exec_pkt3() at run time:
+ */
+static int decode_pkt3(struct emu *emu, struct emu_prog *prog,
+		struct emu_stats *acc, uint32_t opc,
+		const uint32_t *dw, uint32_t cnt)
+{
+	struct emu_op *op;
+
+	switch (opc) {
+	case CP_NOP:
+		return 0;
+
+	case CP_INDIRECT_BUFFER:
+	case CP_INDIRECT_BUFFER_PFD:
+		if (cnt < 2)
+			return -EINVAL;
+		prog_account(prog, acc);
+		/* checked by push_ib() when it runs, like any other IB: */
+		op = prog_op(prog, EMU_OP_IB);
+		op->a = dw[0];
+		op->n = dw[1];
+		op->flags = (opc == CP_INDIRECT_BUFFER_PFD);
+		return 0;
+
+	case CP_WAIT_FOR_IDLE:
+		prog_account(prog, acc);
+		prog_op(prog, EMU_OP_WFI);
+		return 0;
+
+	case CP_MEM_WRITE:
+		if (cnt < 2)
+			return -EINVAL;
+		return prog_mem_write(emu, prog, acc, dw[0], &dw[1], cnt - 1);
+
+	case CP_REG_TO_MEM: {
+		uint32_t reg = dw[0] & 0xffff;
+		uint32_t n = ((dw[0] >> 19) & 0x7ff) + 1;
+		struct emu_bo *bo;
+		if ((cnt < 2) || ((reg + n) > EMU_NUM_REGS))
+			return -EINVAL;
+		bo = iova_bo_dwords(emu, dw[1], n);
+		if (!bo)
+			return -EFAULT;
+		op = prog_op(prog, EMU_OP_REG_TO_MEM);
+		op->bo = bo;
+		op->ptr = (uint8_t *)bo->map + (dw[1] - bo->iova);
+		op->a = reg;
+		op->n = n;
+		acc->mem_writes += n;
+		return 0;
+	}
+
+	case CP_SET_CONSTANT:
+		if (cnt < 2)
+			return -EINVAL;
+		if (((dw[0] >> 16) & 0xff) != 0x4)
+			return 0;
+		if (dw[0] & 0x80000000) {
+			if (cnt < 3)
+				return -EINVAL;
+			op = prog_op(prog, EMU_OP_REG_ADD);
+			op->a = ((dw[0] & 0xffff) + 0x2000) % EMU_NUM_REGS;
+			op->n = dw[1] % EMU_NUM_REGS;
+			op->b = prog_data(prog, 1);
+			prog->data[op->b] = dw[2];
+			acc->reg_writes++;
+		} else {
+			prog_regs(prog, acc, (dw[0] & 0xffff) + 0x2000,
+					&dw[1], cnt - 1);
+		}
+		return 0;
+
+	case CP_EVENT_WRITE:
+		if ((dw[0] & 0xff) == CACHE_FLUSH_TS) {
+			struct emu_bo *bo;
+			if (cnt < 3)
+				return -EINVAL;
+			bo = emu_iova_bo(emu, dw[1], 4);
+			if (!bo)
+				return -EFAULT;
+			acc->events++;
+			acc->mem_writes++;
+			prog_account(prog, acc);
+			op = prog_op(prog, EMU_OP_EVENT_TS);
+			op->bo = bo;
+			op->a = dw[1] - bo->iova;
+			op->b = prog_data(prog, 1);
+			prog->data[op->b] = dw[2];
+			return 0;
+		}
+		acc->events++;
+		return 0;
+
+	case CP_REG_RMW:
+		if (cnt < 3)
+			return -EINVAL;
+		op = prog_op(prog, EMU_OP_REG_RMW);
+		op->a = dw[0] % EMU_NUM_REGS;
+		op->b = prog_data(prog, 2);
+		prog->data[op->b + 0] = dw[1];
+		prog->data[op->b + 1] = dw[2];
+		acc->reg_writes++;
+		return 0;
+
+	case CP_COND_WRITE:
+	case CP_WAIT_REG_MEM:
+	case CP_WAIT_REG_EQ:
+	case CP_WAIT_REG_GTE:
+		/* these depend on when they execute, leave them to
+		 * exec_pkt3():
+		 */
+		return -EAGAIN;
+
+	case CP_DRAW_INDX:
+	case CP_DRAW_INDX_2:
+	case CP_DRAW_INDX_BIN:
+	case CP_DRAW_INDX_2_BIN:
+	case CP_DRAW_INDX_OFFSET:
+	case CP_DRAW_INDIRECT:
+	case CP_DRAW_INDX_INDIRECT:
+	case CP_DRAW_AUTO:
+		prog_account(prog, acc);
+		prog_op(prog, EMU_OP_DRAW)->flags = draw_vis(opc, dw, cnt);
+		return 0;
+
+	case CP_SET_BIN_DATA:
+		/* reads the stream size at run time: */
+		return -EAGAIN;
+
+	case CP_LOAD_STATE:
+		/* the source is checked at run time: */
+		return -EAGAIN;
+
+	case CP_SET_DRAW_STATE:
+		/* can run group IBs straight away (LOAD_IMMED): */
+		return -EAGAIN;
+
+	default:
+		return 0;
+	}
+}
+
+static void decode(struct emu *emu, struct emu_prog *prog,
+		const uint32_t *dw, uint32_t dwords)
+{
+	const uint32_t *pkt = dw, *end = dw + dwords;
+	struct emu_stats acc = {0};
+	struct emu_op *op;
+	/* CP_COND_EXEC op, and the end of the dwords it covers: */
+	uint32_t cond = ~0, cond_end = 0;
+
+	while (pkt <= end) {
+		uint32_t hdr, cnt;
+
+		if ((cond != ~0u) && ((pkt - dw) >= cond_end)) {
+			if ((pkt - dw) > cond_end) {
+				/* ends part way into a packet */
+				prog->interpret = 1;
+				return;
+			}
+			prog_account(prog, &acc);
+			prog->ops[cond].n = prog->nr_ops - cond - 1;
+			prog->barrier = prog->nr_ops;
+			cond = ~0;
+		}
+
+		if (pkt == end)
+			break;
+
+		hdr = *pkt;
+		cnt = ((hdr >> 16) & 0x3fff) + 1;
+
+		switch (hdr & 0xc0000000) {
+		case CP_TYPE2_PKT:
+			cnt = 0;
+			break;
+		case CP_TYPE0_PKT:
+		case CP_TYPE3_PKT:
+			if ((pkt + 1 + cnt) <= end)
+				break;
+			/* fallthrough */
+		default:
+			/* the interpreter would execute up to the bad
+			 * packet, and then fail (unless it is skipped):
+			 */
+			if (cond != ~0u) {
+				prog->interpret = 1;
+				return;
+			}
+			prog_account(prog, &acc);
+			prog_op(prog, EMU_OP_ERROR)->a = hdr;
+			goto out;
+		}
+
+		acc.packets++;
+		acc.dwords += 1 + cnt;
+
+		switch (hdr & 0xc0000000) {
+		case CP_TYPE0_PKT:
+			if (hdr & 0x8000) {
+				/* all values to the same reg, only the last
+				 * one sticks:
+				 */
+				prog_regs(prog, &acc, hdr & 0x7fff, &pkt[cnt], 1);
+				acc.reg_writes += cnt - 1;
+			} else {
+				prog_regs(prog, &acc, hdr & 0x7fff, &pkt[1], cnt);
+			}
+			break;
+		case CP_TYPE3_PKT:
+			if ((((hdr >> 8) & 0xff) == CP_COND_EXEC) && (cnt >= 4)) {
+				uint32_t n = min(pkt[4], (uint32_t)(end - pkt) - 1 - cnt);
+				if (cond != ~0u) {
+					/* nested */
+					prog->interpret = 1;
+					return;
+				}
+				prog_account(prog, &acc);
+				op = prog_op(prog, EMU_OP_COND_EXEC);
+				op->b = prog_data(prog, 4);
+				memcpy(&prog->data[op->b], &pkt[1], 3 * 4);
+				prog->data[op->b + 3] = n;
+				cond = prog->nr_ops - 1;
+				cond_end = (pkt - dw) + 1 + cnt + n;
+				prog->barrier = prog->nr_ops;
+			} else if (decode_pkt3(emu, prog, &acc, (hdr >> 8) & 0xff,
+					&pkt[1], cnt)) {
+				prog_account(prog, &acc);
+				op = prog_op(prog, EMU_OP_PKT3);
+				op->a = (hdr >> 8) & 0xff;
+				op->n = cnt;
+				op->b = prog_data(prog, cnt);
+				memcpy(&prog->data[op->b], &pkt[1], cnt * 4);
+			}
+			break;
+		}
+
+		pkt += 1 + cnt;
+	}
+
+	prog_account(prog, &acc);
+
+out:
+	prog_costs(prog, &emu->costs);
+}
+
+static struct emu_prog * get_prog(struct emu *emu, struct emu_bo *bo,
+		uint32_t iova, uint32_t dwords)
+{
+	struct emu_memo *memo = &emu->memo[(((iova ^ dwords) * 0x9e3779b1) >> 24) %
+			EMU_MEMO_SIZE];
+	const uint32_t *dw = (const uint32_t *)((uint8_t *)bo->map +
+			(iova - bo->iova));
+	struct emu_prog **bucket, *prog;
+	uint64_t hash;
+
+	/* unchanged since the last time it was executed? */
+	if ((memo->bo == bo) && (memo->gen == emu_bo_gen(bo)) &&
+			(memo->iova == iova) && (memo->dwords == dwords)) {
+		emu->memo_hits++;
+		prog = memo->prog;
+		goto out;
+	}
+
+	hash = hash_dwords(dw, dwords);
+	bucket = &emu->progs[hash % EMU_PROG_BUCKETS];
+
+	for (prog = *bucket; prog; prog = prog->next) {
+		/* the hash is cheap to collide, so check the contents too: */
+		if ((prog->hash == hash) && (prog->dwords == dwords) &&
+				!memcmp(prog->src, dw, dwords * 4)) {
+			emu->prog_hits++;
+			goto remember;
+		}
+	}
+
+	prog = calloc(1, sizeof(*prog));
+	if (!prog)
+		return NULL;
+
+	prog->src = malloc(dwords * 4);
+	if (!prog->src) {
+		free(prog);
+		return NULL;
+	}
+
+	prog->hash = hash;
+	prog->dwords = dwords;
+	memcpy(prog->src, dw, dwords * 4);
+
+	decode(emu, prog, dw, dwords);
+
+	prog->next = *bucket;
+	*bucket = prog;
+
+	emu->nr_progs++;
+	emu->prog_mem += sizeof(*prog) + (dwords * 4) +
+			prog->max_ops * sizeof(prog->ops[0]) +
+			prog->max_data * sizeof(prog->data[0]) +
+			prog->max_deltas * sizeof(prog->deltas[0]);
+	emu->prog_misses++;
+
+remember:
+	memo->bo = bo;
+	memo->gen = emu_bo_gen(bo);
+	memo->iova = iova;
+	memo->dwords = dwords;
+	memo->prog = prog;
+
+out:
+	if (memcmp(&prog->costs, &emu->costs, sizeof(emu->costs)))
+		prog_costs(prog, &emu->costs);
+
+	return prog;
+}
+
+void emu_flush_progs(struct emu *emu)
+{
+	uint32_t i;
+
+	for (i = 0; i < EMU_PROG_BUCKETS; i++) {
+		while (emu->progs[i]) {
+			struct emu_prog *prog = emu->progs[i];
+			emu->progs[i] = prog->next;
+			free(prog->src);
+			free(prog->ops);
+			free(prog->data);
+			free(prog->deltas);
+			free(prog);
+		}
+	}
+
+	memset(emu->memo, 0, sizeof(emu->memo));
+	emu->nr_progs = 0;
+	emu->prog_mem = 0;
+}
+
+/* execute decoded ops until the IB ends or pushes another IB: */
+static int run_prog(struct emu *emu, struct emu_ib *ib)
+{
+	struct emu_stats *s = &emu->submit_stats;
+	const struct emu_prog *prog = ib->prog;
+	uint32_t *regs = emu->regs;
+	uint32_t depth = emu->depth;
+	int ret;
+
+	while (ib->pc < prog->nr_ops) {
+		const struct emu_op *op = &prog->ops[ib->pc++];
+		const uint32_t *data = &prog->data[op->b];
+
+		switch (op->op) {
+		case EMU_OP_ACCOUNT:
+			emu->now += prog->deltas[op->a].cycles;
+			add_stats(s, &prog->deltas[op->a]);
+			break;
+		case EMU_OP_REGS:
+			memcpy(&regs[op->a], data, op->n * 4);
+			break;
+		case EMU_OP_REG_ADD:
+			regs[op->a] = regs[op->n] + data[0];
+			break;
+		case EMU_OP_MEM_WRITE:
+			memcpy(op->ptr, data, op->n * 4);
+			emu_bo_dirty(op->bo);
+			break;
+		case EMU_OP_REG_TO_MEM:
+			memcpy(op->ptr, &regs[op->a], op->n * 4);
+			emu_bo_dirty(op->bo);
+			break;
+		case EMU_OP_REG_RMW:
+			regs[op->a] = (regs[op->a] & data[0]) | data[1];
+			break;
+		case EMU_OP_EVENT_TS:
+			queue_write(emu, op->bo, op->a, data[0]);
+			break;
+		case EMU_OP_COND_EXEC:
+			ret = cond_exec(emu, data);
+			if (ret < 0)
+				return ret;
+			if (!ret) {
+				ib->pc += op->n;
+				skip(emu, data[3]);
+			}
+			break;
+		case EMU_OP_IB:
+			if (op->flags) {
+				s->ib_pfds++;
+				charge(emu, &s->ib_cycles, emu->costs.ib_pfd);
+			} else {
+				s->ibs++;
+				charge(emu, &s->ib_cycles, emu->costs.ib);
+			}
+			return push_ib(emu, op->a, op->n);
+		case EMU_OP_WFI:
+			wait_for_idle(emu);
+			break;
+		case EMU_OP_DRAW:
+			ret = draw(emu, op->flags);
+			if (ret)
+				return ret;
+			break;
+		case EMU_OP_PKT3:
+			ret = exec_pkt3(emu, op->a, data, op->n);
+			if (ret > 0) {
+				/* blocked, retry the same op later: */
+				ib->pc--;
+			}
+			if (ret || (emu->depth != depth))
+				return ret;
+			break;
+		case EMU_OP_ERROR:
+			ERROR_MSG("invalid packet: %08x", op->a);
+			return -EINVAL;
+		}
+	}
+
+	emu->depth--;
+
+	return 0;
+}
+
+static int run(struct emu *emu)
+{
+	while (emu->depth > 0) {
+		struct emu_ib *ib = &emu->stack[emu->depth - 1];
+		int ret;
+
+		if (ib->prog)
+			ret = run_prog(emu, ib);
+		else
+			ret = run_pkts(emu, ib);
+
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void queue_job(struct emu *emu, uint32_t iova, uint32_t dwords,
+		uint32_t fence)
+{
+	GROW(emu->jobs, emu->nr_jobs, emu->max_jobs);
+	emu->jobs[emu->nr_jobs++] = (struct emu_job){
+		.iova = iova,
+		.dwords = dwords,
+		.fence = fence,
+	};
+}
+
+/* host time the modelled GPU has got to in the current run: */
+static uint64_t model_ns(struct emu *emu)
+{
+	return emu->run_ns + (emu_cycles_to_us(emu,
+			emu->now - emu->run_cycles) * 1000);
+}
+
+/* the last job of a submit is done (or dropped): */
+static void end_submit(struct emu *emu)
+{
+	emu->completed = emu->job_fence;
+
+	/* however many runs of the CP it took, including time blocked: */
+	trace_gpu(emu->job_pipe, emu->job_fence, emu->span_ns, model_ns(emu));
+
+	/* the next submit sets up its own bin, if any: */
+	emu->vis_ptr = emu->vis_end = 0;
+}
+
+/* work through the queued jobs, until done or blocked: */
+static int kick(struct emu *emu)
+{
+	int ret = 0;
+
+	while (!emu->blocked) {
+		if (!emu->depth) {
+			struct emu_job *job;
+
+			if (emu->first_job == emu->nr_jobs)
+				break;
+
+			job = &emu->jobs[emu->first_job++];
+			emu->job_fence = job->fence;
+			emu->job_pipe = job->pipe;
+
+			if (job->first)
+				emu->span_ns = model_ns(emu);
+
+			/* nothing on the IB stack references a decoded IB at
+			 * this point:
+			 */
+			if ((emu->nr_progs > EMU_MAX_PROGS) ||
+					(emu->prog_mem > EMU_MAX_PROG_MEM))
+				emu_flush_progs(emu);
+
+			if (job->dwords) {
+				ret = push_ib(emu, job->iova, job->dwords);
+				if (ret)
+					break;
+			}
+		}
+
+		ret = run(emu);
+		if (ret)
+			break;
+
+		if (emu->job_fence)
+			end_submit(emu);
+	}
+
+	if (ret < 0) {
+		/* drop the rest of the submit: */
+		emu->depth = 0;
+		emu->resume = NULL;
+		while (!emu->job_fence && (emu->first_job < emu->nr_jobs))
+			emu->job_fence = emu->jobs[emu->first_job++].fence;
+		if (emu->job_fence)
+			end_submit(emu);
+	}
+
+	if (emu->first_job == emu->nr_jobs)
+		emu->first_job = emu->nr_jobs = 0;
+
+	/* the back-end carries on regardless of the front-end: */
+	retire(emu, ~0ull);
+
+	return min(ret, 0);
+}
+
+static int run_queue(struct emu *emu)
+{
+	int ret;
+
+	/* for tracing, lay the modelled execution out on the host timeline:
+	 * it starts now, or once the GPU is done with earlier work:
+	 */
+	if (trace_enabled) {
+		emu->run_ns = max(gettime_ns(), emu->gpu_ns);
+		emu->run_cycles = emu->now;
+	}
+
+	memset(&emu->submit_stats, 0, sizeof(emu->submit_stats));
+	ret = kick(emu);
+	add_stats(&emu->stats, &emu->submit_stats);
+
+	if (trace_enabled)
+		emu->gpu_ns = model_ns(emu);
+
+	return ret;
+}
+
+/* execute a cmdstream buffer at the given GPU address, after anything
+ * already queued.  If it blocks on a wait, it is not an error, but
+ * emu_idle() is false until the wait is satisfied:
+ */
+int emu_exec(struct emu *emu, uint32_t iova, uint32_t dwords)
+{
+	queue_job(emu, iova, dwords, 0);
+	return run_queue(emu);
+}
+
+/* CPU writes, which wake up the CP if it is waiting on them: */
+int emu_write(struct emu *emu, uint32_t iova, uint32_t val)
+{
+	struct emu_bo *bo = emu_iova_bo(emu, iova, 4);
+
+	if (!bo)
+		return -EFAULT;
+
+	((uint32_t *)bo->map)[(iova - bo->iova) / 4] = val;
+	emu_bo_dirty(bo);
+
+	if (emu->blocked && emu->wait.mem && (emu->wait.addr == iova)) {
+		emu->blocked = 0;
+		return run_queue(emu);
+	}
+
+	return 0;
+}
+
+/* re-check a blocked wait, after something which doesn't go through
+ * emu_write() could have changed the outcome (such as another CP sharing
+ * the address space).  It blocks again if still not satisfied:
+ */
+int emu_wake(struct emu *emu)
+{
+	if (!emu->blocked)
+		return 0;
+
+	emu->blocked = 0;
+	return run_queue(emu);
+}
+
+void emu_write_reg(struct emu *emu, uint32_t reg, uint32_t val)
+{
+	reg %= EMU_NUM_REGS;
+	emu->regs[reg] = val;
+
+	if (emu->blocked && !emu->wait.mem && (emu->wait.addr == reg)) {
+		emu->blocked = 0;
+		run_queue(emu);
+	}
+}
+
+/* Same interface as the DRM_MSM_GEM_SUBMIT ioctl: relocs are applied
+ * (to every cmd, including IB targets) and then the BUF cmds queued and
+ * executed.
+ */
+int emu_submit(struct emu *emu, struct drm_msm_gem_submit *req)
+{
+	struct drm_msm_gem_submit_bo *bos = U642VOID(req->bos);
+	struct drm_msm_gem_submit_cmd *cmds = U642VOID(req->cmds);
+	struct emu_bo **ebos;
+	uint32_t i, j, first;
+	int ret = 0;
+
+	ebos = calloc(req->nr_bos, sizeof(ebos[0]));
+
+	for (i = 0; i < req->nr_bos; i++) {
+		ebos[i] = emu_bo_lookup(emu, bos[i].handle);
+		if (!ebos[i]) {
+			ERROR_MSG("invalid handle: %u", bos[i].handle);
+			ret = -EINVAL;
+			goto out;
+		}
+		bos[i].presumed = ebos[i]->iova;
+	}
+
+	for (i = 0; i < req->nr_cmds; i++) {
+		struct drm_msm_gem_submit_cmd *cmd = &cmds[i];
+		struct drm_msm_gem_submit_reloc *relocs = U642VOID(cmd->relocs);
+		struct emu_bo *bo;
+
+		if (cmd->submit_idx >= req->nr_bos) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		bo = ebos[cmd->submit_idx];
+
+		/* without overflowing: */
+		if ((cmd->size > bo->size) ||
+				(cmd->submit_offset > (bo->size - cmd->size))) {
+			ERROR_MSG("cmd overruns bo");
+			ret = -EINVAL;
+			goto out;
+		}
+
+		/* the cmdstream has presumably been written by the CPU since
+		 * it was last executed:
+		 */
+		emu_bo_dirty(bo);
+
+		for (j = 0; j < cmd->nr_relocs; j++) {
+			struct drm_msm_gem_submit_reloc *r = &relocs[j];
+			uint32_t iova;
+
+			/* the reloc must patch a dword of this cmd: */
+			if ((r->reloc_idx >= req->nr_bos) || (cmd->size < 4) ||
+					(r->submit_offset < cmd->submit_offset) ||
+					((r->submit_offset - cmd->submit_offset) >
+							(cmd->size - 4))) {
+				ERROR_MSG("invalid reloc: %08x", r->submit_offset);
+				ret = -EINVAL;
+				goto out;
+			}
+
+			iova = ebos[r->reloc_idx]->iova + r->reloc_offset;
+			if (r->shift < 0)
+				iova >>= -r->shift;
+			else
+				iova <<= r->shift;
+
+			((uint32_t *)bo->map)[r->submit_offset / 4] = iova | r->or;
+		}
+	}
+
+	req->fence = ++emu->fence;
+	first = emu->nr_jobs;
+
+	for (i = 0, j = ~0; i < req->nr_cmds; i++) {
+		struct drm_msm_gem_submit_cmd *cmd = &cmds[i];
+
+		if (cmd->type == MSM_SUBMIT_CMD_IB_TARGET_BUF)
+			continue;
+
+		queue_job(emu, ebos[cmd->submit_idx]->iova + cmd->submit_offset,
+				cmd->size / 4, 0);
+		j = emu->nr_jobs - 1;
+	}
+
+	/* the fence completes along with the last cmd: */
+	if (j != ~0u)
+		emu->jobs[j].fence = req->fence;
+	else
+		queue_job(emu, 0, 0, req->fence);
+
+	/* for the submit's GPU span, traced once it completes: */
+	emu->jobs[first].first = 1;
+	for (i = first; i < emu->nr_jobs; i++)
+		emu->jobs[i].pipe = req->pipe;
+
+	/* stats (and errors) are for whatever runs now, which could include
+	 * earlier submits if the CP was blocked:
+	 */
+	ret = run_queue(emu);
+
+out:
+	free(ebos);
+	return ret;
+}
+
+static int emu_flush(void *priv, struct drm_msm_gem_submit *req)
+{
+	return emu_submit(priv, req);
+}
+
+/* send a submit builder's flushes to the emulator instead of the kernel: */
+void emu_attach(struct emu *emu, struct msm_submit *submit)
+{
+	submit->flush = emu_flush;
+	submit->priv = emu;
+}
+
+/* submits run until they complete or block, so there is nothing more
+ * to wait for:
+ */
+static int emu_wait_fence(void *priv, uint32_t fence, uint64_t timeout_ns)
+{
+	struct emu *emu = priv;
+
+	if ((int32_t)(emu->completed - fence) >= 0)
+		return 0;
+
+	return timeout_ns ? -ETIMEDOUT : -EBUSY;
+}
+
+/* wait for an upload ring's fences on the emulator instead of the kernel: */
+void emu_attach_upload(struct emu *emu, struct upload_ring *ring)
+{
+	ring->wait = emu_wait_fence;
+	ring->priv = emu;
+}
+
+void emu_dump_stats(struct emu *emu, const char *name,
+		const struct emu_stats *s)
+{
+#define PCT(c) (s->cycles ? 100.0 * (c) / s->cycles : 0.0)
+	printf("%s: %.3fus (%"PRIu64" cycles @ %uMHz)\n", name,
+			emu_cycles_to_us(emu, s->cycles), s->cycles,
+			emu->costs.clock_mhz);
+	printf("  %"PRIu64" packets, %"PRIu64" dwords, %"PRIu64" reg writes, "
+			"%"PRIu64" mem dwords, %"PRIu64" draws\n", s->packets,
+			s->dwords, s->reg_writes, s->mem_writes, s->draws);
+	if (s->binned || s->vis_skipped)
+		printf("  %"PRIu64" draws binned, %"PRIu64" skipped by visibility\n",
+				s->binned, s->vis_skipped);
+	if (s->state_dwords)
+		printf("  %"PRIu64" state dwords loaded indirectly\n",
+				s->state_dwords);
+	if (s->groups)
+		printf("  %"PRIu64" draw state groups run\n", s->groups);
+	printf("  %"PRIu64" IBs, %"PRIu64" PFD IBs, %"PRIu64" WFIs, %"PRIu64" events, "
+			"%"PRIu64" waits\n", s->ibs, s->ib_pfds, s->wfis, s->events,
+			s->waits);
+	printf("  fetch %.1f%%, reg %.1f%%, mem %.1f%%, wfi %.1f%%, ib %.1f%%, "
+			"event %.1f%%, wait %.1f%%\n",
+			PCT(s->fetch_cycles), PCT(s->reg_cycles), PCT(s->mem_cycles),
+			PCT(s->wfi_cycles), PCT(s->ib_cycles), PCT(s->event_cycles),
+			PCT(s->wait_cycles));
+#undef PCT
+}
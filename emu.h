@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef EMU_H_
+#define EMU_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "submit.h"
+#include "cmdbuf.h"
+#include "upload.h"
+
+/*
+ * Software PM4 executor, a stand-in for the CP when there is no GPU (or
+ * to estimate cmdstream cost offline).  It has a register file and a flat
+ * 32b GPU address space made up of emulated bo's, and executes submits
+ * (in the DRM_MSM_GEM_SUBMIT format, handling relocs like the kernel does)
+ * with a cycle-approximate timing model of the CP front-end.
+ *
+ * The timing model is deliberately simple: each packet costs a fixed
+ * decode cost plus a per-dword fetch cost, plus whatever the packet does
+ * (register writes, memory writes, IB fetch).  Draws queue work to the
+ * back-end, which runs in parallel with the front-end until something
+ * (CP_WAIT_FOR_IDLE) forces the front-end to drain it.
+ *
+ * Timestamps (CACHE_FLUSH_TS) land when the back-end gets to them, and
+ * the polling packets (CP_WAIT_REG_MEM, etc) are event driven: a wait
+ * that is not satisfied skips ahead to the next back-end write, or if
+ * there is none, blocks the CP until the CPU writes the polled location
+ * with emu_write()/emu_write_reg().
+ *
+ * Draws with USE_VISIBILITY take part in binning.  Vertices are not
+ * transformed, instead a draw is taken to cover its screen scissor
+ * (GRAS_SC_SCREEN_SCISSOR_TL/BR).  While VSC_BIN_CONTROL.BINNING_ENABLE
+ * is set such draws are only binned: each VSC pipe's stream gets a dword
+ * with a mask of the pipe's bins the draw touches, and the stream's size
+ * in bytes (at VSC_SIZE_ADDRESS + 4 * pipe) grows by 4.  Otherwise, once
+ * CP_SET_BIN_DATA has pointed the CP at a stream, each such draw consumes
+ * a dword of it and is skipped if bit PC_VSTREAM_CONTROL.N is clear.
+ *
+ * CP_LOAD_STATE with SS_INDIRECT fetches its state from memory at the
+ * same per-dword cost as the cmdstream, taking NUM_UNIT as a count of
+ * 2 dword units.  The source must lie within a bo.
+ *
+ * CP_SET_DRAW_STATE entries (ID/COUNT, then address) set a group's IB,
+ * which is run before the next draw; later draws don't run it again
+ * unless it is set again.  Entries with LOAD_IMMED run the IB straight
+ * away.  Group IBs can't call IBs or wait, and run in the interpreter.
+ */
+
+#define EMU_NUM_REGS     0x10000
+#define EMU_MAX_IB_DEPTH 4
+
+/* limits for the decoded IB cache, checked between emu_exec() calls: */
+#define EMU_PROG_BUCKETS 1024
+#define EMU_MAX_PROGS    4096
+#define EMU_MAX_PROG_MEM (64 * 1024 * 1024)
+#define EMU_MEMO_SIZE    256
+
+/* CP_SET_DRAW_STATE group ids: */
+#define EMU_MAX_GROUPS   32
+
+struct emu_bo {
+	uint32_t handle;
+	uint32_t iova;
+	uint32_t size;
+	void *map;
+	uint32_t gen;            /* bumped whenever the contents change */
+};
+
+/* all costs in CP clock cycles: */
+struct emu_costs {
+	uint32_t clock_mhz;
+	uint32_t pkt;            /* packet header decode */
+	uint32_t dword;          /* per dword fetched (including header) */
+	uint32_t reg_write;      /* per register written */
+	uint32_t mem_write;      /* per dword written to memory */
+	uint32_t wfi;            /* CP_WAIT_FOR_IDLE, after back-end drained */
+	uint32_t ib;             /* CP_INDIRECT_BUFFER fetch latency */
+	uint32_t ib_pfd;         /* CP_INDIRECT_BUFFER_PFD (prefetched) */
+	uint32_t event;          /* CP_EVENT_WRITE */
+	uint32_t draw;           /* back-end cost per draw */
+};
+
+extern const struct emu_costs emu_default_costs;
+
+struct emu_stats {
+	uint64_t cycles;         /* front-end cycles */
+	uint64_t packets;
+	uint64_t dwords;
+	uint64_t reg_writes;
+	uint64_t mem_writes;     /* in dwords */
+	uint64_t wfis;
+	uint64_t ibs;
+	uint64_t ib_pfds;
+	uint64_t events;
+	uint64_t draws;
+	uint64_t binned;         /* draws seen by a binning pass */
+	uint64_t vis_skipped;    /* draws skipped by the visibility stream */
+	uint64_t state_dwords;   /* fetched by CP_LOAD_STATE with SS_INDIRECT */
+	uint64_t groups;         /* draw state group IBs run */
+	uint64_t waits;          /* completed CP_WAIT_x packets */
+
+	/* breakdown of cycles: */
+	uint64_t fetch_cycles;
+	uint64_t reg_cycles;
+	uint64_t mem_cycles;
+	uint64_t wfi_cycles;     /* including waiting for the back-end */
+	uint64_t ib_cycles;
+	uint64_t event_cycles;
+	uint64_t wait_cycles;    /* waiting on back-end writes */
+};
+
+/* compare functions of CP_WAIT_REG_MEM and CP_COND_WRITE: */
+enum emu_func {
+	EMU_FUNC_ALWAYS,
+	EMU_FUNC_LT,
+	EMU_FUNC_LE,
+	EMU_FUNC_EQ,
+	EMU_FUNC_NE,
+	EMU_FUNC_GE,
+	EMU_FUNC_GT,
+};
+
+/* a condition the CP is waiting on: */
+struct emu_wait {
+	uint32_t func;
+	uint32_t mem;            /* polls memory, rather than a register */
+	uint32_t addr;           /* iova or register */
+	uint32_t ref, mask;
+};
+
+/*
+ * Pre-decoded IB.  Rather than re-parsing packet headers on every
+ * execution, an IB is decoded once into a compact array of ops: register
+ * writes become runs of values (the same-register form of type0 packets
+ * collapses to the last value), memory writes get their destination
+ * translated to a CPU pointer, and the cost of everything that does not
+ * depend on the back-end is summed up into accounting ops placed in
+ * front of the next op that does (draws, WFIs, IBs).
+ *
+ * Programs are cached by a hash of the IB contents, so re-executing the
+ * same IB (in the same or in a different bo) skips decode entirely.  On
+ * top of that, the last program seen at a given address is remembered
+ * for as long as the bo's generation is unchanged, which skips hashing
+ * as well.
+ */
+enum emu_opc {
+	EMU_OP_ACCOUNT,          /* a: index into deltas[] */
+	EMU_OP_REGS,             /* n values from data[b] to regs[a..] */
+	EMU_OP_REG_ADD,          /* regs[a] = regs[n] + data[b] */
+	EMU_OP_MEM_WRITE,        /* n dwords from data[b] to ptr */
+	EMU_OP_REG_TO_MEM,       /* n dwords from regs[a] to ptr */
+	EMU_OP_REG_RMW,          /* regs[a] = (regs[a] & data[b]) | data[b+1] */
+	EMU_OP_EVENT_TS,         /* back-end write of data[b] to bo at a */
+	EMU_OP_COND_EXEC,        /* skips n ops if the condition in data[b] fails */
+	EMU_OP_IB,               /* a: iova, n: dwords, flags: pfd */
+	EMU_OP_WFI,
+	EMU_OP_DRAW,             /* flags: visibility mode */
+	EMU_OP_PKT3,             /* not decoded, a: opcode, n dwords in data[b] */
+	EMU_OP_ERROR,            /* a: hdr */
+};
+
+struct emu_op {
+	uint16_t op;
+	uint16_t flags;
+	uint32_t n;
+	uint32_t a;
+	uint32_t b;
+	void *ptr;
+	struct emu_bo *bo;       /* for memory writes */
+};
+
+struct emu_prog {
+	struct emu_prog *next;   /* hash chain */
+	uint64_t hash;
+	uint32_t dwords;
+	uint32_t *src;           /* the IB it was decoded from, to verify hits */
+
+	struct emu_op *ops;
+	uint32_t nr_ops, max_ops;
+	uint32_t *data;
+	uint32_t nr_data, max_data;
+
+	/* fixed costs between ops, with cycles precomputed for: */
+	struct emu_stats *deltas;
+	uint32_t nr_deltas, max_deltas;
+	struct emu_costs costs;
+
+	int interpret;           /* could not be decoded, use the interpreter */
+	uint32_t barrier;        /* ops before this can't be merged into */
+};
+
+/* The GPU address space.  It can be shared by several emulated CPs
+ * (one per pipe, see emudev.h), in which case the bo table is protected
+ * by a rwlock, since bo's can be created while the CPs are running:
+ */
+struct emu_space {
+	struct emu_bo **bos;
+	uint32_t nr_bos, max_bos;
+	uint32_t next_iova, next_handle;
+
+	int refcnt;
+	int shared;
+	pthread_rwlock_t lock;
+};
+
+struct emu {
+	uint32_t *regs;
+
+	struct emu_space *space;
+
+	uint32_t fence;
+
+	struct emu_costs costs;
+	struct emu_stats stats;        /* since emu_new() */
+	struct emu_stats submit_stats; /* for the last submit */
+
+	uint64_t now;            /* front-end cycle count since emu_new() */
+	uint64_t backend_idle;   /* cycle at which back-end goes idle */
+	uint64_t gpu_ns;         /* host time the modelled GPU is busy until */
+
+	/* for tracing, the host time and cycle count the current run of the
+	 * CP started at, and when the running submit's span started:
+	 */
+	uint64_t run_ns, run_cycles;
+	uint64_t span_ns;
+
+	/* visibility stream set by CP_SET_BIN_DATA in the current submit,
+	 * 0 if none:
+	 */
+	uint32_t vis_ptr, vis_end;
+
+	/* draw state groups, and those to run before the next draw: */
+	struct emu_group {
+		uint32_t iova, dwords;
+	} groups[EMU_MAX_GROUPS];
+	uint32_t groups_pending;
+	int in_group;
+
+	/* back-end writes (CACHE_FLUSH_TS) which have not landed yet: */
+	struct emu_pending {
+		uint64_t time;
+		struct emu_bo *bo;
+		uint32_t offset, val;
+	} *pending;
+	uint32_t first_pending, nr_pending, max_pending;
+
+	/* queued cmds, which the CP works through in order.  If it blocks
+	 * on a wait, it carries on from the same point once the condition
+	 * could have changed (see emu_write()):
+	 */
+	struct emu_job {
+		uint32_t iova, dwords;
+		uint32_t fence;          /* non-zero for the last cmd of a submit */
+		uint32_t pipe;
+		int first;               /* the first cmd of a submit */
+	} *jobs;
+	uint32_t first_job, nr_jobs, max_jobs;
+	uint32_t job_fence;          /* of the job on the IB stack */
+	uint32_t job_pipe;
+	uint32_t completed;          /* last completed fence */
+
+	int blocked;
+	struct emu_wait wait;
+	const uint32_t *resume;  /* blocked packet, which was already fetched */
+
+	/* IB stack, stack[0] is the submitted cmd.  Entries are either
+	 * interpreted (ptr/end) or pre-decoded (prog/pc):
+	 */
+	struct emu_ib {
+		const uint32_t *ptr, *end;
+		struct emu_prog *prog;
+		uint32_t pc;
+	} stack[EMU_MAX_IB_DEPTH];
+	uint32_t depth;
+
+	/* decoded IB cache: */
+	int decode;              /* use pre-decoded IBs (default) */
+	struct emu_prog *progs[EMU_PROG_BUCKETS];
+	uint32_t nr_progs;
+	uint64_t prog_mem;
+	uint64_t prog_hits, prog_misses, memo_hits;
+	struct emu_memo {
+		struct emu_bo *bo;
+		uint32_t iova, dwords, gen;
+		struct emu_prog *prog;
+	} memo[EMU_MEMO_SIZE];
+};
+
+struct emu * emu_new(void);
+struct emu * emu_new_shared(struct emu *other);
+void emu_del(struct emu *emu);
+struct emu_bo * emu_bo_new(struct emu *emu, uint32_t size);
+struct emu_bo * emu_bo_lookup(struct emu *emu, uint32_t handle);
+struct emu_bo * emu_iova_bo(struct emu *emu, uint32_t iova, uint32_t size);
+void * emu_iova_ptr(struct emu *emu, uint32_t iova, uint32_t size);
+struct cmdbuf * emu_cmdbuf_new(struct emu *emu, uint32_t size);
+int emu_exec(struct emu *emu, uint32_t iova, uint32_t dwords);
+void emu_flush_progs(struct emu *emu);
+int emu_write(struct emu *emu, uint32_t iova, uint32_t val);
+int emu_wake(struct emu *emu);
+void emu_write_reg(struct emu *emu, uint32_t reg, uint32_t val);
+int emu_submit(struct emu *emu, struct drm_msm_gem_submit *req);
+void emu_attach(struct emu *emu, struct msm_submit *submit);
+void emu_attach_upload(struct emu *emu, struct upload_ring *ring);
+void emu_dump_stats(struct emu *emu, const char *name,
+		const struct emu_stats *stats);
+
+/* must be called after writing to a bo from the CPU, if it has been
+ * executed before (emu_submit() takes care of this for cmds):
+ */
+static inline void emu_bo_dirty(struct emu_bo *bo)
+{
+	/* atomic, since the CPs of several pipes can share a bo: */
+	__atomic_fetch_add(&bo->gen, 1, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t emu_bo_gen(struct emu_bo *bo)
+{
+	return __atomic_load_n(&bo->gen, __ATOMIC_RELAXED);
+}
+
+/* whether the bo has back-end writes queued which haven't landed yet: */
+static inline int emu_bo_pending(struct emu *emu, struct emu_bo *bo)
+{
+	uint32_t i;
+
+	for (i = emu->first_pending; i < emu->nr_pending; i++)
+		if (emu->pending[i].bo == bo)
+			return 1;
+
+	return 0;
+}
+
+static inline int emu_idle(struct emu *emu)
+{
+	return !emu->blocked && (emu->first_job == emu->nr_jobs);
+}
+
+static inline double emu_cycles_to_us(struct emu *emu, uint64_t cycles)
+{
+	if (!emu->costs.clock_mhz)
+		return 0.0;
+	return (double)cycles / emu->costs.clock_mhz;
+}
+
+/* reloc to an emulated bo: */
+static inline void
+EMU_RELOC(struct cmdbuf *cb, struct emu_bo *bo, uint32_t offset, uint32_t or)
+{
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = bo->handle,
+		.flags = MSM_SUBMIT_BO_READ | MSM_SUBMIT_BO_WRITE,
+		.offset = offset,
+		.or = or,
+	});
+}
+
+/* shifted reloc to an emulated bo: */
+static inline void
+EMU_RELOCS(struct cmdbuf *cb, struct emu_bo *bo,
+		uint32_t offset, uint32_t or, int32_t shift)
+{
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = bo->handle,
+		.flags = MSM_SUBMIT_BO_READ | MSM_SUBMIT_BO_WRITE,
+		.offset = offset,
+		.or = or,
+		.shift = shift,
+	});
+}
+
+#endif /* EMU_H_ */
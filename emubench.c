@@ -0,0 +1,229 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+#include "a3xx.xml.h"
+
+/* Measures how fast the emulated CP gets through cmdstream on the host
+ * (packets per second, not estimated GPU time), executing the same
+ * frame over and over as when replaying a capture.  The packet
+ * interpreter is compared against pre-decoded IBs, which should give
+ * identical results (registers, memory and timing model) much faster.
+ */
+
+struct frame {
+	struct emu *emu;
+	struct emu_bo *bo;
+	struct cmdbuf *cb, *state;
+};
+
+static int nr_draws = 1000;
+static int nr_iters = 200;
+
+static void emit_draw(struct cmdbuf *cb, struct emu_bo *bo, uint32_t n)
+{
+	uint32_t i;
+
+	/* per-draw state, as register writes.. */
+	CB_PKT0(cb, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 6);
+	for (i = 0; i < 6; i++)
+		CB_RING(cb, n + i);
+
+	CB_PKT3(cb, CP_SET_CONSTANT, 13);
+	CB_RING(cb, CP_REG(REG_A3XX_RB_MODE_CONTROL));
+	for (i = 0; i < 12; i++)
+		CB_RING(cb, n * i);
+
+	/* ..shader constants, which are not emulated.. */
+	CB_PKT3(cb, CP_SET_CONSTANT, 33);
+	CB_RING(cb, 0x00000000);
+	for (i = 0; i < 32; i++)
+		CB_RING(cb, i);
+
+	/* ..some memory writes, and the draw itself: */
+	CB_PKT3(cb, CP_MEM_WRITE, 5);
+	EMU_RELOC(cb, bo, (n % 256) * 16, 0);
+	for (i = 0; i < 4; i++)
+		CB_RING(cb, n);
+
+	CB_PKT3(cb, CP_DRAW_INDX, 3);
+	CB_RING(cb, 0x00000000);
+	CB_RING(cb, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+			INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+	CB_RING(cb, 3);
+}
+
+static int frame_init(struct frame *f, int decode)
+{
+	struct msm_submit *submit;
+	uint32_t i;
+	int ret;
+
+	f->emu = emu_new();
+	f->emu->decode = decode;
+	f->bo = emu_bo_new(f->emu, 0x2000);
+	f->cb = emu_cmdbuf_new(f->emu, nr_draws * 80 * 4 + 0x1000);
+	f->state = emu_cmdbuf_new(f->emu, 0x1000);
+
+	for (i = 0; i < 64; i++) {
+		CB_PKT0(f->state, REG_AXXX_CP_SCRATCH_REG0 + (i % 8), 1);
+		CB_RING(f->state, i);
+	}
+
+	for (i = 0; i < (uint32_t)nr_draws; i++) {
+		if (!(i % 8))
+			CB_IB(f->cb, f->state, true);
+
+		emit_draw(f->cb, f->bo, i);
+
+		if ((i % 16) == 15) {
+			CB_PKT3(f->cb, CP_EVENT_WRITE, 3);
+			CB_RING(f->cb, CACHE_FLUSH_TS);
+			EMU_RELOC(f->cb, f->bo, 0x1000, 0);
+			CB_RING(f->cb, i);
+			CB_PKT3(f->cb, CP_WAIT_FOR_IDLE, 1);
+			CB_RING(f->cb, 0x00000000);
+		}
+	}
+
+	/* submit once to apply the relocs, after which the frame can be
+	 * re-executed directly:
+	 */
+	submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	emu_attach(f->emu, submit);
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, f->cb);
+	ret = msm_submit_flush(submit);
+	msm_submit_del(submit);
+
+	return ret;
+}
+
+static void frame_fini(struct frame *f)
+{
+	cmdbuf_del(f->cb);
+	cmdbuf_del(f->state);
+	emu_del(f->emu);
+}
+
+/* returns packets per second: */
+static double frame_run(struct frame *f)
+{
+	struct emu_bo *bo = emu_bo_lookup(f->emu, f->cb->handle);
+	uint64_t packets = f->emu->stats.packets;
+	uint64_t t;
+	int i;
+
+	t = gettime_ns();
+	for (i = 0; i < nr_iters; i++) {
+		if (emu_exec(f->emu, bo->iova, cmdbuf_dwords(f->cb))) {
+			printf("exec failed\n");
+			return 0;
+		}
+	}
+	t = gettime_ns() - t;
+
+	packets = f->emu->stats.packets - packets;
+
+	return packets * 1000000000.0 / max(t, 1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct frame interp, fast;
+	double interp_rate, fast_rate;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			nr_draws = strtol(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_iters = strtol(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-d draws] [-n iterations]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (frame_init(&interp, 0) || frame_init(&fast, 1)) {
+		printf("could not set up frame\n");
+		return -1;
+	}
+
+	printf("%d draws, %u dwords per frame, %d iterations\n", nr_draws,
+			cmdbuf_dwords(interp.cb), nr_iters);
+
+	interp_rate = frame_run(&interp);
+	fast_rate = frame_run(&fast);
+
+	printf("interpreter: %8.2f Mpkt/s\n", interp_rate / 1000000.0);
+	printf("decoded:     %8.2f Mpkt/s (%.1fx), %"PRIu64" decoded, "
+			"%"PRIu64" hash hits, %"PRIu64" memo hits\n",
+			fast_rate / 1000000.0, fast_rate / max(interp_rate, 1.0),
+			fast.emu->prog_misses, fast.emu->prog_hits,
+			fast.emu->memo_hits);
+
+	/* both should end up in exactly the same state: */
+	printf("Test 1: timing model matches\n");
+	if (memcmp(&interp.emu->stats, &fast.emu->stats, sizeof(fast.emu->stats)) ||
+			(interp.emu->now != fast.emu->now)) {
+		emu_dump_stats(interp.emu, "interpreter", &interp.emu->stats);
+		emu_dump_stats(fast.emu, "decoded", &fast.emu->stats);
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 2: registers and memory match\n");
+	if (memcmp(interp.emu->regs, fast.emu->regs,
+			EMU_NUM_REGS * sizeof(fast.emu->regs[0])) ||
+			memcmp(interp.bo->map, fast.bo->map, interp.bo->size)) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	frame_fini(&interp);
+	frame_fini(&fast);
+
+	return ret;
+}
@@ -0,0 +1,454 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "emudev.h"
+
+static const struct {
+	uint32_t id;
+	const char *name;
+} pipe_info[EMU_NUM_PIPES] = {
+		{ MSM_PIPE_2D0, "2d0" },
+		{ MSM_PIPE_2D1, "2d1" },
+		{ MSM_PIPE_3D0, "3d0" },
+};
+
+static struct emu_dev_pipe * get_pipe(struct emu_dev *dev, uint32_t id)
+{
+	uint32_t i;
+
+	for (i = 0; i < EMU_NUM_PIPES; i++)
+		if (dev->pipes[i].id == id)
+			return &dev->pipes[i];
+
+	return NULL;
+}
+
+static struct emu_dev_submit * copy_submit(struct drm_msm_gem_submit *req)
+{
+	struct drm_msm_gem_submit_bo *bos = U642VOID(req->bos);
+	struct drm_msm_gem_submit_cmd *cmds = U642VOID(req->cmds);
+	struct emu_dev_submit *s = calloc(1, sizeof(*s));
+	struct drm_msm_gem_submit_bo *nbos;
+	struct drm_msm_gem_submit_cmd *ncmds;
+	uint32_t i;
+
+	nbos = malloc(req->nr_bos * sizeof(bos[0]));
+	memcpy(nbos, bos, req->nr_bos * sizeof(bos[0]));
+
+	ncmds = malloc(req->nr_cmds * sizeof(cmds[0]));
+	memcpy(ncmds, cmds, req->nr_cmds * sizeof(cmds[0]));
+
+	for (i = 0; i < req->nr_cmds; i++) {
+		uint32_t sz = cmds[i].nr_relocs *
+				sizeof(struct drm_msm_gem_submit_reloc);
+		void *relocs = malloc(sz);
+		memcpy(relocs, U642VOID(cmds[i].relocs), sz);
+		ncmds[i].relocs = VOID2U64(relocs);
+	}
+
+	s->req = *req;
+	s->req.bos = VOID2U64(nbos);
+	s->req.cmds = VOID2U64(ncmds);
+
+	return s;
+}
+
+static void free_submit(struct emu_dev_submit *s)
+{
+	struct drm_msm_gem_submit_cmd *cmds = U642VOID(s->req.cmds);
+	uint32_t i;
+
+	for (i = 0; i < s->req.nr_cmds; i++)
+		free(U642VOID(cmds[i].relocs));
+	free(cmds);
+	free(U642VOID(s->req.bos));
+	free(s);
+}
+
+/* wait for the submits on other pipes this one depends on, called with
+ * the lock held:
+ */
+static void wait_deps(struct emu_dev_pipe *p, struct emu_dev_submit *s)
+{
+	struct emu_dev *dev = p->dev;
+	uint64_t t = gettime_ns();
+	int waited = 0;
+	uint32_t i;
+
+	for (i = 0; i < EMU_NUM_PIPES; i++) {
+		struct emu_dev_pipe *q = &dev->pipes[i];
+		uint64_t time;
+
+		if (!s->deps[i])
+			continue;
+
+		while ((q->completed < s->deps[i]) && !dev->stop) {
+			pthread_cond_wait(&dev->cond, &dev->lock);
+			waited = 1;
+		}
+
+		if (q->completed < s->deps[i])
+			continue;
+
+		/* the CP can't start until the other pipe is done: */
+		time = q->fence_time[s->deps[i]];
+		if (time > p->emu->now) {
+			p->sync_cycles += time - p->emu->now;
+			p->emu->now = time;
+		}
+
+		p->emu->gpu_ns = max(p->emu->gpu_ns, q->fence_ns[s->deps[i]]);
+	}
+
+	if (waited) {
+		p->nr_dep_waits++;
+		p->dep_wait_ns += gettime_ns() - t;
+	}
+}
+
+/* whether the CP is blocked, and another pipe has executed something
+ * since it last ran (which could have satisfied the wait):
+ */
+static int woken(struct emu_dev_pipe *p)
+{
+	return !emu_idle(p->emu) && (p->seen != p->dev->progress);
+}
+
+/* once the CP has run, with the lock dropped.  If it is blocked on a
+ * wait, nothing handed to it since the wait has completed, otherwise
+ * everything has:
+ */
+static void ran(struct emu_dev_pipe *p, uint64_t packets, uint64_t t)
+{
+	struct emu_dev *dev = p->dev;
+
+	p->busy_ns += t;
+
+	if (p->emu->stats.packets != packets)
+		dev->progress++;
+
+	if (emu_idle(p->emu)) {
+		while (p->completed < p->submitted) {
+			p->completed++;
+			p->fence_time[p->completed] = p->emu->now;
+			p->fence_ns[p->completed] = p->emu->gpu_ns;
+		}
+	}
+
+	pthread_cond_broadcast(&dev->cond);
+}
+
+static void * pipe_thread(void *arg)
+{
+	struct emu_dev_pipe *p = arg;
+	struct emu_dev *dev = p->dev;
+
+	pthread_mutex_lock(&dev->lock);
+
+	for (;;) {
+		struct emu_dev_submit *s;
+		uint64_t packets, t;
+
+		while (!p->head && !woken(p) && !dev->stop)
+			pthread_cond_wait(&dev->cond, &dev->lock);
+
+		if (dev->stop)
+			break;
+
+		packets = p->emu->stats.packets;
+
+		if (woken(p)) {
+			p->seen = dev->progress;
+			pthread_mutex_unlock(&dev->lock);
+
+			t = gettime_ns();
+			emu_wake(p->emu);
+			t = gettime_ns() - t;
+
+			pthread_mutex_lock(&dev->lock);
+			ran(p, packets, t);
+			continue;
+		}
+
+		s = p->head;
+
+		/* before waiting, so what other pipes execute meanwhile
+		 * still wakes the CP if it is blocked:
+		 */
+		p->seen = dev->progress;
+		wait_deps(p, s);
+
+		pthread_mutex_unlock(&dev->lock);
+
+		t = gettime_ns();
+		emu_submit(p->emu, &s->req);
+		t = gettime_ns() - t;
+
+		pthread_mutex_lock(&dev->lock);
+
+		p->nr_submits++;
+		p->submitted = s->fence;
+
+		p->head = s->next;
+		if (!p->head)
+			p->tail = NULL;
+
+		ran(p, packets, t);
+
+		free_submit(s);
+	}
+
+	pthread_mutex_unlock(&dev->lock);
+
+	return NULL;
+}
+
+struct emu_dev * emu_dev_new(void)
+{
+	struct emu_dev *dev = calloc(1, sizeof(*dev));
+	uint32_t i;
+
+	if (!dev)
+		return NULL;
+
+	dev->emu = emu_new();
+	pthread_mutex_init(&dev->lock, NULL);
+	pthread_cond_init(&dev->cond, NULL);
+
+	/* all the CPs have to exist before any of them start: */
+	for (i = 0; i < EMU_NUM_PIPES; i++) {
+		struct emu_dev_pipe *p = &dev->pipes[i];
+		p->dev = dev;
+		p->idx = i;
+		p->id = pipe_info[i].id;
+		p->emu = emu_new_shared(dev->emu);
+	}
+
+	for (i = 0; i < EMU_NUM_PIPES; i++) {
+		struct emu_dev_pipe *p = &dev->pipes[i];
+		if (pthread_create(&p->thread, NULL, pipe_thread, p)) {
+			ERROR_MSG("could not create thread for pipe %s",
+					pipe_info[i].name);
+			dev->stop = 1;
+			while (i--)
+				pthread_join(dev->pipes[i].thread, NULL);
+			return NULL;
+		}
+	}
+
+	return dev;
+}
+
+void emu_dev_del(struct emu_dev *dev)
+{
+	uint32_t i;
+
+	emu_dev_finish(dev);
+
+	pthread_mutex_lock(&dev->lock);
+	dev->stop = 1;
+	pthread_cond_broadcast(&dev->cond);
+	pthread_mutex_unlock(&dev->lock);
+
+	for (i = 0; i < EMU_NUM_PIPES; i++) {
+		struct emu_dev_pipe *p = &dev->pipes[i];
+		pthread_join(p->thread, NULL);
+		emu_del(p->emu);
+		free(p->fence_time);
+		free(p->fence_ns);
+	}
+
+	emu_del(dev->emu);
+	pthread_cond_destroy(&dev->cond);
+	pthread_mutex_destroy(&dev->lock);
+	free(dev->bos);
+	free(dev);
+}
+
+/* work out what the submit has to wait for, and note its own accesses.
+ * Called with the lock held:
+ */
+static void track_bos(struct emu_dev *dev, struct emu_dev_pipe *p,
+		struct emu_dev_submit *s)
+{
+	struct drm_msm_gem_submit_bo *bos = U642VOID(s->req.bos);
+	uint32_t i, j;
+
+	for (i = 0; i < s->req.nr_bos; i++) {
+		uint32_t handle = bos[i].handle;
+		struct emu_dev_bo *bo;
+
+		if (handle >= dev->nr_bos) {
+			uint32_t nr = max(2 * dev->nr_bos, handle + 1);
+			dev->bos = realloc(dev->bos, nr * sizeof(dev->bos[0]));
+			memset(&dev->bos[dev->nr_bos], 0,
+					(nr - dev->nr_bos) * sizeof(dev->bos[0]));
+			dev->nr_bos = nr;
+		}
+
+		bo = &dev->bos[handle];
+
+		/* read-after-write and write-after-write: */
+		if (bo->write_fence && (bo->write_pipe != p->idx)) {
+			s->deps[bo->write_pipe] = max(s->deps[bo->write_pipe],
+					bo->write_fence);
+		}
+
+		if (bos[i].flags & MSM_SUBMIT_BO_WRITE) {
+			/* write-after-read: */
+			for (j = 0; j < EMU_NUM_PIPES; j++) {
+				if (j == p->idx)
+					continue;
+				s->deps[j] = max(s->deps[j], bo->read_fence[j]);
+			}
+
+			bo->write_pipe = p->idx;
+			bo->write_fence = s->fence;
+		}
+
+		if (bos[i].flags & MSM_SUBMIT_BO_READ)
+			bo->read_fence[p->idx] = s->fence;
+	}
+}
+
+/* Same interface as the DRM_MSM_GEM_SUBMIT ioctl, queues the submit on
+ * the requested pipe and returns without waiting for it:
+ */
+int emu_dev_submit(struct emu_dev *dev, struct drm_msm_gem_submit *req)
+{
+	struct emu_dev_pipe *p = get_pipe(dev, req->pipe);
+	struct emu_dev_submit *s;
+
+	if (!p) {
+		ERROR_MSG("invalid pipe: %u", req->pipe);
+		return -EINVAL;
+	}
+
+	s = copy_submit(req);
+	if (!s)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&dev->lock);
+
+	s->fence = req->fence = ++p->fence;
+
+	if (s->fence >= p->max_fence_time) {
+		p->max_fence_time = max(2 * p->max_fence_time, 64);
+		p->fence_time = realloc(p->fence_time,
+				p->max_fence_time * sizeof(p->fence_time[0]));
+		p->fence_ns = realloc(p->fence_ns,
+				p->max_fence_time * sizeof(p->fence_ns[0]));
+	}
+	p->fence_time[s->fence] = ~0ull;
+	p->fence_ns[s->fence] = 0;
+
+	track_bos(dev, p, s);
+
+	if (p->tail)
+		p->tail->next = s;
+	else
+		p->head = s;
+	p->tail = s;
+
+	pthread_cond_broadcast(&dev->cond);
+	pthread_mutex_unlock(&dev->lock);
+
+	return 0;
+}
+
+void emu_dev_wait(struct emu_dev *dev, uint32_t pipe, uint32_t fence)
+{
+	struct emu_dev_pipe *p = get_pipe(dev, pipe);
+
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&dev->lock);
+	while (p->completed < fence)
+		pthread_cond_wait(&dev->cond, &dev->lock);
+	pthread_mutex_unlock(&dev->lock);
+}
+
+/* wait until every pipe has worked through its queue: */
+void emu_dev_finish(struct emu_dev *dev)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&dev->lock);
+	for (i = 0; i < EMU_NUM_PIPES; i++)
+		while (dev->pipes[i].head)
+			pthread_cond_wait(&dev->cond, &dev->lock);
+	pthread_mutex_unlock(&dev->lock);
+}
+
+static int dev_flush(void *priv, struct drm_msm_gem_submit *req)
+{
+	return emu_dev_submit(priv, req);
+}
+
+/* send a submit builder's flushes to the emulated device, to the pipe
+ * it was created for:
+ */
+void emu_dev_attach(struct emu_dev *dev, struct msm_submit *submit)
+{
+	submit->flush = dev_flush;
+	submit->priv = dev;
+}
+
+void emu_dev_dump_stats(struct emu_dev *dev)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&dev->lock);
+
+	for (i = 0; i < EMU_NUM_PIPES; i++) {
+		struct emu_dev_pipe *p = &dev->pipes[i];
+		struct emu *emu = p->emu;
+
+		if (!p->nr_submits)
+			continue;
+
+		printf("%s: %"PRIu64" submits, fence %u/%u, %.3fus busy of %.3fus, "
+				"%.3fus waiting on other pipes\n", pipe_info[i].name,
+				p->nr_submits, p->completed, p->fence,
+				emu_cycles_to_us(emu, emu->stats.cycles),
+				emu_cycles_to_us(emu, emu->now),
+				emu_cycles_to_us(emu, p->sync_cycles));
+		printf("  host: %.3fms executing, %"PRIu64" waits for other "
+				"pipes, %.3fms waiting\n", p->busy_ns / 1000000.0,
+				p->nr_dep_waits, p->dep_wait_ns / 1000000.0);
+	}
+
+	pthread_mutex_unlock(&dev->lock);
+}
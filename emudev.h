@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef EMUDEV_H_
+#define EMUDEV_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "emu.h"
+
+/*
+ * Emulated multi-pipe GPU: one emulated CP per pipe (2D0, 2D1 and 3D0),
+ * sharing one address space, each working through its own queue of
+ * submits on its own thread, with its own fence timeline.
+ *
+ * Submits are synchronized across pipes the way the kernel does it, by
+ * the bo's READ/WRITE flags: a submit waits for the last write to any
+ * bo it uses, and a write also waits for reads still in flight on the
+ * other pipes.  Within a pipe, submits execute in order.  A cross-pipe
+ * wait also moves the waiting CP's clock forward to when the other pipe
+ * finished, so the timing model reflects the serialization too.
+ *
+ * A CP blocked on a wait (CP_WAIT_REG_MEM, etc) re-checks it whenever
+ * another pipe has executed something, since that could have written
+ * what it is waiting on.
+ */
+
+#define EMU_NUM_PIPES 3
+
+/* last access to a bo by any pipe, indexed by handle: */
+struct emu_dev_bo {
+	uint32_t write_pipe;     /* pipe index of the last write */
+	uint32_t write_fence;
+	uint32_t read_fence[EMU_NUM_PIPES];
+};
+
+/* a queued submit, copied since the caller's tables are reused: */
+struct emu_dev_submit {
+	struct emu_dev_submit *next;
+	struct drm_msm_gem_submit req;
+	uint32_t fence;
+	uint32_t deps[EMU_NUM_PIPES];    /* fence to wait for, per pipe */
+};
+
+struct emu_dev_pipe {
+	struct emu_dev *dev;
+	uint32_t idx;
+	uint32_t id;             /* MSM_PIPE_x */
+	struct emu *emu;
+	pthread_t thread;
+
+	struct emu_dev_submit *head, *tail;
+
+	uint32_t fence;          /* last queued */
+	uint32_t submitted;      /* last handed to the CP */
+	uint32_t completed;      /* last completed */
+	uint32_t seen;           /* dev->progress when the CP last ran */
+	uint64_t *fence_time;    /* CP cycle count at which each fence completed */
+	uint64_t *fence_ns;      /* .. and the modelled host time, for tracing */
+	uint32_t max_fence_time;
+
+	/* stats: */
+	uint64_t nr_submits;
+	uint64_t nr_dep_waits;   /* submits which had to wait on another pipe */
+	uint64_t dep_wait_ns;    /* .. host time spent waiting */
+	uint64_t sync_cycles;    /* .. CP cycles spent waiting */
+	uint64_t busy_ns;        /* host time spent executing */
+};
+
+struct emu_dev {
+	/* owns the address space, for creating and accessing bo's: */
+	struct emu *emu;
+
+	struct emu_dev_pipe pipes[EMU_NUM_PIPES];
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;     /* signalled on new submits and completion */
+	int stop;
+
+	/* bumped whenever a CP executes anything: */
+	uint32_t progress;
+
+	struct emu_dev_bo *bos;
+	uint32_t nr_bos;
+};
+
+struct emu_dev * emu_dev_new(void);
+void emu_dev_del(struct emu_dev *dev);
+int emu_dev_submit(struct emu_dev *dev, struct drm_msm_gem_submit *req);
+void emu_dev_wait(struct emu_dev *dev, uint32_t pipe, uint32_t fence);
+void emu_dev_finish(struct emu_dev *dev);
+void emu_dev_attach(struct emu_dev *dev, struct msm_submit *submit);
+void emu_dev_dump_stats(struct emu_dev *dev);
+
+#endif /* EMUDEV_H_ */
@@ -0,0 +1,535 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include "gmem.h"
+
+static const struct {
+	enum a3xx_color_fmt fmt;
+	const char *name;
+	uint32_t cpp;
+} formats[] = {
+	{ RB_R8G8B8_UNORM,       "rgb8",    3 },
+	{ RB_R8G8B8A8_UNORM,     "rgba8",   4 },
+	{ RB_Z16_UNORM,          "z16",     2 },
+	{ RB_A8_UNORM,           "a8",      1 },
+	{ RB_R16G16B16A16_FLOAT, "rgba16f", 8 },
+	{ RB_R32G32B32A32_FLOAT, "rgba32f", 16 },
+};
+
+const char * gmem_fmt_name(enum a3xx_color_fmt fmt)
+{
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++)
+		if (formats[i].fmt == fmt)
+			return formats[i].name;
+	return "unknown";
+}
+
+uint32_t gmem_fmt_cpp(enum a3xx_color_fmt fmt)
+{
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++)
+		if (formats[i].fmt == fmt)
+			return formats[i].cpp;
+	return 4;
+}
+
+int gmem_parse_fmt(const char *name, enum a3xx_color_fmt *fmt)
+{
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++) {
+		if (!strcmp(formats[i].name, name)) {
+			*fmt = formats[i].fmt;
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+int gmem_query_size(int fd, uint32_t *size)
+{
+	struct drm_msm_param req = {
+			.pipe = MSM_PIPE_3D0,
+			.param = MSM_PARAM_GMEM_SIZE,
+	};
+	int ret;
+
+	ret = drmCommandWriteRead(fd, DRM_MSM_GET_PARAM, &req, sizeof(req));
+	if (ret) {
+		ERROR_MSG("get param failed: %d (%s)", ret, strerror(errno));
+		return -errno;
+	}
+
+	*size = req.value;
+
+	return 0;
+}
+
+/* assign each rt its place in GMEM, returns the GMEM used per bin: */
+static uint32_t gmem_fit(struct gmem_layout *l, const struct gmem_config *cfg,
+		uint32_t bin_w, uint32_t bin_h)
+{
+	uint32_t i, off = 0, end = 0;
+
+	for (i = 0; i < cfg->nr_rts; i++) {
+		off = ALIGN(end, GMEM_BASE_ALIGN);
+		l->base[i] = off;
+		end = off + bin_w * bin_h * gmem_fmt_cpp(cfg->rts[i].fmt) *
+				gmem_samples(cfg->samples);
+	}
+
+	return end;
+}
+
+/* group the bins into blocks for the VSC pipes, with the pipes as close
+ * to square as the pipe count allows:
+ */
+static void gmem_assign_pipes(struct gmem_layout *l)
+{
+	uint32_t tpp_x = 1, tpp_y = 1, x, y;
+
+	while (((l->nbins_y + tpp_y - 1) / tpp_y) > GMEM_MAX_PIPES)
+		tpp_y++;
+	while ((((l->nbins_y + tpp_y - 1) / tpp_y) *
+			((l->nbins_x + tpp_x - 1) / tpp_x)) > GMEM_MAX_PIPES)
+		tpp_x++;
+
+	/* PC_VSTREAM_CONTROL.N, and VSC_PIPE_CONFIG.W/H: */
+	l->nr_pipes = 0;
+	if (((tpp_x * tpp_y) > 32) || (tpp_x > 15) || (tpp_y > 15))
+		return;
+
+	for (y = 0; y < l->nbins_y; y += tpp_y) {
+		for (x = 0; x < l->nbins_x; x += tpp_x) {
+			struct gmem_pipe *pipe = &l->pipes[l->nr_pipes++];
+			pipe->x = x;
+			pipe->y = y;
+			pipe->w = min(tpp_x, l->nbins_x - x);
+			pipe->h = min(tpp_y, l->nbins_y - y);
+		}
+	}
+}
+
+/* layout with the given bin size: */
+int gmem_layout(struct gmem_layout *l, const struct gmem_config *cfg,
+		uint32_t gmem_size, uint32_t bin_w, uint32_t bin_h)
+{
+	uint32_t i, n;
+
+	if (!cfg->width || !cfg->height || !cfg->nr_rts ||
+			(cfg->nr_rts > GMEM_MAX_RTS))
+		return -EINVAL;
+
+	if (!bin_w || !bin_h || (bin_w % GMEM_BIN_ALIGN) ||
+			(bin_h % GMEM_BIN_ALIGN) ||
+			(bin_w > GMEM_MAX_BIN_W) || (bin_h > GMEM_MAX_BIN_H))
+		return -EINVAL;
+
+	memset(l, 0, sizeof(*l));
+
+	l->gmem_size = gmem_size;
+	l->bin_w = bin_w;
+	l->bin_h = bin_h;
+	l->nbins_x = (cfg->width + bin_w - 1) / bin_w;
+	l->nbins_y = (cfg->height + bin_h - 1) / bin_h;
+	l->nr_bins = l->nbins_x * l->nbins_y;
+	l->used = gmem_fit(l, cfg, bin_w, bin_h);
+
+	if (l->used > gmem_size)
+		return -ENOSPC;
+
+	gmem_assign_pipes(l);
+
+	/* each line of a tile is written (and read, to restore) in
+	 * GMEM_BURST sized pieces, so a tile edge which does not land on a
+	 * burst boundary costs a partial burst:
+	 */
+	for (n = 0; n < l->nr_bins; n++) {
+		struct gmem_tile t;
+
+		gmem_tile(l, cfg, n, &t);
+
+		for (i = 0; i < cfg->nr_rts; i++) {
+			uint32_t cpp = gmem_fmt_cpp(cfg->rts[i].fmt);
+			uint32_t start = (t.x * cpp) & ~(GMEM_BURST - 1);
+			uint32_t end = ALIGN((t.x + t.w) * cpp, GMEM_BURST);
+
+			l->resolve_bytes += (uint64_t)(end - start) * t.h;
+			l->gmem_bytes += (uint64_t)t.w * t.h * cpp *
+					gmem_samples(cfg->samples);
+		}
+	}
+
+	if (cfg->restore)
+		l->restore_bytes = l->resolve_bytes;
+
+	l->waste = (uint64_t)l->nr_bins * bin_w * bin_h -
+			(uint64_t)cfg->width * cfg->height;
+
+	return 0;
+}
+
+/* best layout with nbins_x columns, using the tallest bins that fit
+ * and then evening out the rows:
+ */
+int gmem_layout_cols(struct gmem_layout *l, const struct gmem_config *cfg,
+		uint32_t gmem_size, uint32_t nbins_x)
+{
+	uint32_t bin_w, bin_h, nbins_y;
+
+	if (!nbins_x || !cfg->width || !cfg->height)
+		return -EINVAL;
+
+	bin_w = ALIGN((cfg->width + nbins_x - 1) / nbins_x, GMEM_BIN_ALIGN);
+
+	/* some other column count gives the same bins: */
+	if ((cfg->width + bin_w - 1) / bin_w != nbins_x)
+		return -EINVAL;
+
+	if (bin_w > GMEM_MAX_BIN_W)
+		return -ENOSPC;
+
+	bin_h = min(GMEM_MAX_BIN_H, ALIGN(cfg->height, GMEM_BIN_ALIGN));
+	while (gmem_fit(l, cfg, bin_w, bin_h) > gmem_size) {
+		if (bin_h == GMEM_BIN_ALIGN)
+			return -ENOSPC;
+		bin_h -= GMEM_BIN_ALIGN;
+	}
+
+	nbins_y = (cfg->height + bin_h - 1) / bin_h;
+	bin_h = ALIGN((cfg->height + nbins_y - 1) / nbins_y, GMEM_BIN_ALIGN);
+
+	return gmem_layout(l, cfg, gmem_size, bin_w, bin_h);
+}
+
+/* fewest bins first, then the least memory traffic, then the least
+ * GMEM spent past the edges, then the widest bins (longer runs for
+ * each resolve):
+ */
+bool gmem_better(const struct gmem_layout *a, const struct gmem_layout *b)
+{
+	uint64_t abytes = a->resolve_bytes + a->restore_bytes;
+	uint64_t bbytes = b->resolve_bytes + b->restore_bytes;
+
+	if (a->nr_bins != b->nr_bins)
+		return a->nr_bins < b->nr_bins;
+	if (abytes != bbytes)
+		return abytes < bbytes;
+	if (a->waste != b->waste)
+		return a->waste < b->waste;
+	return a->bin_w > b->bin_w;
+}
+
+int gmem_plan(struct gmem_layout *l, const struct gmem_config *cfg,
+		uint32_t gmem_size)
+{
+	struct gmem_layout cand;
+	uint32_t nbins_x, max_x;
+	int ret = -ENOSPC;
+
+	max_x = (cfg->width + GMEM_BIN_ALIGN - 1) / GMEM_BIN_ALIGN;
+
+	for (nbins_x = 1; nbins_x <= max_x; nbins_x++) {
+		if (gmem_layout_cols(&cand, cfg, gmem_size, nbins_x))
+			continue;
+		if (ret || gmem_better(&cand, l)) {
+			*l = cand;
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+/* a (shifted) address, relative to a bo if there is a handle: */
+static void gmem_addr(struct cmdbuf *cb, uint32_t handle, uint32_t offset,
+		uint32_t flags, int32_t shift)
+{
+	if (handle) {
+		cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+			.handle = handle,
+			.flags = flags,
+			.offset = offset,
+			.shift = shift,
+		});
+	} else if (shift < 0) {
+		CB_RING(cb, offset >> -shift);
+	} else {
+		CB_RING(cb, offset << shift);
+	}
+}
+
+/* per-pass state, GMEM placement of the rt's: */
+void gmem_emit_setup(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg)
+{
+	uint32_t i;
+
+	CB_PKT0(cb, REG_A3XX_RB_FRAME_BUFFER_DIMENSION, 1);
+	CB_RING(cb, A3XX_RB_FRAME_BUFFER_DIMENSION_WIDTH(cfg->width) |
+			A3XX_RB_FRAME_BUFFER_DIMENSION_HEIGHT(cfg->height));
+
+	CB_PKT0(cb, REG_A3XX_RB_MSAA_CONTROL, 1);
+	CB_RING(cb, A3XX_RB_MSAA_CONTROL_SAMPLES(cfg->samples) |
+			A3XX_RB_MSAA_CONTROL_SAMPLE_MASK(0xffff) |
+			COND(cfg->samples == MSAA_ONE, A3XX_RB_MSAA_CONTROL_DISABLE));
+
+	for (i = 0; i < cfg->nr_rts; i++) {
+		uint32_t cpp = gmem_fmt_cpp(cfg->rts[i].fmt);
+
+		CB_PKT0(cb, REG_A3XX_RB_MRT_BUF_INFO(i), 2);
+		CB_RING(cb, A3XX_RB_MRT_BUF_INFO_COLOR_FORMAT(cfg->rts[i].fmt) |
+				A3XX_RB_MRT_BUF_INFO_COLOR_TILE_MODE(TILE_32X32) |
+				A3XX_RB_MRT_BUF_INFO_COLOR_SWAP(WZYX) |
+				A3XX_RB_MRT_BUF_INFO_COLOR_BUF_PITCH(l->bin_w * cpp));
+		CB_RING(cb, A3XX_RB_MRT_BUF_BASE_COLOR_BUF_BASE(l->base[i]));
+	}
+}
+
+/* start of bin n, up to where its draws go: */
+void gmem_emit_prologue(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, uint32_t n)
+{
+	struct gmem_tile t;
+	uint32_t x2, y2;
+
+	gmem_tile(l, cfg, n, &t);
+	x2 = t.x + t.w - 1;
+	y2 = t.y + t.h - 1;
+
+	CB_PKT3(cb, CP_SET_BIN, 3);
+	CB_RING(cb, 0x00000000);
+	CB_RING(cb, CP_SET_BIN_1_X1(t.x) | CP_SET_BIN_1_Y1(t.y));
+	CB_RING(cb, CP_SET_BIN_2_X2(x2) | CP_SET_BIN_2_Y2(y2));
+
+	if (gmem_binning(l, cfg)) {
+		uint32_t bit, p = gmem_bin_pipe(l, n, &bit);
+		const struct gmem_pipe *pipe = &l->pipes[p];
+
+		CB_PKT3(cb, CP_SET_BIN_DATA, 2);
+		gmem_addr(cb, cfg->vsc_handle, cfg->vsc_offset + GMEM_VSC_DATA +
+				p * cfg->vsc_pipe_size, MSM_SUBMIT_BO_READ, 0);
+		gmem_addr(cb, cfg->vsc_handle, cfg->vsc_offset + p * 4,
+				MSM_SUBMIT_BO_READ, 0);
+
+		CB_PKT0(cb, REG_A3XX_PC_VSTREAM_CONTROL, 1);
+		CB_RING(cb, A3XX_PC_VSTREAM_CONTROL_SIZE(pipe->w * pipe->h) |
+				A3XX_PC_VSTREAM_CONTROL_N(bit));
+	}
+
+	CB_PKT0(cb, REG_A3XX_GRAS_SC_WINDOW_SCISSOR_TL, 2);
+	CB_RING(cb, A3XX_GRAS_SC_WINDOW_SCISSOR_TL_X(t.x) |
+			A3XX_GRAS_SC_WINDOW_SCISSOR_TL_Y(t.y));
+	CB_RING(cb, A3XX_GRAS_SC_WINDOW_SCISSOR_BR_X(x2) |
+			A3XX_GRAS_SC_WINDOW_SCISSOR_BR_Y(y2));
+
+	CB_PKT0(cb, REG_A3XX_RB_WINDOW_OFFSET, 1);
+	CB_RING(cb, A3XX_RB_WINDOW_OFFSET_X(t.x) | A3XX_RB_WINDOW_OFFSET_Y(t.y));
+
+	CB_PKT0(cb, REG_A3XX_RB_MODE_CONTROL, 2);
+	CB_RING(cb, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
+			A3XX_RB_MODE_CONTROL_MARB_CACHE_SPLIT_MODE);
+	CB_RING(cb, A3XX_RB_RENDER_CONTROL_BIN_WIDTH(l->bin_w) |
+			A3XX_RB_RENDER_CONTROL_ENABLE_GMEM);
+}
+
+/*
+ * Copy each rt of bin n out to memory.  The resolve is a RECTLIST draw in
+ * RB_RESOLVE_PASS mode, so the blit program and vertex state for it are
+ * expected to be part of the draws' state.
+ */
+void gmem_emit_resolve(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, uint32_t n)
+{
+	struct gmem_tile t;
+	uint32_t i;
+
+	gmem_tile(l, cfg, n, &t);
+
+	CB_PKT0(cb, REG_A3XX_RB_MODE_CONTROL, 2);
+	CB_RING(cb, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_RESOLVE_PASS) |
+			A3XX_RB_MODE_CONTROL_MARB_CACHE_SPLIT_MODE);
+	CB_RING(cb, A3XX_RB_RENDER_CONTROL_BIN_WIDTH(l->bin_w) |
+			A3XX_RB_RENDER_CONTROL_DISABLE_COLOR_PIPE);
+
+	for (i = 0; i < cfg->nr_rts; i++) {
+		const struct gmem_rt *rt = &cfg->rts[i];
+		uint32_t pitch = gmem_rt_pitch(cfg, i);
+		uint32_t off = rt->offset + (t.y * pitch) +
+				(t.x * gmem_fmt_cpp(rt->fmt));
+
+		CB_PKT0(cb, REG_A3XX_RB_COPY_CONTROL, 4);
+		CB_RING(cb, A3XX_RB_COPY_CONTROL_MSAA_RESOLVE(cfg->samples) |
+				A3XX_RB_COPY_CONTROL_MODE(RB_COPY_RESOLVE) |
+				A3XX_RB_COPY_CONTROL_GMEM_BASE(l->base[i]));
+		gmem_addr(cb, rt->handle, off, MSM_SUBMIT_BO_WRITE, -1);
+		CB_RING(cb, A3XX_RB_COPY_DEST_PITCH_PITCH(pitch));
+		CB_RING(cb, A3XX_RB_COPY_DEST_INFO_TILE(LINEAR) |
+				A3XX_RB_COPY_DEST_INFO_FORMAT(rt->fmt) |
+				A3XX_RB_COPY_DEST_INFO_SWAP(WZYX) |
+				A3XX_RB_COPY_DEST_INFO_COMPONENT_ENABLE(0xf) |
+				A3XX_RB_COPY_DEST_INFO_ENDIAN(ENDIAN_NONE));
+
+		CB_PKT3(cb, CP_DRAW_INDX, 3);
+		CB_RING(cb, 0x00000000);
+		CB_RING(cb, DRAW(DI_PT_RECTLIST, DI_SRC_SEL_AUTO_INDEX,
+				INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+		CB_RING(cb, 2);
+	}
+}
+
+/* render and resolve bin n, with the draws (if any) called as an IB: */
+void gmem_emit_tile(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, uint32_t n, struct cmdbuf *draws)
+{
+	gmem_emit_prologue(cb, l, cfg, n);
+	if (draws)
+		CB_IB(cb, draws, true);
+	gmem_emit_resolve(cb, l, cfg, n);
+}
+
+/*
+ * Binning pass: run the draws once over the whole surface with binning
+ * enabled, to fill in each pipe's visibility stream.  The streams are
+ * complete by the time the CP gets to the bins.
+ */
+void gmem_emit_binning(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, struct cmdbuf *draws)
+{
+	uint32_t p;
+
+	/* the streams start out empty: */
+	CB_PKT3(cb, CP_MEM_WRITE, 1 + GMEM_MAX_PIPES);
+	gmem_addr(cb, cfg->vsc_handle, cfg->vsc_offset, MSM_SUBMIT_BO_WRITE, 0);
+	for (p = 0; p < GMEM_MAX_PIPES; p++)
+		CB_RING(cb, 0x00000000);
+
+	CB_PKT0(cb, REG_A3XX_VSC_BIN_SIZE, 2);
+	CB_RING(cb, A3XX_VSC_BIN_SIZE_WIDTH(l->bin_w) |
+			A3XX_VSC_BIN_SIZE_HEIGHT(l->bin_h));
+	gmem_addr(cb, cfg->vsc_handle, cfg->vsc_offset, MSM_SUBMIT_BO_WRITE, 0);
+
+	for (p = 0; p < GMEM_MAX_PIPES; p++) {
+		const struct gmem_pipe *pipe = &l->pipes[p];
+
+		CB_PKT0(cb, REG_A3XX_VSC_PIPE_CONFIG(p), 3);
+		if (p < l->nr_pipes) {
+			CB_RING(cb, A3XX_VSC_PIPE_CONFIG_X(pipe->x) |
+					A3XX_VSC_PIPE_CONFIG_Y(pipe->y) |
+					A3XX_VSC_PIPE_CONFIG_W(pipe->w) |
+					A3XX_VSC_PIPE_CONFIG_H(pipe->h));
+			gmem_addr(cb, cfg->vsc_handle, cfg->vsc_offset +
+					GMEM_VSC_DATA + p * cfg->vsc_pipe_size,
+					MSM_SUBMIT_BO_WRITE, 0);
+			CB_RING(cb, cfg->vsc_pipe_size);
+		} else {
+			CB_RING(cb, 0x00000000);
+			CB_RING(cb, 0x00000000);
+			CB_RING(cb, 0x00000000);
+		}
+	}
+
+	CB_PKT0(cb, REG_A3XX_GRAS_SC_WINDOW_SCISSOR_TL, 2);
+	CB_RING(cb, A3XX_GRAS_SC_WINDOW_SCISSOR_TL_X(0) |
+			A3XX_GRAS_SC_WINDOW_SCISSOR_TL_Y(0));
+	CB_RING(cb, A3XX_GRAS_SC_WINDOW_SCISSOR_BR_X(cfg->width - 1) |
+			A3XX_GRAS_SC_WINDOW_SCISSOR_BR_Y(cfg->height - 1));
+
+	CB_PKT0(cb, REG_A3XX_RB_WINDOW_OFFSET, 1);
+	CB_RING(cb, A3XX_RB_WINDOW_OFFSET_X(0) | A3XX_RB_WINDOW_OFFSET_Y(0));
+
+	CB_PKT0(cb, REG_A3XX_RB_MODE_CONTROL, 1);
+	CB_RING(cb, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_TILING_PASS) |
+			A3XX_RB_MODE_CONTROL_MARB_CACHE_SPLIT_MODE);
+
+	CB_PKT0(cb, REG_A3XX_VSC_BIN_CONTROL, 1);
+	CB_RING(cb, A3XX_VSC_BIN_CONTROL_BINNING_ENABLE);
+
+	CB_IB(cb, draws, true);
+
+	CB_PKT0(cb, REG_A3XX_VSC_BIN_CONTROL, 1);
+	CB_RING(cb, 0x00000000);
+
+	CB_PKT3(cb, CP_WAIT_FOR_IDLE, 1);
+	CB_RING(cb, 0x00000000);
+}
+
+struct gmem_pass * gmem_pass_new(const struct gmem_config *cfg,
+		const struct gmem_layout *l, struct cmdbuf *draws,
+		struct cmdbuf *bins)
+{
+	struct gmem_pass *pass = calloc(1, sizeof(*pass));
+
+	if (!pass)
+		return NULL;
+
+	pass->cfg = *cfg;
+	pass->layout = *l;
+	pass->draws = draws;
+	pass->bins = bins;
+
+	return pass;
+}
+
+void gmem_pass_del(struct gmem_pass *pass)
+{
+	free(pass);
+}
+
+/* returns the cmdbuf to record the pass's draws into: */
+struct cmdbuf * gmem_pass_begin(struct gmem_pass *pass)
+{
+	/* the draws of a pass are a segment of their own: */
+	if (cmdbuf_dwords(pass->draws) && !cmdbuf_segment(pass->draws, 0))
+		cmdbuf_reset(pass->draws);
+
+	return pass->draws;
+}
+
+void gmem_pass_end(struct gmem_pass *pass)
+{
+	uint32_t n;
+
+	gmem_emit_setup(pass->bins, &pass->layout, &pass->cfg);
+	if (gmem_binning(&pass->layout, &pass->cfg))
+		gmem_emit_binning(pass->bins, &pass->layout, &pass->cfg,
+				pass->draws);
+	for (n = 0; n < pass->layout.nr_bins; n++)
+		gmem_emit_tile(pass->bins, &pass->layout, &pass->cfg, n,
+				pass->draws);
+}
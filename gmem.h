@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef GMEM_H_
+#define GMEM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cmdbuf.h"
+
+/*
+ * Bin (tile) layout planning for GMEM rendering.  The render targets of a
+ * pass have to fit, for one bin at a time, in GMEM (the size of which the
+ * kernel reports as MSM_PARAM_GMEM_SIZE), and each bin costs a replay of
+ * the draws plus a resolve (RB_COPY) of every render target back to
+ * memory.  The planner picks the bin size which gives the fewest bins,
+ * and among layouts with the same number of bins, the one which moves
+ * the fewest bytes.
+ *
+ * Bin position and size are in units of GMEM_BIN_ALIGN pixels, and are
+ * limited to what VSC_BIN_SIZE can describe so the same layout can be
+ * used for the binning pass.  Each render target starts on a
+ * GMEM_BASE_ALIGN boundary within GMEM (RB_COPY_CONTROL.GMEM_BASE).
+ *
+ * For the binning pass, the bins are grouped into (at most
+ * GMEM_MAX_PIPES) blocks of up to 32 bins, one per VSC pipe, and each
+ * pipe gets a visibility stream in the VSC bo: the stream sizes first,
+ * then a stream of vsc_pipe_size bytes per pipe.
+ */
+
+#define GMEM_MAX_RTS     4
+#define GMEM_MAX_PIPES   8
+#define GMEM_BIN_ALIGN   32
+#define GMEM_MAX_BIN_W   992
+#define GMEM_MAX_BIN_H   992
+#define GMEM_BASE_ALIGN  0x4000
+
+/* granularity of memory writes, for the bandwidth estimate: */
+#define GMEM_BURST       32
+
+struct gmem_rt {
+	enum a3xx_color_fmt fmt;
+	uint32_t handle;         /* GEM handle of resolve target, or 0 */
+	uint32_t offset;         /* .. or its gpu address, if no handle */
+	uint32_t pitch;          /* in bytes, 0 for width * cpp */
+};
+
+struct gmem_config {
+	uint32_t width, height;
+	struct gmem_rt rts[GMEM_MAX_RTS];
+	uint32_t nr_rts;
+	enum a3xx_msaa_samples samples;
+	bool restore;            /* contents are loaded rather than cleared */
+
+	/* skip draws which are not visible in a bin, if non-zero: */
+	uint32_t vsc_handle;     /* GEM handle of the VSC bo, or 0 */
+	uint32_t vsc_offset;     /* .. or its gpu address, if no handle */
+	uint32_t vsc_pipe_size;  /* bytes of stream per pipe */
+};
+
+/* a block of bins sharing a visibility stream: */
+struct gmem_pipe {
+	uint32_t x, y, w, h;     /* in bins */
+};
+
+struct gmem_layout {
+	uint32_t gmem_size;
+	uint32_t bin_w, bin_h;
+	uint32_t nbins_x, nbins_y;
+	uint32_t nr_bins;
+	uint32_t base[GMEM_MAX_RTS];   /* offset of each rt within GMEM */
+	uint32_t used;                 /* bytes of GMEM used per bin */
+
+	/* estimated memory traffic per pass, in bytes: */
+	uint64_t resolve_bytes;  /* written by RB_COPY */
+	uint64_t restore_bytes;  /* read back into GMEM, if cfg->restore */
+	uint64_t gmem_bytes;     /* GMEM read by the resolves (all samples) */
+	uint64_t waste;          /* pixels in bins past the edge of the surface */
+
+	/* no pipes if there are too many bins for binning: */
+	struct gmem_pipe pipes[GMEM_MAX_PIPES];
+	uint32_t nr_pipes;
+};
+
+struct gmem_tile {
+	uint32_t x, y, w, h;     /* clipped to the surface */
+};
+
+/*
+ * A binned render pass: the draws are recorded once, into a cmdbuf which
+ * every bin calls as an IB (so the CPU cost of the draws does not scale
+ * with the number of bins, and the kernel sees the draws once, as an
+ * IB_TARGET_BUF cmd), and per bin only a small prologue (CP_SET_BIN,
+ * scissor, window offset) and the resolves are emitted.
+ *
+ * With a VSC bo in the config (and few enough bins), the draws are run
+ * through a binning pass first, and each bin only renders the draws
+ * which touch it.  The draws have to be emitted with the visibility
+ * mode gmem_pass_vis() returns for this.
+ *
+ * Usage:
+ *
+ *     draws = gmem_pass_begin(pass);
+ *     ... emit draws with CB_x() ...
+ *     gmem_pass_end(pass);
+ *     msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, pass->bins);
+ */
+struct gmem_pass {
+	struct gmem_config cfg;
+	struct gmem_layout layout;
+	struct cmdbuf *draws;    /* called from every bin */
+	struct cmdbuf *bins;
+};
+
+const char * gmem_fmt_name(enum a3xx_color_fmt fmt);
+uint32_t gmem_fmt_cpp(enum a3xx_color_fmt fmt);
+int gmem_parse_fmt(const char *name, enum a3xx_color_fmt *fmt);
+int gmem_query_size(int fd, uint32_t *size);
+int gmem_layout(struct gmem_layout *l, const struct gmem_config *cfg,
+		uint32_t gmem_size, uint32_t bin_w, uint32_t bin_h);
+int gmem_layout_cols(struct gmem_layout *l, const struct gmem_config *cfg,
+		uint32_t gmem_size, uint32_t nbins_x);
+bool gmem_better(const struct gmem_layout *a, const struct gmem_layout *b);
+int gmem_plan(struct gmem_layout *l, const struct gmem_config *cfg,
+		uint32_t gmem_size);
+void gmem_emit_setup(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg);
+void gmem_emit_prologue(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, uint32_t n);
+void gmem_emit_resolve(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, uint32_t n);
+void gmem_emit_tile(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, uint32_t n, struct cmdbuf *draws);
+void gmem_emit_binning(struct cmdbuf *cb, const struct gmem_layout *l,
+		const struct gmem_config *cfg, struct cmdbuf *draws);
+
+struct gmem_pass * gmem_pass_new(const struct gmem_config *cfg,
+		const struct gmem_layout *l, struct cmdbuf *draws,
+		struct cmdbuf *bins);
+void gmem_pass_del(struct gmem_pass *pass);
+struct cmdbuf * gmem_pass_begin(struct gmem_pass *pass);
+void gmem_pass_end(struct gmem_pass *pass);
+
+/* the visibility streams start past the sizes: */
+#define GMEM_VSC_DATA    (GMEM_MAX_PIPES * 4)
+
+static inline uint32_t gmem_vsc_size(const struct gmem_config *cfg)
+{
+	return GMEM_VSC_DATA + GMEM_MAX_PIPES * cfg->vsc_pipe_size;
+}
+
+static inline bool gmem_binning(const struct gmem_layout *l,
+		const struct gmem_config *cfg)
+{
+	return cfg->vsc_pipe_size && l->nr_pipes;
+}
+
+static inline uint32_t gmem_samples(enum a3xx_msaa_samples samples)
+{
+	return 1 << samples;
+}
+
+static inline uint32_t gmem_rt_pitch(const struct gmem_config *cfg,
+		uint32_t i)
+{
+	if (cfg->rts[i].pitch)
+		return cfg->rts[i].pitch;
+	return ALIGN(cfg->width * gmem_fmt_cpp(cfg->rts[i].fmt), GMEM_BURST);
+}
+
+/* bins are numbered row by row: */
+static inline void gmem_tile(const struct gmem_layout *l,
+		const struct gmem_config *cfg, uint32_t n, struct gmem_tile *t)
+{
+	t->x = (n % l->nbins_x) * l->bin_w;
+	t->y = (n / l->nbins_x) * l->bin_h;
+	t->w = min(l->bin_w, cfg->width - t->x);
+	t->h = min(l->bin_h, cfg->height - t->y);
+}
+
+/* pipe of bin n, and its bit within the pipe: */
+static inline uint32_t gmem_bin_pipe(const struct gmem_layout *l,
+		uint32_t n, uint32_t *bit)
+{
+	uint32_t x = n % l->nbins_x, y = n / l->nbins_x, p;
+
+	for (p = 0; p < l->nr_pipes; p++) {
+		const struct gmem_pipe *pipe = &l->pipes[p];
+		if ((x >= pipe->x) && (x < pipe->x + pipe->w) &&
+				(y >= pipe->y) && (y < pipe->y + pipe->h)) {
+			*bit = (y - pipe->y) * pipe->w + (x - pipe->x);
+			return p;
+		}
+	}
+
+	*bit = 0;
+	return 0;
+}
+
+static inline enum pc_di_vis_cull_mode gmem_pass_vis(struct gmem_pass *pass)
+{
+	return gmem_binning(&pass->layout, &pass->cfg) ?
+			USE_VISIBILITY : IGNORE_VISIBILITY;
+}
+
+#endif /* GMEM_H_ */
@@ -0,0 +1,285 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <xf86drm.h>
+
+#include "util.h"
+#include "emu.h"
+#include "gmem.h"
+
+/* Plans the bin layout for a render pass (size, render target formats
+ * and MSAA given on the command line) against the GMEM size reported by
+ * the kernel, and lists every layout that fits, ranked the way
+ * gmem_plan() ranks them, with the estimated memory traffic for the
+ * resolves and the cost of the tiling cmdstream on the emulated CP.
+ */
+
+static uint32_t nr_draws = 16;
+static uint32_t fps = 60;
+static int dump;
+
+struct result {
+	uint32_t dwords;
+	uint64_t cycles;
+};
+
+static int run_layout(const struct gmem_layout *l, struct gmem_config *cfg,
+		struct result *res, int dump_cb)
+{
+	struct emu *emu = emu_new();
+	struct msm_submit *submit;
+	struct cmdbuf *cb, *draws;
+	uint32_t i, n;
+	int ret;
+
+	for (i = 0; i < cfg->nr_rts; i++) {
+		struct emu_bo *bo = emu_bo_new(emu,
+				gmem_rt_pitch(cfg, i) * cfg->height);
+		cfg->rts[i].handle = bo->handle;
+	}
+
+	draws = emu_cmdbuf_new(emu, nr_draws * 24 + 64);
+	for (i = 0; i < nr_draws; i++) {
+		CB_PKT0(draws, REG_AXXX_CP_SCRATCH_REG0, 1);
+		CB_RING(draws, i);
+		CB_PKT3(draws, CP_DRAW_INDX, 3);
+		CB_RING(draws, 0x00000000);
+		CB_RING(draws, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+				INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+		CB_RING(draws, 3);
+	}
+
+	cb = emu_cmdbuf_new(emu, (l->nr_bins * (20 + 9 * cfg->nr_rts) +
+			8 * cfg->nr_rts + 16) * 4);
+
+	gmem_emit_setup(cb, l, cfg);
+	for (n = 0; n < l->nr_bins; n++)
+		gmem_emit_tile(cb, l, cfg, n, draws);
+
+	res->dwords = cmdbuf_dwords(cb);
+
+	submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	emu_attach(emu, submit);
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+	ret = msm_submit_flush(submit);
+	msm_submit_del(submit);
+
+	res->cycles = emu->stats.cycles;
+
+	if (dump_cb) {
+		for (i = 0; i < res->dwords; i++)
+			printf("%08x%s", cb->start[i], (i % 8) == 7 ? "\n" : " ");
+		printf("\n");
+	}
+
+	cmdbuf_del(cb);
+	cmdbuf_del(draws);
+	emu_del(emu);
+
+	for (i = 0; i < cfg->nr_rts; i++)
+		cfg->rts[i].handle = 0;
+
+	return ret;
+}
+
+static void print_layout(const struct gmem_layout *l,
+		const struct result *res, int chosen)
+{
+	uint64_t bytes = l->resolve_bytes + l->restore_bytes +
+			(uint64_t)res->dwords * 4;
+
+	printf("%s %3ux%-3u %4ux%-4u %5.1f%% %5.1f%% %9.2f %9.2f %7u %9"PRIu64" %8.1f\n",
+			chosen ? "*" : " ", l->nbins_x, l->nbins_y,
+			l->bin_w, l->bin_h, 100.0 * l->used / l->gmem_size,
+			100.0 * l->waste / ((uint64_t)l->nr_bins * l->bin_w * l->bin_h),
+			l->resolve_bytes / 1000000.0, l->restore_bytes / 1000000.0,
+			res->dwords, res->cycles, bytes * fps / 1000000.0);
+}
+
+static uint32_t parse_size(const char *str)
+{
+	char *end;
+	uint32_t size = strtoul(str, &end, 0);
+
+	if ((*end == 'k') || (*end == 'K'))
+		size *= 1024;
+	else if ((*end == 'm') || (*end == 'M'))
+		size *= 1024 * 1024;
+
+	return size;
+}
+
+static int parse_fmts(struct gmem_config *cfg, char *str)
+{
+	char *tok;
+
+	cfg->nr_rts = 0;
+	for (tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+		if (cfg->nr_rts == GMEM_MAX_RTS) {
+			printf("at most %d render targets\n", GMEM_MAX_RTS);
+			return -EINVAL;
+		}
+		if (gmem_parse_fmt(tok, &cfg->rts[cfg->nr_rts].fmt)) {
+			printf("unknown format: %s\n", tok);
+			return -EINVAL;
+		}
+		cfg->nr_rts++;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct gmem_config cfg = {
+			.width = 1920,
+			.height = 1080,
+			.rts = { { .fmt = RB_R8G8B8A8_UNORM } },
+			.nr_rts = 1,
+			.samples = MSAA_ONE,
+	};
+	struct gmem_layout best, l;
+	struct result res;
+	uint32_t gmem_size = 0, bin_w = 0, bin_h = 0, nbins_x, i;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "s:f:m:g:b:n:F:rd")) != -1) {
+		switch (opt) {
+		case 's':
+			if (sscanf(optarg, "%ux%u", &cfg.width, &cfg.height) != 2)
+				goto usage;
+			break;
+		case 'f':
+			if (parse_fmts(&cfg, optarg))
+				return -1;
+			break;
+		case 'm':
+			switch (strtol(optarg, NULL, 0)) {
+			case 1: cfg.samples = MSAA_ONE;  break;
+			case 2: cfg.samples = MSAA_TWO;  break;
+			case 4: cfg.samples = MSAA_FOUR; break;
+			default: goto usage;
+			}
+			break;
+		case 'g':
+			gmem_size = parse_size(optarg);
+			break;
+		case 'b':
+			if (sscanf(optarg, "%ux%u", &bin_w, &bin_h) != 2)
+				goto usage;
+			break;
+		case 'n':
+			nr_draws = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			fps = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg.restore = true;
+			break;
+		case 'd':
+			dump = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (!gmem_size) {
+		int fd = drmOpen("msm", NULL);
+
+		if ((fd < 0) || gmem_query_size(fd, &gmem_size)) {
+			printf("could not query GMEM size, use -g\n");
+			return -1;
+		}
+		drmClose(fd);
+	}
+
+	printf("%ux%u, %ux MSAA, %s, GMEM %u bytes, render targets:",
+			cfg.width, cfg.height, gmem_samples(cfg.samples),
+			cfg.restore ? "restore" : "clear", gmem_size);
+	for (i = 0; i < cfg.nr_rts; i++)
+		printf(" %s", gmem_fmt_name(cfg.rts[i].fmt));
+	printf("\n");
+
+	/* a given bin size, rather than planning: */
+	if (bin_w) {
+		ret = gmem_layout(&best, &cfg, gmem_size, bin_w, bin_h);
+		if (ret) {
+			printf("%ux%u bins: %s\n", bin_w, bin_h, strerror(-ret));
+			return ret;
+		}
+	} else {
+		ret = gmem_plan(&best, &cfg, gmem_size);
+		if (ret) {
+			printf("no layout fits: %s\n", strerror(-ret));
+			return ret;
+		}
+	}
+
+	printf("%-9s %-9s %6s %6s %9s %9s %7s %9s %8s\n", "  bins", "bin",
+			"gmem", "waste", "resolveMB", "restoreMB", "dwords",
+			"cycles", "MB/s");
+
+	for (nbins_x = 1; !bin_w && (nbins_x <= (cfg.width + GMEM_BIN_ALIGN - 1) /
+			GMEM_BIN_ALIGN); nbins_x++) {
+		if (gmem_layout_cols(&l, &cfg, gmem_size, nbins_x))
+			continue;
+		if ((l.bin_w == best.bin_w) && (l.bin_h == best.bin_h))
+			continue;
+		if (run_layout(&l, &cfg, &res, 0))
+			return -1;
+		print_layout(&l, &res, 0);
+	}
+
+	if (run_layout(&best, &cfg, &res, dump))
+		return -1;
+	print_layout(&best, &res, 1);
+
+	printf("GMEM bases:");
+	for (i = 0; i < cfg.nr_rts; i++)
+		printf(" 0x%05x", best.base[i]);
+	printf(", %u of %u bytes used per bin, %.2f MB GMEM read per pass\n",
+			best.used, gmem_size, best.gmem_bytes / 1000000.0);
+
+	return 0;
+
+usage:
+	printf("usage: %s [-s WxH] [-f fmt[,fmt..]] [-m 1|2|4] [-g gmem-size] "
+			"[-b WxH] [-n draws] [-F fps] [-r] [-d]\n", argv[0]);
+	printf("formats: rgb8 rgba8 z16 a8 rgba16f rgba32f\n");
+	return -1;
+}
@@ -0,0 +1,193 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include <freedreno_drmif.h>
+#include <freedreno_ringbuffer.h>
+
+#include "util.h"
+#include "bo.h"
+#include "batch.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+
+/* test for IB_TARGET_BUF cmds: a secondary cmdbuf with "static" content
+ * is built once and called from the primary cmdbuf of each frame, vs.
+ * re-emitting the same content inline every frame.  Several frames go
+ * into each submit, to exercise multiple primaries calling the same IB.
+ */
+
+#define NFRAMES  64
+#define NPRIMARY 8
+
+/* the static content, NPKTS CP_MEM_WRITE's into the target bo: */
+#define NPKTS    256
+
+static void emit_static(struct cmdbuf *cb, struct fd_bo *target)
+{
+	uint32_t i;
+	for (i = 0; i < NPKTS; i++) {
+		CB_PKT3(cb, CP_MEM_WRITE, 2);
+		CB_RELOC(cb, target, (i + 1) * 4, 0);
+		CB_RING(cb, 0xc0de0000 | i);
+	}
+}
+
+static int check(struct fd_pipe *pipe, struct fd_bo *target)
+{
+	uint32_t *ptr, i, errors = 0;
+
+	msm_bo_cpu_prep(target, pipe, DRM_FREEDRENO_PREP_READ);
+	ptr = fd_bo_map(target);
+	if (ptr[0] != NFRAMES) {
+		printf("frame: expected %08x, got %08x\n", NFRAMES, ptr[0]);
+		errors++;
+	}
+	for (i = 0; i < NPKTS; i++) {
+		if (ptr[i + 1] != (0xc0de0000 | i)) {
+			if (errors++ < 8)
+				printf("%04x: expected %08x, got %08x\n", i,
+						0xc0de0000 | i, ptr[i + 1]);
+		}
+	}
+	memset(ptr, 0, (NPKTS + 1) * 4);
+	fd_bo_cpu_fini(target);
+
+	return errors;
+}
+
+static int run(int fd, struct fd_pipe *pipe, struct cmdbuf **primaries,
+		struct cmdbuf *ib, struct fd_bo *target)
+{
+	struct batch *batch = batch_new(fd, MSM_PIPE_3D0);
+	uint64_t t, emit = 0;
+	uint32_t i, dwords = 0;
+
+	batch->max_cmds = NPRIMARY;
+
+	t = gettime_ns();
+	for (i = 0; i < NFRAMES; i++) {
+		struct cmdbuf *cb = primaries[i % NPRIMARY];
+		uint64_t e;
+
+		/* wait for the previous submit using this cmdbuf: */
+		msm_bo_cpu_prep(cb->bo, pipe, DRM_FREEDRENO_PREP_WRITE);
+		fd_bo_cpu_fini(cb->bo);
+
+		e = gettime_ns();
+		cmdbuf_reset(cb);
+		CB_PKT3(cb, CP_MEM_WRITE, 2);
+		CB_RELOC(cb, target, 0, 0);
+		CB_RING(cb, i + 1);
+
+		if (ib) {
+			/* alternate between prefetch and non-prefetch: */
+			CB_IB(cb, ib, i & 1);
+		} else {
+			emit_static(cb, target);
+		}
+
+		emit += gettime_ns() - e;
+		dwords += cmdbuf_dwords(cb);
+
+		batch_queue(batch, cb);
+	}
+	batch_flush(batch);
+	t = gettime_ns() - t;
+
+	printf("%s: %u frames in %.3fms, emit %.3fus/frame, %u dwords/frame\n",
+			ib ? "ib" : "inline", NFRAMES, t / 1000000.0,
+			emit / 1000.0 / NFRAMES, dwords / NFRAMES);
+	batch_dump_stats(batch);
+	batch_del(batch);
+
+	return check(pipe, target);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fd_device *dev;
+	struct fd_pipe *pipe;
+	struct cmdbuf *primaries[NPRIMARY], *ib;
+	struct fd_bo *target;
+	uint32_t i;
+	int fd, ret = 0;
+
+	fd = drmOpen("msm", NULL);
+	if (fd < 0) {
+		printf("failed to initialize DRM\n");
+		return fd;
+	}
+
+	dev = fd_device_new(fd);
+	if (!dev) {
+		printf("failed to initialize freedreno device\n");
+		return -1;
+	}
+
+	pipe = fd_pipe_new(dev, FD_PIPE_3D);
+	if (!pipe) {
+		printf("failed to initialize freedreno pipe\n");
+		return -1;
+	}
+
+	for (i = 0; i < NPRIMARY; i++)
+		primaries[i] = cmdbuf_new(dev, 0x4000);
+
+	target = fd_bo_new(dev, 0x1000, 0);
+
+	/* build the IB once, its contents are never touched again: */
+	ib = cmdbuf_new(dev, 0x4000);
+	emit_static(ib, target);
+
+	printf("Test 1: static content emitted inline:\n");
+	if (run(fd, pipe, primaries, NULL, target))
+		ret = -1;
+
+	printf("Test 2: static content in IB target:\n");
+	if (run(fd, pipe, primaries, ib, target))
+		ret = -1;
+
+	for (i = 0; i < NPRIMARY; i++)
+		cmdbuf_del(primaries[i]);
+	cmdbuf_del(ib);
+	fd_bo_del(target);
+
+	printf("%s\n", ret ? "FAILED" : "PASSED");
+
+	return ret;
+}
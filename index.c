@@ -0,0 +1,531 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define HAVE_X86 1
+#endif
+#if defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+#include "index.h"
+
+/*
+ * The SIMD scans find the min/max excluding restart indices (all ones,
+ * the largest value) without a compare and select per vector: they keep
+ * the min of the indices, which a restart index can't lower, and the
+ * min and max of the indices plus one, which wraps restart indices to
+ * zero.  So there are restart indices if the min plus one is zero, and
+ * the max is the max plus one, minus one (or there are no indices other
+ * than restart indices, if that is zero).
+ */
+
+static void
+range_finish(struct index_range *r, uint32_t lo, uint32_t lo1, uint32_t hi1)
+{
+	r->restart = (lo1 == 0);
+	if (hi1 == 0) {
+		r->min = ~0;
+		r->max = 0;
+	} else {
+		r->min = lo;
+		r->max = hi1 - 1;
+	}
+}
+
+/*
+ * Plain C:
+ */
+
+static bool c_supported(void)
+{
+	return true;
+}
+
+static void
+c_scan_u16(const uint16_t *idx, uint32_t n, struct index_range *r)
+{
+	uint16_t lo = 0xffff, lo1 = 0xffff, hi1 = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		uint16_t v = idx[i], v1 = v + 1;
+		lo = min(lo, v);
+		lo1 = min(lo1, v1);
+		hi1 = max(hi1, v1);
+	}
+
+	range_finish(r, lo, lo1, hi1);
+}
+
+static void
+c_scan_u32(const uint32_t *idx, uint32_t n, struct index_range *r)
+{
+	uint32_t lo = ~0, lo1 = ~0, hi1 = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		uint32_t v = idx[i], v1 = v + 1;
+		lo = min(lo, v);
+		lo1 = min(lo1, v1);
+		hi1 = max(hi1, v1);
+	}
+
+	range_finish(r, lo, lo1, hi1);
+}
+
+static void
+c_narrow(uint16_t *dst, const uint32_t *src, uint32_t n)
+{
+	uint32_t i;
+
+	/* truncating keeps restart indices as restart indices: */
+	for (i = 0; i < n; i++)
+		dst[i] = src[i];
+}
+
+static const struct index_impl c_impl = {
+	.name = "c",
+	.supported = c_supported,
+	.scan_u16 = c_scan_u16,
+	.scan_u32 = c_scan_u32,
+	.narrow = c_narrow,
+};
+
+/* the tails of the SIMD scans, folded into their partial results: */
+static void
+tail_u16(const uint16_t *idx, uint32_t n, uint16_t *lo, uint16_t *lo1, uint16_t *hi1)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		uint16_t v = idx[i], v1 = v + 1;
+		*lo = min(*lo, v);
+		*lo1 = min(*lo1, v1);
+		*hi1 = max(*hi1, v1);
+	}
+}
+
+static void
+tail_u32(const uint32_t *idx, uint32_t n, uint32_t *lo, uint32_t *lo1, uint32_t *hi1)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		uint32_t v = idx[i], v1 = v + 1;
+		*lo = min(*lo, v);
+		*lo1 = min(*lo1, v1);
+		*hi1 = max(*hi1, v1);
+	}
+}
+
+#ifdef HAVE_X86
+
+/*
+ * SSE4.1 (for the unsigned 16/32 bit min/max, and the unsigned saturating
+ * 32 -> 16 bit pack):
+ */
+
+#define SSE41 __attribute__((target("sse4.1")))
+
+static bool sse41_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.1");
+}
+
+SSE41 static uint16_t sse41_hmin_u16(__m128i v)
+{
+	return _mm_extract_epi16(_mm_minpos_epu16(v), 0);
+}
+
+SSE41 static uint16_t sse41_hmax_u16(__m128i v)
+{
+	__m128i ones = _mm_set1_epi32(~0);
+	return ~_mm_extract_epi16(_mm_minpos_epu16(_mm_xor_si128(v, ones)), 0);
+}
+
+SSE41 static uint32_t sse41_hmin_u32(__m128i v)
+{
+	v = _mm_min_epu32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_epu32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+SSE41 static uint32_t sse41_hmax_u32(__m128i v)
+{
+	v = _mm_max_epu32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_epu32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+SSE41 static void
+sse41_scan_u16(const uint16_t *idx, uint32_t n, struct index_range *r)
+{
+	__m128i one = _mm_set1_epi16(1);
+	__m128i lo = _mm_set1_epi16(~0), lo1 = lo, hi1 = _mm_setzero_si128();
+	uint16_t l, l1, h1;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&idx[i]);
+		__m128i v1 = _mm_add_epi16(v, one);
+		lo = _mm_min_epu16(lo, v);
+		lo1 = _mm_min_epu16(lo1, v1);
+		hi1 = _mm_max_epu16(hi1, v1);
+	}
+
+	l = sse41_hmin_u16(lo);
+	l1 = sse41_hmin_u16(lo1);
+	h1 = sse41_hmax_u16(hi1);
+	tail_u16(&idx[i], n - i, &l, &l1, &h1);
+
+	range_finish(r, l, l1, h1);
+}
+
+SSE41 static void
+sse41_scan_u32(const uint32_t *idx, uint32_t n, struct index_range *r)
+{
+	__m128i one = _mm_set1_epi32(1);
+	__m128i lo = _mm_set1_epi32(~0), lo1 = lo, hi1 = _mm_setzero_si128();
+	uint32_t l, l1, h1, i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&idx[i]);
+		__m128i v1 = _mm_add_epi32(v, one);
+		lo = _mm_min_epu32(lo, v);
+		lo1 = _mm_min_epu32(lo1, v1);
+		hi1 = _mm_max_epu32(hi1, v1);
+	}
+
+	l = sse41_hmin_u32(lo);
+	l1 = sse41_hmin_u32(lo1);
+	h1 = sse41_hmax_u32(hi1);
+	tail_u32(&idx[i], n - i, &l, &l1, &h1);
+
+	range_finish(r, l, l1, h1);
+}
+
+/* packus saturates signed 32 bit values, so restart indices (-1) would
+ * become zero.  Packing the indices plus one (restart indices wrap to
+ * zero, the rest are at most 0xffff) and subtracting one afterwards
+ * brings them back as 0xffff:
+ */
+SSE41 static void
+sse41_narrow(uint16_t *dst, const uint32_t *src, uint32_t n)
+{
+	__m128i one32 = _mm_set1_epi32(1), one16 = _mm_set1_epi16(1);
+	uint32_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i + 4]);
+		__m128i p = _mm_packus_epi32(_mm_add_epi32(a, one32),
+				_mm_add_epi32(b, one32));
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_sub_epi16(p, one16));
+	}
+
+	c_narrow(&dst[i], &src[i], n - i);
+}
+
+static const struct index_impl sse41_impl = {
+	.name = "sse4.1",
+	.supported = sse41_supported,
+	.scan_u16 = sse41_scan_u16,
+	.scan_u32 = sse41_scan_u32,
+	.narrow = sse41_narrow,
+};
+
+/*
+ * AVX2, the same with twice the width (the horizontal reductions are
+ * done by the SSE4.1 ones on the two halves):
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static bool avx2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+AVX2 static void
+avx2_scan_u16(const uint16_t *idx, uint32_t n, struct index_range *r)
+{
+	__m256i one = _mm256_set1_epi16(1);
+	__m256i lo = _mm256_set1_epi16(~0), lo1 = lo, hi1 = _mm256_setzero_si256();
+	uint16_t l, l1, h1;
+	uint32_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&idx[i]);
+		__m256i v1 = _mm256_add_epi16(v, one);
+		lo = _mm256_min_epu16(lo, v);
+		lo1 = _mm256_min_epu16(lo1, v1);
+		hi1 = _mm256_max_epu16(hi1, v1);
+	}
+
+	l = sse41_hmin_u16(_mm_min_epu16(_mm256_castsi256_si128(lo),
+			_mm256_extracti128_si256(lo, 1)));
+	l1 = sse41_hmin_u16(_mm_min_epu16(_mm256_castsi256_si128(lo1),
+			_mm256_extracti128_si256(lo1, 1)));
+	h1 = sse41_hmax_u16(_mm_max_epu16(_mm256_castsi256_si128(hi1),
+			_mm256_extracti128_si256(hi1, 1)));
+	tail_u16(&idx[i], n - i, &l, &l1, &h1);
+
+	range_finish(r, l, l1, h1);
+}
+
+AVX2 static void
+avx2_scan_u32(const uint32_t *idx, uint32_t n, struct index_range *r)
+{
+	__m256i one = _mm256_set1_epi32(1);
+	__m256i lo = _mm256_set1_epi32(~0), lo1 = lo, hi1 = _mm256_setzero_si256();
+	uint32_t l, l1, h1, i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&idx[i]);
+		__m256i v1 = _mm256_add_epi32(v, one);
+		lo = _mm256_min_epu32(lo, v);
+		lo1 = _mm256_min_epu32(lo1, v1);
+		hi1 = _mm256_max_epu32(hi1, v1);
+	}
+
+	l = sse41_hmin_u32(_mm_min_epu32(_mm256_castsi256_si128(lo),
+			_mm256_extracti128_si256(lo, 1)));
+	l1 = sse41_hmin_u32(_mm_min_epu32(_mm256_castsi256_si128(lo1),
+			_mm256_extracti128_si256(lo1, 1)));
+	h1 = sse41_hmax_u32(_mm_max_epu32(_mm256_castsi256_si128(hi1),
+			_mm256_extracti128_si256(hi1, 1)));
+	tail_u32(&idx[i], n - i, &l, &l1, &h1);
+
+	range_finish(r, l, l1, h1);
+}
+
+/* as sse41_narrow(), but packus works within 128 bit lanes so the
+ * result's middle quadwords need swapping:
+ */
+AVX2 static void
+avx2_narrow(uint16_t *dst, const uint32_t *src, uint32_t n)
+{
+	__m256i one32 = _mm256_set1_epi32(1), one16 = _mm256_set1_epi16(1);
+	uint32_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i *)&src[i + 8]);
+		__m256i p = _mm256_packus_epi32(_mm256_add_epi32(a, one32),
+				_mm256_add_epi32(b, one32));
+		p = _mm256_permute4x64_epi64(p, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm256_sub_epi16(p, one16));
+	}
+
+	c_narrow(&dst[i], &src[i], n - i);
+}
+
+static const struct index_impl avx2_impl = {
+	.name = "avx2",
+	.supported = avx2_supported,
+	.scan_u16 = avx2_scan_u16,
+	.scan_u32 = avx2_scan_u32,
+	.narrow = avx2_narrow,
+};
+
+#endif /* HAVE_X86 */
+
+#ifdef __ARM_NEON
+
+/*
+ * NEON (always there when the compiler targets it):
+ */
+
+static bool neon_supported(void)
+{
+	return true;
+}
+
+static uint16_t neon_hmin_u16(uint16x8_t v)
+{
+	uint16x4_t d = vpmin_u16(vget_low_u16(v), vget_high_u16(v));
+	d = vpmin_u16(d, d);
+	d = vpmin_u16(d, d);
+	return vget_lane_u16(d, 0);
+}
+
+static uint16_t neon_hmax_u16(uint16x8_t v)
+{
+	uint16x4_t d = vpmax_u16(vget_low_u16(v), vget_high_u16(v));
+	d = vpmax_u16(d, d);
+	d = vpmax_u16(d, d);
+	return vget_lane_u16(d, 0);
+}
+
+static uint32_t neon_hmin_u32(uint32x4_t v)
+{
+	uint32x2_t d = vpmin_u32(vget_low_u32(v), vget_high_u32(v));
+	d = vpmin_u32(d, d);
+	return vget_lane_u32(d, 0);
+}
+
+static uint32_t neon_hmax_u32(uint32x4_t v)
+{
+	uint32x2_t d = vpmax_u32(vget_low_u32(v), vget_high_u32(v));
+	d = vpmax_u32(d, d);
+	return vget_lane_u32(d, 0);
+}
+
+static void
+neon_scan_u16(const uint16_t *idx, uint32_t n, struct index_range *r)
+{
+	uint16x8_t one = vdupq_n_u16(1);
+	uint16x8_t lo = vdupq_n_u16(0xffff), lo1 = lo, hi1 = vdupq_n_u16(0);
+	uint16_t l, l1, h1;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		uint16x8_t v = vld1q_u16(&idx[i]);
+		uint16x8_t v1 = vaddq_u16(v, one);
+		lo = vminq_u16(lo, v);
+		lo1 = vminq_u16(lo1, v1);
+		hi1 = vmaxq_u16(hi1, v1);
+	}
+
+	l = neon_hmin_u16(lo);
+	l1 = neon_hmin_u16(lo1);
+	h1 = neon_hmax_u16(hi1);
+	tail_u16(&idx[i], n - i, &l, &l1, &h1);
+
+	range_finish(r, l, l1, h1);
+}
+
+static void
+neon_scan_u32(const uint32_t *idx, uint32_t n, struct index_range *r)
+{
+	uint32x4_t one = vdupq_n_u32(1);
+	uint32x4_t lo = vdupq_n_u32(~0), lo1 = lo, hi1 = vdupq_n_u32(0);
+	uint32_t l, l1, h1, i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32x4_t v = vld1q_u32(&idx[i]);
+		uint32x4_t v1 = vaddq_u32(v, one);
+		lo = vminq_u32(lo, v);
+		lo1 = vminq_u32(lo1, v1);
+		hi1 = vmaxq_u32(hi1, v1);
+	}
+
+	l = neon_hmin_u32(lo);
+	l1 = neon_hmin_u32(lo1);
+	h1 = neon_hmax_u32(hi1);
+	tail_u32(&idx[i], n - i, &l, &l1, &h1);
+
+	range_finish(r, l, l1, h1);
+}
+
+/* vmovn truncates, so restart indices stay restart indices: */
+static void
+neon_narrow(uint16_t *dst, const uint32_t *src, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		uint16x4_t a = vmovn_u32(vld1q_u32(&src[i]));
+		uint16x4_t b = vmovn_u32(vld1q_u32(&src[i + 4]));
+		vst1q_u16(&dst[i], vcombine_u16(a, b));
+	}
+
+	c_narrow(&dst[i], &src[i], n - i);
+}
+
+static const struct index_impl neon_impl = {
+	.name = "neon",
+	.supported = neon_supported,
+	.scan_u16 = neon_scan_u16,
+	.scan_u32 = neon_scan_u32,
+	.narrow = neon_narrow,
+};
+
+#endif /* __ARM_NEON */
+
+/* best last: */
+const struct index_impl *index_impls[] = {
+		&c_impl,
+#ifdef HAVE_X86
+		&sse41_impl,
+		&avx2_impl,
+#endif
+#ifdef __ARM_NEON
+		&neon_impl,
+#endif
+		NULL,
+};
+
+const struct index_impl *index_funcs;
+
+/* pick the best supported implementation, unless overridden by the
+ * MSMTEST_INDEX environment variable:
+ */
+void index_init(void)
+{
+	const char *name = getenv("MSMTEST_INDEX");
+	const struct index_impl *best = &c_impl;
+	int i;
+
+	if (name && !index_use(name))
+		return;
+
+	for (i = 0; index_impls[i]; i++)
+		if (index_impls[i]->supported())
+			best = index_impls[i];
+
+	index_funcs = best;
+}
+
+int index_use(const char *name)
+{
+	int i;
+
+	for (i = 0; index_impls[i]; i++) {
+		if (strcmp(index_impls[i]->name, name))
+			continue;
+		if (!index_impls[i]->supported()) {
+			ERROR_MSG("%s not supported", name);
+			return -ENOTSUP;
+		}
+		index_funcs = index_impls[i];
+		return 0;
+	}
+
+	ERROR_MSG("no index implementation: %s", name);
+	return -EINVAL;
+}
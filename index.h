@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef INDEX_H_
+#define INDEX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "util.h"
+
+/*
+ * Index buffer scanning, for the index range (VFD_INDEX_MIN/MAX) and
+ * index size of indexed draws: the min/max index, whether there are any
+ * primitive restart indices (all ones, ie. 0xffff or 0xffffffff, which
+ * don't count towards the range), and narrowing of 32 bit indices to
+ * 16 bit when the range allows it.  For draws with primitive restart
+ * off, index_range_no_restart() puts the all ones indices back in the
+ * range, as the vertices they are then.
+ *
+ * Each kernel has a plain C version, and SIMD versions (SSE4.1 and AVX2
+ * on x86, NEON on arm) which are picked at run time by what the CPU
+ * supports.  index_use() overrides the choice, eg. to compare them.
+ */
+
+struct index_range {
+	uint32_t min, max;       /* min > max if there are no indices */
+	bool restart;            /* contains restart indices */
+};
+
+struct index_impl {
+	const char *name;
+	bool (*supported)(void);
+	void (*scan_u16)(const uint16_t *idx, uint32_t n, struct index_range *r);
+	void (*scan_u32)(const uint32_t *idx, uint32_t n, struct index_range *r);
+	void (*narrow)(uint16_t *dst, const uint32_t *src, uint32_t n);
+};
+
+extern const struct index_impl *index_impls[];
+extern const struct index_impl *index_funcs;
+
+void index_init(void);
+int index_use(const char *name);
+
+static inline const struct index_impl * index_impl(void)
+{
+	if (!index_funcs)
+		index_init();
+	return index_funcs;
+}
+
+static inline void
+index_scan_u16(const uint16_t *idx, uint32_t n, struct index_range *r)
+{
+	index_impl()->scan_u16(idx, n, r);
+}
+
+static inline void
+index_scan_u32(const uint32_t *idx, uint32_t n, struct index_range *r)
+{
+	index_impl()->scan_u32(idx, n, r);
+}
+
+/* narrow 32 bit indices to 16 bit, which is only valid if the range's
+ * max is below 0xffff.  Restart indices stay restart indices:
+ */
+static inline void
+index_narrow(uint16_t *dst, const uint32_t *src, uint32_t n)
+{
+	index_impl()->narrow(dst, src, n);
+}
+
+static inline bool index_range_empty(const struct index_range *r)
+{
+	return r->min > r->max;
+}
+
+/* for a draw with primitive restart off, where the all ones indices
+ * (ones, at the index size) the scan found are vertices like any other:
+ */
+static inline void
+index_range_no_restart(struct index_range *r, uint32_t ones)
+{
+	if (!r->restart)
+		return;
+
+	r->min = min(r->min, ones);
+	r->max = ones;
+	r->restart = false;
+}
+
+/* widen a range to include another: */
+static inline void
+index_range_merge(struct index_range *r, const struct index_range *other)
+{
+	r->min = min(r->min, other->min);
+	r->max = max(r->max, other->max);
+	r->restart |= other->restart;
+}
+
+#endif /* INDEX_H_ */
@@ -0,0 +1,324 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "index.h"
+
+/* Index buffer kernel benchmark: the index range scans (16 and 32 bit)
+ * and 32 -> 16 bit narrowing of each implementation supported by the
+ * CPU (see index.h), over buffers of 1K to 16M indices.  Reports GB/s
+ * of indices read, and checks every implementation against a naive
+ * reference, on the benchmark buffers and on short odd sized ones with
+ * restart indices in awkward places.
+ */
+
+#define MIN_BYTES   (64 * 1024 * 1024)   /* read per timing */
+
+static uint32_t max_size = 16 * 1024 * 1024;
+
+static uint32_t seed = 0x12345678;
+
+/* indices below 0xffff (so they can be narrowed), with a restart index
+ * every so often:
+ */
+static void fill(uint32_t *idx32, uint16_t *idx16, uint32_t n, uint32_t range)
+{
+	uint32_t base = rnd(&seed) % (0xffff - range), i;
+
+	for (i = 0; i < n; i++) {
+		if ((rnd(&seed) % 64) == 0)
+			idx32[i] = 0xffffffff;
+		else
+			idx32[i] = base + rnd(&seed) % range;
+		idx16[i] = idx32[i];
+	}
+}
+
+static void ref_scan(const uint32_t *idx, uint32_t n, uint32_t restart,
+		struct index_range *r)
+{
+	uint32_t i;
+
+	*r = (struct index_range){ .min = ~0 };
+	for (i = 0; i < n; i++) {
+		if (idx[i] == restart) {
+			r->restart = true;
+			continue;
+		}
+		r->min = min(r->min, idx[i]);
+		r->max = max(r->max, idx[i]);
+	}
+}
+
+static bool range_equal(const struct index_range *a, const struct index_range *b)
+{
+	if (a->restart != b->restart)
+		return false;
+	if (index_range_empty(a) || index_range_empty(b))
+		return index_range_empty(a) && index_range_empty(b);
+	return (a->min == b->min) && (a->max == b->max);
+}
+
+/* check an implementation on n indices, returning the number of errors: */
+static int check(const struct index_impl *impl, const uint32_t *idx32,
+		const uint16_t *idx16, uint16_t *dst, uint32_t n)
+{
+	struct index_range ref32, ref16, r;
+	int errors = 0;
+
+	ref_scan(idx32, n, 0xffffffff, &ref32);
+	ref16 = ref32;
+
+	impl->scan_u32(idx32, n, &r);
+	if (!range_equal(&r, &ref32)) {
+		printf("  %s: scan_u32 of %u: %u..%u%s, expected %u..%u%s\n",
+				impl->name, n, r.min, r.max, r.restart ? " restart" : "",
+				ref32.min, ref32.max, ref32.restart ? " restart" : "");
+		errors++;
+	}
+
+	impl->scan_u16(idx16, n, &r);
+	if (!range_equal(&r, &ref16)) {
+		printf("  %s: scan_u16 of %u: %u..%u%s, expected %u..%u%s\n",
+				impl->name, n, r.min, r.max, r.restart ? " restart" : "",
+				ref16.min, ref16.max, ref16.restart ? " restart" : "");
+		errors++;
+	}
+
+	/* one past the end should be left alone: */
+	dst[n] = 0x5a5a;
+	impl->narrow(dst, idx32, n);
+	if (memcmp(dst, idx16, n * 2) || (dst[n] != 0x5a5a)) {
+		printf("  %s: narrow of %u differs\n", impl->name, n);
+		errors++;
+	}
+
+	return errors;
+}
+
+/* short buffers, to cover the tails of the SIMD loops, with the edge
+ * values (0, 0xfffe, restart) in each position:
+ */
+static int check_edges(const struct index_impl *impl)
+{
+	static const uint32_t special[] = { 0, 0xfffe, 0xffffffff };
+	uint32_t idx32[72];
+	uint16_t idx16[72], dst[73];
+	uint32_t n, pos, s, i;
+	int errors = 0;
+
+	for (n = 0; n <= 70; n++) {
+		for (pos = 0; pos < max(n, 1); pos++) {
+			for (s = 0; s < ARRAY_SIZE(special); s++) {
+				for (i = 0; i < n; i++)
+					idx32[i] = 100 + rnd(&seed) % 1000;
+				if (n)
+					idx32[pos] = special[s];
+				for (i = 0; i < n; i++)
+					idx16[i] = idx32[i];
+				errors += check(impl, idx32, idx16, dst, n);
+			}
+		}
+
+		/* and all restart indices: */
+		for (i = 0; i < n; i++) {
+			idx32[i] = 0xffffffff;
+			idx16[i] = 0xffff;
+		}
+		errors += check(impl, idx32, idx16, dst, n);
+	}
+
+	return errors;
+}
+
+/* with primitive restart off, the all ones indices are vertices, so
+ * they are the max (and the min, if there is nothing else):
+ */
+static int check_no_restart(const struct index_impl *impl)
+{
+	static const uint32_t vals[] = { 100, 0xfffe, 0xffffffff };
+	uint32_t idx32[ARRAY_SIZE(vals)];
+	uint16_t idx16[ARRAY_SIZE(vals)];
+	struct index_range r;
+	uint32_t n, i;
+	int errors = 0;
+
+	for (n = 1; n <= ARRAY_SIZE(vals); n++) {
+		/* the last n values, so the first case is only all ones: */
+		for (i = 0; i < n; i++) {
+			idx32[i] = vals[ARRAY_SIZE(vals) - n + i];
+			idx16[i] = idx32[i];
+		}
+
+		impl->scan_u32(idx32, n, &r);
+		index_range_no_restart(&r, 0xffffffff);
+		if (r.restart || (r.min != idx32[0]) || (r.max != 0xffffffff)) {
+			printf("  %s: scan_u32 of %u without restart: %u..%u\n",
+					impl->name, n, r.min, r.max);
+			errors++;
+		}
+
+		impl->scan_u16(idx16, n, &r);
+		index_range_no_restart(&r, 0xffff);
+		if (r.restart || (r.min != idx16[0]) || (r.max != 0xffff)) {
+			printf("  %s: scan_u16 of %u without restart: %u..%u\n",
+					impl->name, n, r.min, r.max);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+static double gbps(uint64_t bytes, uint64_t ns)
+{
+	return ns ? (double)bytes / ns : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t *idx32;
+	uint16_t *idx16, *dst;
+	uint32_t n, reps, i, j;
+	int opt, errors = 0, edge_errors = 0, restart_errors = 0, ret = 0;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			max_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-s max-indices]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (max_size < 1024) {
+		printf("nothing to do\n");
+		return -1;
+	}
+
+	idx32 = malloc(max_size * 4);
+	idx16 = malloc(max_size * 2);
+	dst = malloc(max_size * 2 + 2);
+	if (!idx32 || !idx16 || !dst) {
+		printf("could not allocate %u indices\n", max_size);
+		return -1;
+	}
+
+	index_init();
+	printf("using %s:", index_impl()->name);
+	for (i = 0; index_impls[i]; i++)
+		if (index_impls[i]->supported())
+			printf(" %s", index_impls[i]->name);
+	printf(" supported\n");
+
+	printf("%10s %-8s %10s %10s %10s   (GB/s of indices read)\n",
+			"indices", "impl", "scan u16", "scan u32", "narrow");
+
+	for (n = 1024; n <= max_size; n *= 4) {
+		fill(idx32, idx16, n, min(n, 0x8000));
+		reps = max(MIN_BYTES / (n * 4), 1);
+
+		for (i = 0; index_impls[i]; i++) {
+			const struct index_impl *impl = index_impls[i];
+			uint64_t t, ns16, ns32, nsn;
+			struct index_range r;
+
+			if (!impl->supported())
+				continue;
+
+			errors += check(impl, idx32, idx16, dst, n);
+
+			t = gettime_ns();
+			for (j = 0; j < reps; j++)
+				impl->scan_u16(idx16, n, &r);
+			ns16 = gettime_ns() - t;
+
+			t = gettime_ns();
+			for (j = 0; j < reps; j++)
+				impl->scan_u32(idx32, n, &r);
+			ns32 = gettime_ns() - t;
+
+			t = gettime_ns();
+			for (j = 0; j < reps; j++)
+				impl->narrow(dst, idx32, n);
+			nsn = gettime_ns() - t;
+
+			printf("%10u %-8s %10.2f %10.2f %10.2f\n", n, impl->name,
+					gbps((uint64_t)reps * n * 2, ns16),
+					gbps((uint64_t)reps * n * 4, ns32),
+					gbps((uint64_t)reps * n * 4, nsn));
+		}
+	}
+
+	for (i = 0; index_impls[i]; i++) {
+		if (!index_impls[i]->supported())
+			continue;
+		edge_errors += check_edges(index_impls[i]);
+		restart_errors += check_no_restart(index_impls[i]);
+	}
+
+	printf("Test 1: every implementation matches the reference\n");
+	if (errors) {
+		printf("FAILED (%d errors)\n", errors);
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 2: short buffers with edge and restart indices\n");
+	if (edge_errors) {
+		printf("FAILED (%d errors)\n", edge_errors);
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 3: all ones indices are vertices with restart off\n");
+	if (restart_errors) {
+		printf("FAILED (%d errors)\n", restart_errors);
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	free(idx32);
+	free(idx16);
+	free(dst);
+
+	return ret;
+}
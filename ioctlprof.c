@@ -0,0 +1,373 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+/*
+ * LD_PRELOAD ioctl interposer, to profile the msm ioctls of unmodified
+ * binaries:
+ *
+ *   LD_PRELOAD=/path/to/libioctlprof.so ./some-program
+ *
+ * Each DRM_IOCTL_MSM_x on an msm device gets a latency histogram, and
+ * submits and allocations also get histograms of their arguments (bos,
+ * cmds, relocs, cmd and bo sizes).  All of it is updated with relaxed
+ * atomics, without any locks, so it works from any number of threads.
+ *
+ * The stats are dumped at exit, and on SIGUSR1 (unless the program has
+ * its own handler for it by its first msm ioctl), to stderr or to
+ * $MSM_IOCTLPROF_FILE.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#ifndef __user
+#  define __user
+#endif
+#include "msm_drm.h"
+#include "util.h"
+
+#ifndef U642VOID
+#  define U642VOID(x) ((void *)(unsigned long)(x))
+#endif
+
+#define NR_BUCKETS 48            /* log2 buckets */
+
+struct hist {
+	uint64_t buckets[NR_BUCKETS];
+	uint64_t count, sum, max;
+};
+
+static struct {
+	struct hist lat;         /* ns */
+	uint64_t errors;
+} ioctls[DRM_MSM_NUM_IOCTLS];
+
+static struct hist submit_bos, submit_cmds, submit_relocs, cmd_size;
+static struct hist new_size;
+
+static const char *ioctl_names[DRM_MSM_NUM_IOCTLS] = {
+		[DRM_MSM_GET_PARAM]    = "GET_PARAM",
+		[0x01]                 = "SET_PARAM",   /* placeholder */
+		[DRM_MSM_GEM_NEW]      = "GEM_NEW",
+		[DRM_MSM_GEM_INFO]     = "GEM_INFO",
+		[DRM_MSM_GEM_CPU_PREP] = "GEM_CPU_PREP",
+		[DRM_MSM_GEM_CPU_FINI] = "GEM_CPU_FINI",
+		[DRM_MSM_GEM_SUBMIT]   = "GEM_SUBMIT",
+		[DRM_MSM_WAIT_FENCE]   = "WAIT_FENCE",
+};
+
+static int (*real_ioctl)(int fd, unsigned long request, ...);
+
+/* whether each fd is an msm device, 0 if not checked yet: */
+#define MAX_FDS 4096
+enum { FD_UNKNOWN, FD_MSM, FD_OTHER };
+static uint8_t fd_state[MAX_FDS];
+
+static int wake_fds[2] = { -1, -1 };
+static pthread_once_t sigusr1_once = PTHREAD_ONCE_INIT;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void hist_add(struct hist *h, uint64_t v)
+{
+	uint32_t b = v ? (64 - __builtin_clzll(v)) : 0;
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	if (b >= NR_BUCKETS)
+		b = NR_BUCKETS - 1;
+
+	__atomic_add_fetch(&h->buckets[b], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->sum, v, __ATOMIC_RELAXED);
+
+	while ((v > max) && !__atomic_compare_exchange_n(&h->max, &max, v, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/* upper bound of the bucket the percentile falls in: */
+static uint64_t hist_pct(const struct hist *h, double p)
+{
+	uint64_t target = p * h->count, n = 0;
+	uint32_t b;
+
+	for (b = 0; b < NR_BUCKETS; b++) {
+		n += h->buckets[b];
+		if (n > target)
+			return b ? min(((uint64_t)1 << b) - 1, h->max) : 0;
+	}
+
+	return h->max;
+}
+
+static void hist_dump(FILE *f, const char *name, const struct hist *h,
+		const char *unit)
+{
+	if (!h->count)
+		return;
+
+	fprintf(f, "  %-14s %10"PRIu64" %12.1f %10"PRIu64" %10"PRIu64" %10"PRIu64
+			" %10"PRIu64"%s%s\n", name, h->count, (double)h->sum / h->count,
+			hist_pct(h, 0.5), hist_pct(h, 0.9), hist_pct(h, 0.99), h->max,
+			*unit ? " " : "", unit);
+}
+
+static void hist_bars(FILE *f, const struct hist *h)
+{
+	uint64_t most = 0;
+	uint32_t b;
+
+	for (b = 0; b < NR_BUCKETS; b++)
+		most = max(most, h->buckets[b]);
+
+	for (b = 0; b < NR_BUCKETS; b++) {
+		char bar[41];
+		uint32_t n;
+
+		if (!h->buckets[b])
+			continue;
+
+		n = (h->buckets[b] * 40 + most - 1) / most;
+		memset(bar, '#', n);
+		bar[n] = '\0';
+
+		fprintf(f, "      < %12"PRIu64"ns %10"PRIu64" %s\n",
+				(uint64_t)1 << b, h->buckets[b], bar);
+	}
+}
+
+static void dump(void)
+{
+	const char *path = getenv("MSM_IOCTLPROF_FILE");
+	FILE *f = path ? fopen(path, "a") : NULL;
+	uint32_t i;
+
+	if (!f)
+		f = stderr;
+
+	fprintf(f, "msm ioctl profile (pid %d):\n", getpid());
+	fprintf(f, "  %-14s %10s %12s %10s %10s %10s %10s\n", "", "count",
+			"mean", "p50", "p90", "p99", "max");
+
+	for (i = 0; i < DRM_MSM_NUM_IOCTLS; i++) {
+		if (!ioctls[i].lat.count)
+			continue;
+		hist_dump(f, ioctl_names[i], &ioctls[i].lat, "ns");
+		if (ioctls[i].errors)
+			fprintf(f, "    %"PRIu64" errors\n", ioctls[i].errors);
+		hist_bars(f, &ioctls[i].lat);
+	}
+
+	fprintf(f, "arguments:\n");
+	hist_dump(f, "submit bos", &submit_bos, "");
+	hist_dump(f, "submit cmds", &submit_cmds, "");
+	hist_dump(f, "submit relocs", &submit_relocs, "");
+	hist_dump(f, "cmd size", &cmd_size, "bytes");
+	hist_dump(f, "bo size", &new_size, "bytes");
+
+	if (f != stderr)
+		fclose(f);
+	else
+		fflush(f);
+}
+
+static int is_msm(int fd)
+{
+	char name[16] = "";
+	struct drm_version version = {
+			.name_len = sizeof(name) - 1,
+			.name = name,
+	};
+	int msm;
+
+	if ((fd >= 0) && (fd < MAX_FDS) && fd_state[fd])
+		return fd_state[fd] == FD_MSM;
+
+	msm = !real_ioctl(fd, DRM_IOCTL_VERSION, &version) &&
+			!strcmp(name, "msm");
+
+	if ((fd >= 0) && (fd < MAX_FDS))
+		__atomic_store_n(&fd_state[fd], msm ? FD_MSM : FD_OTHER,
+				__ATOMIC_RELAXED);
+
+	return msm;
+}
+
+/* only called once the kernel has accepted the args, so the pointers
+ * in them are known to be good:
+ */
+static void record_args(uint32_t nr, void *arg)
+{
+	switch (nr) {
+	case DRM_MSM_GEM_SUBMIT: {
+		struct drm_msm_gem_submit *req = arg;
+		struct drm_msm_gem_submit_cmd *cmds = U642VOID(req->cmds);
+		uint32_t i, relocs = 0;
+
+		for (i = 0; i < req->nr_cmds; i++) {
+			hist_add(&cmd_size, cmds[i].size);
+			relocs += cmds[i].nr_relocs;
+		}
+
+		hist_add(&submit_bos, req->nr_bos);
+		hist_add(&submit_cmds, req->nr_cmds);
+		hist_add(&submit_relocs, relocs);
+		break;
+	}
+	case DRM_MSM_GEM_NEW: {
+		struct drm_msm_gem_new *req = arg;
+		hist_add(&new_size, req->size);
+		break;
+	}
+	}
+}
+
+/* dumping from the signal handler itself is not safe, so it just wakes
+ * up a thread to do it:
+ */
+static void sigusr1(int sig)
+{
+	char c = 0;
+	int saved = errno;
+
+	if (write(wake_fds[1], &c, 1) < 0) {
+		/* nothing to do about it */
+	}
+
+	errno = saved;
+}
+
+static void * dump_thread(void *arg)
+{
+	char c;
+
+	while (read(wake_fds[0], &c, 1) == 1)
+		dump();
+
+	return NULL;
+}
+
+/* done on the first msm ioctl rather than in the constructor, so that a
+ * handler the program installs in main() is seen:
+ */
+static void setup_sigusr1(void)
+{
+	struct sigaction sa, old;
+	pthread_t thread;
+
+	if (sigaction(SIGUSR1, NULL, &old) || (old.sa_handler != SIG_DFL)) {
+		fprintf(stderr, "ioctlprof: SIGUSR1 in use, only dumping at exit\n");
+		return;
+	}
+
+	if (pipe(wake_fds))
+		return;
+
+	if (pthread_create(&thread, NULL, dump_thread, NULL))
+		return;
+	pthread_detach(thread);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigusr1;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sa, NULL);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	uint32_t nr = _IOC_NR(request) - DRM_COMMAND_BASE;
+	uint64_t t;
+	va_list ap;
+	void *arg;
+	int ret;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (!real_ioctl)
+		real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+	if ((_IOC_TYPE(request) != DRM_IOCTL_BASE) ||
+			(nr >= DRM_MSM_NUM_IOCTLS) || !is_msm(fd))
+		return real_ioctl(fd, request, arg);
+
+	pthread_once(&sigusr1_once, setup_sigusr1);
+
+	t = now_ns();
+	ret = real_ioctl(fd, request, arg);
+	t = now_ns() - t;
+
+	hist_add(&ioctls[nr].lat, t);
+	if (ret)
+		__atomic_add_fetch(&ioctls[nr].errors, 1, __ATOMIC_RELAXED);
+	else
+		record_args(nr, arg);
+
+	return ret;
+}
+
+/* the fd could be reused for something else: */
+int close(int fd)
+{
+	static int (*real_close)(int fd);
+
+	if (!real_close)
+		real_close = dlsym(RTLD_NEXT, "close");
+
+	if ((fd >= 0) && (fd < MAX_FDS))
+		__atomic_store_n(&fd_state[fd], FD_UNKNOWN, __ATOMIC_RELAXED);
+
+	return real_close(fd);
+}
+
+static void __attribute__((constructor)) init(void)
+{
+	if (!real_ioctl)
+		real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+	atexit(dump);
+}
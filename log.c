@@ -0,0 +1,463 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "log.h"
+#include "util.h"
+
+enum log_level log_level = LOG_DEBUG;
+uint32_t log_burst = 20;
+
+#define LOG_QUEUE_SIZE 1024      /* power of two */
+#define LOG_STR_SIZE   256       /* for copies of string arguments */
+
+struct log_rec {
+	struct log_site *site;
+	uint32_t suppressed;
+	uint32_t nr_args;
+	struct log_arg args[LOG_MAX_ARGS];
+	char strs[LOG_STR_SIZE];
+};
+
+/* bounded multi-producer, single consumer queue: a slot's seq says
+ * whether it is free for the producer at position seq, or holds the
+ * record for the consumer at position seq - 1:
+ */
+static struct {
+	uint32_t seq;
+	struct log_rec rec;
+} queue[LOG_QUEUE_SIZE];
+
+static uint32_t enq_pos __attribute__((aligned(64)));
+static uint32_t deq_pos __attribute__((aligned(64)));
+static uint64_t dropped;
+
+static FILE *out;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_t thread;
+static int sync_mode, started, stop;
+
+static const char *prefix[] = {
+		[LOG_ERROR] = "[E] ",
+		[LOG_WARN]  = "[W] ",
+		[LOG_INFO]  = "[I] ",
+		[LOG_DEBUG] = "[D] ",
+};
+
+/* format a single conversion, with the argument cast back to the type
+ * the length modifier asks for:
+ */
+static int format_arg(char *buf, int size, const char *spec, int len,
+		char conv, const char *mod, const struct log_arg *arg)
+{
+	char fmt[32];
+	int64_t i = arg->i;
+
+	if (len > (int)(sizeof(fmt) - 4))
+		return snprintf(buf, size, "(?)");
+
+	memcpy(fmt, spec, len);
+
+	switch (conv) {
+	case 'd': case 'i':
+	case 'o': case 'u': case 'x': case 'X':
+		if (arg->type != LOG_ARG_INT)
+			break;
+		/* without a 'l' (or wider) modifier, the value was int sized: */
+		if (!strpbrk(mod, "ljzqtL")) {
+			if (strchr("di", conv))
+				i = (int)i;
+			else
+				i = (unsigned)i;
+		}
+		strcpy(&fmt[len], "ll");
+		fmt[len + 2] = conv;
+		fmt[len + 3] = '\0';
+		if (strchr("di", conv))
+			return snprintf(buf, size, fmt, (long long)i);
+		return snprintf(buf, size, fmt, (unsigned long long)i);
+	case 'c':
+		fmt[len] = conv;
+		fmt[len + 1] = '\0';
+		return snprintf(buf, size, fmt, (int)i);
+	case 'p':
+		fmt[len] = conv;
+		fmt[len + 1] = '\0';
+		return snprintf(buf, size, fmt, (void *)(intptr_t)i);
+	case 's':
+		if (arg->type != LOG_ARG_STR)
+			break;
+		fmt[len] = conv;
+		fmt[len + 1] = '\0';
+		return snprintf(buf, size, fmt, arg->s);
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		if (arg->type != LOG_ARG_DOUBLE)
+			break;
+		fmt[len] = conv;
+		fmt[len + 1] = '\0';
+		return snprintf(buf, size, fmt, arg->d);
+	}
+
+	return snprintf(buf, size, "(?)");
+}
+
+static FILE * get_out(void)
+{
+	FILE *f = __atomic_load_n(&out, __ATOMIC_ACQUIRE);
+	return f ? f : stdout;
+}
+
+static void print_rec(FILE *f, const struct log_rec *rec)
+{
+	const struct log_site *site = rec->site;
+	const char *p = site->fmt;
+	char buf[1024];
+	uint32_t n = 0, a = 0;
+
+#define APPEND(...) do { \
+		int r = snprintf(&buf[n], sizeof(buf) - n, __VA_ARGS__); \
+		n = min(n + max(r, 0), sizeof(buf) - 1); \
+	} while (0)
+
+	APPEND("%s", prefix[site->level]);
+
+	while (*p) {
+		const char *spec, *mod;
+		char mods[4] = "";
+		int r, m = 0;
+
+		if (*p != '%') {
+			const char *end = strchr(p, '%');
+			if (!end)
+				end = p + strlen(p);
+			APPEND("%.*s", (int)(end - p), p);
+			p = end;
+			continue;
+		}
+
+		if (p[1] == '%') {
+			APPEND("%%");
+			p += 2;
+			continue;
+		}
+
+		spec = p++;
+		p += strspn(p, "-+ #0123456789.");
+		mod = p;
+		p += strspn(p, "hlLqjzt");
+		memcpy(mods, mod, min((size_t)(p - mod), sizeof(mods) - 1));
+		m = mod - spec;
+
+		if (!*p)
+			break;
+
+		if (a < rec->nr_args) {
+			r = format_arg(&buf[n], sizeof(buf) - n, spec, m, *p, mods,
+					&rec->args[a++]);
+			n = min(n + max(r, 0), sizeof(buf) - 1);
+		} else {
+			APPEND("(?)");
+		}
+		p++;
+	}
+
+	APPEND(" (%s:%d)", site->func, site->line);
+	if (rec->suppressed)
+		APPEND(" [%u more suppressed]", rec->suppressed);
+
+#undef APPEND
+
+	fputs(buf, f);
+	fputc('\n', f);
+}
+
+/* returns the number of messages suppressed since the last one that got
+ * through, or -1 if this one is suppressed too:
+ */
+static int ratelimit(struct log_site *site)
+{
+	struct timespec ts;
+	uint64_t now, window;
+
+	if (!log_burst)
+		return 0;
+
+	/* the coarse clock is plenty for this, and much cheaper: */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	now = ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+	window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+
+	if ((now - window) >= 1000000000) {
+		/* if another thread starts the new window first, this message
+		 * just counts against it:
+		 */
+		if (__atomic_compare_exchange_n(&site->window, &window, now, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+	}
+
+	if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > log_burst) {
+		__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	return __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+}
+
+/* copy the arguments, and any strings, since they may not be around by
+ * the time the message is formatted:
+ */
+static void capture(struct log_rec *rec, struct log_site *site,
+		uint32_t nr_args, const struct log_arg *args)
+{
+	uint32_t i, n = 0;
+
+	rec->site = site;
+	rec->nr_args = min(nr_args, LOG_MAX_ARGS);
+
+	for (i = 0; i < rec->nr_args; i++) {
+		rec->args[i] = args[i];
+
+		if (args[i].type == LOG_ARG_STR) {
+			const char *s = args[i].s ? args[i].s : "(null)";
+			uint32_t len = min(strlen(s), sizeof(rec->strs) - n - 1);
+
+			memcpy(&rec->strs[n], s, len);
+			rec->strs[n + len] = '\0';
+			rec->args[i].s = &rec->strs[n];
+			n += len + (n + len < sizeof(rec->strs) - 1);
+		}
+	}
+}
+
+static int drain(void)
+{
+	FILE *f = get_out();
+	uint32_t pos = deq_pos;
+	uint64_t d;
+	int n = 0;
+
+	/* at most a queue's worth at a time, so deq_pos keeps moving under
+	 * a constant stream of messages:
+	 */
+	while (n < LOG_QUEUE_SIZE) {
+		uint32_t idx = pos & (LOG_QUEUE_SIZE - 1);
+
+		if (__atomic_load_n(&queue[idx].seq, __ATOMIC_ACQUIRE) != (pos + 1))
+			break;
+
+		print_rec(f, &queue[idx].rec);
+
+		__atomic_store_n(&queue[idx].seq, pos + LOG_QUEUE_SIZE,
+				__ATOMIC_RELEASE);
+		pos++;
+		n++;
+	}
+
+	d = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+	if (d)
+		fprintf(f, "%s%"PRIu64" log messages dropped, queue full\n",
+				prefix[LOG_WARN], d);
+
+	if (n)
+		fflush(f);
+
+	/* only once flushed, so log_flush() callers see it all: */
+	__atomic_store_n(&deq_pos, pos, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+static void * log_thread(void *arg)
+{
+	const struct timespec period = { .tv_nsec = 1000000 };
+
+	while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+		if (!drain())
+			nanosleep(&period, NULL);
+	}
+
+	drain();
+
+	return NULL;
+}
+
+static void log_fini(void)
+{
+	if (!started)
+		return;
+
+	/* anything logged from here on (eg. other atexit handlers) is printed
+	 * directly:
+	 */
+	__atomic_store_n(&sync_mode, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	started = 0;
+}
+
+static void log_init(void)
+{
+	static const char *names[] = {
+			[LOG_ERROR] = "error",
+			[LOG_WARN]  = "warn",
+			[LOG_INFO]  = "info",
+			[LOG_DEBUG] = "debug",
+	};
+	const char *s;
+	uint32_t i;
+
+	if ((s = getenv("MSM_LOG_LEVEL"))) {
+		for (i = 0; i < ARRAY_SIZE(names); i++)
+			if (!strcmp(s, names[i]))
+				log_level = i;
+	}
+
+	if ((s = getenv("MSM_LOG_BURST")))
+		log_burst = strtoul(s, NULL, 0);
+
+	if ((s = getenv("MSM_LOG_FILE")))
+		out = fopen(s, "w");
+
+	if ((s = getenv("MSM_LOG_SYNC")))
+		sync_mode = atoi(s);
+
+	for (i = 0; i < LOG_QUEUE_SIZE; i++)
+		queue[i].seq = i;
+
+	/* without the thread, fall back to printing synchronously: */
+	if (!sync_mode && !pthread_create(&thread, NULL, log_thread, NULL)) {
+		started = 1;
+		atexit(log_fini);
+	} else {
+		sync_mode = 1;
+	}
+}
+
+void log_msg(struct log_site *site, uint32_t nr_args,
+		const struct log_arg *args)
+{
+	uint32_t pos, idx;
+	int suppressed;
+
+	pthread_once(&once, log_init);
+
+	if (site->level > log_level)
+		return;
+
+	if (site->level == LOG_ERROR) {
+		struct log_rec rec;
+		FILE *f = get_out();
+
+		log_flush();
+		capture(&rec, site, nr_args, args);
+		rec.suppressed = 0;
+		print_rec(f, &rec);
+		fflush(f);
+		return;
+	}
+
+	suppressed = ratelimit(site);
+	if (suppressed < 0)
+		return;
+
+	if (__atomic_load_n(&sync_mode, __ATOMIC_RELAXED)) {
+		struct log_rec rec;
+		capture(&rec, site, nr_args, args);
+		rec.suppressed = suppressed;
+		print_rec(get_out(), &rec);
+		return;
+	}
+
+	pos = __atomic_load_n(&enq_pos, __ATOMIC_RELAXED);
+	for (;;) {
+		int32_t diff;
+
+		idx = pos & (LOG_QUEUE_SIZE - 1);
+		diff = __atomic_load_n(&queue[idx].seq, __ATOMIC_ACQUIRE) - pos;
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&enq_pos, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	capture(&queue[idx].rec, site, nr_args, args);
+	queue[idx].rec.suppressed = suppressed;
+
+	__atomic_store_n(&queue[idx].seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* wait for everything logged so far to be printed: */
+void log_flush(void)
+{
+	uint32_t pos = __atomic_load_n(&enq_pos, __ATOMIC_ACQUIRE);
+
+	if (!started)
+		return;
+
+	while ((int32_t)(__atomic_load_n(&deq_pos, __ATOMIC_ACQUIRE) - pos) < 0)
+		sched_yield();
+}
+
+void log_set_level(enum log_level level)
+{
+	log_level = level;
+}
+
+/* print from the caller instead of the background thread, eg. to see
+ * every message before a crash:
+ */
+void log_set_sync(int sync)
+{
+	pthread_once(&once, log_init);
+	if (sync)
+		log_flush();
+	__atomic_store_n(&sync_mode, sync || !started, __ATOMIC_RELAXED);
+}
+
+void log_set_file(FILE *f)
+{
+	log_flush();
+	__atomic_store_n(&out, f, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Logging behind the INFO/DEBUG/WARN/ERROR_MSG macros (util.h).
+ *
+ * A message costs the caller a level check, a rate limit check and
+ * copying the arguments (and any strings) into a queue; the formatting
+ * and printing happen later, on a background thread.  The format string
+ * must be a literal, and '*' widths are not supported.
+ *
+ * Errors are the exception: they are printed and flushed by the caller,
+ * after anything still queued, so they come out in order with the
+ * program's own output and survive a crash right after.  They are not
+ * rate limited either.
+ *
+ * Each other call site is limited to log_burst messages per second,
+ * anything beyond that is counted and reported along with the next
+ * message that gets through.  If the queue is full, messages are dropped
+ * (and counted) rather than waiting.
+ *
+ * Environment:
+ *   MSM_LOG_LEVEL=error|warn|info|debug  (default debug)
+ *   MSM_LOG_BURST=<n>                    (per site per second, 0 for no limit)
+ *   MSM_LOG_SYNC=1                       format and print immediately
+ *   MSM_LOG_FILE=<file>                  instead of stdout
+ */
+
+enum log_level {
+	LOG_ERROR,
+	LOG_WARN,
+	LOG_INFO,
+	LOG_DEBUG,
+};
+
+struct log_site {
+	enum log_level level;
+	const char *fmt;
+	const char *func;
+	int line;
+
+	/* rate limiting: */
+	uint64_t window;         /* start of the current second */
+	uint32_t count;          /* messages in it */
+	uint32_t suppressed;
+};
+
+enum log_arg_type {
+	LOG_ARG_INT,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STR,
+};
+
+struct log_arg {
+	enum log_arg_type type;
+	union {
+		int64_t i;
+		double d;
+		const char *s;
+	};
+};
+
+#define LOG_MAX_ARGS 10
+
+extern enum log_level log_level;
+extern uint32_t log_burst;
+
+void log_msg(struct log_site *site, uint32_t nr_args,
+		const struct log_arg *args);
+void log_flush(void);
+void log_set_level(enum log_level level);
+void log_set_sync(int sync);
+void log_set_file(FILE *f);
+
+/* never called, only there so the compiler checks the format string: */
+static inline void __attribute__((format(printf, 1, 2)))
+log_check_fmt(const char *fmt, ...)
+{
+}
+
+/* capture an argument according to its type: */
+#define LOG_DBL(x) _Generic((x), float: (x), double: (x), default: 0.0)
+#define LOG_STR(x) _Generic((x), char *: (x), const char *: (x), default: "")
+#define LOG_INT(x) __builtin_choose_expr(__builtin_classify_type(x) == 5, \
+		(int64_t)(intptr_t)(x), (int64_t)(x))
+#define LOG_ARG(x) _Generic((x), \
+		float:        (struct log_arg){ LOG_ARG_DOUBLE, { .d = LOG_DBL(x) } }, \
+		double:       (struct log_arg){ LOG_ARG_DOUBLE, { .d = LOG_DBL(x) } }, \
+		char *:       (struct log_arg){ LOG_ARG_STR,    { .s = LOG_STR(x) } }, \
+		const char *: (struct log_arg){ LOG_ARG_STR,    { .s = LOG_STR(x) } }, \
+		default:      (struct log_arg){ LOG_ARG_INT,    { .i = LOG_INT(x) } })
+
+#define _LOG_N(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, n, ...) n
+#define LOG_NR_ARGS(...) \
+		_LOG_N(0, ##__VA_ARGS__, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define _LOG_ARGS_0()      { LOG_ARG_INT, { 0 } }
+#define _LOG_ARGS_1(a)     LOG_ARG(a)
+#define _LOG_ARGS_2(a, ...) LOG_ARG(a), _LOG_ARGS_1(__VA_ARGS__)
+#define _LOG_ARGS_3(a, ...) LOG_ARG(a), _LOG_ARGS_2(__VA_ARGS__)
+#define _LOG_ARGS_4(a, ...) LOG_ARG(a), _LOG_ARGS_3(__VA_ARGS__)
+#define _LOG_ARGS_5(a, ...) LOG_ARG(a), _LOG_ARGS_4(__VA_ARGS__)
+#define _LOG_ARGS_6(a, ...) LOG_ARG(a), _LOG_ARGS_5(__VA_ARGS__)
+#define _LOG_ARGS_7(a, ...) LOG_ARG(a), _LOG_ARGS_6(__VA_ARGS__)
+#define _LOG_ARGS_8(a, ...) LOG_ARG(a), _LOG_ARGS_7(__VA_ARGS__)
+#define _LOG_ARGS_9(a, ...) LOG_ARG(a), _LOG_ARGS_8(__VA_ARGS__)
+#define _LOG_ARGS_10(a, ...) LOG_ARG(a), _LOG_ARGS_9(__VA_ARGS__)
+#define _LOG_CAT(a, b) _LOG_CAT_(a, b)
+#define _LOG_CAT_(a, b) a ## b
+#define LOG_ARGS(...) \
+		_LOG_CAT(_LOG_ARGS_, LOG_NR_ARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#define LOG_MSG(lvl, fmtstr, ...) do { \
+		static struct log_site _log_site = { \
+				.level = lvl, .fmt = fmtstr, \
+				.func = __FUNCTION__, .line = __LINE__, \
+		}; \
+		if (0) \
+			log_check_fmt(fmtstr, ##__VA_ARGS__); \
+		if (__builtin_expect((lvl) <= log_level, 1)) { \
+			log_msg(&_log_site, LOG_NR_ARGS(__VA_ARGS__), \
+					(const struct log_arg[]){ LOG_ARGS(__VA_ARGS__) }); \
+		} \
+	} while (0)
+
+#endif /* LOG_H_ */
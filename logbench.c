@@ -0,0 +1,127 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+
+/* Shows how the various argument types come out of the logger (log.h),
+ * and measures what a message costs the caller: queued for the
+ * background thread, formatted and printed synchronously, and dropped by
+ * the rate limit.
+ */
+
+static int nr_msgs = 100000;
+
+static void samples(void)
+{
+	char buf[32];
+	uint64_t big = 0x123456789abcULL;
+
+	strcpy(buf, "on the stack");
+
+	INFO_MSG("no arguments");
+	INFO_MSG("int %d, unsigned %u, hex %08x, negative as hex %x",
+			-42, 42u, 0xbeef, -1);
+	INFO_MSG("64b %"PRIu64", %"PRIx64", long %ld", big, big, -1L);
+	INFO_MSG("char '%c', float %.3f, double %g", 'x', 1.5f, 0.25);
+	INFO_MSG("strings: '%s', '%-8s|', '%s'", "literal", "pad", buf);
+	INFO_MSG("pointer %p, 100%%", (void *)buf);
+	WARN_MSG("a warning: %s", strerror(EINVAL));
+	ERROR_MSG("an error: %d", -EINVAL);
+	DEBUG_MSG("debug, hidden with MSM_LOG_LEVEL=info");
+
+	/* overwritten before the message is printed: */
+	strcpy(buf, "clobbered");
+}
+
+/* caller side cost per message, in batches that fit in the queue: */
+static double bench(int batch)
+{
+	uint64_t total = 0;
+	int i, j;
+
+	for (i = 0; i < nr_msgs; i += batch) {
+		uint64_t t = gettime_ns();
+
+		for (j = 0; j < batch; j++)
+			DEBUG_MSG("message %d of %d: %s %08x", i + j, nr_msgs,
+					"string", j);
+
+		total += gettime_ns() - t;
+
+		log_flush();
+	}
+
+	return (double)total / nr_msgs;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *null;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_msgs = strtol(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-n messages]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	samples();
+	log_flush();
+
+	null = fopen("/dev/null", "w");
+	log_set_file(null);
+	log_set_level(LOG_DEBUG);
+
+	log_burst = 0;
+	printf("queued:        %.1fns/message\n", bench(256));
+
+	log_set_sync(1);
+	printf("synchronous:   %.1fns/message\n", bench(256));
+	log_set_sync(0);
+
+	log_burst = 1;
+	printf("rate limited:  %.1fns/message\n", bench(256));
+
+	log_set_file(NULL);
+	fclose(null);
+
+	return 0;
+}
@@ -254,7 +254,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	fd_ringbuffer_flush(ring);
+	FLUSH_RING(ring);
 
 	sleep(20);
 
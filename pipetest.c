@@ -0,0 +1,315 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "util.h"
+#include "emudev.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+#include "a3xx.xml.h"
+
+/* Concurrent submission to the 2D and 3D pipes of the emulated device
+ * (emudev.h), checking that cross-pipe dependencies are honored, and
+ * comparing how long the same work takes with independent bo's vs. a
+ * bo every submit marks for write (so all the pipes serialize).
+ */
+
+static struct emu_dev *dev;
+static struct msm_submit *submits[EMU_NUM_PIPES];
+static struct cmdbuf *work;
+static int nr_submits = 64;
+static int work_dwords = 8192;
+
+static void reloc(struct cmdbuf *cb, struct emu_bo *bo,
+		uint32_t offset, uint32_t flags)
+{
+	cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+		.handle = bo->handle,
+		.flags = flags,
+		.offset = offset,
+	});
+}
+
+/* the cmdbufs are owned by the device until the submits complete, so
+ * they are only freed after emu_dev_finish():
+ */
+static struct cmdbuf **cbs;
+static int nr_cbs, max_cbs;
+
+static struct cmdbuf * new_cmdbuf(void)
+{
+	struct cmdbuf *cb = emu_cmdbuf_new(dev->emu, 0x1000);
+	GROW(cbs, nr_cbs, max_cbs);
+	cbs[nr_cbs++] = cb;
+	CB_IB(cb, work, true);
+	return cb;
+}
+
+static void free_cmdbufs(void)
+{
+	while (nr_cbs > 0)
+		cmdbuf_del(cbs[--nr_cbs]);
+}
+
+static void flush(uint32_t pipe, struct cmdbuf *cb)
+{
+	msm_submit_cmd(submits[pipe], MSM_SUBMIT_CMD_BUF, cb);
+	msm_submit_flush(submits[pipe]);
+}
+
+/* independent work on each pipe, optionally with all the submits also
+ * marking a shared bo for write:
+ */
+static int test_independent(struct emu_bo *shared)
+{
+	struct emu_bo *bos[EMU_NUM_PIPES];
+	uint64_t t;
+	int i, p, ret = 0;
+
+	for (p = 0; p < EMU_NUM_PIPES; p++)
+		bos[p] = emu_bo_new(dev->emu, nr_submits * 4);
+
+	t = gettime_ns();
+
+	for (i = 0; i < nr_submits; i++) {
+		for (p = 0; p < EMU_NUM_PIPES; p++) {
+			struct cmdbuf *cb = new_cmdbuf();
+			CB_PKT3(cb, CP_MEM_WRITE, 2);
+			reloc(cb, bos[p], i * 4, MSM_SUBMIT_BO_WRITE);
+			CB_RING(cb, i + 1);
+			if (shared) {
+				CB_PKT3(cb, CP_NOP, 1);
+				reloc(cb, shared, 0, MSM_SUBMIT_BO_READ |
+						MSM_SUBMIT_BO_WRITE);
+			}
+			flush(p, cb);
+		}
+	}
+
+	emu_dev_finish(dev);
+
+	t = gettime_ns() - t;
+
+	printf("%d submits per pipe in %.3fms\n", nr_submits, t / 1000000.0);
+	emu_dev_dump_stats(dev);
+
+	for (p = 0; p < EMU_NUM_PIPES; p++) {
+		uint32_t *ptr = bos[p]->map;
+		for (i = 0; i < nr_submits; i++) {
+			if (ptr[i] != (uint32_t)(i + 1)) {
+				printf("pipe %d: %d: expected %08x, got %08x\n",
+						p, i, i + 1, ptr[i]);
+				ret = -1;
+				break;
+			}
+		}
+	}
+
+	return ret;
+}
+
+/* 2d0 produces a value that 3d0 checks, for each submit.  The producer
+ * has to wait for the consumer to read the previous value before it can
+ * overwrite it, and the consumer for the producer to write it:
+ */
+static int test_producer_consumer(void)
+{
+	struct emu_bo *val = emu_bo_new(dev->emu, 0x1000);
+	struct emu_bo *ok = emu_bo_new(dev->emu, nr_submits * 4);
+	uint32_t *ptr = ok->map;
+	int i, ret = 0;
+
+	for (i = 0; i < nr_submits; i++) {
+		struct cmdbuf *cb = new_cmdbuf();
+
+		CB_PKT3(cb, CP_MEM_WRITE, 2);
+		reloc(cb, val, 0, MSM_SUBMIT_BO_WRITE);
+		CB_RING(cb, i + 1);
+		flush(0, cb);
+
+		cb = new_cmdbuf();
+		CB_PKT3(cb, CP_COND_WRITE, 6);
+		CB_RING(cb, 0x100 | 0x10 | EMU_FUNC_EQ);
+		reloc(cb, val, 0, MSM_SUBMIT_BO_READ);
+		CB_RING(cb, i + 1);
+		CB_RING(cb, 0xffffffff);
+		reloc(cb, ok, i * 4, MSM_SUBMIT_BO_WRITE);
+		CB_RING(cb, 1);
+		flush(2, cb);
+	}
+
+	emu_dev_finish(dev);
+	emu_dev_dump_stats(dev);
+
+	for (i = 0; i < nr_submits; i++) {
+		if (ptr[i] != 1) {
+			printf("submit %d ran out of order\n", i);
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+/* 3d0 waits on a flag (CP_WAIT_REG_MEM) which 2d0 then writes.  The
+ * flag isn't in either submit's bos[] for synchronization, so nothing
+ * but the write itself unblocks 3d0:
+ */
+static int test_cross_pipe_wait(void)
+{
+	struct emu_bo *flag = emu_bo_new(dev->emu, 0x1000);
+	struct emu_bo *ok = emu_bo_new(dev->emu, nr_submits * 4);
+	uint32_t *ptr = ok->map;
+	int i, ret = 0;
+
+	for (i = 0; i < nr_submits; i++) {
+		struct cmdbuf *cb = new_cmdbuf();
+
+		CB_PKT3(cb, CP_WAIT_REG_MEM, 5);
+		CB_RING(cb, 0x10 | EMU_FUNC_GE);
+		reloc(cb, flag, 0, 0);
+		CB_RING(cb, i + 1);
+		CB_RING(cb, 0xffffffff);
+		CB_RING(cb, 0);
+		CB_PKT3(cb, CP_MEM_WRITE, 2);
+		reloc(cb, ok, i * 4, MSM_SUBMIT_BO_WRITE);
+		CB_RING(cb, 1);
+		flush(2, cb);
+
+		cb = new_cmdbuf();
+		CB_PKT3(cb, CP_MEM_WRITE, 2);
+		reloc(cb, flag, 0, 0);
+		CB_RING(cb, i + 1);
+		flush(0, cb);
+	}
+
+	emu_dev_wait(dev, MSM_PIPE_3D0, nr_submits);
+	emu_dev_finish(dev);
+	emu_dev_dump_stats(dev);
+
+	for (i = 0; i < nr_submits; i++) {
+		if (ptr[i] != 1) {
+			printf("submit %d did not complete\n", i);
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+static void reset(void)
+{
+	int p;
+
+	for (p = 0; p < EMU_NUM_PIPES; p++)
+		msm_submit_del(submits[p]);
+	free_cmdbufs();
+	cmdbuf_del(work);
+	emu_dev_del(dev);
+}
+
+static void init(void)
+{
+	int i;
+
+	dev = emu_dev_new();
+
+	submits[0] = msm_submit_new(-1, MSM_PIPE_2D0);
+	submits[1] = msm_submit_new(-1, MSM_PIPE_2D1);
+	submits[2] = msm_submit_new(-1, MSM_PIPE_3D0);
+	for (i = 0; i < EMU_NUM_PIPES; i++)
+		emu_dev_attach(dev, submits[i]);
+
+	/* some work for each submit to do, shared by all of them (and only
+	 * read, so it doesn't cause any serialization):
+	 */
+	work = emu_cmdbuf_new(dev->emu, work_dwords * 4 + 0x1000);
+	for (i = 0; i < work_dwords / 2; i++) {
+		CB_PKT0(work, REG_AXXX_CP_SCRATCH_REG0 + (i % 8), 1);
+		CB_RING(work, i);
+	}
+}
+
+static void report(int ret)
+{
+	printf("%s\n", ret ? "FAILED" : "PASSED");
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, ret, failed = 0;
+
+	while ((opt = getopt(argc, argv, "n:w:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_submits = strtol(optarg, NULL, 0);
+			break;
+		case 'w':
+			work_dwords = strtol(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-n submits] [-w work-dwords]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	printf("Test 1: independent work on each pipe\n");
+	init();
+	ret = test_independent(NULL);
+	reset();
+	report(ret);
+	failed |= ret;
+
+	printf("Test 2: same work, all submits writing a shared bo\n");
+	init();
+	ret = test_independent(emu_bo_new(dev->emu, 0x1000));
+	reset();
+	report(ret);
+	failed |= ret;
+
+	printf("Test 3: producer on 2d0, consumer on 3d0\n");
+	init();
+	ret = test_producer_consumer();
+	reset();
+	report(ret);
+	failed |= ret;
+
+	printf("Test 4: 3d0 waiting on a write from 2d0\n");
+	init();
+	ret = test_cross_pipe_wait();
+	reset();
+	report(ret);
+	failed |= ret;
+
+	return failed;
+}
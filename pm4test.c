@@ -105,7 +105,7 @@ int main(int argc, char *argv[])
 		OUT_RELOC(ring, bo, i * 4, 0);
 	}
 
-	fd_ringbuffer_flush(ring);
+	FLUSH_RING(ring);
 
 	/* and read back the values: */
 	fd_bo_cpu_prep(bo, pipe, DRM_FREEDRENO_PREP_READ);
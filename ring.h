@@ -32,6 +32,8 @@
 #include "adreno_pm4.xml.h"
 
 #include "util.h"
+#include "trace.h"
+#include "ringprof.h"
 
 #define LOG_DWORDS 0
 
@@ -43,6 +45,7 @@ OUT_RING(struct fd_ringbuffer *ring, uint32_t data)
 		DEBUG_MSG("ring[%p]: OUT_RING   %04x:  %08x\n", ring,
 				(uint32_t)(ring->cur - ring->last_start), data);
 	}
+	RING_PROF_DWORDS(1);
 	*(ring->cur++) = data;
 }
 
@@ -54,6 +57,8 @@ OUT_RELOC(struct fd_ringbuffer *ring, struct fd_bo *bo,
 		DEBUG_MSG("ring[%p]: OUT_RELOC  %04x:  %p+%u", ring,
 				(uint32_t)(ring->cur - ring->last_start), bo, offset);
 	}
+	RING_PROF_RELOC();
+	RING_PROF_DWORDS(1);
 	fd_ringbuffer_reloc(ring, &(struct fd_reloc){
 		.bo = bo,
 		.flags = FD_RELOC_READ | FD_RELOC_WRITE,
@@ -71,6 +76,8 @@ OUT_RELOCS(struct fd_ringbuffer *ring, struct fd_bo *bo,
 		DEBUG_MSG("ring[%p]: OUT_RELOCS  %04x:  %p+%u << %d", ring,
 				(uint32_t)(ring->cur - ring->last_start), bo, offset, shift);
 	}
+	RING_PROF_RELOC();
+	RING_PROF_DWORDS(1);
 	fd_ringbuffer_reloc(ring, &(struct fd_reloc){
 		.bo = bo,
 		.flags = FD_RELOC_READ | FD_RELOC_WRITE,
@@ -94,6 +101,7 @@ static inline void BEGIN_RING(struct fd_ringbuffer *ring, uint32_t ndwords)
 static inline void
 OUT_PKT0(struct fd_ringbuffer *ring, uint16_t regindx, uint16_t cnt)
 {
+	RING_PROF_PKT(RING_PROF_PKT0, cnt+1);
 	BEGIN_RING(ring, cnt+1);
 	OUT_RING(ring, CP_TYPE0_PKT | ((cnt-1) << 16) | (regindx & 0x7FFF));
 }
@@ -101,6 +109,7 @@ OUT_PKT0(struct fd_ringbuffer *ring, uint16_t regindx, uint16_t cnt)
 static inline void
 OUT_PKT3(struct fd_ringbuffer *ring, uint8_t opcode, uint16_t cnt)
 {
+	RING_PROF_PKT(opcode, cnt+1);
 	BEGIN_RING(ring, cnt+1);
 	OUT_RING(ring, CP_TYPE3_PKT | ((cnt-1) << 16) | ((opcode & 0xFF) << 8));
 }
@@ -110,8 +119,23 @@ OUT_IB(struct fd_ringbuffer *ring, struct fd_ringmarker *start,
 		struct fd_ringmarker *end)
 {
 	OUT_PKT3(ring, CP_INDIRECT_BUFFER, 2);
+	RING_PROF_RELOC();
+	RING_PROF_DWORDS(1);
 	fd_ringbuffer_emit_reloc_ring(ring, start, end);
 	OUT_RING(ring, fd_ringmarker_dwords(start, end));
 }
 
+/* fd_ringbuffer_flush(), traced: */
+static inline int FLUSH_RING(struct fd_ringbuffer *ring)
+{
+	int ret;
+
+	RING_PROF_END();
+	TRACE_BEGIN(TRACE_RING_FLUSH, (uintptr_t)ring, 0);
+	ret = fd_ringbuffer_flush(ring);
+	TRACE_END(TRACE_RING_FLUSH, (uintptr_t)ring, ret);
+
+	return ret;
+}
+
 #endif /* RING_H_ */
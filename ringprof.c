@@ -0,0 +1,213 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#ifdef RING_PROFILE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "ringprof.h"
+#include "util.h"
+
+__thread struct ring_prof *ring_prof_cur;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ring_prof *profs;
+
+/* to convert TSC cycles to time: */
+static uint64_t ticks0, ns0;
+
+struct op_total {
+	uint64_t cycles, packets, dwords, relocs;
+	int op;
+};
+
+static const char * opcode_name(int op)
+{
+#define OP(x) case x: return #x
+	switch (op) {
+	case RING_PROF_PKT0: return "PKT0";
+	OP(CP_ME_INIT);
+	OP(CP_NOP);
+	OP(CP_INDIRECT_BUFFER);
+	OP(CP_INDIRECT_BUFFER_PFD);
+	OP(CP_WAIT_FOR_IDLE);
+	OP(CP_WAIT_REG_MEM);
+	OP(CP_WAIT_REG_EQ);
+	OP(CP_WAIT_REG_GTE);
+	OP(CP_WAIT_UNTIL_READ);
+	OP(CP_WAIT_IB_PFD_COMPLETE);
+	OP(CP_REG_RMW);
+	OP(CP_SET_BIN_DATA);
+	OP(CP_REG_TO_MEM);
+	OP(CP_MEM_WRITE);
+	OP(CP_MEM_WRITE_CNTR);
+	OP(CP_COND_EXEC);
+	OP(CP_COND_WRITE);
+	OP(CP_EVENT_WRITE);
+	OP(CP_EVENT_WRITE_SHD);
+	OP(CP_EVENT_WRITE_CFL);
+	OP(CP_EVENT_WRITE_ZPD);
+	OP(CP_RUN_OPENCL);
+	OP(CP_DRAW_INDX);
+	OP(CP_DRAW_INDX_2);
+	OP(CP_DRAW_INDX_BIN);
+	OP(CP_DRAW_INDX_2_BIN);
+	OP(CP_VIZ_QUERY);
+	OP(CP_SET_STATE);
+	OP(CP_SET_CONSTANT);
+	OP(CP_IM_LOAD);
+	OP(CP_IM_LOAD_IMMEDIATE);
+	OP(CP_LOAD_CONSTANT_CONTEXT);
+	OP(CP_INVALIDATE_STATE);
+	OP(CP_SET_SHADER_BASES);
+	OP(CP_SET_BIN_MASK);
+	OP(CP_SET_BIN_SELECT);
+	OP(CP_CONTEXT_UPDATE);
+	OP(CP_INTERRUPT);
+	OP(CP_IM_STORE);
+	OP(CP_SET_DRAW_INIT_FLAGS);
+	OP(CP_SET_PROTECTED_MODE);
+	OP(CP_LOAD_STATE);
+	OP(CP_COND_INDIRECT_BUFFER_PFE);
+	OP(CP_COND_INDIRECT_BUFFER_PFD);
+	OP(CP_SET_BIN);
+	OP(CP_TEST_TWO_MEMS);
+	OP(CP_WAIT_FOR_ME);
+	OP(CP_SET_DRAW_STATE);
+	OP(CP_DRAW_INDX_OFFSET);
+	OP(CP_DRAW_INDIRECT);
+	OP(CP_DRAW_INDX_INDIRECT);
+	OP(CP_DRAW_AUTO);
+	default: return NULL;
+	}
+#undef OP
+}
+
+/* first packet on a thread: */
+struct ring_prof * ring_prof_new(void)
+{
+	struct ring_prof *p = calloc(1, sizeof(*p));
+
+	p->cur = -1;
+
+	pthread_mutex_lock(&lock);
+	if (!profs) {
+		ticks0 = trace_clock();
+		ns0 = gettime_ns();
+		atexit(ring_prof_dump);
+	}
+	p->next = profs;
+	profs = p;
+	pthread_mutex_unlock(&lock);
+
+	ring_prof_cur = p;
+
+	return p;
+}
+
+static int cmp_cycles(const void *a, const void *b)
+{
+	const struct op_total *ta = a, *tb = b;
+	/* most expensive first: */
+	return (ta->cycles < tb->cycles) - (ta->cycles > tb->cycles);
+}
+
+void ring_prof_dump(void)
+{
+	struct op_total ops[RING_PROF_NR], total = {0};
+	struct ring_prof *p;
+	double ns_per_tick;
+	int i, n = 0;
+
+	memset(ops, 0, sizeof(ops));
+
+	/* merge the threads' counters, including threads which have exited
+	 * (their counters are never freed):
+	 */
+	pthread_mutex_lock(&lock);
+	for (p = profs; p; p = p->next) {
+		for (i = 0; i < RING_PROF_NR; i++) {
+			ops[i].cycles  += p->ops[i].cycles;
+			ops[i].packets += p->ops[i].packets;
+			ops[i].dwords  += p->ops[i].dwords;
+			ops[i].relocs  += p->ops[i].relocs;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	ns_per_tick = (double)(gettime_ns() - ns0) /
+			max(trace_clock() - ticks0, 1);
+
+	for (i = 0; i < RING_PROF_NR; i++) {
+		if (!ops[i].packets)
+			continue;
+		ops[i].op = i;
+		total.cycles  += ops[i].cycles;
+		total.packets += ops[i].packets;
+		total.dwords  += ops[i].dwords;
+		total.relocs  += ops[i].relocs;
+		ops[n++] = ops[i];
+	}
+
+	if (!n)
+		return;
+
+	qsort(ops, n, sizeof(ops[0]), cmp_cycles);
+
+	printf("emit profile: %"PRIu64" packets, %"PRIu64" dwords, %"PRIu64
+			" relocs, %"PRIu64" cycles (%.3fms)\n", total.packets,
+			total.dwords, total.relocs, total.cycles,
+			total.cycles * ns_per_tick / 1000000.0);
+	printf("  %-28s %6s %10s %10s %8s %12s %10s %10s\n", "opcode",
+			"%", "packets", "dwords", "relocs", "cycles", "cyc/pkt",
+			"cyc/dword");
+
+	for (i = 0; i < n; i++) {
+		const char *name = opcode_name(ops[i].op);
+		char buf[16];
+
+		if (!name) {
+			snprintf(buf, sizeof(buf), "0x%02x", ops[i].op);
+			name = buf;
+		}
+
+		printf("  %-28s %6.1f %10"PRIu64" %10"PRIu64" %8"PRIu64" %12"PRIu64
+				" %10.1f %10.1f\n", name,
+				100.0 * ops[i].cycles / max(total.cycles, 1),
+				ops[i].packets, ops[i].dwords, ops[i].relocs, ops[i].cycles,
+				(double)ops[i].cycles / ops[i].packets,
+				(double)ops[i].cycles / max(ops[i].dwords, 1));
+	}
+}
+
+#endif /* RING_PROFILE */
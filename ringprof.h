@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef RINGPROF_H_
+#define RINGPROF_H_
+
+#include <stdint.h>
+
+/*
+ * Emit cost profiling for the ring.h and cmdbuf.h helpers, only in a
+ * profiling build (configure --enable-ring-profile, which defines
+ * RING_PROFILE), otherwise the hooks compile to nothing.
+ *
+ * Each packet header starts an interval which lasts until the last of
+ * the packet's dwords is emitted, and the TSC cycles in it, along with
+ * the dwords and relocs emitted, are charged to the packet's opcode.  So
+ * the cost of an opcode includes working out the payload, but not the
+ * caller's work between packets.  A packet which is never completed is
+ * closed by the next packet header (or flush).  The counters are per
+ * thread, and are merged and printed, ranked by cycles, at exit.
+ */
+
+#ifdef RING_PROFILE
+
+#include "trace.h"
+
+#define RING_PROF_PKT0 256       /* type0 register writes */
+#define RING_PROF_NR   257
+
+struct ring_prof {
+	struct ring_prof *next;
+	int cur;                 /* opcode being emitted, or -1 */
+	uint32_t left;           /* dwords of it still to be emitted */
+	uint64_t start;
+	struct {
+		uint64_t packets, dwords, relocs, cycles;
+	} ops[RING_PROF_NR];
+};
+
+extern __thread struct ring_prof *ring_prof_cur;
+
+struct ring_prof * ring_prof_new(void);
+void ring_prof_dump(void);
+
+static inline struct ring_prof * ring_prof_get(void)
+{
+	struct ring_prof *p = ring_prof_cur;
+	return p ? p : ring_prof_new();
+}
+
+/* close the current interval: */
+static inline void RING_PROF_END(void)
+{
+	struct ring_prof *p = ring_prof_get();
+
+	if (p->cur >= 0) {
+		p->ops[p->cur].cycles += trace_clock() - p->start;
+		p->cur = -1;
+	}
+}
+
+/* ndwords includes the header: */
+static inline void RING_PROF_PKT(int op, uint32_t ndwords)
+{
+	struct ring_prof *p = ring_prof_get();
+	uint64_t now = trace_clock();
+
+	if (p->cur >= 0)
+		p->ops[p->cur].cycles += now - p->start;
+
+	p->cur = op;
+	p->left = ndwords;
+	p->start = now;
+	p->ops[op].packets++;
+}
+
+static inline void RING_PROF_DWORDS(uint32_t n)
+{
+	struct ring_prof *p = ring_prof_get();
+
+	if (p->cur < 0)
+		return;
+
+	p->ops[p->cur].dwords += n;
+
+	/* the packet is complete: */
+	if (n >= p->left)
+		RING_PROF_END();
+	else
+		p->left -= n;
+}
+
+static inline void RING_PROF_RELOC(void)
+{
+	struct ring_prof *p = ring_prof_get();
+	if (p->cur >= 0)
+		p->ops[p->cur].relocs++;
+}
+
+#else
+
+#define RING_PROF_PKT0 256
+
+static inline void RING_PROF_END(void) {}
+static inline void RING_PROF_PKT(int op, uint32_t ndwords) {}
+static inline void RING_PROF_DWORDS(uint32_t n) {}
+static inline void RING_PROF_RELOC(void) {}
+
+#endif /* RING_PROFILE */
+
+#endif /* RINGPROF_H_ */
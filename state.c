@@ -0,0 +1,209 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "state.h"
+#include "bo.h"
+
+struct state_cache * state_cache_new_user(uint32_t handle, void *ptr,
+		uint32_t size)
+{
+	struct state_cache *cache = calloc(1, sizeof(*cache));
+
+	if (!cache)
+		return NULL;
+
+	cache->shadow = malloc(size);
+	if (!cache->shadow) {
+		free(cache);
+		return NULL;
+	}
+
+	cache->handle = handle;
+	cache->map    = ptr;
+	cache->size   = size;
+
+	return cache;
+}
+
+struct state_cache * state_cache_new(struct fd_device *dev, int fd,
+		uint32_t size)
+{
+	struct fd_bo *bo = msm_bo_new(dev, fd, size, MSM_BO_WC);
+	struct state_cache *cache;
+
+	if (!bo) {
+		ERROR_MSG("failed to allocate state bo");
+		return NULL;
+	}
+
+	cache = state_cache_new_user(fd_bo_handle(bo), fd_bo_map(bo), size);
+	if (!cache) {
+		fd_bo_del(bo);
+		return NULL;
+	}
+
+	cache->bo = bo;
+
+	return cache;
+}
+
+void state_cache_del(struct state_cache *cache)
+{
+	if (cache->bo)
+		fd_bo_del(cache->bo);
+	free(cache->shadow);
+	free(cache->entries);
+	free(cache->table);
+	free(cache);
+}
+
+static uint64_t entry_hash(const void *priv, uint32_t i)
+{
+	const struct state_cache *cache = priv;
+	return cache->entries[i].hash;
+}
+
+/* find or add the copy of a block of state, returns NULL if it is not
+ * already in the cache and there is no room left for it:
+ */
+const struct state_entry * state_cache_get(struct state_cache *cache,
+		const uint32_t *data, uint32_t dwords)
+{
+	uint64_t hash = hash_dwords(data, dwords);
+	struct state_entry *entry;
+	uint32_t h, idx, offset;
+
+	/* keep the table at most half full: */
+	if (2 * (cache->nr_entries + 1) > cache->table_size)
+		hash_table_grow(&cache->table, &cache->table_size,
+				cache->nr_entries, entry_hash, cache);
+
+	h = hash_slot(hash, cache->table_size);
+	while (cache->table[h]) {
+		entry = &cache->entries[cache->table[h] - 1];
+		if ((entry->hash == hash) && (entry->dwords == dwords) &&
+				!memcmp(&cache->shadow[entry->offset / 4], data,
+						dwords * 4)) {
+			cache->hits++;
+			return entry;
+		}
+		h = hash_next(h, cache->table_size);
+	}
+
+	offset = ALIGN(cache->used, STATE_ALIGN);
+	if ((offset + dwords * 4) > cache->size)
+		return NULL;
+
+	memcpy(&cache->map[offset / 4], data, dwords * 4);
+	memcpy(&cache->shadow[offset / 4], data, dwords * 4);
+	cache->used = offset + dwords * 4;
+	cache->dwords_stored += dwords;
+
+	GROW(cache->entries, cache->nr_entries, cache->max_entries);
+
+	idx = cache->nr_entries++;
+	cache->entries[idx] = (struct state_entry){
+		.hash   = hash,
+		.offset = offset,
+		.dwords = dwords,
+	};
+	cache->table[h] = idx + 1;
+
+	return &cache->entries[idx];
+}
+
+static void load_one(struct state_cache *cache, struct cmdbuf *cb,
+		enum adreno_state_block block, enum adreno_state_type type,
+		uint32_t dst_off, const uint32_t *data, uint32_t dwords)
+{
+	const struct state_entry *entry = state_cache_get(cache, data, dwords);
+	uint32_t i;
+
+	cache->loads++;
+
+	if (entry) {
+		CB_PKT3(cb, CP_LOAD_STATE, 2);
+		CB_RING(cb, CP_LOAD_STATE_0_DST_OFF(dst_off) |
+				CP_LOAD_STATE_0_STATE_SRC(SS_INDIRECT) |
+				CP_LOAD_STATE_0_STATE_BLOCK(block) |
+				CP_LOAD_STATE_0_NUM_UNIT(dwords / 2));
+		cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+			.handle = cache->handle,
+			.flags = MSM_SUBMIT_BO_READ,
+			.offset = entry->offset,
+			.or = CP_LOAD_STATE_1_STATE_TYPE(type),
+		});
+		cache->dwords_avoided += dwords;
+		return;
+	}
+
+	cache->inline_loads++;
+
+	CB_PKT3(cb, CP_LOAD_STATE, 2 + dwords);
+	CB_RING(cb, CP_LOAD_STATE_0_DST_OFF(dst_off) |
+			CP_LOAD_STATE_0_STATE_SRC(SS_DIRECT) |
+			CP_LOAD_STATE_0_STATE_BLOCK(block) |
+			CP_LOAD_STATE_0_NUM_UNIT(dwords / 2));
+	CB_RING(cb, CP_LOAD_STATE_1_STATE_TYPE(type));
+	for (i = 0; i < dwords; i++)
+		CB_RING(cb, data[i]);
+}
+
+/* load a block of state, indirectly from the cache if possible: */
+void state_load(struct state_cache *cache, struct cmdbuf *cb,
+		enum adreno_state_block block, enum adreno_state_type type,
+		uint32_t dst_off, const uint32_t *data, uint32_t dwords)
+{
+	assert(!(dwords & 1));
+
+	while (dwords > 2 * STATE_MAX_UNITS) {
+		load_one(cache, cb, block, type, dst_off, data,
+				2 * STATE_MAX_UNITS);
+		dst_off += STATE_MAX_UNITS;
+		data += 2 * STATE_MAX_UNITS;
+		dwords -= 2 * STATE_MAX_UNITS;
+	}
+
+	load_one(cache, cb, block, type, dst_off, data, dwords);
+}
+
+void state_cache_dump_stats(struct state_cache *cache)
+{
+	printf("state cache: %u blocks, %u/%u bytes used\n", cache->nr_entries,
+			cache->used, cache->size);
+	printf("  %"PRIu64" loads, %"PRIu64" hits, %"PRIu64" inline (cache full)\n",
+			cache->loads, cache->hits, cache->inline_loads);
+	printf("  %"PRIu64" dwords stored, %"PRIu64" inline dwords avoided\n",
+			cache->dwords_stored, cache->dwords_avoided);
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef STATE_H_
+#define STATE_H_
+
+#include <stdint.h>
+
+#include <freedreno_drmif.h>
+
+#include "cmdbuf.h"
+#include "util.h"
+
+/*
+ * A cache of immutable shader and constant state, loaded with
+ * CP_LOAD_STATE.  Each distinct block of state is copied once into the
+ * cache's bo, and found again by a hash of its contents, so loading it
+ * costs a 3 dword CP_LOAD_STATE with SS_INDIRECT pointing at the copy,
+ * rather than the state itself inline (SS_DIRECT) in the cmdstream.
+ *
+ * Hits are checked against a CPU copy of the bo, so the (write-combined)
+ * bo is never read back.  Nothing is ever evicted: once the bo is full,
+ * state which is not already in the cache is loaded inline instead.
+ *
+ * Like a cmdbuf, the cache can also sit on memory which is not an fd_bo
+ * (see state_cache_new_user()), for example an emulated bo.
+ *
+ * Blocks are just dwords, so the cache also holds the IBs of draw state
+ * groups, see drawstate.h.
+ *
+ * NUM_UNIT (and DST_OFF) count 2 dword units, ie. one instruction or half
+ * a vec4 constant, so state must be an even number of dwords.  Blocks of
+ * more units than NUM_UNIT can hold are loaded in several pieces.
+ */
+
+/* alignment of each block of state within the bo: */
+#define STATE_ALIGN 32
+
+/* most units a single CP_LOAD_STATE can load: */
+#define STATE_MAX_UNITS (CP_LOAD_STATE_0_NUM_UNIT__MASK >> \
+		CP_LOAD_STATE_0_NUM_UNIT__SHIFT)
+
+struct state_entry {
+	uint64_t hash;
+	uint32_t offset;         /* in bytes, within the bo */
+	uint32_t dwords;
+};
+
+struct state_cache {
+	struct fd_bo *bo;        /* NULL if not backed by an fd_bo */
+	uint32_t handle;
+	uint32_t *map;
+	uint32_t *shadow;        /* CPU copy of the bo contents */
+	uint32_t size, used;     /* in bytes */
+
+	struct state_entry *entries;
+	uint32_t nr_entries, max_entries;
+	uint32_t *table;         /* open addressed, entries[] index + 1 */
+	uint32_t table_size;
+
+	/* stats: */
+	uint64_t loads;
+	uint64_t hits;
+	uint64_t inline_loads;   /* loaded inline, the bo was full */
+	uint64_t dwords_stored;  /* copied into the bo */
+	uint64_t dwords_avoided; /* loaded indirectly, rather than inline */
+};
+
+struct state_cache * state_cache_new(struct fd_device *dev, int fd,
+		uint32_t size);
+struct state_cache * state_cache_new_user(uint32_t handle, void *ptr,
+		uint32_t size);
+void state_cache_del(struct state_cache *cache);
+const struct state_entry * state_cache_get(struct state_cache *cache,
+		const uint32_t *data, uint32_t dwords);
+void state_load(struct state_cache *cache, struct cmdbuf *cb,
+		enum adreno_state_block block, enum adreno_state_type type,
+		uint32_t dst_off, const uint32_t *data, uint32_t dwords);
+void state_cache_dump_stats(struct state_cache *cache);
+
+#endif /* STATE_H_ */
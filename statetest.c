@@ -0,0 +1,438 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "state.h"
+
+/* State cache test: a few frames of draws, each loading a vertex and
+ * fragment shader and a block of constants (out of a small set of
+ * distinct programs and constant blocks), are built with CP_LOAD_STATE
+ * through the state cache and run on the emulated CP.  Checks that each
+ * distinct block is stored once, and that every load (indirect, or inline
+ * once the cache is full) delivers the right state.  Reports the inline
+ * dwords avoided, and the cmdstream size and time to build it against
+ * loading everything inline.
+ */
+
+static uint32_t nr_draws = 200;
+static uint32_t nr_frames = 3;
+static uint32_t nr_progs = 8;
+static uint32_t nr_consts = 16;
+static uint32_t cache_size = 256 * 1024;
+
+struct blk {
+	enum adreno_state_block block;
+	enum adreno_state_type type;
+	uint32_t *data;
+	uint32_t dwords;
+};
+
+/* the vertex shaders, then the fragment shaders, then the constants: */
+static struct blk *blks;
+static uint32_t nr_blks, max_dwords, total_dwords;
+/* the blocks a frame actually loads: */
+static uint32_t nr_used, used_dwords;
+
+struct run {
+	struct emu *emu;
+	struct emu_bo *bo;
+	struct state_cache *cache;
+	struct cmdbuf *cb;
+	uint64_t dwords;         /* cmdstream dwords over all frames */
+	/* time spent building it: the CP fetches indirect state just the
+	 * same as inline, so this is where the cache saves time:
+	 */
+	uint64_t emit_ns;
+};
+
+static uint32_t seed = 0x12345678;
+
+/* the n'th block loaded in a frame: each program is used for a run of
+ * draws, the constants change every draw:
+ */
+static const struct blk * frame_blk(uint32_t n)
+{
+	uint32_t draw = n / 3;
+
+	switch (n % 3) {
+	case 0:  return &blks[(draw / 4) % nr_progs];
+	case 1:  return &blks[nr_progs + (draw / 4) % nr_progs];
+	default: return &blks[2 * nr_progs + draw % nr_consts];
+	}
+}
+
+static void make_blks(void)
+{
+	uint32_t *used;
+	uint32_t i, j;
+
+	nr_blks = 2 * nr_progs + nr_consts;
+	blks = calloc(nr_blks, sizeof(blks[0]));
+
+	for (i = 0; i < nr_blks; i++) {
+		struct blk *b = &blks[i];
+
+		if (i < nr_progs) {
+			b->block = SB_VERT_SHADER;
+			b->type = ST_SHADER;
+			b->dwords = 2 * (32 + rnd(&seed) % 224);
+		} else if (i < 2 * nr_progs) {
+			b->block = SB_FRAG_SHADER;
+			b->type = ST_SHADER;
+			b->dwords = 2 * (32 + rnd(&seed) % 224);
+		} else {
+			b->block = SB_FRAG_SHADER;
+			b->type = ST_CONSTANTS;
+			b->dwords = 4 * (8 + rnd(&seed) % 56);
+		}
+
+		b->data = malloc(b->dwords * 4);
+		for (j = 0; j < b->dwords; j++)
+			b->data[j] = rnd(&seed) ^ (i << 24);
+
+		max_dwords = max(max_dwords, b->dwords);
+		total_dwords += b->dwords;
+	}
+
+	used = calloc(nr_blks, sizeof(used[0]));
+	for (i = 0; i < 3 * nr_draws; i++) {
+		const struct blk *b = frame_blk(i);
+
+		if (!used[b - blks]++) {
+			nr_used++;
+			used_dwords += b->dwords;
+		}
+	}
+	free(used);
+}
+
+static int run_frames(struct run *run, uint32_t size, int decode)
+{
+	uint32_t f, i, n;
+	int ret = 0;
+
+	memset(run, 0, sizeof(*run));
+
+	run->emu = emu_new();
+	run->emu->decode = decode;
+	run->bo = emu_bo_new(run->emu, size);
+	run->cache = state_cache_new_user(run->bo->handle, run->bo->map, size);
+	run->cb = emu_cmdbuf_new(run->emu,
+			nr_draws * (3 * (3 + max_dwords) + 4) * 4 + 64);
+
+	for (f = 0; (f < nr_frames) && !ret; f++) {
+		struct msm_submit *submit;
+		uint64_t t = gettime_ns();
+
+		cmdbuf_reset(run->cb);
+
+		for (i = 0, n = 0; i < nr_draws; i++) {
+			uint32_t j;
+
+			for (j = 0; j < 3; j++, n++) {
+				const struct blk *b = frame_blk(n);
+				state_load(run->cache, run->cb, b->block,
+						b->type, 0, b->data, b->dwords);
+			}
+
+			CB_PKT3(run->cb, CP_DRAW_INDX, 3);
+			CB_RING(run->cb, 0x00000000);
+			CB_RING(run->cb, DRAW(DI_PT_TRILIST,
+					DI_SRC_SEL_AUTO_INDEX, INDEX_SIZE_IGN,
+					IGNORE_VISIBILITY));
+			CB_RING(run->cb, 3);
+		}
+
+		run->emit_ns += gettime_ns() - t;
+		run->dwords += cmdbuf_dwords(run->cb);
+
+		submit = msm_submit_new(-1, MSM_PIPE_3D0);
+		emu_attach(run->emu, submit);
+		msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, run->cb);
+		ret = msm_submit_flush(submit);
+		msm_submit_del(submit);
+	}
+
+	return ret;
+}
+
+static void run_fini(struct run *run)
+{
+	state_cache_del(run->cache);
+	cmdbuf_del(run->cb);
+	emu_del(run->emu);
+}
+
+/* walk the last frame's cmdstream (with relocs applied by the submit)
+ * checking what each CP_LOAD_STATE loads:
+ */
+static int check_loads(struct run *run)
+{
+	const uint32_t *dw = run->cb->start, *end = run->cb->cur;
+	uint32_t n = 0, errors = 0;
+
+	while (dw < end) {
+		uint32_t cnt = ((dw[0] >> 16) & 0x3fff) + 1;
+		uint32_t op = (dw[0] >> 8) & 0xff;
+		const struct blk *b;
+		const uint32_t *data;
+		uint32_t src, block, units;
+
+		if ((dw[0] & 0xc0000000) != CP_TYPE3_PKT) {
+			printf("  unexpected packet: %08x\n", dw[0]);
+			return -1;
+		}
+
+		if (op != CP_LOAD_STATE) {
+			dw += 1 + cnt;
+			continue;
+		}
+
+		b = frame_blk(n);
+		src = (dw[1] & CP_LOAD_STATE_0_STATE_SRC__MASK) >>
+				CP_LOAD_STATE_0_STATE_SRC__SHIFT;
+		block = (dw[1] & CP_LOAD_STATE_0_STATE_BLOCK__MASK) >>
+				CP_LOAD_STATE_0_STATE_BLOCK__SHIFT;
+		units = (dw[1] & CP_LOAD_STATE_0_NUM_UNIT__MASK) >>
+				CP_LOAD_STATE_0_NUM_UNIT__SHIFT;
+
+		if (src == SS_INDIRECT) {
+			data = emu_iova_ptr(run->emu, dw[2] &
+					CP_LOAD_STATE_1_EXT_SRC_ADDR__MASK,
+					b->dwords * 4);
+		} else {
+			data = (cnt == 2 + b->dwords) ? &dw[3] : NULL;
+		}
+
+		if ((block != b->block) ||
+				((dw[2] & CP_LOAD_STATE_1_STATE_TYPE__MASK) != b->type) ||
+				(2 * units != b->dwords) || !data ||
+				memcmp(data, b->data, b->dwords * 4)) {
+			if (errors++ < 10)
+				printf("  load %u (%s): wrong state\n", n,
+						(src == SS_INDIRECT) ? "indirect" : "inline");
+		}
+
+		dw += 1 + cnt;
+		n++;
+	}
+
+	if (n != 3 * nr_draws) {
+		printf("  %u loads, expected %u\n", n, 3 * nr_draws);
+		errors++;
+	}
+
+	return errors ? -1 : 0;
+}
+
+/* a block larger than NUM_UNIT can hold is loaded in pieces, each to
+ * where the previous one left off:
+ */
+static int check_split(void)
+{
+	uint32_t dwords = 2 * (2 * STATE_MAX_UNITS + 100), dst_off = 0, n = 0;
+	uint32_t *data = malloc(dwords * 4);
+	struct run run = {0};
+	const uint32_t *dw;
+	uint32_t i;
+	int ret = 0;
+
+	for (i = 0; i < dwords; i++)
+		data[i] = rnd(&seed);
+
+	run.emu = emu_new();
+	run.bo = emu_bo_new(run.emu, 0x4000);
+	run.cache = state_cache_new_user(run.bo->handle, run.bo->map, 0x4000);
+	run.cb = emu_cmdbuf_new(run.emu, 0x1000);
+
+	state_load(run.cache, run.cb, SB_VERT_SHADER, ST_SHADER, 0,
+			data, dwords);
+
+	for (dw = run.cb->start; dw < run.cb->cur; dw += 3) {
+		uint32_t units = (dw[1] & CP_LOAD_STATE_0_NUM_UNIT__MASK) >>
+				CP_LOAD_STATE_0_NUM_UNIT__SHIFT;
+		uint32_t off = (dw[1] & CP_LOAD_STATE_0_DST_OFF__MASK) >>
+				CP_LOAD_STATE_0_DST_OFF__SHIFT;
+		const struct state_entry *entry = &run.cache->entries[n];
+
+		if ((((dw[0] >> 8) & 0xff) != CP_LOAD_STATE) ||
+				(off != dst_off) || (entry->dwords != 2 * units) ||
+				memcmp(&run.cache->map[entry->offset / 4],
+						&data[2 * off], units * 8)) {
+			printf("  piece %u: wrong state\n", n);
+			ret = -1;
+			break;
+		}
+
+		dst_off += units;
+		n++;
+	}
+
+	if (!ret && (dst_off != dwords / 2)) {
+		printf("  %u of %u units loaded\n", dst_off, dwords / 2);
+		ret = -1;
+	}
+
+	run_fini(&run);
+	free(data);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct run cached, interp, full, none;
+	uint64_t loads;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "c:d:f:p:s:")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_consts = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			nr_draws = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			nr_frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			nr_progs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cache_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-c const-blocks] [-d draws] [-f frames] "
+					"[-p programs] [-s cache-size]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (!nr_draws || !nr_frames || !nr_progs || !nr_consts) {
+		printf("nothing to do\n");
+		return -1;
+	}
+
+	make_blks();
+	loads = 3ull * nr_draws * nr_frames;
+
+	printf("%u frames of %u draws, %u programs, %u constant blocks "
+			"(%u of %u dwords of state used)\n", nr_frames, nr_draws,
+			nr_progs, nr_consts, used_dwords, total_dwords);
+
+	/* a cache with room for nothing loads everything inline, and one
+	 * with room for half the state falls back to inline part way:
+	 */
+	if (run_frames(&cached, cache_size, 1) ||
+			run_frames(&interp, cache_size, 0) ||
+			run_frames(&full, used_dwords * 2, 1) ||
+			run_frames(&none, STATE_ALIGN, 1)) {
+		printf("could not run the frames\n");
+		return -1;
+	}
+
+	state_cache_dump_stats(cached.cache);
+
+	printf("inline:  %"PRIu64" dwords/frame, built in %.1fus\n",
+			none.dwords / nr_frames, none.emit_ns / 1000.0 / nr_frames);
+	printf("cached:  %"PRIu64" dwords/frame, built in %.1fus\n",
+			cached.dwords / nr_frames, cached.emit_ns / 1000.0 / nr_frames);
+	printf("%"PRIu64" inline dwords avoided (%.1f%% of the cmdstream)\n",
+			cached.cache->dwords_avoided,
+			100.0 * cached.cache->dwords_avoided / none.dwords);
+
+	printf("Test 1: each distinct block is stored once\n");
+	if ((cached.cache->nr_entries != nr_used) ||
+			(cached.cache->dwords_stored != used_dwords) ||
+			(cached.cache->loads != loads) ||
+			(cached.cache->hits != loads - nr_used) ||
+			(cached.cache->inline_loads != 0) ||
+			(cached.emu->stats.state_dwords !=
+				cached.cache->dwords_avoided)) {
+		state_cache_dump_stats(cached.cache);
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 2: every load delivers the right state\n");
+	if (check_loads(&cached) || check_loads(&none)) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 3: a full cache falls back to inline loads\n");
+	if (check_loads(&full) || !full.cache->inline_loads ||
+			!full.cache->dwords_avoided ||
+			(none.cache->inline_loads != loads)) {
+		state_cache_dump_stats(full.cache);
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 4: interpreter matches decoded IBs\n");
+	if (memcmp(&cached.emu->stats, &interp.emu->stats,
+			sizeof(cached.emu->stats))) {
+		emu_dump_stats(cached.emu, "decoded", &cached.emu->stats);
+		emu_dump_stats(interp.emu, "interpreter", &interp.emu->stats);
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 5: blocks larger than NUM_UNIT are split\n");
+	if (check_split()) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	run_fini(&cached);
+	run_fini(&interp);
+	run_fini(&full);
+	run_fini(&none);
+
+	return ret;
+}
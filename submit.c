@@ -0,0 +1,243 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include "submit.h"
+#include "trace.h"
+#include "ringprof.h"
+
+struct msm_submit * msm_submit_new(int fd, uint32_t pipe)
+{
+	struct msm_submit *submit = calloc(1, sizeof(*submit));
+
+	if (!submit)
+		return NULL;
+
+	submit->fd = fd;
+	submit->pipe = pipe;
+
+	return submit;
+}
+
+void msm_submit_del(struct msm_submit *submit)
+{
+	free(submit->bos);
+	free(submit->bo_table);
+	free(submit->cmds);
+	free(submit->relocs);
+	free(submit);
+}
+
+static uint64_t hash_handle(uint32_t handle)
+{
+	return (uint64_t)handle * 0x9e3779b97f4a7c15ull;
+}
+
+static uint64_t bo_hash(const void *priv, uint32_t i)
+{
+	const struct msm_submit *submit = priv;
+	return hash_handle(submit->bos[i].handle);
+}
+
+/* find or add the bos[] entry for a bo, OR'ing in the usage flags: */
+uint32_t msm_submit_bo(struct msm_submit *submit,
+		uint32_t handle, uint32_t flags)
+{
+	uint32_t h, idx;
+
+	/* keep the table at most half full: */
+	if (2 * (submit->nr_bos + 1) > submit->bo_table_size)
+		hash_table_grow(&submit->bo_table, &submit->bo_table_size,
+				submit->nr_bos, bo_hash, submit);
+
+	h = hash_slot(hash_handle(handle), submit->bo_table_size);
+	while (submit->bo_table[h]) {
+		idx = submit->bo_table[h] - 1;
+		if (submit->bos[idx].handle == handle) {
+			submit->bos[idx].flags |= flags;
+			return idx;
+		}
+		h = hash_next(h, submit->bo_table_size);
+	}
+
+	GROW(submit->bos, submit->nr_bos, submit->max_bos);
+
+	idx = submit->nr_bos++;
+	submit->bos[idx] = (struct drm_msm_gem_submit_bo){
+		.flags  = flags,
+		.handle = handle,
+	};
+	submit->bo_table[h] = idx + 1;
+
+	return idx;
+}
+
+static bool has_ib_target(struct msm_submit *submit, uint32_t submit_idx,
+		uint32_t submit_offset)
+{
+	uint32_t i;
+
+	for (i = 0; i < submit->nr_cmds; i++) {
+		struct drm_msm_gem_submit_cmd *cmd = &submit->cmds[i];
+		if ((cmd->type == MSM_SUBMIT_CMD_IB_TARGET_BUF) &&
+				(cmd->submit_idx == submit_idx) &&
+				(cmd->submit_offset == submit_offset))
+			return true;
+	}
+
+	return false;
+}
+
+/* Append a cmd for the current contents of the cmdbuf.  The cmdbuf's
+ * bo must stay alive, and its contents untouched, until the submit is
+ * flushed, but the cmdbuf itself can be reset and re-used right away
+ * since the relocs are copied.
+ *
+ * Any IB targets called by the cmdbuf are added (once per submit) as
+ * IB_TARGET_BUF cmds, so the kernel patches their relocs.
+ */
+void msm_submit_cmd(struct msm_submit *submit, uint32_t type,
+		struct cmdbuf *cb)
+{
+	struct drm_msm_gem_submit_cmd *cmd;
+	uint32_t i;
+
+	for (i = 0; i < cb->nr_ibs; i++) {
+		struct cmdbuf *target = cb->ibs[i];
+		uint32_t idx = msm_submit_bo(submit, target->handle, MSM_SUBMIT_BO_READ);
+		if (!has_ib_target(submit, idx, cmdbuf_offset(target)))
+			msm_submit_cmd(submit, MSM_SUBMIT_CMD_IB_TARGET_BUF, target);
+	}
+
+	GROW(submit->cmds, submit->nr_cmds, submit->max_cmds);
+
+	cmd = &submit->cmds[submit->nr_cmds++];
+	*cmd = (struct drm_msm_gem_submit_cmd){
+		.type       = type,
+		.submit_idx = msm_submit_bo(submit, cb->handle, MSM_SUBMIT_BO_READ),
+		.submit_offset = cmdbuf_offset(cb),
+		.size       = cmdbuf_dwords(cb) * 4,
+		.nr_relocs  = cb->nr_relocs - cb->first_reloc,
+		/* index into submit->relocs, since that can still be
+		 * realloc'd.  Fixed up to a pointer in flush:
+		 */
+		.relocs     = submit->nr_relocs,
+	};
+
+	for (i = cb->first_reloc; i < cb->nr_relocs; i++) {
+		struct cmdbuf_reloc *r = &cb->relocs[i];
+
+		GROW(submit->relocs, submit->nr_relocs, submit->max_relocs);
+
+		submit->relocs[submit->nr_relocs++] =
+				(struct drm_msm_gem_submit_reloc){
+			.submit_offset = r->submit_offset,
+			.or            = r->or,
+			.shift         = r->shift,
+			.reloc_idx     = msm_submit_bo(submit, r->handle, r->flags),
+			.reloc_offset  = r->offset,
+		};
+	}
+}
+
+void msm_submit_reset(struct msm_submit *submit)
+{
+	submit->nr_bos = 0;
+	submit->nr_cmds = 0;
+	submit->nr_relocs = 0;
+	if (submit->bo_table)
+		memset(submit->bo_table, 0,
+				submit->bo_table_size * sizeof(submit->bo_table[0]));
+}
+
+int msm_submit_flush(struct msm_submit *submit)
+{
+	struct drm_msm_gem_submit req = {
+			.pipe    = submit->pipe,
+			.nr_bos  = submit->nr_bos,
+			.bos     = VOID2U64(submit->bos),
+			.nr_cmds = submit->nr_cmds,
+			.cmds    = VOID2U64(submit->cmds),
+	};
+	uint32_t i;
+	int ret;
+
+	if (!submit->nr_cmds)
+		return 0;
+
+	RING_PROF_END();
+	TRACE_BEGIN(TRACE_SUBMIT, submit->pipe, submit->nr_cmds);
+
+	for (i = 0; i < submit->nr_cmds; i++) {
+		struct drm_msm_gem_submit_cmd *cmd = &submit->cmds[i];
+		cmd->relocs = VOID2U64(&submit->relocs[cmd->relocs]);
+	}
+
+	if (submit->flush) {
+		ret = submit->flush(submit->priv, &req);
+	} else {
+		ret = drmCommandWriteRead(submit->fd, DRM_MSM_GEM_SUBMIT,
+				&req, sizeof(req));
+	}
+	if (ret) {
+		ERROR_MSG("submit failed: %d (%s)", ret, strerror(errno));
+	} else {
+		submit->fence = req.fence;
+	}
+
+	TRACE_END(TRACE_SUBMIT, submit->pipe, ret ? 0 : req.fence);
+
+	msm_submit_reset(submit);
+
+	return ret;
+}
+
+/* wait for a fence, with a timeout relative to now (zero to just poll): */
+int msm_wait_fence(int fd, uint32_t fence, uint64_t timeout_ns)
+{
+	uint64_t abs = gettime_ns() + timeout_ns;
+	struct drm_msm_wait_fence req = {
+			.fence = fence,
+			.timeout = {
+				.tv_sec  = abs / 1000000000,
+				.tv_nsec = abs % 1000000000,
+			},
+	};
+	int ret;
+
+	TRACE_BEGIN(TRACE_FENCE_WAIT, fence, timeout_ns / 1000);
+	ret = drmCommandWrite(fd, DRM_MSM_WAIT_FENCE, &req, sizeof(req));
+	TRACE_END(TRACE_FENCE_WAIT, fence, ret);
+
+	return ret;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SUBMIT_H_
+#define SUBMIT_H_
+
+#include <stdint.h>
+
+#include <freedreno_drmif.h>
+
+#ifndef __user
+#  define __user
+#endif
+#ifndef U642VOID
+#  define U642VOID(x) ((void *)(unsigned long)(x))
+#endif
+#ifndef VOID2U64
+#  define VOID2U64(x) ((uint64_t)(unsigned long)(x))
+#endif
+
+#include "msm_drm.h"
+
+#include "cmdbuf.h"
+
+/*
+ * Builder for a DRM_MSM_GEM_SUBMIT ioctl with an arbitrary number of
+ * cmds.  All the cmds added share a single bos[] table: each bo gets
+ * exactly one entry, with the usage flags of every reference OR'd
+ * together (the kernel rejects duplicate entries, see submittest).
+ */
+
+struct msm_submit {
+	int fd;
+	uint32_t pipe;           /* MSM_PIPE_x */
+
+	struct drm_msm_gem_submit_bo *bos;
+	uint32_t nr_bos, max_bos;
+	uint32_t *bo_table;      /* open addressed handle -> bos[] idx + 1 */
+	uint32_t bo_table_size;
+
+	struct drm_msm_gem_submit_cmd *cmds;
+	uint32_t nr_cmds, max_cmds;
+
+	struct drm_msm_gem_submit_reloc *relocs;
+	uint32_t nr_relocs, max_relocs;
+
+	uint32_t fence;          /* fence of the last flush */
+
+	/* by default submits go to the kernel, but this can be overridden
+	 * to send them somewhere else (such as the emulator, see emu.h):
+	 */
+	int (*flush)(void *priv, struct drm_msm_gem_submit *req);
+	void *priv;
+};
+
+struct msm_submit * msm_submit_new(int fd, uint32_t pipe);
+void msm_submit_del(struct msm_submit *submit);
+uint32_t msm_submit_bo(struct msm_submit *submit,
+		uint32_t handle, uint32_t flags);
+void msm_submit_cmd(struct msm_submit *submit, uint32_t type,
+		struct cmdbuf *cb);
+int msm_submit_flush(struct msm_submit *submit);
+void msm_submit_reset(struct msm_submit *submit);
+
+int msm_wait_fence(int fd, uint32_t fence, uint64_t timeout_ns);
+
+/* non-blocking check whether a fence has passed: */
+static inline bool msm_fence_passed(int fd, uint32_t fence)
+{
+	return msm_wait_fence(fd, fence, 0) == 0;
+}
+
+#endif /* SUBMIT_H_ */
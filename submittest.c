@@ -113,7 +113,7 @@ int main(int argc, char *argv[])
 	printf("Test 2: second level IB check:\n");
 	ring->cur = ring->last_start = ring->start;
 	OUT_IB(ring, start, end);
-	fd_ringbuffer_flush(ring);
+	FLUSH_RING(ring);
 	sleep(1);
 
 	printf("Test 3: invalid submit:\n");
@@ -0,0 +1,572 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define HAVE_X86 1
+#endif
+#if defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+#include "tile.h"
+
+uint32_t tile_fmt_cpp(enum a3xx_tex_fmt fmt)
+{
+	switch (fmt) {
+	case TFMT_NORM_UINT_NV12_Y_TILED:
+	case TFMT_NORM_UINT_NV12_Y:
+	case TFMT_NORM_UINT_I420_Y:
+	case TFMT_NORM_UINT_I420_U:
+	case TFMT_NORM_UINT_I420_V:
+	case TFMT_NORM_UINT_A8:
+	case TFMT_NORM_UINT_8:
+		return 1;
+	case TFMT_NORM_USHORT_565:
+	case TFMT_NORM_USHORT_5551:
+	case TFMT_NORM_USHORT_4444:
+	case TFMT_NORM_UINT_NV12_UV_TILED:
+	case TFMT_NORM_UINT_NV12_UV:
+	case TFMT_NORM_UINT_L8_A8:
+	case TFMT_NORM_UINT_8_8:
+	case TFMT_FLOAT_16:
+		return 2;
+	case TFMT_NORM_UINT_8_8_8:
+		return 3;
+	case TFMT_NORM_UINT_X8Z24:
+	case TFMT_NORM_UINT_2_10_10_10:
+	case TFMT_NORM_UINT_8_8_8_8:
+	case TFMT_FLOAT_16_16:
+	case TFMT_FLOAT_32:
+		return 4;
+	case TFMT_FLOAT_16_16_16_16:
+	case TFMT_FLOAT_32_32:
+		return 8;
+	case TFMT_FLOAT_32_32_32_32:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+int tile_layout_init(struct tile_layout *layout, enum a3xx_tile_mode mode,
+		uint32_t width, uint32_t height, uint32_t cpp)
+{
+	if (!width || !height || !cpp || (cpp > 16) ||
+			((mode != LINEAR) && (mode != TILE_32X32))) {
+		ERROR_MSG("invalid layout: %ux%u, cpp %u, mode %u",
+				width, height, cpp, mode);
+		return -EINVAL;
+	}
+
+	layout->mode = mode;
+	layout->width = width;
+	layout->height = height;
+	layout->cpp = cpp;
+
+	if (mode == LINEAR) {
+		layout->pitch = ALIGN(width, 32) * cpp;
+		layout->size = layout->pitch * height;
+	} else {
+		layout->pitch = ALIGN(width, 32) * 32 * cpp;
+		layout->size = layout->pitch * (ALIGN(height, 32) / 32);
+	}
+
+	return 0;
+}
+
+/* the kernels, per texel size, ie. 32 texel rows of: */
+#define COPY_RECT(copy, n) \
+	for (r = 0; r < rows; r++) \
+		copy(dst + r * dst_pitch, src + r * src_pitch, n)
+
+/*
+ * Plain C:
+ */
+
+static bool c_supported(void)
+{
+	return true;
+}
+
+static void
+c_copy_rect(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src,
+		uint32_t src_pitch, uint32_t bytes, uint32_t rows)
+{
+	uint32_t r;
+
+	switch (bytes) {
+	case 32:  COPY_RECT(memcpy, 32);  break;
+	case 64:  COPY_RECT(memcpy, 64);  break;
+	case 96:  COPY_RECT(memcpy, 96);  break;
+	case 128: COPY_RECT(memcpy, 128); break;
+	case 256: COPY_RECT(memcpy, 256); break;
+	case 512: COPY_RECT(memcpy, 512); break;
+	default:  COPY_RECT(memcpy, bytes); break;
+	}
+}
+
+static const struct tile_impl c_impl = {
+	.name = "c",
+	.supported = c_supported,
+	.copy_rect = c_copy_rect,
+};
+
+/* non-temporal stores need an aligned dst, on every row: */
+static bool dst_aligned(const uint8_t *dst, uint32_t dst_pitch,
+		uint32_t rows, uint32_t align)
+{
+	return !(((uintptr_t)dst | ((rows > 1) ? dst_pitch : 0)) & (align - 1));
+}
+
+#ifdef HAVE_X86
+
+/*
+ * SSE2, always there on x86-64 but checked anyway for 32 bit:
+ */
+
+#define SSE2 __attribute__((target("sse2")))
+#define INLINE inline __attribute__((always_inline))
+
+static bool sse2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+SSE2 static INLINE void sse2_copy(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+	uint32_t i = 0;
+
+	for (; i + 64 <= n; i += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i + 16]);
+		__m128i c = _mm_loadu_si128((const __m128i *)&src[i + 32]);
+		__m128i d = _mm_loadu_si128((const __m128i *)&src[i + 48]);
+		_mm_stream_si128((__m128i *)&dst[i], a);
+		_mm_stream_si128((__m128i *)&dst[i + 16], b);
+		_mm_stream_si128((__m128i *)&dst[i + 32], c);
+		_mm_stream_si128((__m128i *)&dst[i + 48], d);
+	}
+	for (; i + 16 <= n; i += 16)
+		_mm_stream_si128((__m128i *)&dst[i],
+				_mm_loadu_si128((const __m128i *)&src[i]));
+	if (i < n)
+		memcpy(&dst[i], &src[i], n - i);
+}
+
+SSE2 static void
+sse2_copy_rect(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src,
+		uint32_t src_pitch, uint32_t bytes, uint32_t rows)
+{
+	uint32_t r;
+
+	if (!dst_aligned(dst, dst_pitch, rows, 16)) {
+		c_copy_rect(dst, dst_pitch, src, src_pitch, bytes, rows);
+		return;
+	}
+
+	switch (bytes) {
+	case 32:  COPY_RECT(sse2_copy, 32);  break;
+	case 64:  COPY_RECT(sse2_copy, 64);  break;
+	case 96:  COPY_RECT(sse2_copy, 96);  break;
+	case 128: COPY_RECT(sse2_copy, 128); break;
+	case 256: COPY_RECT(sse2_copy, 256); break;
+	case 512: COPY_RECT(sse2_copy, 512); break;
+	default:  COPY_RECT(sse2_copy, bytes); break;
+	}
+}
+
+static const struct tile_impl sse2_impl = {
+	.name = "sse2",
+	.supported = sse2_supported,
+	.copy_rect = sse2_copy_rect,
+};
+
+/*
+ * AVX2:
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static bool avx2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+AVX2 static INLINE void avx2_copy(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+	uint32_t i = 0;
+
+	for (; i + 64 <= n; i += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i *)&src[i + 32]);
+		_mm256_stream_si256((__m256i *)&dst[i], a);
+		_mm256_stream_si256((__m256i *)&dst[i + 32], b);
+	}
+	for (; i + 32 <= n; i += 32)
+		_mm256_stream_si256((__m256i *)&dst[i],
+				_mm256_loadu_si256((const __m256i *)&src[i]));
+	if (i < n)
+		memcpy(&dst[i], &src[i], n - i);
+}
+
+AVX2 static void
+avx2_copy_rect(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src,
+		uint32_t src_pitch, uint32_t bytes, uint32_t rows)
+{
+	uint32_t r;
+
+	if (!dst_aligned(dst, dst_pitch, rows, 32)) {
+		sse2_copy_rect(dst, dst_pitch, src, src_pitch, bytes, rows);
+		return;
+	}
+
+	switch (bytes) {
+	case 32:  COPY_RECT(avx2_copy, 32);  break;
+	case 64:  COPY_RECT(avx2_copy, 64);  break;
+	case 96:  COPY_RECT(avx2_copy, 96);  break;
+	case 128: COPY_RECT(avx2_copy, 128); break;
+	case 256: COPY_RECT(avx2_copy, 256); break;
+	case 512: COPY_RECT(avx2_copy, 512); break;
+	default:  COPY_RECT(avx2_copy, bytes); break;
+	}
+}
+
+static const struct tile_impl avx2_impl = {
+	.name = "avx2",
+	.supported = avx2_supported,
+	.copy_rect = avx2_copy_rect,
+};
+
+#endif /* HAVE_X86 */
+
+#ifdef __ARM_NEON
+
+/*
+ * NEON (there are no non-temporal store intrinsics, so these are plain
+ * 64 byte stores, which still fill whole WC buffers):
+ */
+
+static bool neon_supported(void)
+{
+	return true;
+}
+
+static inline __attribute__((always_inline)) void
+neon_copy(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+	uint32_t i = 0;
+
+	for (; i + 64 <= n; i += 64)
+		vst1q_u8_x4(&dst[i], vld1q_u8_x4(&src[i]));
+	for (; i + 16 <= n; i += 16)
+		vst1q_u8(&dst[i], vld1q_u8(&src[i]));
+	if (i < n)
+		memcpy(&dst[i], &src[i], n - i);
+}
+
+static void
+neon_copy_rect(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src,
+		uint32_t src_pitch, uint32_t bytes, uint32_t rows)
+{
+	uint32_t r;
+
+	switch (bytes) {
+	case 32:  COPY_RECT(neon_copy, 32);  break;
+	case 64:  COPY_RECT(neon_copy, 64);  break;
+	case 96:  COPY_RECT(neon_copy, 96);  break;
+	case 128: COPY_RECT(neon_copy, 128); break;
+	case 256: COPY_RECT(neon_copy, 256); break;
+	case 512: COPY_RECT(neon_copy, 512); break;
+	default:  COPY_RECT(neon_copy, bytes); break;
+	}
+}
+
+static const struct tile_impl neon_impl = {
+	.name = "neon",
+	.supported = neon_supported,
+	.copy_rect = neon_copy_rect,
+};
+
+#endif /* __ARM_NEON */
+
+const struct tile_impl *tile_impls[] = {
+		&c_impl,
+#ifdef HAVE_X86
+		&sse2_impl,
+		&avx2_impl,
+#endif
+#ifdef __ARM_NEON
+		&neon_impl,
+#endif
+		NULL,
+};
+
+const struct tile_impl *tile_funcs;
+
+#define MEASURE_TILES 256
+
+/* time storing a 1MB band of 32x32 rgba8 tiles, the common case, best
+ * of a few runs (the first of which warms up the buffers).  Anything
+ * that fits in the caches would favour memcpy over the non-temporal
+ * stores, unlike real textures:
+ */
+static uint64_t measure(const struct tile_impl *impl, uint8_t *dst,
+		const uint8_t *src)
+{
+	uint64_t best = ~0ull;
+	uint32_t run, t;
+
+	for (run = 0; run < 4; run++) {
+		uint64_t ns = gettime_ns();
+
+		for (t = 0; t < MEASURE_TILES; t++)
+			impl->copy_rect(dst + t * 32 * 32 * 4, 32 * 4,
+					src + t * 32 * 4, MEASURE_TILES * 32 * 4,
+					32 * 4, 32);
+
+		ns = gettime_ns() - ns;
+		best = min(best, ns);
+	}
+
+	return best;
+}
+
+/* pick the fastest supported implementation, unless overridden by the
+ * MSMTEST_TILE environment variable.  Which is fastest depends on the
+ * compiler flags as much as the CPU (unoptimized, the SIMD kernels lose
+ * to memcpy), so they are timed rather than assumed:
+ */
+void tile_init(void)
+{
+	const char *name = getenv("MSMTEST_TILE");
+	const struct tile_impl *best = &c_impl;
+	uint32_t size = MEASURE_TILES * 32 * 32 * 4;
+	uint64_t best_ns = ~0ull;
+	void *src = NULL, *dst = NULL;
+	int i;
+
+	if (name && !tile_use(name))
+		return;
+
+	if (!posix_memalign(&src, 64, size) &&
+			!posix_memalign(&dst, 64, size)) {
+		memset(src, 0x5a, size);
+
+		for (i = 0; tile_impls[i]; i++) {
+			uint64_t ns;
+
+			if (!tile_impls[i]->supported())
+				continue;
+
+			ns = measure(tile_impls[i], dst, src);
+			if (ns < best_ns) {
+				best = tile_impls[i];
+				best_ns = ns;
+			}
+		}
+	}
+
+	free(src);
+	free(dst);
+
+	tile_funcs = best;
+}
+
+int tile_use(const char *name)
+{
+	int i;
+
+	for (i = 0; tile_impls[i]; i++) {
+		if (strcmp(tile_impls[i]->name, name))
+			continue;
+		if (!tile_impls[i]->supported()) {
+			ERROR_MSG("%s not supported", name);
+			return -ENOTSUP;
+		}
+		tile_funcs = tile_impls[i];
+		return 0;
+	}
+
+	ERROR_MSG("no tile implementation: %s", name);
+	return -EINVAL;
+}
+
+/* a range of bands (32 rows, ie. a row of tiles) to copy: */
+struct tile_job {
+	const struct tile_layout *layout;
+	const struct tile_impl *impl;
+	uint8_t *dst;
+	const uint8_t *src;
+	uint32_t linear_pitch;   /* of the linear side */
+	bool store;              /* linear -> layout, else layout -> linear */
+	uint32_t first, last;    /* bands */
+	pthread_t thread;
+	bool started;
+};
+
+static void copy_band(struct tile_job *job, uint32_t band)
+{
+	const struct tile_layout *l = job->layout;
+	const struct tile_impl *impl = job->impl;
+	uint32_t y = band * 32, rows = min(l->height - y, 32);
+	uint32_t tile_row = 32 * l->cpp, tile_size = 32 * tile_row;
+	uint32_t full = l->width / 32, rem = (l->width % 32) * l->cpp;
+	uint32_t lp = job->linear_pitch;
+	uint32_t tx, r;
+
+	if (l->mode == LINEAR) {
+		if (job->store)
+			impl->copy_rect(job->dst + y * l->pitch, l->pitch,
+					job->src + y * lp, lp,
+					l->width * l->cpp, rows);
+		else
+			impl->copy_rect(job->dst + y * lp, lp,
+					job->src + y * l->pitch, l->pitch,
+					l->width * l->cpp, rows);
+		return;
+	}
+
+	if (job->store) {
+		/* tile by tile, in the tiled layout's order: */
+		uint8_t *dst = job->dst + band * l->pitch;
+		const uint8_t *src = job->src + y * lp;
+
+		for (tx = 0; tx < full; tx++)
+			impl->copy_rect(dst + tx * tile_size, tile_row,
+					src + tx * tile_row, lp, tile_row, rows);
+		if (rem)
+			impl->copy_rect(dst + full * tile_size, tile_row,
+					src + full * tile_row, lp, rem, rows);
+	} else {
+		/* row by row, in the linear layout's order, each row being
+		 * a row of every tile in the band:
+		 */
+		for (r = 0; r < rows; r++) {
+			uint8_t *dst = job->dst + (y + r) * lp;
+			const uint8_t *src = job->src + band * l->pitch +
+					r * tile_row;
+
+			impl->copy_rect(dst, tile_row, src, tile_size,
+					tile_row, full);
+			if (rem)
+				impl->copy_rect(dst + full * tile_row, 0,
+						src + full * tile_size, 0, rem, 1);
+		}
+	}
+}
+
+static void * job_thread(void *arg)
+{
+	struct tile_job *job = arg;
+	uint32_t band;
+
+	for (band = job->first; band < job->last; band++)
+		copy_band(job, band);
+
+#ifdef HAVE_X86
+	/* order the non-temporal stores before anything that follows (a
+	 * fence per tile would cost more than the copies of small ones):
+	 */
+	_mm_sfence();
+#endif
+
+	return NULL;
+}
+
+static int run_jobs(const struct tile_layout *layout, uint8_t *dst,
+		const uint8_t *src, uint32_t linear_pitch, bool store,
+		uint32_t nr_threads)
+{
+	struct tile_job jobs[TILE_MAX_THREADS];
+	uint32_t nr_bands = ALIGN(layout->height, 32) / 32;
+	uint32_t n, i;
+
+	if (linear_pitch < layout->width * layout->cpp) {
+		ERROR_MSG("pitch too small: %u", linear_pitch);
+		return -EINVAL;
+	}
+
+	n = min(max(nr_threads, 1), TILE_MAX_THREADS);
+	n = min(n, nr_bands);
+	if (layout->size < TILE_MT_MIN_BYTES)
+		n = 1;
+
+	for (i = 0; i < n; i++) {
+		jobs[i] = (struct tile_job){
+			.layout = layout,
+			.impl = tile_impl(),
+			.dst = dst,
+			.src = src,
+			.linear_pitch = linear_pitch,
+			.store = store,
+			.first = nr_bands * i / n,
+			.last = nr_bands * (i + 1) / n,
+		};
+	}
+
+	/* if a thread can't be started, its bands are done here instead: */
+	for (i = 1; i < n; i++)
+		jobs[i].started = !pthread_create(&jobs[i].thread, NULL,
+				job_thread, &jobs[i]);
+
+	job_thread(&jobs[0]);
+
+	for (i = 1; i < n; i++) {
+		if (jobs[i].started)
+			pthread_join(jobs[i].thread, NULL);
+		else
+			job_thread(&jobs[i]);
+	}
+
+	return 0;
+}
+
+/* copy linear texels, src_pitch bytes apart, into the layout at dst: */
+int tile_store(const struct tile_layout *layout, void *dst,
+		const void *src, uint32_t src_pitch, uint32_t nr_threads)
+{
+	return run_jobs(layout, dst, src, src_pitch, true, nr_threads);
+}
+
+/* copy the layout's texels at src out to linear rows, dst_pitch bytes
+ * apart:
+ */
+int tile_load(const struct tile_layout *layout, void *dst,
+		uint32_t dst_pitch, const void *src, uint32_t nr_threads)
+{
+	return run_jobs(layout, dst, src, dst_pitch, false, nr_threads);
+}
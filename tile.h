@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef TILE_H_
+#define TILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "util.h"
+
+/*
+ * CPU texture layout: copying linear texels into a texture's layout
+ * (tile_store(), for uploads) and back (tile_load()), for either tile
+ * mode:
+ *
+ *   LINEAR       rows of texels, pitch aligned to 32 texels
+ *   TILE_32X32   32x32 texel tiles, in rows of tiles; each tile's texels
+ *                are row-major and contiguous (32 * cpp bytes per row,
+ *                32 * 32 * cpp per tile), partial tiles at the right and
+ *                bottom edges are padded
+ *
+ * Either way, the work is copying rectangles of rows between two
+ * pitches (for a tile, 32 rows of 32 texels), which is done by kernels
+ * per texel size (the row sizes are then constant), with plain C,
+ * SSE2 and AVX2 on x86, or NEON on arm, whichever is fastest when timed
+ * at run time (see tile_init()).  The SIMD kernels write with
+ * non-temporal stores, which is what write-combined bo mappings want,
+ * and is also faster into cached memory that won't be read back soon.
+ * Stores into the texture layout are done in its address order, so the
+ * writes to a WC bo are sequential.
+ *
+ * Large textures are split into bands of 32 rows across threads.
+ */
+
+/* below this, the threads cost more than they save: */
+#define TILE_MT_MIN_BYTES (256 * 1024)
+#define TILE_MAX_THREADS  16
+
+struct tile_layout {
+	enum a3xx_tile_mode mode;
+	uint32_t width, height;  /* in texels */
+	uint32_t cpp;            /* bytes per texel */
+	uint32_t pitch;          /* bytes per row, or row of tiles */
+	uint32_t size;           /* in bytes */
+};
+
+struct tile_impl {
+	const char *name;
+	bool (*supported)(void);
+	/* copy rows of 'bytes' bytes from src to dst, stepping each by
+	 * its pitch:
+	 */
+	void (*copy_rect)(uint8_t *dst, uint32_t dst_pitch,
+			const uint8_t *src, uint32_t src_pitch,
+			uint32_t bytes, uint32_t rows);
+};
+
+extern const struct tile_impl *tile_impls[];
+extern const struct tile_impl *tile_funcs;
+
+void tile_init(void);
+int tile_use(const char *name);
+
+static inline const struct tile_impl * tile_impl(void)
+{
+	if (!tile_funcs)
+		tile_init();
+	return tile_funcs;
+}
+
+uint32_t tile_fmt_cpp(enum a3xx_tex_fmt fmt);
+
+int tile_layout_init(struct tile_layout *layout, enum a3xx_tile_mode mode,
+		uint32_t width, uint32_t height, uint32_t cpp);
+
+/* byte offset of texel (x, y) within the layout: */
+static inline uint32_t
+tile_offset(const struct tile_layout *layout, uint32_t x, uint32_t y)
+{
+	if (layout->mode == LINEAR)
+		return y * layout->pitch + x * layout->cpp;
+
+	return (y / 32) * layout->pitch +
+			(((x / 32) * 32 * 32) + (y % 32) * 32 + (x % 32)) *
+			layout->cpp;
+}
+
+int tile_store(const struct tile_layout *layout, void *dst,
+		const void *src, uint32_t src_pitch, uint32_t nr_threads);
+int tile_load(const struct tile_layout *layout, void *dst,
+		uint32_t dst_pitch, const void *src, uint32_t nr_threads);
+
+#endif /* TILE_H_ */
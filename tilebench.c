@@ -0,0 +1,265 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "tile.h"
+
+/* Texture layout benchmark: stores linear texels into each tile mode
+ * (as a texture upload would) and loads them back, per texture format,
+ * with each implementation supported by the CPU (see tile.h), single
+ * threaded and across threads.  Reports MB/s of texels, and checks every
+ * combination against a per-texel reference (tile_offset()) on odd sized
+ * textures.
+ */
+
+#define MIN_BYTES   (64 * 1024 * 1024)   /* copied per timing */
+
+static uint32_t size = 2048;
+static uint32_t nr_threads = 4;
+
+static const struct {
+	const char *name;
+	enum a3xx_tex_fmt fmt;
+} formats[] = {
+	{ "r8",      TFMT_NORM_UINT_8 },
+	{ "rgb565",  TFMT_NORM_USHORT_565 },
+	{ "rgb8",    TFMT_NORM_UINT_8_8_8 },
+	{ "rgba8",   TFMT_NORM_UINT_8_8_8_8 },
+	{ "rgba16f", TFMT_FLOAT_16_16_16_16 },
+	{ "rgba32f", TFMT_FLOAT_32_32_32_32 },
+};
+
+static const struct {
+	const char *name;
+	enum a3xx_tile_mode mode;
+} modes[] = {
+	{ "linear", LINEAR },
+	{ "32x32",  TILE_32X32 },
+};
+
+static uint32_t seed = 0x12345678;
+
+static void * alloc(uint32_t bytes)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, 64, ALIGN(bytes, 64)))
+		return NULL;
+	memset(ptr, 0, bytes);
+	return ptr;
+}
+
+/* check a store and load of a w x h texture, against tile_offset(): */
+static int check(enum a3xx_tile_mode mode, uint32_t w, uint32_t h,
+		uint32_t cpp, uint32_t threads)
+{
+	struct tile_layout l;
+	uint8_t *lin, *tex, *ref, *back;
+	uint32_t pitch = w * cpp, x, y, i;
+	int errors = 0;
+
+	if (tile_layout_init(&l, mode, w, h, cpp))
+		return 1;
+
+	lin = alloc(pitch * h);
+	back = alloc(pitch * h);
+	tex = alloc(l.size);
+	ref = alloc(l.size);
+
+	for (i = 0; i < pitch * h; i++)
+		lin[i] = rnd(&seed);
+
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			memcpy(&ref[tile_offset(&l, x, y)],
+					&lin[y * pitch + x * cpp], cpp);
+
+	tile_store(&l, tex, lin, pitch, threads);
+	if (memcmp(tex, ref, l.size)) {
+		printf("  %s: store %s %ux%u cpp %u, %u threads differs\n",
+				tile_impl()->name, mode == LINEAR ? "linear" : "32x32",
+				w, h, cpp, threads);
+		errors++;
+	}
+
+	tile_load(&l, back, pitch, ref, threads);
+	if (memcmp(back, lin, pitch * h)) {
+		printf("  %s: load %s %ux%u cpp %u, %u threads differs\n",
+				tile_impl()->name, mode == LINEAR ? "linear" : "32x32",
+				w, h, cpp, threads);
+		errors++;
+	}
+
+	free(lin);
+	free(back);
+	free(tex);
+	free(ref);
+
+	return errors;
+}
+
+static int check_all(void)
+{
+	static const uint32_t sizes[][2] = {
+		{ 1, 1 }, { 31, 33 }, { 32, 32 }, { 67, 45 }, { 100, 3 },
+		{ 300, 257 },
+	};
+	static const uint32_t cpps[] = { 1, 2, 3, 4, 8, 16 };
+	uint32_t m, s, c;
+	int errors = 0;
+
+	for (m = 0; m < ARRAY_SIZE(modes); m++)
+		for (s = 0; s < ARRAY_SIZE(sizes); s++)
+			for (c = 0; c < ARRAY_SIZE(cpps); c++)
+				errors += check(modes[m].mode, sizes[s][0],
+						sizes[s][1], cpps[c], 1) +
+					check(modes[m].mode, sizes[s][0],
+						sizes[s][1], cpps[c], 3);
+
+	return errors;
+}
+
+/* MB/s of texels, storing or loading: */
+static double bench(const struct tile_layout *l, uint8_t *lin,
+		uint8_t *tex, bool store, uint32_t threads)
+{
+	uint32_t pitch = l->width * l->cpp;
+	uint64_t bytes = (uint64_t)pitch * l->height;
+	uint32_t reps = max(MIN_BYTES / bytes, 1), i;
+	uint64_t t = gettime_ns();
+
+	for (i = 0; i < reps; i++) {
+		if (store)
+			tile_store(l, tex, lin, pitch, threads);
+		else
+			tile_load(l, lin, pitch, tex, threads);
+	}
+
+	t = gettime_ns() - t;
+
+	return t ? (double)bytes * reps * 1000 / t : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t *lin, *tex;
+	uint32_t f, m, i;
+	int opt, errors = 0, ret = 0;
+
+	while ((opt = getopt(argc, argv, "s:t:")) != -1) {
+		switch (opt) {
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-s texture-size] [-t threads]\n",
+					argv[0]);
+			return -1;
+		}
+	}
+
+	if (!size || (size > 8192) || !nr_threads) {
+		printf("nothing to do\n");
+		return -1;
+	}
+
+	/* the largest texture, rgba32f: */
+	lin = alloc(size * size * 16);
+	tex = alloc(ALIGN(size, 32) * ALIGN(size, 32) * 16);
+	if (!lin || !tex) {
+		printf("could not allocate %ux%u textures\n", size, size);
+		return -1;
+	}
+	for (i = 0; i < size * size * 4; i++)
+		((uint32_t *)lin)[i] = rnd(&seed);
+
+	tile_init();
+	printf("%ux%u textures, %u threads, using %s:", size, size, nr_threads,
+			tile_impl()->name);
+	for (i = 0; tile_impls[i]; i++)
+		if (tile_impls[i]->supported())
+			printf(" %s", tile_impls[i]->name);
+	printf(" supported\n");
+
+	printf("%-8s %-7s %-6s %10s %10s %10s %10s   (MB/s)\n", "format",
+			"mode", "impl", "store", "store mt", "load", "load mt");
+
+	for (f = 0; f < ARRAY_SIZE(formats); f++) {
+		for (m = 0; m < ARRAY_SIZE(modes); m++) {
+			struct tile_layout l;
+
+			tile_layout_init(&l, modes[m].mode, size, size,
+					tile_fmt_cpp(formats[f].fmt));
+
+			for (i = 0; tile_impls[i]; i++) {
+				if (!tile_impls[i]->supported())
+					continue;
+				tile_use(tile_impls[i]->name);
+
+				printf("%-8s %-7s %-6s %10.0f %10.0f %10.0f %10.0f\n",
+						formats[f].name, modes[m].name,
+						tile_impls[i]->name,
+						bench(&l, lin, tex, true, 1),
+						bench(&l, lin, tex, true, nr_threads),
+						bench(&l, lin, tex, false, 1),
+						bench(&l, lin, tex, false, nr_threads));
+			}
+		}
+	}
+
+	for (i = 0; tile_impls[i]; i++) {
+		if (!tile_impls[i]->supported())
+			continue;
+		tile_use(tile_impls[i]->name);
+		errors += check_all();
+	}
+
+	printf("Test 1: every implementation matches the reference layout\n");
+	if (errors) {
+		printf("FAILED (%d errors)\n", errors);
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	free(lin);
+	free(tex);
+
+	return ret;
+}
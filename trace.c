@@ -0,0 +1,200 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "trace.h"
+
+int trace_enabled;
+__thread struct trace_buf *trace_cur;
+
+static struct {
+	pthread_mutex_t lock;
+	/* buffers are never freed, since a thread could still be holding
+	 * on to its own after tracing stops (they are reused if it starts
+	 * again):
+	 */
+	struct trace_buf *bufs;
+	uint32_t nr_threads;
+
+	FILE *f;
+	struct trace_hdr hdr;
+	pthread_t thread;
+	int stop;
+} trace = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* first record on a thread, give it its own ring: */
+struct trace_buf * trace_buf_new(void)
+{
+	struct trace_buf *buf;
+	void *p;
+
+	if (posix_memalign(&p, 64, sizeof(*buf)))
+		return NULL;
+	buf = p;
+
+	memset(buf, 0, offsetof(struct trace_buf, recs));
+
+	pthread_mutex_lock(&trace.lock);
+	buf->thread = trace.nr_threads++;
+	buf->next = trace.bufs;
+	__atomic_store_n(&trace.bufs, buf, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trace.lock);
+
+	trace_cur = buf;
+
+	return buf;
+}
+
+static void drain(struct trace_buf *buf)
+{
+	uint32_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = buf->tail;
+
+	while (tail != head) {
+		uint32_t idx = tail & (TRACE_BUF_SIZE - 1);
+		uint32_t n = min(head - tail, TRACE_BUF_SIZE - idx);
+
+		fwrite(&buf->recs[idx], sizeof(buf->recs[0]), n, trace.f);
+		tail += n;
+	}
+
+	__atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void drain_all(void)
+{
+	struct trace_buf *buf;
+
+	/* buffers are only ever added at the head, so the list can be
+	 * walked without the lock:
+	 */
+	for (buf = __atomic_load_n(&trace.bufs, __ATOMIC_ACQUIRE); buf;
+			buf = buf->next)
+		drain(buf);
+}
+
+static void * writer(void *arg)
+{
+	const struct timespec period = { .tv_nsec = 1000000 };
+
+	while (!__atomic_load_n(&trace.stop, __ATOMIC_ACQUIRE)) {
+		drain_all();
+		nanosleep(&period, NULL);
+	}
+
+	return NULL;
+}
+
+int trace_start(const char *path)
+{
+	struct trace_buf *buf;
+	int ret;
+
+	if (trace_enabled)
+		return -EBUSY;
+
+	trace.f = fopen(path, "w");
+	if (!trace.f) {
+		ERROR_MSG("could not open %s: %s", path, strerror(errno));
+		return -errno;
+	}
+
+	/* throw away anything left over from an earlier trace: */
+	for (buf = trace.bufs; buf; buf = buf->next) {
+		buf->tail = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+		buf->dropped = 0;
+	}
+
+	memset(&trace.hdr, 0, sizeof(trace.hdr));
+	trace.hdr.magic = TRACE_MAGIC;
+	trace.hdr.version = TRACE_VERSION;
+	trace.hdr.rec_size = sizeof(struct trace_rec);
+	trace.hdr.ticks0 = trace_clock();
+	trace.hdr.ns0 = gettime_ns();
+
+	/* the header is written again with the rest filled in on stop: */
+	fwrite(&trace.hdr, sizeof(trace.hdr), 1, trace.f);
+
+	trace.stop = 0;
+	ret = pthread_create(&trace.thread, NULL, writer, NULL);
+	if (ret) {
+		ERROR_MSG("could not start writer: %s", strerror(ret));
+		fclose(trace.f);
+		trace.f = NULL;
+		return -ret;
+	}
+
+	__atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void trace_stop(void)
+{
+	struct trace_buf *buf;
+
+	if (!trace_enabled)
+		return;
+
+	__atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&trace.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(trace.thread, NULL);
+
+	drain_all();
+
+	trace.hdr.ticks1 = trace_clock();
+	trace.hdr.ns1 = gettime_ns();
+	for (buf = trace.bufs; buf; buf = buf->next)
+		trace.hdr.dropped += buf->dropped;
+
+	fseek(trace.f, 0, SEEK_SET);
+	fwrite(&trace.hdr, sizeof(trace.hdr), 1, trace.f);
+	fclose(trace.f);
+	trace.f = NULL;
+
+	if (trace.hdr.dropped)
+		WARN_MSG("trace dropped %"PRIu64" records", trace.hdr.dropped);
+}
+
+/* MSM_TRACE=<file> traces any program linked with libmsmtest: */
+static void __attribute__((constructor)) trace_init(void)
+{
+	const char *path = getenv("MSM_TRACE");
+
+	if (path && !trace_start(path))
+		atexit(trace_stop);
+}
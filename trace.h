@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#include "util.h"
+
+/*
+ * Binary tracing, cheap enough to leave in the submit path: each thread
+ * appends fixed size records to its own single-producer/single-consumer
+ * ring, with a raw cycle counter timestamp, and a background thread
+ * drains the rings to a file.  Nothing on the recording side takes a
+ * lock or formats anything; if the writer falls behind, records are
+ * dropped (and counted) rather than stalling the thread.
+ *
+ * Tracing is started with trace_start(), or by setting MSM_TRACE=<file>
+ * in the environment, and the file is read back by traceview.
+ */
+
+enum trace_event {
+	TRACE_SUBMIT,       /* a0: pipe, a1: nr_cmds (begin) / fence (end) */
+	TRACE_FENCE_WAIT,   /* a0: fence, a1: timeout us (begin) / ret (end) */
+	TRACE_CPU_PREP,     /* a0: handle, a1: op (begin) / ret (end) */
+	TRACE_BO_ALLOC,     /* a0: size, a1: flags (begin) / handle (end) */
+	TRACE_MARK,         /* anything else, a0/a1 up to the caller */
+	TRACE_RING_FLUSH,   /* a0: ring, a1: - (begin) / ret (end) */
+	TRACE_GPU,          /* a0: pipe, a1: fence, timestamps in ns */
+	TRACE_NR_EVENTS,
+};
+
+enum trace_phase {
+	TRACE_PH_BEGIN,
+	TRACE_PH_END,
+	TRACE_PH_INSTANT,
+
+	/* the timestamp is CLOCK_MONOTONIC ns, rather than trace_clock()
+	 * ticks, for times that come from elsewhere (such as the GPU):
+	 */
+	TRACE_PH_NS = 0x100,
+};
+
+struct trace_rec {
+	uint64_t ts;         /* in trace_clock() ticks */
+	uint32_t a0, a1;
+	uint16_t event;
+	uint16_t phase;
+	uint32_t thread;
+};
+
+#define TRACE_MAGIC   0x45434152544d534dULL  /* "MSMTRACE" */
+#define TRACE_VERSION 1
+
+/* file header, the records follow: */
+struct trace_hdr {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t rec_size;
+	/* two points to convert ticks to ns, at start and stop: */
+	uint64_t ticks0, ns0;
+	uint64_t ticks1, ns1;
+	uint64_t dropped;
+};
+
+#define TRACE_BUF_SIZE 0x10000   /* records per thread, power of two */
+
+struct trace_buf {
+	struct trace_buf *next;
+	uint32_t thread;
+	uint64_t dropped;
+	/* head is only written by the owning thread and tail only by the
+	 * writer, on separate cachelines:
+	 */
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	struct trace_rec recs[TRACE_BUF_SIZE] __attribute__((aligned(64)));
+};
+
+extern int trace_enabled;
+extern __thread struct trace_buf *trace_cur;
+
+int trace_start(const char *path);
+void trace_stop(void);
+struct trace_buf * trace_buf_new(void);
+
+static inline uint64_t trace_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+	uint64_t v;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r" (v));
+	return v;
+#else
+	return gettime_ns();
+#endif
+}
+
+static inline void
+trace_rec_at(enum trace_event event, uint32_t phase, uint64_t ts,
+		uint32_t a0, uint32_t a1)
+{
+	struct trace_buf *buf = trace_cur;
+	struct trace_rec *rec;
+	uint32_t head;
+
+	if (!buf) {
+		buf = trace_buf_new();
+		if (!buf)
+			return;
+	}
+
+	head = buf->head;
+	if ((head - __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE)) ==
+			TRACE_BUF_SIZE) {
+		buf->dropped++;
+		return;
+	}
+
+	rec = &buf->recs[head & (TRACE_BUF_SIZE - 1)];
+	rec->ts = ts;
+	rec->a0 = a0;
+	rec->a1 = a1;
+	rec->event = event;
+	rec->phase = phase;
+	rec->thread = buf->thread;
+
+	__atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#define TRACE(event, phase, a0, a1) do { \
+		if (__builtin_expect(trace_enabled, 0)) \
+			trace_rec_at(event, phase, trace_clock(), a0, a1); \
+	} while (0)
+
+#define TRACE_BEGIN(event, a0, a1) TRACE(event, TRACE_PH_BEGIN, a0, a1)
+#define TRACE_END(event, a0, a1)   TRACE(event, TRACE_PH_END, a0, a1)
+#define TRACE_INSTANT(event, a0, a1) TRACE(event, TRACE_PH_INSTANT, a0, a1)
+
+/* a span of GPU execution on a pipe, with times in ns: */
+static inline void
+trace_gpu(uint32_t pipe, uint32_t fence, uint64_t start_ns, uint64_t end_ns)
+{
+	if (__builtin_expect(trace_enabled, 0)) {
+		trace_rec_at(TRACE_GPU, TRACE_PH_BEGIN | TRACE_PH_NS, start_ns,
+				pipe, fence);
+		trace_rec_at(TRACE_GPU, TRACE_PH_END | TRACE_PH_NS, end_ns,
+				pipe, fence);
+	}
+}
+
+static inline const char * trace_event_name(uint32_t event)
+{
+	static const char *names[] = {
+			[TRACE_SUBMIT]     = "submit",
+			[TRACE_FENCE_WAIT] = "fence_wait",
+			[TRACE_CPU_PREP]   = "cpu_prep",
+			[TRACE_BO_ALLOC]   = "bo_alloc",
+			[TRACE_MARK]       = "mark",
+			[TRACE_RING_FLUSH] = "ring_flush",
+			[TRACE_GPU]        = "gpu",
+	};
+	if (event < ARRAY_SIZE(names))
+		return names[event];
+	return "unknown";
+}
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,188 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "util.h"
+#include "trace.h"
+#include "emu.h"
+
+/* Measures the cost of recording a trace event (trace.h), with tracing
+ * disabled and enabled, from several threads at once, and then traces
+ * some submits to the emulator so the file has something to look at
+ * with traceview.
+ */
+
+static int nr_events = 1000000;
+static int nr_threads = 4;
+
+/* time to record n events, in batches small enough that the writer can
+ * keep up (so we measure the recording, not the dropping):
+ */
+static uint64_t record(int n)
+{
+	const int batch = TRACE_BUF_SIZE / 4;
+	uint64_t total = 0;
+	int i, j;
+
+	for (i = 0; i < n; i += batch) {
+		uint64_t t = gettime_ns();
+
+		for (j = 0; j < min(batch, n - i); j += 2) {
+			TRACE_BEGIN(TRACE_MARK, i, j);
+			TRACE_END(TRACE_MARK, i, j);
+		}
+
+		total += gettime_ns() - t;
+
+		/* let the writer catch up: */
+		while (trace_enabled && trace_cur &&
+				(__atomic_load_n(&trace_cur->tail, __ATOMIC_ACQUIRE) !=
+						trace_cur->head))
+			sched_yield();
+	}
+
+	return total;
+}
+
+static void * thread_fn(void *arg)
+{
+	uint64_t *ns = arg;
+	*ns = record(nr_events);
+	return NULL;
+}
+
+static double bench_threads(void)
+{
+	pthread_t threads[nr_threads];
+	uint64_t ns[nr_threads], total = 0;
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&threads[i], NULL, thread_fn, &ns[i]);
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+		total += ns[i];
+	}
+
+	return (double)total / ((uint64_t)nr_events * nr_threads);
+}
+
+/* some traced submits, through the emulator.  Every 16th one waits for
+ * the CPU, and only completes (along with the submits queued behind it)
+ * when the register is written:
+ */
+static void trace_submits(int n)
+{
+	struct emu *emu = emu_new();
+	struct msm_submit *submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	struct cmdbuf *cb = emu_cmdbuf_new(emu, 0x4000);
+	int i, j;
+
+	emu_attach(emu, submit);
+
+	for (i = 0; i < n; i++) {
+		cmdbuf_reset(cb);
+		for (j = 0; j < (i % 16 + 1) * 64; j++) {
+			CB_PKT0(cb, REG_AXXX_CP_SCRATCH_REG0 + (j % 8), 1);
+			CB_RING(cb, j);
+		}
+		if (!(i % 16)) {
+			CB_PKT3(cb, CP_WAIT_REG_EQ, 4);
+			CB_RING(cb, REG_AXXX_CP_SCRATCH_REG7);
+			CB_RING(cb, i + 1);
+			CB_RING(cb, 0xffffffff);
+			CB_RING(cb, 0x10);
+		}
+		msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+		msm_submit_flush(submit);
+		if ((i % 16) == 3)
+			emu_write_reg(emu, REG_AXXX_CP_SCRATCH_REG7, i - 2);
+	}
+
+	msm_submit_del(submit);
+	cmdbuf_del(cb);
+	emu_del(emu);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = "tracebench.trace";
+	uint64_t t;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "n:t:o:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_events = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			nr_threads = max(1, strtol(optarg, NULL, 0));
+			break;
+		case 'o':
+			path = optarg;
+			break;
+		default:
+			printf("usage: %s [-n events] [-t threads] [-o file]\n",
+					argv[0]);
+			return -1;
+		}
+	}
+
+	t = gettime_ns();
+	for (i = 0; i < nr_events; i++)
+		trace_clock();
+	printf("trace_clock():     %.1fns\n",
+			(double)(gettime_ns() - t) / nr_events);
+
+	printf("disabled:          %.1fns/event\n",
+			(double)record(nr_events) / nr_events);
+
+	if (trace_start(path))
+		return -1;
+
+	printf("enabled, 1 thread: %.1fns/event\n",
+			(double)record(nr_events) / nr_events);
+	printf("enabled, %d threads: %.1fns/event\n", nr_threads,
+			bench_threads());
+
+	trace_submits(256);
+
+	trace_stop();
+
+	printf("trace written to %s\n", path);
+
+	return 0;
+}
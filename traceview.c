@@ -0,0 +1,424 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "trace.h"
+#include "submit.h"
+
+/* Reads back a trace written by trace.h (eg. with MSM_TRACE=<file>), and
+ * prints latency percentiles for each kind of event, and optionally the
+ * whole timeline, or exports it as a Chrome trace to look at along with
+ * the GPU side.
+ */
+
+static struct trace_hdr hdr;
+static struct trace_rec *recs;
+static uint32_t nr_recs;
+
+/* a begin/end pair: */
+struct span {
+	uint64_t start, dur;     /* ns, start relative to the trace start */
+	const struct trace_rec *begin, *end;
+};
+
+static struct span *spans;
+static uint32_t nr_spans, max_spans;
+
+/* time since the start of the trace: */
+static uint64_t to_ns(const struct trace_rec *rec)
+{
+	double scale = 1.0;
+
+	if (rec->phase & TRACE_PH_NS)
+		return (rec->ts > hdr.ns0) ? (rec->ts - hdr.ns0) : 0;
+
+	if (hdr.ticks1 > hdr.ticks0)
+		scale = (double)(hdr.ns1 - hdr.ns0) / (hdr.ticks1 - hdr.ticks0);
+
+	if (rec->ts < hdr.ticks0)
+		return 0;
+
+	return (rec->ts - hdr.ticks0) * scale;
+}
+
+static int load(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	long size;
+
+	if (!f) {
+		ERROR_MSG("could not open %s: %s", path, strerror(errno));
+		return -errno;
+	}
+
+	if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+			(hdr.magic != TRACE_MAGIC) ||
+			(hdr.version != TRACE_VERSION) ||
+			(hdr.rec_size != sizeof(struct trace_rec))) {
+		ERROR_MSG("%s: not a trace (or from a different version)", path);
+		fclose(f);
+		return -EINVAL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f) - sizeof(hdr);
+	fseek(f, sizeof(hdr), SEEK_SET);
+
+	nr_recs = size / sizeof(recs[0]);
+	recs = malloc(max(nr_recs, 1) * sizeof(recs[0]));
+	nr_recs = fread(recs, sizeof(recs[0]), nr_recs, f);
+
+	fclose(f);
+
+	return 0;
+}
+
+/* records are in the file a thread's worth at a time, sort indices by
+ * time (keeping the order each thread recorded them in for ties):
+ */
+static int cmp_rec(const void *a, const void *b)
+{
+	uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+	uint64_t ta = to_ns(&recs[ia]), tb = to_ns(&recs[ib]);
+
+	if (ta != tb)
+		return (ta < tb) ? -1 : 1;
+	return (ia > ib) - (ia < ib);
+}
+
+static int cmp_dur(const void *a, const void *b)
+{
+	const struct span *sa = a, *sb = b;
+	return (sa->dur > sb->dur) - (sa->dur < sb->dur);
+}
+
+static int cmp_start(const void *a, const void *b)
+{
+	const struct span *sa = a, *sb = b;
+	return (sa->start > sb->start) - (sa->start < sb->start);
+}
+
+/* match up begins and ends, per thread and event (they can nest): */
+static void build_spans(void)
+{
+	struct {
+		uint32_t *stack;
+		uint32_t nr, max;
+	} *open = NULL;
+	uint32_t *order = malloc(max(nr_recs, 1) * sizeof(order[0]));
+	uint32_t nr_threads = 0, i, unmatched = 0;
+
+	for (i = 0; i < nr_recs; i++) {
+		order[i] = i;
+		nr_threads = max(nr_threads, recs[i].thread + 1);
+	}
+
+	qsort(order, nr_recs, sizeof(order[0]), cmp_rec);
+
+	open = calloc(max(nr_threads, 1) * TRACE_NR_EVENTS, sizeof(*open));
+
+	for (i = 0; i < nr_recs; i++) {
+		const struct trace_rec *rec = &recs[order[i]];
+		typeof(*open) *o;
+
+		if (rec->event >= TRACE_NR_EVENTS)
+			continue;
+
+		o = &open[rec->thread * TRACE_NR_EVENTS + rec->event];
+
+		switch (rec->phase & ~TRACE_PH_NS) {
+		case TRACE_PH_BEGIN:
+			GROW(o->stack, o->nr, o->max);
+			o->stack[o->nr++] = order[i];
+			break;
+		case TRACE_PH_END:
+			if (!o->nr) {
+				unmatched++;
+				break;
+			}
+			GROW(spans, nr_spans, max_spans);
+			spans[nr_spans].begin = &recs[o->stack[--o->nr]];
+			spans[nr_spans].end = rec;
+			spans[nr_spans].start = to_ns(spans[nr_spans].begin);
+			spans[nr_spans].dur = to_ns(rec) - spans[nr_spans].start;
+			nr_spans++;
+			break;
+		case TRACE_PH_INSTANT:
+			GROW(spans, nr_spans, max_spans);
+			spans[nr_spans++] = (struct span){
+				.start = to_ns(rec),
+				.begin = rec,
+				.end = rec,
+			};
+			break;
+		}
+	}
+
+	for (i = 0; i < nr_threads * TRACE_NR_EVENTS; i++) {
+		unmatched += open[i].nr;
+		free(open[i].stack);
+	}
+	free(open);
+	free(order);
+
+	printf("%u records from %u threads over %.3fms, %"PRIu64" dropped",
+			nr_recs, nr_threads, (hdr.ns1 - hdr.ns0) / 1000000.0,
+			hdr.dropped);
+	if (unmatched)
+		printf(", %u unmatched", unmatched);
+	printf("\n");
+}
+
+static double pct(struct span *s, uint32_t n, double p)
+{
+	return s[min((uint32_t)(p * n), n - 1)].dur / 1000.0;
+}
+
+static void percentiles(void)
+{
+	struct span *s = malloc(max(nr_spans, 1) * sizeof(s[0]));
+	uint32_t ev, i, n;
+
+	printf("%-12s %8s %10s %10s %10s %10s %10s %10s\n", "event", "count",
+			"mean(us)", "p50", "p90", "p99", "p99.9", "max");
+
+	for (ev = 0; ev < TRACE_NR_EVENTS; ev++) {
+		uint64_t sum = 0;
+
+		for (i = 0, n = 0; i < nr_spans; i++) {
+			if ((spans[i].begin->event == ev) &&
+					(spans[i].begin != spans[i].end)) {
+				s[n++] = spans[i];
+				sum += spans[i].dur;
+			}
+		}
+
+		if (!n)
+			continue;
+
+		qsort(s, n, sizeof(s[0]), cmp_dur);
+
+		printf("%-12s %8u %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+				trace_event_name(ev), n, sum / 1000.0 / n,
+				pct(s, n, 0.5), pct(s, n, 0.9), pct(s, n, 0.99),
+				pct(s, n, 0.999), s[n - 1].dur / 1000.0);
+	}
+
+	free(s);
+}
+
+static void timeline(void)
+{
+	uint32_t i;
+
+	qsort(spans, nr_spans, sizeof(spans[0]), cmp_start);
+
+	printf("%12s %6s %-12s %10s %10s %10s\n", "start(us)", "thread",
+			"event", "dur(us)", "a0", "a1");
+
+	for (i = 0; i < nr_spans; i++) {
+		struct span *s = &spans[i];
+
+		printf("%12.3f %6u %-12s ", s->start / 1000.0, s->begin->thread,
+				trace_event_name(s->begin->event));
+		if (s->begin == s->end)
+			printf("%10s", "-");
+		else
+			printf("%10.3f", s->dur / 1000.0);
+		/* begin args, and the end's second arg (the result): */
+		printf(" %10u %10u", s->begin->a0, s->begin->a1);
+		if (s->begin != s->end)
+			printf(" -> %u", s->end->a1);
+		printf("\n");
+	}
+}
+
+/* names for the begin a0/a1 and the end a1 of each event: */
+static const char *arg_names[TRACE_NR_EVENTS][3] = {
+		[TRACE_SUBMIT]     = { "pipe", "nr_cmds", "fence" },
+		[TRACE_FENCE_WAIT] = { "fence", "timeout_us", "ret" },
+		[TRACE_CPU_PREP]   = { "handle", "op", "ret" },
+		[TRACE_BO_ALLOC]   = { "size", "flags", "handle" },
+		[TRACE_MARK]       = { "a0", "a1", "a1" },
+		[TRACE_RING_FLUSH] = { "ring", NULL, "ret" },
+		[TRACE_GPU]        = { "pipe", "fence", NULL },
+};
+
+static const char * pipe_name(uint32_t pipe)
+{
+	switch (pipe) {
+	case MSM_PIPE_2D0: return "2d0";
+	case MSM_PIPE_2D1: return "2d1";
+	case MSM_PIPE_3D0: return "3d0";
+	default:           return "unknown";
+	}
+}
+
+/* Chrome trace event format (chrome://tracing, or ui.perfetto.dev): a
+ * "cpu" process with a track per thread, and a "gpu" process with a
+ * track per pipe, with flow arrows from each submit to its execution:
+ */
+static int export_json(const char *path)
+{
+	enum { PID_CPU = 1, PID_GPU = 2 };
+	uint32_t seen_pipes = 0, nr_threads = 0, i;
+	FILE *f = fopen(path, "w");
+	const char *sep = "";
+
+	if (!f) {
+		ERROR_MSG("could not open %s: %s", path, strerror(errno));
+		return -errno;
+	}
+
+	qsort(spans, nr_spans, sizeof(spans[0]), cmp_start);
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+#define EMIT(fmt, ...) do { \
+		fprintf(f, "%s" fmt, sep, ##__VA_ARGS__); \
+		sep = ",\n"; \
+	} while (0)
+
+	EMIT("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+			"\"args\":{\"name\":\"cpu\"}}", PID_CPU);
+	EMIT("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+			"\"args\":{\"name\":\"gpu\"}}", PID_GPU);
+
+	for (i = 0; i < nr_spans; i++) {
+		const struct span *s = &spans[i];
+		const struct trace_rec *b = s->begin, *e = s->end;
+		const char **names = arg_names[b->event];
+		int gpu = (b->event == TRACE_GPU);
+		uint32_t pid = gpu ? PID_GPU : PID_CPU;
+		uint32_t tid = gpu ? b->a0 : b->thread;
+
+		/* name each track the first time it shows up: */
+		if (gpu && (b->a0 < 32) && !(seen_pipes & (1 << b->a0))) {
+			seen_pipes |= 1 << b->a0;
+			EMIT("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+					"\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+					PID_GPU, b->a0, pipe_name(b->a0));
+		} else if (!gpu && (b->thread >= nr_threads)) {
+			for (; nr_threads <= b->thread; nr_threads++) {
+				EMIT("{\"ph\":\"M\",\"name\":\"thread_name\","
+						"\"pid\":%d,\"tid\":%u,\"args\":"
+						"{\"name\":\"thread %u\"}}",
+						PID_CPU, nr_threads, nr_threads);
+			}
+		}
+
+		if (b == e) {
+			EMIT("{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\","
+					"\"pid\":%u,\"tid\":%u,\"ts\":%.3f",
+					trace_event_name(b->event), pid, tid, s->start / 1000.0);
+		} else {
+			EMIT("{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%u,"
+					"\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+					trace_event_name(b->event), pid, tid,
+					s->start / 1000.0, s->dur / 1000.0);
+		}
+
+		fprintf(f, ",\"args\":{\"%s\":%u", names[0], b->a0);
+		if (names[1])
+			fprintf(f, ",\"%s\":%u", names[1], b->a1);
+		if ((b != e) && names[2])
+			fprintf(f, ",\"%s\":%u", names[2], e->a1);
+		fprintf(f, "}}");
+
+		/* flow from the end of a submit to the GPU executing it, by
+		 * pipe and fence:
+		 */
+		if ((b->event == TRACE_SUBMIT) && (b != e) && e->a1) {
+			EMIT("{\"ph\":\"s\",\"name\":\"exec\",\"cat\":\"submit\","
+					"\"id\":%"PRIu64",\"pid\":%u,\"tid\":%u,\"ts\":%.3f}",
+					((uint64_t)b->a0 << 32) | e->a1, pid, tid,
+					(s->start + s->dur) / 1000.0);
+		} else if (gpu) {
+			EMIT("{\"ph\":\"f\",\"bp\":\"e\",\"name\":\"exec\","
+					"\"cat\":\"submit\",\"id\":%"PRIu64",\"pid\":%u,"
+					"\"tid\":%u,\"ts\":%.3f}",
+					((uint64_t)b->a0 << 32) | b->a1, pid, tid,
+					s->start / 1000.0);
+		}
+	}
+
+#undef EMIT
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *json = NULL;
+	int opt, show_timeline = 0;
+
+	while ((opt = getopt(argc, argv, "tj:")) != -1) {
+		switch (opt) {
+		case 't':
+			show_timeline = 1;
+			break;
+		case 'j':
+			json = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != (argc - 1))
+		goto usage;
+
+	if (load(argv[optind]))
+		return -1;
+
+	build_spans();
+	percentiles();
+
+	if (show_timeline)
+		timeline();
+
+	if (json && export_json(json))
+		return -1;
+
+	return 0;
+
+usage:
+	printf("usage: %s [-t] [-j chrome-trace.json] trace-file\n", argv[0]);
+	return -1;
+}
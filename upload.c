@@ -0,0 +1,221 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "upload.h"
+#include "submit.h"
+#include "bo.h"
+#include "util.h"
+
+struct upload_ring * upload_ring_new(struct fd_device *dev, int fd,
+		uint32_t size)
+{
+	struct upload_ring *ring = calloc(1, sizeof(*ring));
+
+	if (!ring)
+		return NULL;
+
+	ring->fd = fd;
+	ring->size = size;
+	ring->bo = msm_bo_new(dev, fd, size, MSM_BO_WC);
+	if (!ring->bo) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->handle = fd_bo_handle(ring->bo);
+	ring->map = fd_bo_map(ring->bo);
+
+	return ring;
+}
+
+struct upload_ring * upload_ring_new_user(uint32_t handle, void *ptr,
+		uint32_t size)
+{
+	struct upload_ring *ring = calloc(1, sizeof(*ring));
+
+	if (!ring)
+		return NULL;
+
+	ring->fd = -1;
+	ring->handle = handle;
+	ring->map = ptr;
+	ring->size = size;
+
+	return ring;
+}
+
+void upload_ring_del(struct upload_ring *ring)
+{
+	if (ring->bo)
+		fd_bo_del(ring->bo);
+	free(ring->markers);
+	free(ring);
+}
+
+static int wait_fence(struct upload_ring *ring, uint32_t fence,
+		uint64_t timeout_ns)
+{
+	if (ring->wait)
+		return ring->wait(ring->priv, fence, timeout_ns);
+	return msm_wait_fence(ring->fd, fence, timeout_ns);
+}
+
+/* retire the oldest pending fence, blocking if @wait.  Returns 1 if it
+ * was retired, 0 if there is nothing (yet) to retire, or the error of a
+ * failed wait, in which case the space stays in use:
+ */
+static int retire_one(struct upload_ring *ring, bool wait)
+{
+	struct upload_marker *m;
+	int ret;
+
+	if (ring->first_marker == ring->nr_markers)
+		return 0;
+
+	m = &ring->markers[ring->first_marker];
+
+	if (wait_fence(ring, m->fence, 0)) {
+		uint64_t t;
+
+		if (!wait)
+			return 0;
+
+		t = gettime_ns();
+		ret = wait_fence(ring, m->fence, 5000000000ull);
+		ring->stall_ns += gettime_ns() - t;
+		ring->nr_stalls++;
+
+		if (ret) {
+			ERROR_MSG("wait for fence %u failed: %d", m->fence, ret);
+			return ret;
+		}
+	}
+
+	ring->tail = m->head;
+	ring->first_marker++;
+
+	return 1;
+}
+
+/* Allocate size bytes, returns a pointer to write the data to, and
+ * the bo/offset to reference it from the cmdstream (ie. OUT_RELOC()).
+ * For a ring which is not backed by an fd_bo, the bo is NULL and the
+ * data is referenced by ring->handle instead.
+ * Data allocated is considered in use until the next fence recorded
+ * with upload_ring_fence() has passed.
+ */
+void * upload_alloc(struct upload_ring *ring, uint32_t size, uint32_t align,
+		struct fd_bo **bo, uint32_t *offset)
+{
+	uint32_t pos = ring->head % ring->size;
+	uint32_t pad = ALIGN(pos, align) - pos;
+	bool wrap = false;
+	int ret;
+
+	if ((pos + pad + size) > ring->size) {
+		/* skip the remainder, and start again from the beginning: */
+		pad = ring->size - pos;
+		wrap = true;
+	}
+
+	if ((pad + size) > ring->size) {
+		ERROR_MSG("allocation too large: %u", size);
+		return NULL;
+	}
+
+	/* opportunistically retire anything already done: */
+	while ((ret = retire_one(ring, false)) > 0)
+		;
+	if (ret < 0)
+		return NULL;
+
+	while ((ring->head + pad + size - ring->tail) > ring->size) {
+		ret = retire_one(ring, true);
+		if (ret < 0)
+			return NULL;
+		if (!ret) {
+			/* everything in the way is un-fenced, ie. allocated
+			 * for the submit currently being built:
+			 */
+			ERROR_MSG("upload ring too small: %u bytes in use",
+					(uint32_t)(ring->head - ring->tail));
+			return NULL;
+		}
+	}
+
+	pos = (ring->head + pad) % ring->size;
+	ring->head += pad + size;
+
+	if (wrap)
+		ring->nr_wraps++;
+
+	ring->bytes += size;
+	ring->nr_allocs++;
+
+	*bo = ring->bo;
+	*offset = pos;
+
+	return ring->map + pos;
+}
+
+/* record the fence of the submit referencing everything allocated since
+ * the previous fence:
+ */
+void upload_ring_fence(struct upload_ring *ring, uint32_t fence)
+{
+	if (ring->head == ring->fenced)
+		return;
+
+	if (ring->first_marker == ring->nr_markers) {
+		ring->first_marker = ring->nr_markers = 0;
+	} else if ((ring->nr_markers == ring->max_markers) && ring->first_marker) {
+		ring->nr_markers -= ring->first_marker;
+		memmove(ring->markers, &ring->markers[ring->first_marker],
+				ring->nr_markers * sizeof(ring->markers[0]));
+		ring->first_marker = 0;
+	}
+
+	GROW(ring->markers, ring->nr_markers, ring->max_markers);
+	ring->markers[ring->nr_markers++] = (struct upload_marker){
+		.fence = fence,
+		.head  = ring->head,
+	};
+
+	ring->fenced = ring->head;
+}
+
+void upload_ring_dump_stats(struct upload_ring *ring)
+{
+	printf("upload: %"PRIu64" bytes in %"PRIu64" allocs, %"PRIu64" wraps, "
+			"%"PRIu64" stalls (%.3fms)\n", ring->bytes, ring->nr_allocs,
+			ring->nr_wraps, ring->nr_stalls, ring->stall_ns / 1000000.0);
+}
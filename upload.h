@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef UPLOAD_H_
+#define UPLOAD_H_
+
+#include <stdint.h>
+
+#include <freedreno_drmif.h>
+
+/*
+ * Streaming upload ring, for vertex/index/etc data written once by the
+ * CPU and consumed by the next submit.  A single persistently mapped
+ * write-combined bo, with allocations handed out linearly from a write
+ * cursor.  When the cursor wraps around, re-use of the space is gated
+ * on the fences recorded (with upload_ring_fence()) when the submits
+ * referencing that space were flushed.
+ *
+ * Positions are tracked as monotonically increasing byte counts, so
+ * (head - tail) is always the amount of space in use.
+ *
+ * Like a cmdbuf, the ring can also sit on memory which is not an fd_bo
+ * (see upload_ring_new_user()), in which case fences are waited on with
+ * the wait hook (see emu_attach_upload()) rather than the kernel.
+ */
+
+struct upload_marker {
+	uint32_t fence;
+	uint64_t head;           /* head at time the fence was recorded */
+};
+
+struct upload_ring {
+	int fd;
+	struct fd_bo *bo;        /* NULL if not backed by an fd_bo */
+	uint32_t handle;
+	uint8_t *map;
+	uint32_t size;
+
+	/* if set, used instead of waiting for fences on fd: */
+	int (*wait)(void *priv, uint32_t fence, uint64_t timeout_ns);
+	void *priv;
+
+	uint64_t head;           /* next byte to hand out */
+	uint64_t tail;           /* oldest byte possibly still in use */
+	uint64_t fenced;         /* head at the last recorded fence */
+
+	/* pending (unretired) fences, oldest first: */
+	struct upload_marker *markers;
+	uint32_t first_marker, nr_markers, max_markers;
+
+	/* stats: */
+	uint64_t bytes;          /* bytes allocated (excluding padding) */
+	uint64_t nr_allocs;
+	uint64_t nr_wraps;
+	uint64_t nr_stalls;      /* times we had to block on a fence */
+	uint64_t stall_ns;
+};
+
+struct upload_ring * upload_ring_new(struct fd_device *dev, int fd,
+		uint32_t size);
+struct upload_ring * upload_ring_new_user(uint32_t handle, void *ptr,
+		uint32_t size);
+void upload_ring_del(struct upload_ring *ring);
+void * upload_alloc(struct upload_ring *ring, uint32_t size, uint32_t align,
+		struct fd_bo **bo, uint32_t *offset);
+void upload_ring_fence(struct upload_ring *ring, uint32_t fence);
+void upload_ring_dump_stats(struct upload_ring *ring);
+
+#endif /* UPLOAD_H_ */
@@ -0,0 +1,159 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <xf86drm.h>
+
+#include <freedreno_drmif.h>
+#include <freedreno_ringbuffer.h>
+
+#include "util.h"
+#include "bo.h"
+#include "submit.h"
+#include "upload.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+
+/* streaming upload benchmark: each "frame" uploads a number of vertex/
+ * index sized buffers through the upload ring, references each of them
+ * from the frame's cmdbuf, and submits.  Reports upload bandwidth and
+ * how often we had to stall waiting for the GPU to release ring space,
+ * for a range of ring sizes.
+ */
+
+#define NFRAMES        256
+#define UPLOADS        64     /* per frame */
+#define MAX_UPLOAD     0x4000
+#define NCMDBUF        4
+
+static void run(int fd, struct fd_device *dev, struct fd_pipe *pipe,
+		uint32_t ring_size, const void *src)
+{
+	struct upload_ring *ring = upload_ring_new(dev, fd, ring_size);
+	struct msm_submit *submit = msm_submit_new(fd, MSM_PIPE_3D0);
+	struct cmdbuf *cbs[NCMDBUF];
+	uint32_t i, j, seed = 1;
+	uint64_t t;
+
+	if (!ring) {
+		printf("%10u: failed to allocate ring\n", ring_size);
+		return;
+	}
+
+	for (i = 0; i < NCMDBUF; i++)
+		cbs[i] = cmdbuf_new(dev, 0x2000);
+
+	t = gettime_ns();
+	for (i = 0; i < NFRAMES; i++) {
+		struct cmdbuf *cb = cbs[i % NCMDBUF];
+
+		msm_bo_cpu_prep(cb->bo, pipe, DRM_FREEDRENO_PREP_WRITE);
+		fd_bo_cpu_fini(cb->bo);
+		cmdbuf_reset(cb);
+
+		/* the payload of a CP_NOP is ignored by the CP, so we can
+		 * reference the uploads without the GPU doing anything with
+		 * them (but still have the bo in the submit):
+		 */
+		CB_PKT3(cb, CP_NOP, UPLOADS);
+
+		for (j = 0; j < UPLOADS; j++) {
+			uint32_t size = ALIGN((rnd(&seed) % MAX_UPLOAD) + 4, 4);
+			struct fd_bo *bo;
+			uint32_t offset;
+			void *ptr;
+
+			ptr = upload_alloc(ring, size, 64, &bo, &offset);
+			if (!ptr) {
+				CB_RING(cb, 0);
+				continue;
+			}
+
+			memcpy(ptr, src, size);
+			CB_RELOC(cb, bo, offset, 0);
+		}
+
+		msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, cb);
+		msm_submit_flush(submit);
+		upload_ring_fence(ring, submit->fence);
+	}
+	t = gettime_ns() - t;
+
+	printf("%10u: %8.3f GB/s, %6.2f stalls/frame, ", ring_size,
+			(double)ring->bytes / t, (double)ring->nr_stalls / NFRAMES);
+	upload_ring_dump_stats(ring);
+
+	for (i = 0; i < NCMDBUF; i++)
+		cmdbuf_del(cbs[i]);
+	msm_submit_del(submit);
+	upload_ring_del(ring);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fd_device *dev;
+	struct fd_pipe *pipe;
+	uint32_t size;
+	void *src;
+	int fd;
+
+	fd = drmOpen("msm", NULL);
+	if (fd < 0) {
+		printf("failed to initialize DRM\n");
+		return fd;
+	}
+
+	dev = fd_device_new(fd);
+	if (!dev) {
+		printf("failed to initialize freedreno device\n");
+		return -1;
+	}
+
+	pipe = fd_pipe_new(dev, FD_PIPE_3D);
+	if (!pipe) {
+		printf("failed to initialize freedreno pipe\n");
+		return -1;
+	}
+
+	src = calloc(1, MAX_UPLOAD + 4);
+
+	/* smallest ring must fit a full frame's worth of uploads: */
+	for (size = 0x200000; size <= 0x4000000; size *= 2)
+		run(fd, dev, pipe, size, src);
+
+	free(src);
+
+	return 0;
+}
@@ -32,6 +32,9 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
+
+#include "log.h"
 
 /**
  * Return float bits.
@@ -67,26 +70,95 @@ static inline uint32_t DRAW(enum pc_di_primtype prim_type,
 			(1                 << 14);
 }
 
-#define enable_debug 1  /* TODO make dynamic */
-
 #define ALIGN(v,a) (((v) + (a) - 1) & ~((a) - 1))
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
-#define INFO_MSG(fmt, ...) \
-		do { printf("[I] "fmt " (%s:%d)\n", \
-				##__VA_ARGS__, __FUNCTION__, __LINE__); } while (0)
-#define DEBUG_MSG(fmt, ...) \
-		do if (enable_debug) { printf("[D] "fmt " (%s:%d)\n", \
-				##__VA_ARGS__, __FUNCTION__, __LINE__); } while (0)
-#define WARN_MSG(fmt, ...) \
-		do { printf("[W] "fmt " (%s:%d)\n", \
-				##__VA_ARGS__, __FUNCTION__, __LINE__); } while (0)
-#define ERROR_MSG(fmt, ...) \
-		do { printf("[E] " fmt " (%s:%d)\n", \
-				##__VA_ARGS__, __FUNCTION__, __LINE__); } while (0)
+/* formatted and printed asynchronously, see log.h: */
+#define INFO_MSG(fmt, ...)  LOG_MSG(LOG_INFO, fmt, ##__VA_ARGS__)
+#define DEBUG_MSG(fmt, ...) LOG_MSG(LOG_DEBUG, fmt, ##__VA_ARGS__)
+#define WARN_MSG(fmt, ...)  LOG_MSG(LOG_WARN, fmt, ##__VA_ARGS__)
+#define ERROR_MSG(fmt, ...) LOG_MSG(LOG_ERROR, fmt, ##__VA_ARGS__)
 
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 
+/* grow a dynamic array (if needed) to make room for one more element: */
+#define GROW(arr, nr, cap) do { \
+		if ((nr) == (cap)) { \
+			(cap) = max(2 * (cap), 16); \
+			(arr) = realloc((arr), (cap) * sizeof((arr)[0])); \
+		} \
+	} while (0)
+
+/* content hash, four independent lanes so it is not bound by the
+ * multiply latency:
+ */
+static inline uint64_t hash_dwords(const uint32_t *dw, uint32_t dwords)
+{
+	const uint64_t prime = 0x100000001b3ull;
+	uint64_t h0 = 0xcbf29ce484222325ull ^ dwords, h1 = h0 + 1,
+			h2 = h0 + 2, h3 = h0 + 3;
+	uint32_t i;
+
+	for (i = 0; (i + 4) <= dwords; i += 4) {
+		h0 = (h0 ^ dw[i + 0]) * prime;
+		h1 = (h1 ^ dw[i + 1]) * prime;
+		h2 = (h2 ^ dw[i + 2]) * prime;
+		h3 = (h3 ^ dw[i + 3]) * prime;
+	}
+	for (; i < dwords; i++)
+		h0 = (h0 ^ dw[i]) * prime;
+
+	return (((h0 * prime) ^ h1) * prime ^ h2) * prime ^ h3;
+}
+
+/* open addressed hash tables, of slots holding an entry's index + 1 (0
+ * if free), probed linearly.  The size is a power of two:
+ */
+static inline uint32_t hash_slot(uint64_t hash, uint32_t size)
+{
+	return (uint32_t)(hash ^ (hash >> 32)) & (size - 1);
+}
+
+static inline uint32_t hash_next(uint32_t slot, uint32_t size)
+{
+	return (slot + 1) & (size - 1);
+}
+
+/* double the table (to at least 64 slots), and re-insert the nr entries,
+ * whose hashes entry_hash() returns:
+ */
+static inline void hash_table_grow(uint32_t **table, uint32_t *size,
+		uint32_t nr, uint64_t (*entry_hash)(const void *priv, uint32_t i),
+		const void *priv)
+{
+	uint32_t i;
+
+	free(*table);
+	*size = max(2 * *size, 64);
+	*table = calloc(*size, sizeof((*table)[0]));
+
+	for (i = 0; i < nr; i++) {
+		uint32_t h = hash_slot(entry_hash(priv, i), *size);
+		while ((*table)[h])
+			h = hash_next(h, *size);
+		(*table)[h] = i + 1;
+	}
+}
+
+/* LCG, for repeatable test and benchmark workloads: */
+static inline uint32_t rnd(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+static inline uint64_t gettime_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
 
 #endif /* UTIL_H_ */
@@ -0,0 +1,320 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "vfd.h"
+
+uint32_t vfd_fmt_comps(enum a3xx_vtx_fmt fmt)
+{
+	switch (fmt) {
+	case VFMT_FLOAT_32 ... VFMT_FIXED_32_32_32_32:
+	case VFMT_SHORT_16 ... VFMT_NORM_USHORT_16_16_16_16:
+	case VFMT_UBYTE_8 ... VFMT_NORM_BYTE_8_8_8_8:
+		return (fmt & 3) + 1;
+	case VFMT_UINT_10_10_10_2 ... VFMT_NORM_INT_10_10_10_2:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/* bytes per vertex, 0 if not a valid format: */
+uint32_t vfd_fmt_size(enum a3xx_vtx_fmt fmt)
+{
+	switch (fmt) {
+	case VFMT_FLOAT_32 ... VFMT_FLOAT_32_32_32_32:
+	case VFMT_FIXED_32 ... VFMT_FIXED_32_32_32_32:
+		return 4 * vfd_fmt_comps(fmt);
+	case VFMT_FLOAT_16 ... VFMT_FLOAT_16_16_16_16:
+	case VFMT_SHORT_16 ... VFMT_NORM_USHORT_16_16_16_16:
+		return 2 * vfd_fmt_comps(fmt);
+	case VFMT_UBYTE_8 ... VFMT_NORM_BYTE_8_8_8_8:
+		return vfd_fmt_comps(fmt);
+	case VFMT_UINT_10_10_10_2 ... VFMT_NORM_INT_10_10_10_2:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/* the used part of a description, in dwords: */
+static uint32_t desc_dwords(const struct vfd_desc *desc)
+{
+	return (offsetof(struct vfd_desc, attrs) +
+			desc->nr_attrs * sizeof(desc->attrs[0])) / 4;
+}
+
+static int check_desc(const struct vfd_desc *desc)
+{
+	uint32_t i;
+
+	if (!desc->nr_attrs || (desc->nr_attrs > VFD_MAX_ATTRS)) {
+		ERROR_MSG("invalid number of attributes: %u", desc->nr_attrs);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < VFD_MAX_BUFS; i++) {
+		if (desc->strides[i] > VFD_MAX_STRIDE) {
+			ERROR_MSG("buffer %u: invalid stride: %u", i,
+					desc->strides[i]);
+			return -EINVAL;
+		}
+	}
+
+	for (i = 0; i < desc->nr_attrs; i++) {
+		const struct vfd_attr *a = &desc->attrs[i];
+
+		if ((a->buf >= VFD_MAX_BUFS) || !vfd_fmt_size(a->fmt) ||
+				(a->regid > 0xff) || (a->writemask > 0xf)) {
+			ERROR_MSG("attribute %u: invalid buf %u, fmt %u, "
+					"regid %u or writemask %x", i, a->buf,
+					a->fmt, a->regid, a->writemask);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/* attribute a sorts before b, by buffer then offset: */
+static bool attr_before(const struct vfd_attr *a, const struct vfd_attr *b)
+{
+	if (a->buf != b->buf)
+		return a->buf < b->buf;
+	return a->offset < b->offset;
+}
+
+/* compile a description, grouping the attributes of each buffer into
+ * as few fetches as possible:
+ */
+int vfd_layout_compile(const struct vfd_desc *desc, struct vfd_layout *layout)
+{
+	const struct vfd_attr *sorted[VFD_MAX_ATTRS];
+	uint32_t i, j, total_comps = 0;
+	int ret;
+
+	ret = check_desc(desc);
+	if (ret)
+		return ret;
+
+	memset(layout, 0, sizeof(*layout));
+	memcpy(&layout->desc, desc, desc_dwords(desc) * 4);
+
+	/* insertion sort, there are at most 16: */
+	for (i = 0; i < desc->nr_attrs; i++) {
+		const struct vfd_attr *a = &desc->attrs[i];
+		for (j = i; (j > 0) && attr_before(a, sorted[j - 1]); j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = a;
+	}
+
+	for (i = 0; i < desc->nr_attrs; ) {
+		const struct vfd_attr *first = sorted[i];
+		struct vfd_fetch *f = &layout->fetches[layout->nr_fetches];
+		uint32_t end = first->offset + vfd_fmt_size(first->fmt);
+
+		/* the attributes which fit in this fetch: */
+		for (j = i + 1; j < desc->nr_attrs; j++) {
+			const struct vfd_attr *a = sorted[j];
+			uint32_t a_end = a->offset + vfd_fmt_size(a->fmt);
+
+			if ((a->buf != first->buf) || (a->offset < end) ||
+					((a_end - first->offset) > VFD_MAX_FETCH_SIZE) ||
+					((a->offset - sorted[j - 1]->offset) > VFD_MAX_SHIFT))
+				break;
+			end = a_end;
+		}
+
+		if ((end - first->offset) > VFD_MAX_FETCH_SIZE) {
+			ERROR_MSG("attribute at %u too large", first->offset);
+			return -EINVAL;
+		}
+
+		f->instr = A3XX_VFD_FETCH_INSTR_0_FETCHSIZE(end - first->offset - 1) |
+				A3XX_VFD_FETCH_INSTR_0_BUFSTRIDE(desc->strides[first->buf]) |
+				A3XX_VFD_FETCH_INSTR_0_INDEXCODE(layout->nr_fetches) |
+				A3XX_VFD_FETCH_INSTR_0_STEPRATE(1);
+		f->buf = first->buf;
+		f->offset = first->offset;
+
+		/* a decode per attribute, each shifting to the next one: */
+		for (; i < j; i++) {
+			const struct vfd_attr *a = sorted[i];
+			uint32_t size = vfd_fmt_size(a->fmt);
+			uint32_t mask = a->writemask ? a->writemask :
+					(1u << vfd_fmt_comps(a->fmt)) - 1;
+			uint32_t shift = (i + 1 < j) ?
+					(sorted[i + 1]->offset - a->offset) : size;
+
+			layout->decodes[layout->nr_decodes++] =
+					A3XX_VFD_DECODE_INSTR_CONSTFILL |
+					A3XX_VFD_DECODE_INSTR_WRITEMASK(mask) |
+					A3XX_VFD_DECODE_INSTR_FORMAT(a->fmt) |
+					A3XX_VFD_DECODE_INSTR_REGID(a->regid) |
+					A3XX_VFD_DECODE_INSTR_SHIFTCNT(shift) |
+					A3XX_VFD_DECODE_INSTR_LASTCOMPVALID;
+
+			total_comps += __builtin_popcount(mask);
+		}
+
+		layout->nr_fetches++;
+
+		/* the fetch's last decode moves on to the next fetch: */
+		if (i < desc->nr_attrs) {
+			f->instr |= A3XX_VFD_FETCH_INSTR_0_SWITCHNEXT;
+			layout->decodes[layout->nr_decodes - 1] |=
+					A3XX_VFD_DECODE_INSTR_SWITCHNEXT;
+		}
+	}
+
+	layout->control0 = A3XX_VFD_CONTROL_0_TOTALATTRTOVS(total_comps) |
+			A3XX_VFD_CONTROL_0_PACKETSIZE(2) |
+			A3XX_VFD_CONTROL_0_STRMDECINSTRCNT(layout->nr_decodes) |
+			A3XX_VFD_CONTROL_0_STRMFETCHINSTRCNT(layout->nr_fetches);
+
+	return 0;
+}
+
+struct vfd_cache * vfd_cache_new(void)
+{
+	return calloc(1, sizeof(struct vfd_cache));
+}
+
+void vfd_cache_del(struct vfd_cache *cache)
+{
+	uint32_t i;
+
+	for (i = 0; i < cache->nr_layouts; i++)
+		free(cache->layouts[i]);
+	free(cache->layouts);
+	free(cache->table);
+	free(cache);
+}
+
+static uint64_t layout_hash(const void *priv, uint32_t i)
+{
+	const struct vfd_cache *cache = priv;
+	return cache->layouts[i]->hash;
+}
+
+/* find or compile the layout of a description, returns NULL if it is
+ * not valid:
+ */
+const struct vfd_layout * vfd_layout_get(struct vfd_cache *cache,
+		const struct vfd_desc *desc)
+{
+	uint32_t dwords = desc_dwords(desc);
+	uint64_t hash = hash_dwords((const uint32_t *)desc, dwords);
+	struct vfd_layout *layout;
+	uint32_t h, idx;
+
+	cache->gets++;
+
+	/* keep the table at most half full: */
+	if (2 * (cache->nr_layouts + 1) > cache->table_size)
+		hash_table_grow(&cache->table, &cache->table_size,
+				cache->nr_layouts, layout_hash, cache);
+
+	h = hash_slot(hash, cache->table_size);
+	while (cache->table[h]) {
+		layout = cache->layouts[cache->table[h] - 1];
+		if ((layout->hash == hash) &&
+				(layout->desc.nr_attrs == desc->nr_attrs) &&
+				!memcmp(&layout->desc, desc, dwords * 4)) {
+			cache->hits++;
+			return layout;
+		}
+		h = hash_next(h, cache->table_size);
+	}
+
+	layout = malloc(sizeof(*layout));
+	if (!layout || vfd_layout_compile(desc, layout)) {
+		free(layout);
+		return NULL;
+	}
+	layout->hash = hash;
+
+	cache->fetches_merged += desc->nr_attrs - layout->nr_fetches;
+
+	GROW(cache->layouts, cache->nr_layouts, cache->max_layouts);
+
+	idx = cache->nr_layouts++;
+	cache->layouts[idx] = layout;
+	cache->table[h] = idx + 1;
+
+	return layout;
+}
+
+void vfd_cache_dump_stats(struct vfd_cache *cache)
+{
+	printf("vfd cache: %u layouts, %"PRIu64" gets, %"PRIu64" hits, "
+			"%"PRIu64" fetches merged\n", cache->nr_layouts,
+			cache->gets, cache->hits, cache->fetches_merged);
+}
+
+/* VFD_CONTROL_0 and the decode instructions, which only change with the
+ * layout:
+ */
+void vfd_emit_layout(struct cmdbuf *cb, const struct vfd_layout *layout)
+{
+	uint32_t i;
+
+	CB_PKT0(cb, REG_A3XX_VFD_CONTROL_0, 1);
+	CB_RING(cb, layout->control0);
+
+	CB_PKT0(cb, REG_A3XX_VFD_DECODE_INSTR(0), layout->nr_decodes);
+	for (i = 0; i < layout->nr_decodes; i++)
+		CB_RING(cb, layout->decodes[i]);
+}
+
+/* the fetch instructions, with the addresses of the vertex buffers bound
+ * to the layout's slots:
+ */
+void vfd_emit_fetch(struct cmdbuf *cb, const struct vfd_layout *layout,
+		const struct vfd_buf *bufs)
+{
+	uint32_t i;
+
+	CB_PKT0(cb, REG_A3XX_VFD_FETCH_INSTR_0(0), 2 * layout->nr_fetches);
+	for (i = 0; i < layout->nr_fetches; i++) {
+		const struct vfd_fetch *f = &layout->fetches[i];
+
+		CB_RING(cb, f->instr);
+		cmdbuf_reloc(cb, &(struct cmdbuf_reloc){
+			.handle = bufs[f->buf].handle,
+			.flags = MSM_SUBMIT_BO_READ,
+			.offset = bufs[f->buf].offset + f->offset,
+		});
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef VFD_H_
+#define VFD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cmdbuf.h"
+#include "util.h"
+
+/*
+ * Vertex fetch layout compiler.  A struct vfd_desc describes the vertex
+ * attributes (format, VS input register, vertex buffer slot and offset
+ * within a vertex) and the vertex buffers' strides, and compiles into
+ * the VFD_CONTROL_0, VFD_FETCH_INSTR and VFD_DECODE_INSTR register
+ * values, ready to emit with one packet each.  Only the vertex buffer
+ * addresses (VFD_FETCH_INSTR_1) are left to fill in at emit time.
+ *
+ * Attributes in the same vertex buffer (interleaved vertices) share a
+ * single fetch instruction, covering all of them, with a decode
+ * instruction per attribute shifting through the fetched bytes, rather
+ * than a fetch per attribute.  A buffer's attributes are split across
+ * several fetches only where they overlap, span more than a fetch can
+ * (VFD_MAX_FETCH_SIZE), or are further apart than a decode can shift
+ * (VFD_MAX_SHIFT).
+ *
+ * Compiled layouts are cached by a hash of their description, so each
+ * is compiled once, and a layout only needs re-emitting (see
+ * vfd_emit_layout()) when the pointer returned by vfd_layout_get()
+ * changes; the fetch block (vfd_emit_fetch()) when the vertex buffers
+ * do.
+ */
+
+#define VFD_MAX_ATTRS       16
+#define VFD_MAX_BUFS        16
+#define VFD_MAX_FETCH_SIZE  128
+#define VFD_MAX_SHIFT       31   /* VFD_DECODE_INSTR.SHIFTCNT */
+#define VFD_MAX_STRIDE      1023
+
+struct vfd_attr {
+	uint32_t buf;            /* vertex buffer slot */
+	uint32_t offset;         /* in bytes, within a vertex */
+	uint32_t fmt;            /* enum a3xx_vtx_fmt */
+	uint32_t regid;          /* VS input register */
+	uint32_t writemask;      /* 0 for all of the format's components */
+};
+
+/* all dwords, so the used part can be hashed and compared as is: */
+struct vfd_desc {
+	uint32_t nr_attrs;
+	uint32_t strides[VFD_MAX_BUFS];
+	struct vfd_attr attrs[VFD_MAX_ATTRS];
+};
+
+struct vfd_fetch {
+	uint32_t instr;          /* VFD_FETCH_INSTR_0 */
+	uint32_t buf, offset;    /* of VFD_FETCH_INSTR_1's address */
+};
+
+struct vfd_layout {
+	uint64_t hash;
+	struct vfd_desc desc;
+
+	uint32_t control0;       /* VFD_CONTROL_0 */
+	uint32_t nr_fetches, nr_decodes;
+	struct vfd_fetch fetches[VFD_MAX_ATTRS];
+	uint32_t decodes[VFD_MAX_ATTRS];
+};
+
+struct vfd_cache {
+	struct vfd_layout **layouts;
+	uint32_t nr_layouts, max_layouts;
+	uint32_t *table;         /* open addressed, layouts[] index + 1 */
+	uint32_t table_size;
+
+	/* stats: */
+	uint64_t gets;
+	uint64_t hits;
+	uint64_t fetches_merged; /* fetch instructions saved by merging */
+};
+
+/* a vertex buffer bound to a slot: */
+struct vfd_buf {
+	uint32_t handle;
+	uint32_t offset;
+};
+
+uint32_t vfd_fmt_size(enum a3xx_vtx_fmt fmt);
+uint32_t vfd_fmt_comps(enum a3xx_vtx_fmt fmt);
+
+int vfd_layout_compile(const struct vfd_desc *desc, struct vfd_layout *layout);
+
+struct vfd_cache * vfd_cache_new(void);
+void vfd_cache_del(struct vfd_cache *cache);
+const struct vfd_layout * vfd_layout_get(struct vfd_cache *cache,
+		const struct vfd_desc *desc);
+void vfd_cache_dump_stats(struct vfd_cache *cache);
+
+void vfd_emit_layout(struct cmdbuf *cb, const struct vfd_layout *layout);
+void vfd_emit_fetch(struct cmdbuf *cb, const struct vfd_layout *layout,
+		const struct vfd_buf *bufs);
+
+static inline void vfd_emit(struct cmdbuf *cb,
+		const struct vfd_layout *layout, const struct vfd_buf *bufs)
+{
+	vfd_emit_layout(cb, layout);
+	vfd_emit_fetch(cb, layout, bufs);
+}
+
+#endif /* VFD_H_ */
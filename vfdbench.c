@@ -0,0 +1,550 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "vfd.h"
+
+/* Vertex fetch layout benchmark: a stream of draws of meshes with a few
+ * typical vertex layouts (interleaved, split position stream, skinned,
+ * separate streams) has its vertex fetch state emitted the naive way,
+ * a fetch and a decode packet per attribute on every draw, and with
+ * layouts compiled by vfd.h (cached, merged fetches, layout emitted only
+ * when it changes).  Reports register writes, fetch instructions and CPU
+ * time per draw, and checks on the emulator that both feed each VS input
+ * register the same vertex data.
+ */
+
+#define NR_VERTS    4        /* per draw */
+#define VBO_SIZE    (1024 * 1024)
+
+static uint32_t nr_draws = 20000;
+static uint32_t nr_meshes = 64;
+static uint32_t iters = 20;
+
+#define A(b, o, f, r) { .buf = b, .offset = o, .fmt = f, .regid = r }
+
+static const struct {
+	const char *name;
+	uint32_t nr_bufs;
+	uint32_t nr_fetches;     /* once compiled */
+	struct vfd_desc desc;
+} layouts[] = {
+	{ "interleaved", 1, 1, {
+		.nr_attrs = 4,
+		.strides = { 32 },
+		.attrs = {
+			A(0,  0, VFMT_FLOAT_32_32_32,         0),
+			A(0, 12, VFMT_NORM_SHORT_16_16_16_16, 4),
+			A(0, 20, VFMT_FLOAT_16_16,            8),
+			A(0, 24, VFMT_NORM_UBYTE_8_8_8_8,    12),
+		},
+	} },
+	{ "split-pos", 2, 2, {
+		.nr_attrs = 4,
+		.strides = { 12, 16 },
+		.attrs = {
+			A(0,  0, VFMT_FLOAT_32_32_32,         0),
+			A(1,  0, VFMT_NORM_INT_10_10_10_2,    4),
+			A(1,  4, VFMT_FLOAT_32_32,            8),
+			A(1, 12, VFMT_NORM_UBYTE_8_8_8_8,    12),
+		},
+	} },
+	{ "skinned", 1, 1, {
+		.nr_attrs = 6,
+		.strides = { 48 },
+		.attrs = {
+			A(0,  0, VFMT_FLOAT_32_32_32,         0),
+			A(0, 12, VFMT_FLOAT_16_16_16_16,      4),
+			A(0, 20, VFMT_FLOAT_16_16_16_16,      8),
+			A(0, 28, VFMT_FLOAT_32_32,           12),
+			A(0, 36, VFMT_UBYTE_8_8_8_8,         16),
+			A(0, 40, VFMT_NORM_UBYTE_8_8_8_8,    20),
+		},
+	} },
+	{ "separate", 3, 3, {
+		.nr_attrs = 3,
+		.strides = { 12, 12, 8 },
+		.attrs = {
+			A(0,  0, VFMT_FLOAT_32_32_32,         0),
+			A(1,  0, VFMT_FLOAT_32_32_32,         4),
+			A(2,  0, VFMT_FLOAT_32_32,            8),
+		},
+	} },
+	/* attributes not in offset order: */
+	{ "shuffled", 1, 1, {
+		.nr_attrs = 4,
+		.strides = { 28 },
+		.attrs = {
+			A(0, 24, VFMT_NORM_UBYTE_8_8_8_8,     0),
+			A(0,  0, VFMT_FLOAT_32_32_32,         4),
+			A(0, 20, VFMT_FLOAT_16_16,            8),
+			A(0, 12, VFMT_NORM_SHORT_16_16_16_16, 12),
+		},
+	} },
+	/* attributes further apart than a decode can shift: */
+	{ "sparse", 1, 3, {
+		.nr_attrs = 3,
+		.strides = { 80 },
+		.attrs = {
+			A(0,  0, VFMT_FLOAT_32_32_32_32,      0),
+			A(0, 32, VFMT_FLOAT_32_32_32_32,      4),
+			A(0, 64, VFMT_FLOAT_32_32,            8),
+		},
+	} },
+};
+
+struct mesh {
+	uint32_t layout;
+	struct vfd_buf bufs[VFD_MAX_BUFS];
+};
+static struct mesh *meshes;
+static uint32_t *draws;          /* mesh of each draw */
+
+struct run {
+	struct emu *emu;
+	struct emu_bo *vbo;
+	struct cmdbuf *cb;
+	struct vfd_cache *cache;
+	uint64_t emit_ns;
+	uint32_t dwords;
+	uint32_t reg_writes;
+	uint32_t fetches;        /* fetch instructions, all draws */
+	uint32_t fetch_bytes;    /* bytes fetched per vertex, all draws */
+	uint64_t *hashes;        /* of each draw's VS inputs */
+	uint32_t nr_hashes;
+	uint32_t errors;         /* decodes outside their fetch */
+};
+
+static uint32_t seed = 0x12345678;
+
+static void make_workload(void)
+{
+	uint32_t i, b;
+
+	meshes = calloc(nr_meshes, sizeof(meshes[0]));
+	for (i = 0; i < nr_meshes; i++) {
+		meshes[i].layout = rnd(&seed) % ARRAY_SIZE(layouts);
+		for (b = 0; b < layouts[meshes[i].layout].nr_bufs; b++)
+			meshes[i].bufs[b].offset = (rnd(&seed) % (VBO_SIZE / 2)) & ~3;
+	}
+
+	/* runs of draws of the same mesh: */
+	draws = calloc(nr_draws, sizeof(draws[0]));
+	for (i = 0; i < nr_draws; i++)
+		draws[i] = ((i == 0) || (rnd(&seed) % 4) == 0) ?
+				rnd(&seed) % nr_meshes : draws[i - 1];
+}
+
+static void emit_draw(struct cmdbuf *cb)
+{
+	CB_PKT3(cb, CP_DRAW_INDX, 3);
+	CB_RING(cb, 0x00000000);
+	CB_RING(cb, DRAW(DI_PT_POINTLIST_A3XX, DI_SRC_SEL_AUTO_INDEX,
+			INDEX_SIZE_IGN, IGNORE_VISIBILITY));
+	CB_RING(cb, NR_VERTS);
+}
+
+/* a fetch and a decode per attribute, in the order given: */
+static void emit_naive(struct run *run)
+{
+	struct cmdbuf *cb = run->cb;
+	uint32_t n, i;
+
+	for (n = 0; n < nr_draws; n++) {
+		const struct mesh *m = &meshes[draws[n]];
+		const struct vfd_desc *desc = &layouts[m->layout].desc;
+		uint32_t comps = 0;
+
+		for (i = 0; i < desc->nr_attrs; i++)
+			comps += vfd_fmt_comps(desc->attrs[i].fmt);
+
+		CB_PKT0(cb, REG_A3XX_VFD_CONTROL_0, 1);
+		CB_RING(cb, A3XX_VFD_CONTROL_0_TOTALATTRTOVS(comps) |
+				A3XX_VFD_CONTROL_0_PACKETSIZE(2) |
+				A3XX_VFD_CONTROL_0_STRMDECINSTRCNT(desc->nr_attrs) |
+				A3XX_VFD_CONTROL_0_STRMFETCHINSTRCNT(desc->nr_attrs));
+
+		for (i = 0; i < desc->nr_attrs; i++) {
+			const struct vfd_attr *a = &desc->attrs[i];
+			uint32_t size = vfd_fmt_size(a->fmt);
+			bool switchnext = (i + 1) < desc->nr_attrs;
+
+			CB_PKT0(cb, REG_A3XX_VFD_FETCH_INSTR_0(i), 2);
+			CB_RING(cb, A3XX_VFD_FETCH_INSTR_0_FETCHSIZE(size - 1) |
+					A3XX_VFD_FETCH_INSTR_0_BUFSTRIDE(desc->strides[a->buf]) |
+					COND(switchnext, A3XX_VFD_FETCH_INSTR_0_SWITCHNEXT) |
+					A3XX_VFD_FETCH_INSTR_0_INDEXCODE(i) |
+					A3XX_VFD_FETCH_INSTR_0_STEPRATE(1));
+			EMU_RELOC(cb, run->vbo, m->bufs[a->buf].offset + a->offset, 0);
+
+			CB_PKT0(cb, REG_A3XX_VFD_DECODE_INSTR(i), 1);
+			CB_RING(cb, A3XX_VFD_DECODE_INSTR_CONSTFILL |
+					A3XX_VFD_DECODE_INSTR_WRITEMASK((1 << vfd_fmt_comps(a->fmt)) - 1) |
+					A3XX_VFD_DECODE_INSTR_FORMAT(a->fmt) |
+					A3XX_VFD_DECODE_INSTR_REGID(a->regid) |
+					A3XX_VFD_DECODE_INSTR_SHIFTCNT(size) |
+					A3XX_VFD_DECODE_INSTR_LASTCOMPVALID |
+					COND(switchnext, A3XX_VFD_DECODE_INSTR_SWITCHNEXT));
+		}
+
+		emit_draw(cb);
+	}
+}
+
+static int emit_compiled(struct run *run)
+{
+	struct cmdbuf *cb = run->cb;
+	const struct vfd_layout *last = NULL;
+	struct vfd_buf bufs[VFD_MAX_BUFS];
+	uint32_t n, b;
+
+	for (n = 0; n < nr_draws; n++) {
+		const struct mesh *m = &meshes[draws[n]];
+		const struct vfd_layout *layout =
+				vfd_layout_get(run->cache, &layouts[m->layout].desc);
+
+		if (!layout)
+			return -EINVAL;
+
+		if (layout != last)
+			vfd_emit_layout(cb, layout);
+		last = layout;
+
+		for (b = 0; b < layouts[m->layout].nr_bufs; b++) {
+			bufs[b].handle = run->vbo->handle;
+			bufs[b].offset = m->bufs[b].offset;
+		}
+		vfd_emit_fetch(cb, layout, bufs);
+
+		emit_draw(cb);
+	}
+
+	return 0;
+}
+
+/* what each VS input register of the draw's vertices should get, slot
+ * per regid / 4 (every layout's regids are multiples of 4):
+ */
+typedef uint8_t vs_inputs[NR_VERTS][VFD_MAX_ATTRS][16];
+
+static void expected_inputs(struct run *run, const struct mesh *m,
+		vs_inputs in)
+{
+	const struct vfd_desc *desc = &layouts[m->layout].desc;
+	const uint8_t *map = run->vbo->map;
+	uint32_t v, i;
+
+	memset(in, 0, sizeof(vs_inputs));
+	for (v = 0; v < NR_VERTS; v++) {
+		for (i = 0; i < desc->nr_attrs; i++) {
+			const struct vfd_attr *a = &desc->attrs[i];
+			memcpy(in[v][a->regid / 4], &map[m->bufs[a->buf].offset +
+					v * desc->strides[a->buf] + a->offset],
+					vfd_fmt_size(a->fmt));
+		}
+	}
+}
+
+/* decode a draw's vertices from the VFD registers, the way the VFD walks
+ * them: each decode instruction reads its format's size at the current
+ * position within the current fetch, then shifts, or switches to the
+ * next fetch:
+ */
+static void decode_inputs(struct run *run, const uint32_t *regs, vs_inputs in)
+{
+	uint32_t control0 = regs[REG_A3XX_VFD_CONTROL_0 - REG_A3XX_VFD_CONTROL_0];
+	uint32_t nr_decodes = (control0 & A3XX_VFD_CONTROL_0_STRMDECINSTRCNT__MASK) >>
+			A3XX_VFD_CONTROL_0_STRMDECINSTRCNT__SHIFT;
+	uint32_t nr_fetches = (control0 & A3XX_VFD_CONTROL_0_STRMFETCHINSTRCNT__MASK) >>
+			A3XX_VFD_CONTROL_0_STRMFETCHINSTRCNT__SHIFT;
+	uint32_t v, d, i;
+
+	memset(in, 0, sizeof(vs_inputs));
+
+	run->fetches += nr_fetches;
+	for (i = 0; i < nr_fetches; i++)
+		run->fetch_bytes += (regs[REG_A3XX_VFD_FETCH_INSTR_0(i) - REG_A3XX_VFD_CONTROL_0] &
+				A3XX_VFD_FETCH_INSTR_0_FETCHSIZE__MASK) + 1;
+
+	for (v = 0; v < NR_VERTS; v++) {
+		uint32_t fetch = 0, pos = 0;
+
+		for (d = 0; d < nr_decodes; d++) {
+			uint32_t dec = regs[REG_A3XX_VFD_DECODE_INSTR(d) - REG_A3XX_VFD_CONTROL_0];
+			uint32_t instr = regs[REG_A3XX_VFD_FETCH_INSTR_0(fetch) - REG_A3XX_VFD_CONTROL_0];
+			uint32_t addr = regs[REG_A3XX_VFD_FETCH_INSTR_1(fetch) - REG_A3XX_VFD_CONTROL_0];
+			uint32_t fetch_size = (instr & A3XX_VFD_FETCH_INSTR_0_FETCHSIZE__MASK) + 1;
+			uint32_t stride = (instr & A3XX_VFD_FETCH_INSTR_0_BUFSTRIDE__MASK) >>
+					A3XX_VFD_FETCH_INSTR_0_BUFSTRIDE__SHIFT;
+			uint32_t fmt = (dec & A3XX_VFD_DECODE_INSTR_FORMAT__MASK) >>
+					A3XX_VFD_DECODE_INSTR_FORMAT__SHIFT;
+			uint32_t regid = (dec & A3XX_VFD_DECODE_INSTR_REGID__MASK) >>
+					A3XX_VFD_DECODE_INSTR_REGID__SHIFT;
+			uint32_t size = vfd_fmt_size(fmt);
+			const void *src;
+
+			if (((pos + size) > fetch_size) || (fetch >= nr_fetches) ||
+					((regid / 4) >= VFD_MAX_ATTRS)) {
+				run->errors++;
+				return;
+			}
+
+			src = emu_iova_ptr(run->emu, addr + v * stride + pos, size);
+			if (!src) {
+				run->errors++;
+				return;
+			}
+			memcpy(in[v][regid / 4], src, size);
+
+			if (dec & A3XX_VFD_DECODE_INSTR_SWITCHNEXT) {
+				fetch++;
+				pos = 0;
+			} else {
+				pos += (dec & A3XX_VFD_DECODE_INSTR_SHIFTCNT__MASK) >>
+						A3XX_VFD_DECODE_INSTR_SHIFTCNT__SHIFT;
+			}
+		}
+	}
+}
+
+/* walk the cmdstream, with relocs applied by the submit, tracking the
+ * VFD registers and hashing the VS inputs of each draw:
+ */
+static void collect_inputs(struct run *run)
+{
+	const uint32_t *dw = run->cb->start, *end = run->cb->cur;
+	uint32_t regs[0x40] = {0};
+	vs_inputs in;
+
+	run->hashes = calloc(nr_draws, sizeof(run->hashes[0]));
+	run->nr_hashes = 0;
+
+	while (dw < end) {
+		uint32_t cnt = ((dw[0] >> 16) & 0x3fff) + 1;
+		uint32_t i;
+
+		if ((dw[0] & 0xc0000000) == CP_TYPE0_PKT) {
+			for (i = 0; i < cnt; i++) {
+				uint32_t reg = (dw[0] & 0x7fff) + i;
+				if ((reg >= REG_A3XX_VFD_CONTROL_0) &&
+						(reg < REG_A3XX_VFD_CONTROL_0 + ARRAY_SIZE(regs)))
+					regs[reg - REG_A3XX_VFD_CONTROL_0] = dw[1 + i];
+			}
+			run->reg_writes += cnt;
+		} else if ((((dw[0] >> 8) & 0xff) == CP_DRAW_INDX) &&
+				(run->nr_hashes < nr_draws)) {
+			decode_inputs(run, regs, in);
+			run->hashes[run->nr_hashes++] =
+					hash_dwords((const uint32_t *)in, sizeof(in) / 4);
+		}
+
+		dw += 1 + cnt;
+	}
+}
+
+static int run_mode(struct run *run, bool compiled)
+{
+	struct msm_submit *submit;
+	uint32_t it;
+	int ret = 0;
+
+	memset(run, 0, sizeof(*run));
+
+	run->emu = emu_new();
+	run->vbo = emu_bo_new(run->emu, VBO_SIZE);
+	run->cb = emu_cmdbuf_new(run->emu, nr_draws * 64 * 4);
+	run->cache = vfd_cache_new();
+
+	/* the same vertex data for each run: */
+	for (it = 0; it < VBO_SIZE / 4; it++)
+		((uint32_t *)run->vbo->map)[it] = it * 0x9e3779b9;
+
+	for (it = 0; (it < iters) && !ret; it++) {
+		uint64_t t;
+
+		cmdbuf_reset(run->cb);
+
+		t = gettime_ns();
+		if (compiled)
+			ret = emit_compiled(run);
+		else
+			emit_naive(run);
+		run->emit_ns += gettime_ns() - t;
+	}
+
+	if (ret)
+		return ret;
+
+	run->dwords = cmdbuf_dwords(run->cb);
+
+	submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, run->cb);
+	emu_attach(run->emu, submit);
+	ret = msm_submit_flush(submit);
+	msm_submit_del(submit);
+	if (ret)
+		return ret;
+
+	collect_inputs(run);
+
+	return 0;
+}
+
+static void run_fini(struct run *run)
+{
+	vfd_cache_del(run->cache);
+	cmdbuf_del(run->cb);
+	emu_del(run->emu);
+	free(run->hashes);
+}
+
+static void print_run(struct run *run, const char *name)
+{
+	printf("%-9s %8u %10.2f %10.2f %10.2f %10.1f\n", name, run->dwords,
+			(double)run->reg_writes / nr_draws,
+			(double)run->fetches / nr_draws,
+			(double)run->fetch_bytes / nr_draws,
+			(double)run->emit_ns / iters / nr_draws);
+}
+
+int main(int argc, char *argv[])
+{
+	struct run naive, compiled;
+	struct vfd_cache *cache;
+	vs_inputs in;
+	uint32_t i, bad = 0, unmerged = 0;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "d:i:m:")) != -1) {
+		switch (opt) {
+		case 'd':
+			nr_draws = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			nr_meshes = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("usage: %s [-d draws] [-i iterations] [-m meshes]\n",
+					argv[0]);
+			return -1;
+		}
+	}
+
+	if (!nr_draws || !iters || !nr_meshes) {
+		printf("nothing to do\n");
+		return -1;
+	}
+
+	make_workload();
+
+	printf("%u draws of %u meshes, %u layouts\n", nr_draws, nr_meshes,
+			(uint32_t)ARRAY_SIZE(layouts));
+
+	if (run_mode(&naive, false) || run_mode(&compiled, true)) {
+		printf("could not run the draws\n");
+		return -1;
+	}
+
+	printf("%-9s %8s %10s %10s %10s %10s\n", "mode", "dwords",
+			"regs/draw", "fetch/draw", "bytes/vtx", "emit ns");
+	print_run(&naive, "naive");
+	print_run(&compiled, "compiled");
+	vfd_cache_dump_stats(compiled.cache);
+
+	printf("Test 1: both feed the VS the expected vertex data\n");
+	if ((naive.nr_hashes != nr_draws) || (compiled.nr_hashes != nr_draws) ||
+			naive.errors || compiled.errors) {
+		bad = nr_draws;
+	} else {
+		for (i = 0; i < nr_draws; i++) {
+			uint64_t hash;
+
+			expected_inputs(&compiled, &meshes[draws[i]], in);
+			hash = hash_dwords((const uint32_t *)in, sizeof(in) / 4);
+			if ((naive.hashes[i] != hash) || (compiled.hashes[i] != hash))
+				bad++;
+		}
+	}
+	if (bad) {
+		printf("FAILED (%u draws, %u/%u decode errors)\n", bad,
+				naive.errors, compiled.errors);
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 2: each layout is compiled once\n");
+	if ((compiled.cache->nr_layouts > ARRAY_SIZE(layouts)) ||
+			(compiled.cache->hits + compiled.cache->nr_layouts !=
+					compiled.cache->gets)) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 3: attributes merged into as few fetches as possible\n");
+	cache = vfd_cache_new();
+	for (i = 0; i < ARRAY_SIZE(layouts); i++) {
+		const struct vfd_layout *layout =
+				vfd_layout_get(cache, &layouts[i].desc);
+		if (!layout || (layout->nr_fetches != layouts[i].nr_fetches) ||
+				(layout->nr_decodes != layouts[i].desc.nr_attrs)) {
+			printf("  %s: %u fetches, expected %u\n", layouts[i].name,
+					layout ? layout->nr_fetches : 0,
+					layouts[i].nr_fetches);
+			unmerged++;
+		}
+	}
+	vfd_cache_del(cache);
+	if (unmerged) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	run_fini(&naive);
+	run_fini(&compiled);
+	free(meshes);
+	free(draws);
+
+	return ret;
+}
@@ -0,0 +1,333 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "emu.h"
+#include "gmem.h"
+
+/* Binning pass test: a pass of scissored draws is run through the VSC
+ * binning pass on the emulated CP, and the visibility streams it writes,
+ * and the draws each bin then renders, are checked against which bins
+ * each draw's rectangle actually touches.  Reports the draws skipped in
+ * each bin, and what binning saves in CP/back-end time.
+ */
+
+static uint32_t nr_draws = 200;
+static uint32_t gmem_size = 256 * 1024;
+static struct gmem_config cfg = {
+		.width = 1920,
+		.height = 1080,
+		.rts = { { .fmt = RB_R8G8B8A8_UNORM } },
+		.nr_rts = 1,
+};
+static struct gmem_layout layout;
+
+struct rect {
+	uint32_t x0, y0, x1, y1;     /* inclusive */
+};
+static struct rect *rects;
+
+struct run {
+	struct emu *emu;
+	struct emu_bo *vsc;
+	struct cmdbuf *bins, *draws;
+	struct gmem_pass *pass;
+};
+
+static uint32_t seed = 0x12345678;
+
+static void make_rects(void)
+{
+	uint32_t i;
+
+	rects = calloc(nr_draws, sizeof(rects[0]));
+
+	for (i = 0; i < nr_draws; i++) {
+		struct rect *r = &rects[i];
+		uint32_t w, h;
+
+		/* mostly small, with the occasional full screen draw: */
+		if ((i % 25) == 24) {
+			w = cfg.width;
+			h = cfg.height;
+		} else {
+			w = 1 + rnd(&seed) % 400;
+			h = 1 + rnd(&seed) % 300;
+		}
+
+		r->x0 = rnd(&seed) % (cfg.width - w + 1);
+		r->y0 = rnd(&seed) % (cfg.height - h + 1);
+		r->x1 = r->x0 + w - 1;
+		r->y1 = r->y0 + h - 1;
+	}
+}
+
+/* does draw i touch bin n? */
+static int touches(uint32_t i, uint32_t n)
+{
+	uint32_t bx = n % layout.nbins_x, by = n / layout.nbins_x;
+	const struct rect *r = &rects[i];
+
+	return (r->x0 / layout.bin_w <= bx) && (bx <= r->x1 / layout.bin_w) &&
+			(r->y0 / layout.bin_h <= by) && (by <= r->y1 / layout.bin_h);
+}
+
+static int run_pass(struct run *run, int decode, int binning)
+{
+	struct gmem_config c = cfg;
+	struct msm_submit *submit;
+	struct cmdbuf *draws;
+	uint32_t i;
+	int ret;
+
+	memset(run, 0, sizeof(*run));
+
+	run->emu = emu_new();
+	run->emu->decode = decode;
+
+	c.rts[0].handle = emu_bo_new(run->emu,
+			gmem_rt_pitch(&cfg, 0) * cfg.height)->handle;
+	if (binning) {
+		c.vsc_pipe_size = ALIGN(nr_draws * 4, 32);
+		run->vsc = emu_bo_new(run->emu, gmem_vsc_size(&c));
+		c.vsc_handle = run->vsc->handle;
+	}
+
+	run->draws = emu_cmdbuf_new(run->emu, nr_draws * 8 * 4 + 64);
+	run->bins = emu_cmdbuf_new(run->emu,
+			(layout.nr_bins * 48 + 128) * 4);
+	run->pass = gmem_pass_new(&c, &layout, run->draws, run->bins);
+
+	draws = gmem_pass_begin(run->pass);
+	for (i = 0; i < nr_draws; i++) {
+		CB_PKT0(draws, REG_A3XX_GRAS_SC_SCREEN_SCISSOR_TL, 2);
+		CB_RING(draws, A3XX_GRAS_SC_SCREEN_SCISSOR_TL_X(rects[i].x0) |
+				A3XX_GRAS_SC_SCREEN_SCISSOR_TL_Y(rects[i].y0));
+		CB_RING(draws, A3XX_GRAS_SC_SCREEN_SCISSOR_BR_X(rects[i].x1) |
+				A3XX_GRAS_SC_SCREEN_SCISSOR_BR_Y(rects[i].y1));
+		CB_PKT3(draws, CP_DRAW_INDX, 3);
+		CB_RING(draws, 0x00000000);
+		CB_RING(draws, DRAW(DI_PT_TRILIST, DI_SRC_SEL_AUTO_INDEX,
+				INDEX_SIZE_IGN, gmem_pass_vis(run->pass)));
+		CB_RING(draws, 6);
+	}
+	gmem_pass_end(run->pass);
+
+	submit = msm_submit_new(-1, MSM_PIPE_3D0);
+	emu_attach(run->emu, submit);
+	msm_submit_cmd(submit, MSM_SUBMIT_CMD_BUF, run->bins);
+	ret = msm_submit_flush(submit);
+	msm_submit_del(submit);
+
+	return ret;
+}
+
+/* until the back-end is done, not just the CP: */
+static double run_us(struct run *run)
+{
+	return emu_cycles_to_us(run->emu, max(run->emu->now,
+			run->emu->backend_idle));
+}
+
+static void run_fini(struct run *run)
+{
+	gmem_pass_del(run->pass);
+	cmdbuf_del(run->bins);
+	cmdbuf_del(run->draws);
+	emu_del(run->emu);
+}
+
+/* the streams should have a mask per draw, of the pipe's bins it touches: */
+static int check_streams(struct run *run)
+{
+	const uint32_t *vsc = run->vsc->map;
+	uint32_t p, i, n, errors = 0;
+
+	for (p = 0; p < layout.nr_pipes; p++) {
+		const uint32_t *data = &vsc[(GMEM_VSC_DATA +
+				p * ALIGN(nr_draws * 4, 32)) / 4];
+
+		if (vsc[p] != nr_draws * 4) {
+			printf("  pipe %u: stream size %u, expected %u\n", p,
+					vsc[p], nr_draws * 4);
+			errors++;
+			continue;
+		}
+
+		for (i = 0; i < nr_draws; i++) {
+			uint32_t mask = 0;
+
+			for (n = 0; n < layout.nr_bins; n++) {
+				uint32_t bit;
+				if ((gmem_bin_pipe(&layout, n, &bit) == p) &&
+						touches(i, n))
+					mask |= 1u << bit;
+			}
+
+			if (data[i] != mask) {
+				if (errors++ < 10)
+					printf("  pipe %u, draw %u: mask %08x, "
+							"expected %08x\n", p, i,
+							data[i], mask);
+			}
+		}
+	}
+
+	return errors ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct run binned, interp, plain;
+	uint64_t visible = 0, skipped;
+	uint32_t x, y, n, i;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "d:g:s:")) != -1) {
+		switch (opt) {
+		case 'd':
+			nr_draws = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gmem_size = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			if (sscanf(optarg, "%ux%u", &cfg.width, &cfg.height) == 2)
+				break;
+			/* fallthrough */
+		default:
+			printf("usage: %s [-d draws] [-g gmem-size] [-s WxH]\n",
+					argv[0]);
+			return -1;
+		}
+	}
+
+	if (gmem_plan(&layout, &cfg, gmem_size)) {
+		printf("no layout fits\n");
+		return -1;
+	}
+
+	if (!layout.nr_pipes) {
+		printf("%u bins is too many for binning\n", layout.nr_bins);
+		return -1;
+	}
+
+	make_rects();
+
+	printf("%ux%u, %u draws, %ux%u bins of %ux%u, %u pipes\n",
+			cfg.width, cfg.height, nr_draws, layout.nbins_x,
+			layout.nbins_y, layout.bin_w, layout.bin_h,
+			layout.nr_pipes);
+
+	if (run_pass(&binned, 1, 1) || run_pass(&interp, 0, 1) ||
+			run_pass(&plain, 1, 0)) {
+		printf("could not run the pass\n");
+		return -1;
+	}
+
+	printf("draws skipped per bin:\n");
+	for (y = 0; y < layout.nbins_y; y++) {
+		printf("  ");
+		for (x = 0; x < layout.nbins_x; x++) {
+			uint32_t v = 0;
+
+			n = y * layout.nbins_x + x;
+			for (i = 0; i < nr_draws; i++)
+				v += touches(i, n);
+			visible += v;
+			printf(" %5u", nr_draws - v);
+		}
+		printf("\n");
+	}
+
+	skipped = (uint64_t)layout.nr_bins * nr_draws - visible;
+
+	printf("without binning: %"PRIu64" draws, %.1fus\n",
+			plain.emu->stats.draws, run_us(&plain));
+	printf("with binning:    %"PRIu64" draws (%"PRIu64" skipped), %.1fus\n",
+			binned.emu->stats.draws, binned.emu->stats.vis_skipped,
+			run_us(&binned));
+
+	printf("Test 1: visibility streams match the draws' bins\n");
+	if (check_streams(&binned)) {
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	/* each bin also has its resolve draws, which are not culled: */
+	printf("Test 2: each bin renders only the draws which touch it\n");
+	if ((binned.emu->stats.binned != nr_draws) ||
+			(binned.emu->stats.vis_skipped != skipped) ||
+			(binned.emu->stats.draws !=
+				visible + layout.nr_bins * cfg.nr_rts) ||
+			(plain.emu->stats.draws != (uint64_t)layout.nr_bins *
+				(nr_draws + cfg.nr_rts))) {
+		printf("  %"PRIu64" binned, %"PRIu64" skipped, %"PRIu64" draws, "
+				"expected %u, %"PRIu64", %"PRIu64"\n",
+				binned.emu->stats.binned,
+				binned.emu->stats.vis_skipped,
+				binned.emu->stats.draws, nr_draws, skipped,
+				visible + layout.nr_bins * cfg.nr_rts);
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	printf("Test 3: interpreter matches decoded IBs\n");
+	if (memcmp(&binned.emu->stats, &interp.emu->stats,
+			sizeof(binned.emu->stats)) ||
+			memcmp(binned.emu->regs, interp.emu->regs,
+				EMU_NUM_REGS * sizeof(binned.emu->regs[0])) ||
+			memcmp(binned.vsc->map, interp.vsc->map,
+				gmem_vsc_size(&binned.pass->cfg))) {
+		emu_dump_stats(binned.emu, "decoded", &binned.emu->stats);
+		emu_dump_stats(interp.emu, "interpreter", &interp.emu->stats);
+		printf("FAILED\n");
+		ret = -1;
+	} else {
+		printf("PASSED\n");
+	}
+
+	run_fini(&binned);
+	run_fini(&interp);
+	run_fini(&plain);
+	free(rects);
+
+	return ret;
+}